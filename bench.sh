@@ -0,0 +1,38 @@
+#!/bin/sh
+# CPTInfo benchmark: runs cptinfo in several modes over a corpus made by
+# cptgen and prints files/s and MB/s of each. Used by 'make bench'.
+# Usage: bench.sh <cptinfo> <corpus dir> [extra cptinfo options]
+
+BIN=`cd \`dirname "$1"\` && pwd`/`basename "$1"`
+DIR=`cd "$2" && pwd` || exit 1
+shift 2
+OPTS="$*"
+LIST="$DIR/files.lst"
+SCRATCH="$DIR/dumps"
+
+ls "$DIR"/*.cpt > "$LIST"
+FILES=`wc -l < "$LIST"`
+BYTES=`cat "$DIR"/*.cpt | wc -c`
+echo "Corpus: $FILES file(s), $BYTES bytes in $DIR"
+
+run() {
+    name="$1"
+    shift
+    rm -rf "$SCRATCH" && mkdir "$SCRATCH"
+    start=`date +%s%N`
+    (cd "$SCRATCH" && "$BIN" $OPTS "$@" -l "$LIST" > /dev/null)
+    end=`date +%s%N`
+    awk -v n="$name" -v f="$FILES" -v b="$BYTES" -v t=$((end - start)) 'BEGIN {
+        s = t / 1e9; if (s <= 0) s = 1e-9;
+        printf "%-14s %8.3f s %10.1f files/s %9.1f MB/s\n", n, s, f / s, b / s / 1e6 }'
+}
+
+run "header probe" -s -br 0
+if [ "`uname`" = Linux ]; then run "probe --uring" -s -br 0 --uring 64; fi
+run "-oc" -oc -v
+run "-od" -od -v
+run "-oc -od" -oc -od -v
+run "dump -db" -s -db
+run "dump -di -dp" -s -di -dp
+run "dump -ds" -s -db -di -dp -ds "$SCRATCH/store"
+rm -rf "$SCRATCH" "$LIST"
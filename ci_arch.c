@@ -0,0 +1,304 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo tar and zip archive members.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef WIN32
+#define _GNU_SOURCE             // fseeko() with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "ci_arch.h"
+
+// Members are read in place: tar headers one after another (so a tar can
+// come from a pipe), zip through its central directory (needs seeking).
+// Member data is handed out as CI_input, stored or deflated.
+
+#ifdef WIN32
+#define ci_Seek(file, offs)     fseek((file), (long) (offs), SEEK_SET)
+#define ci_Tell(file)           ((int64_t) ftell(file))
+#else
+#define ci_Seek(file, offs)     fseeko((file), (off_t) (offs), SEEK_SET)
+#define ci_Tell(file)           ((int64_t) ftello(file))
+#endif
+
+static uint32_t ci_Le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t ci_Le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static uint64_t ci_Le64(const uint8_t *p) {
+    return ci_Le32(p) | ((uint64_t) ci_Le32(p+4) << 32);
+}
+
+// --- tar ---
+
+// Numeric field: octal text, or base-256 if high bit of first byte is set.
+static uint64_t ci_TarNumber(const uint8_t *p, uint32_t len) {
+    uint64_t val = 0;
+    uint32_t i = 0;
+    if (p[0] & 0x80) {
+        for (val = p[0] & 0x7F, i=1; i < len; i++) val = (val << 8) | p[i];
+        return val;
+    }
+    while (i < len && (p[i] == ' ' || !p[i])) i++;
+    for (; i < len && p[i] >= '0' && p[i] <= '7'; i++) val = (val << 3) | (p[i] - '0');
+    return val;
+}
+
+// Header checksum: sum of its bytes, checksum field taken as spaces.
+static int ci_TarHeaderOk(const uint8_t *h) {
+    uint32_t i, sum = 0;
+    for (i=0; i < 512; i++) sum += (i >= 148 && i < 156 ? ' ' : h[i]);
+    return sum == ci_TarNumber(h+148, 8);
+}
+
+// Copies at most len chars of (not always terminated) field after dst.
+static void ci_TarName(char *dst, const uint8_t *src, uint32_t len) {
+    uint32_t n = strlen(dst), i;
+    for (i=0; i < len && src[i] && n < CI_ARCH_NAME_MAX-1; i++) dst[n++] = src[i];
+    dst[n] = '\0';
+}
+
+// Reads len bytes of metadata member (GNU long name, pax header) into
+// a new buffer; too long ones are skipped. Returns NULL if skipped.
+static uint8_t *ci_TarMeta(CI_archive *a, uint64_t len, int *err) {
+    uint8_t *buf;
+    *err = 0;
+    if (len > CI_ARCH_META_MAX) {
+        if (ci_Skip(a->file, len) < len) *err = 1;
+        return NULL;
+    }
+    buf = (uint8_t *) malloc(len+1);
+    if (fread(buf, 1, len, a->file) < len) { *err = 1; free(buf); return NULL; }
+    buf[len] = '\0';
+    return buf;
+}
+
+// Takes path and size out of pax extended header records "len key=value\n".
+static void ci_TarPax(const uint8_t *buf, uint64_t len, char *path, uint64_t *size) {
+    uint64_t i = 0, n;
+    const char *rec, *val;
+    while (i < len) {
+        rec = (const char *) buf + i;
+        n = strtoul(rec, NULL, 10);
+        if (!n || n > len - i) break;
+        val = memchr(rec, ' ', n);
+        if (val && n > 1 && rec[n-1] == '\n') {
+            val++;
+            if (!strncmp(val, "path=", 5)) {
+                uint64_t l = rec + n - 1 - (val + 5);
+                if (l > CI_ARCH_NAME_MAX-1) l = CI_ARCH_NAME_MAX-1;
+                memcpy(path, val + 5, l);
+                path[l] = '\0';
+            } else if (!strncmp(val, "size=", 5)) {
+                *size = strtoull(val + 5, NULL, 10);
+            }
+        }
+        i += n;
+    }
+}
+
+static int ci_TarNext(CI_archive *a) {
+    char longname[CI_ARCH_NAME_MAX];
+    uint64_t size, pax_size = UINT64_MAX;
+    uint8_t *meta, type;
+    int err;
+    size_t n;
+
+    longname[0] = '\0';
+    for (;;) {
+        if (!a->hdr_ok) {
+            n = fread(a->hdr, 1, 512, a->file);
+            // Archive may end without its zero blocks
+            if (!n) return 0;
+            if (n < 512) return -1;
+        }
+        a->hdr_ok = 0;
+        for (n=0; n < 512 && !a->hdr[n]; n++);
+        if (n == 512) return 0;
+        if (!ci_TarHeaderOk(a->hdr)) return -1;
+        size = ci_TarNumber(a->hdr+124, 12);
+        if (pax_size != UINT64_MAX) size = pax_size;
+        a->pad = (512 - size % 512) % 512;
+        type = a->hdr[156];
+        switch (type) {
+            // GNU long name, pax header: apply to next member
+            case 'L':
+            case 'x':
+                meta = ci_TarMeta(a, size, &err);
+                if (err || ci_Skip(a->file, a->pad) < a->pad) { free(meta); return -1; }
+                if (meta && type == 'L') {
+                    longname[0] = '\0';
+                    ci_TarName(longname, meta, size);
+                }
+                if (meta && type == 'x') ci_TarPax(meta, size, longname, &pax_size);
+                free(meta);
+                continue;
+            // Regular file
+            case '0':
+            case '\0':
+            case '7':
+                a->name[0] = '\0';
+                if (longname[0]) {
+                    strcpy(a->name, longname);
+                } else {
+                    // ustar: name is prefix/name
+                    if (!memcmp(a->hdr+257, "ustar", 5) && a->hdr[345]) {
+                        ci_TarName(a->name, a->hdr+345, 155);
+                        ci_TarName(a->name, (const uint8_t *) "/", 1);
+                    }
+                    ci_TarName(a->name, a->hdr, 100);
+                }
+                a->size = size;
+                a->method = 0;
+                a->supported = 1;
+                ci_InputOpen(&a->in, a->file, CI_INPUT_RAW, size, size);
+                return 1;
+            // Directories, links, global pax headers...
+            default:
+                if (ci_Skip(a->file, size + a->pad) < size + a->pad) return -1;
+                longname[0] = '\0';
+                pax_size = UINT64_MAX;
+        }
+    }
+}
+
+// --- zip ---
+
+// Finds end of central directory record (zip64 one, if any); sets
+// position and number of entries of central directory.
+static int ci_ZipOpen(CI_archive *a) {
+    uint8_t buf[65536+22], *e = NULL;
+    int64_t size, start, i;
+    size_t n;
+
+    if (fseek(a->file, 0, SEEK_END) || (size = ci_Tell(a->file)) < 22) return -1;
+    // Record is last, followed by comment of up to 64 kB
+    start = (size > (int64_t) sizeof(buf) ? size - (int64_t) sizeof(buf) : 0);
+    if (ci_Seek(a->file, start) || (n = fread(buf, 1, size - start, a->file)) < 22) return -1;
+    for (i = n - 22; i >= 0; i--)
+        if (!memcmp(buf+i, "PK\5\6", 4)) { e = buf + i; break; }
+    if (!e) return -1;
+    a->entries = ci_Le16(e+10);
+    a->next = ci_Le32(e+16);
+    // zip64: locator right before the record points to zip64 record
+    if ((a->entries == 0xFFFF || a->next == 0xFFFFFFFF) && e - buf >= 20 && !memcmp(e-20, "PK\6\7", 4)) {
+        uint8_t e64[56];
+        if (ci_Seek(a->file, ci_Le64(e-20+8)) || fread(e64, 1, 56, a->file) < 56 ||
+            memcmp(e64, "PK\6\6", 4)) return -1;
+        a->entries = ci_Le64(e64+32);
+        a->next = ci_Le64(e64+48);
+    }
+    return 0;
+}
+
+static int ci_ZipNext(CI_archive *a) {
+    uint8_t c[46], l[30], extra[65536];
+    uint32_t flags, nlen, xlen, clen, i, id, len;
+    uint64_t csize, usize, offs;
+
+    if (!a->entries) return 0;
+    a->entries--;
+    if (ci_Seek(a->file, a->next) || fread(c, 1, 46, a->file) < 46 || memcmp(c, "PK\1\2", 4)) return -1;
+    flags = ci_Le16(c+8);
+    a->method = ci_Le16(c+10);
+    csize = ci_Le32(c+20);
+    usize = ci_Le32(c+24);
+    nlen = ci_Le16(c+28);
+    xlen = ci_Le16(c+30);
+    clen = ci_Le16(c+32);
+    offs = ci_Le32(c+42);
+    a->next += 46 + nlen + xlen + clen;
+    i = (nlen < CI_ARCH_NAME_MAX ? nlen : CI_ARCH_NAME_MAX-1);
+    if (fread(a->name, 1, i, a->file) < i) return -1;
+    a->name[i] = '\0';
+    if (ci_Skip(a->file, nlen - i) < nlen - i || fread(extra, 1, xlen, a->file) < xlen) return -1;
+    // zip64 extra field has those of sizes and offset which didn't fit
+    for (i=0; i + 4 <= xlen; i += 4 + len) {
+        id = ci_Le16(extra+i);
+        len = ci_Le16(extra+i+2);
+        if (i + 4 + len > xlen) break;
+        if (id == 0x0001) {
+            uint32_t k = i + 4;
+            if (usize == 0xFFFFFFFF && k + 8 <= i + 4 + len) { usize = ci_Le64(extra+k); k += 8; }
+            if (csize == 0xFFFFFFFF && k + 8 <= i + 4 + len) { csize = ci_Le64(extra+k); k += 8; }
+            if (offs == 0xFFFFFFFF && k + 8 <= i + 4 + len) { offs = ci_Le64(extra+k); k += 8; }
+        }
+    }
+    // Data follows local header, whose name and extra field may differ
+    if (ci_Seek(a->file, offs) || fread(l, 1, 30, a->file) < 30 || memcmp(l, "PK\3\4", 4)) return -1;
+    if (ci_Seek(a->file, offs + 30 + ci_Le16(l+26) + ci_Le16(l+28))) return -1;
+    a->size = usize;
+    // Stored or deflated, not encrypted
+    a->supported = !(flags & 1) && (a->method == 0 || a->method == 8);
+    if (a->supported && ci_InputOpen(&a->in, a->file, (a->method == 8 ? CI_INPUT_DEFLATE : CI_INPUT_RAW), csize, usize))
+        a->supported = 0;
+    return 1;
+}
+
+// --- Archive ---
+
+// Recognizes archive in file (from its current position). Returns 0 if
+// OK, or CI_ARCH_ERR_*.
+int ci_ArchiveOpen(CI_archive *a, FILE *file) {
+    size_t n;
+    memset(a, 0, sizeof(CI_archive));
+    a->file = file;
+    n = fread(a->hdr, 1, 512, file);
+    if (n >= 4 && (!memcmp(a->hdr, "PK\3\4", 4) || !memcmp(a->hdr, "PK\5\6", 4))) {
+        a->type = CI_ARCH_ZIP;
+        if (ci_ZipOpen(a)) return (ci_Seek(file, 0) ? CI_ARCH_ERR_SEEK : CI_ARCH_ERR_TYPE);
+        return 0;
+    }
+    if (n == 512 && ci_TarHeaderOk(a->hdr)) {
+        a->type = CI_ARCH_TAR;
+        a->hdr_ok = 1;
+        return 0;
+    }
+    return CI_ARCH_ERR_TYPE;
+}
+
+// Goes to next member; unread data of current one is skipped. Returns 1
+// if there is one (its data can be read if a->supported), 0 at end of
+// archive, -1 if archive is corrupt.
+int ci_ArchiveNext(CI_archive *a) {
+    if (a->in.file) {
+        if (a->type == CI_ARCH_TAR && a->in.left + a->pad &&
+            ci_Skip(a->file, a->in.left + a->pad) < a->in.left + a->pad) return -1;
+        ci_ArchiveClose(a);
+    }
+    if (a->type == CI_ARCH_TAR) return ci_TarNext(a);
+    return ci_ZipNext(a);
+}
+
+// Releases current member; archive file stays open.
+void ci_ArchiveClose(CI_archive *a) {
+    ci_InputClose(&a->in);
+    a->in.file = NULL;
+}
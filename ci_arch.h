@@ -0,0 +1,63 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo tar and zip archive members.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_ARCH_H_
+#define _CI_ARCH_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "ci_io.h"
+
+#define CI_ARCH_TAR             1
+#define CI_ARCH_ZIP             2
+#define CI_ARCH_NAME_MAX        4096            // longer member names are cut
+#define CI_ARCH_META_MAX        (64 << 10)      // longer pax headers are skipped
+
+// ci_ArchiveOpen() errors
+#define CI_ARCH_ERR_TYPE        -1              // neither tar nor zip
+#define CI_ARCH_ERR_SEEK        -2              // zip, but file can't seek (pipe)
+
+// Archive being read, with its current member
+typedef struct _CI_archive {
+    FILE        *file;
+    uint32_t    type;
+    char        name[CI_ARCH_NAME_MAX];     // member name
+    uint64_t    size;                       // member size
+    uint32_t    method;                     // zip compression method
+    uint32_t    supported;                  // member data can be read
+    CI_input    in;                         // member data
+    // tar
+    uint8_t     hdr[512];
+    uint32_t    hdr_ok;                     // hdr holds next header already
+    uint64_t    pad;                        // padding after member data
+    // zip
+    uint64_t    next;                       // central directory entry of next member
+    uint64_t    entries;                    // members left
+} CI_archive;
+
+int ci_ArchiveOpen(CI_archive *a, FILE *file);
+int ci_ArchiveNext(CI_archive *a);
+void ci_ArchiveClose(CI_archive *a);
+
+#endif
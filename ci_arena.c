@@ -0,0 +1,115 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo per file bump arena.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "ci_arena.h"
+
+#define CI_ARENA_HDR    ((sizeof(CI_arena_block) + CI_ARENA_ALIGN-1) & ~(size_t)(CI_ARENA_ALIGN-1))
+
+// Returns n bytes, aligned to CI_ARENA_ALIGN, valid until reset or rewind.
+// Returns NULL if out of memory.
+void *ci_ArenaAlloc(CI_arena *a, size_t n) {
+    CI_arena_block *b = a->cur;
+    void *p;
+    n = (n + CI_ARENA_ALIGN-1) & ~(size_t)(CI_ARENA_ALIGN-1);
+    if (!b || b->size - b->used < n) {
+        // Rest of current block is left unused
+        if (n <= CI_ARENA_BLOCK && a->spare) {
+            b = a->spare;
+            a->spare = b->next;
+        } else {
+            size_t size = (n > CI_ARENA_BLOCK ? n : CI_ARENA_BLOCK);
+            if (!(b = (CI_arena_block *) malloc(CI_ARENA_HDR + size))) return NULL;
+            b->size = size;
+        }
+        b->used = 0;
+        b->next = a->cur;
+        a->cur = b;
+    }
+    p = (char *) b + CI_ARENA_HDR + b->used;
+    b->used += n;
+    return p;
+}
+
+char *ci_ArenaStrdup(CI_arena *a, const char *s) {
+    size_t n = strlen(s) + 1;
+    char *d = (char *) ci_ArenaAlloc(a, n);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+// sprintf() into a string of just the needed size.
+char *ci_ArenaPrintf(CI_arena *a, const char *fmt, ...) {
+    va_list ap;
+    char *d;
+    int n;
+    va_start(ap, fmt);
+    n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || !(d = (char *) ci_ArenaAlloc(a, n+1))) return NULL;
+    va_start(ap, fmt);
+    vsnprintf(d, n+1, fmt, ap);
+    va_end(ap);
+    return d;
+}
+
+CI_arena_mark ci_ArenaMark(const CI_arena *a) {
+    CI_arena_mark m;
+    m.block = a->cur;
+    m.used = (a->cur ? a->cur->used : 0);
+    return m;
+}
+
+// Drops everything allocated after mark m. Oversized blocks are freed,
+// blocks of usual size go to spare list.
+void ci_ArenaRewind(CI_arena *a, CI_arena_mark m) {
+    CI_arena_block *b;
+    while (a->cur != m.block) {
+        b = a->cur;
+        a->cur = b->next;
+        if (b->size == CI_ARENA_BLOCK) {
+            b->next = a->spare;
+            a->spare = b;
+        } else free(b);
+    }
+    if (a->cur) a->cur->used = m.used;
+}
+
+void ci_ArenaReset(CI_arena *a) {
+    CI_arena_mark m = { NULL, 0 };
+    ci_ArenaRewind(a, m);
+}
+
+void ci_ArenaFree(CI_arena *a) {
+    CI_arena_block *b;
+    ci_ArenaReset(a);
+    while ((b = a->spare)) {
+        a->spare = b->next;
+        free(b);
+    }
+}
@@ -0,0 +1,62 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo per file bump arena.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_ARENA_H_
+#define _CI_ARENA_H_
+
+#include <stddef.h>
+
+#define CI_ARENA_BLOCK          (64*1024)       // usual block size, kept for reuse
+#define CI_ARENA_ALIGN          16              // alignment of every allocation
+
+// Arena block, data follows the (aligned) header
+typedef struct _CI_arena_block {
+    struct _CI_arena_block *next;               // previous block of the arena
+    size_t      size;                           // usable bytes
+    size_t      used;
+} CI_arena_block;
+
+// Bump arena: allocations are never freed one by one, the whole arena
+// is reset (or rewound to a mark) at once. Blocks of usual size are kept
+// for reuse, so steady state does not touch malloc() at all.
+typedef struct _CI_arena {
+    CI_arena_block  *cur;                       // block being filled
+    CI_arena_block  *spare;                     // released blocks of usual size
+} CI_arena;
+
+// Arena position, allocations after it can be dropped by ci_ArenaRewind()
+typedef struct _CI_arena_mark {
+    CI_arena_block  *block;
+    size_t          used;
+} CI_arena_mark;
+
+void *ci_ArenaAlloc(CI_arena *a, size_t n);
+char *ci_ArenaStrdup(CI_arena *a, const char *s);
+char *ci_ArenaPrintf(CI_arena *a, const char *fmt, ...);
+CI_arena_mark ci_ArenaMark(const CI_arena *a);
+void ci_ArenaRewind(CI_arena *a, CI_arena_mark m);
+void ci_ArenaReset(CI_arena *a);
+void ci_ArenaFree(CI_arena *a);
+
+#endif
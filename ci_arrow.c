@@ -0,0 +1,455 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo Arrow IPC file writer.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef WIN32
+#define _GNU_SOURCE             // pwrite(), MAP_ANONYMOUS with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "ci_arrow.h"
+
+// Arrow columnar format: file is "ARROW1", schema message, record batch
+// messages, end of stream marker, footer listing batches, its length and
+// "ARROW1" again. Messages are flatbuffers (Message.fbs, Schema.fbs,
+// File.fbs of Arrow format), bodies have 8 byte aligned buffers.
+#define CI_ARROW_MAGIC          "ARROW1"
+#define CI_ARROW_V5             4       // MetadataVersion
+#define CI_ARROW_CONT           0xFFFFFFFF
+#define CI_FB_TYPE_INT          2       // Type union
+#define CI_FB_TYPE_UTF8         5
+#define CI_FB_MSG_SCHEMA        1       // MessageHeader union
+#define CI_FB_MSG_BATCH         3
+#define CI_FB_FIELDS            8       // fields of a table at most
+
+static const uint8_t ci_arrow_size[] = { 1, 4, 8, 4, 4 };      // value bytes by type
+static const uint8_t ci_arrow_signed[] = { 0, 0, 0, 1, 0 };
+
+// --- Flatbuffer building ---
+// Built front to back: parents first, children after them, so every
+// offset points forward as it must. Positions are relative to buf start,
+// which must be 8 byte aligned where flatbuffer starts.
+
+// Appends n bytes (zeroes if p is NULL), returns their position.
+static uint64_t ci_FbBytes(CI_arrow_buf *b, const void *p, uint64_t n) {
+    uint64_t pos = b->len;
+    if (b->len + n > b->size) {
+        while (b->len + n > b->size) b->size = 2*b->size + 4096;
+        b->p = (uint8_t *) realloc(b->p, b->size);
+    }
+    if (p) memcpy(b->p + pos, p, n);
+    else memset(b->p + pos, 0, n);
+    b->len += n;
+    return pos;
+}
+
+static void ci_FbPad(CI_arrow_buf *b, uint32_t align) {
+    if (b->len % align) ci_FbBytes(b, NULL, align - b->len % align);
+}
+
+// Stores value (little endian, as is host) of given size at pos.
+static void ci_FbSet(CI_arrow_buf *b, uint64_t pos, uint64_t value, uint32_t size) {
+    memcpy(b->p + pos, &value, size);
+}
+
+// Stores offset from pos to target.
+static void ci_FbRef(CI_arrow_buf *b, uint64_t pos, uint64_t target) {
+    ci_FbSet(b, pos, target - pos, 4);
+}
+
+// Writes vtable and zeroed table of n fields, size[i] bytes each (0 for
+// absent ones). Fields are laid out largest first, aligned; field[i] gets
+// position of i-th one. Returns position of table.
+static uint64_t ci_FbTable(CI_arrow_buf *b, uint32_t n, const uint8_t *size, uint64_t *field) {
+    uint16_t vt[2+CI_FB_FIELDS];
+    uint32_t i, s, c = 4;
+    uint64_t vpos, tpos;
+
+    vt[0] = 4 + 2*n;
+    for (i=0; i < n; i++) vt[2+i] = 0;
+    for (s=8; s; s >>= 1)
+        for (i=0; i < n; i++)
+            if (size[i] == s) {
+                c = (c + s-1) & ~(s-1);
+                vt[2+i] = c;
+                c += s;
+            }
+    vt[1] = c;
+    ci_FbPad(b, 2);
+    vpos = ci_FbBytes(b, vt, vt[0]);
+    ci_FbPad(b, 8);
+    tpos = ci_FbBytes(b, NULL, c);
+    ci_FbSet(b, tpos, tpos - vpos, 4);
+    for (i=0; i < n; i++) field[i] = tpos + vt[2+i];
+    return tpos;
+}
+
+// Writes zeroed vector of n elements, size bytes each, aligned to align.
+// Returns position of its length, elements follow.
+static uint64_t ci_FbVector(CI_arrow_buf *b, uint32_t n, uint32_t size, uint32_t align) {
+    while ((b->len + 4) % align) ci_FbBytes(b, NULL, 1);
+    ci_FbBytes(b, &n, 4);
+    ci_FbBytes(b, NULL, (uint64_t) n*size);
+    return b->len - (uint64_t) n*size - 4;
+}
+
+static uint64_t ci_FbString(CI_arrow_buf *b, const char *str) {
+    uint32_t n = strlen(str);
+    uint64_t pos;
+    ci_FbPad(b, 4);
+    pos = ci_FbBytes(b, &n, 4);
+    ci_FbBytes(b, str, n+1);
+    return pos;
+}
+
+// --- Arrow metadata ---
+
+// Writes Schema table of a's columns, all nullable.
+static uint64_t ci_ArrowSchema(CI_arrow_buf *b, const CI_arrow *a) {
+    static const uint8_t schema[2] = { 0, 4 };                  // endianness, fields
+    static const uint8_t field[6] = { 4, 1, 1, 4, 0, 4 };       // name, nullable, type_type, type, -, children
+    static const uint8_t type_int[2] = { 4, 1 };                // bitWidth, is_signed
+    uint64_t s[2], f[6], t[2], fields, pos;
+    uint32_t i, type;
+
+    pos = ci_FbTable(b, 2, schema, s);
+    fields = ci_FbVector(b, a->cols, 4, 4);
+    ci_FbRef(b, s[1], fields);
+    for (i=0; i < a->cols; i++) {
+        type = a->col[i].type;
+        ci_FbRef(b, fields + 4 + 4*i, ci_FbTable(b, 6, field, f));
+        ci_FbSet(b, f[1], 1, 1);
+        ci_FbRef(b, f[0], ci_FbString(b, a->col[i].name));
+        ci_FbRef(b, f[5], ci_FbVector(b, 0, 4, 4));
+        if (type == CI_ARROW_UTF8) {
+            ci_FbSet(b, f[2], CI_FB_TYPE_UTF8, 1);
+            ci_FbRef(b, f[3], ci_FbTable(b, 0, NULL, t));
+        } else {
+            ci_FbSet(b, f[2], CI_FB_TYPE_INT, 1);
+            ci_FbRef(b, f[3], ci_FbTable(b, 2, type_int, t));
+            ci_FbSet(b, t[0], 8*ci_arrow_size[type], 4);
+            ci_FbSet(b, t[1], ci_arrow_signed[type], 1);
+        }
+    }
+    return pos;
+}
+
+// Starts message: continuation marker, metadata length (set by
+// ci_ArrowMessageEnd()), Message table. Returns position of its header
+// offset, header table is to be written by caller.
+static uint64_t ci_ArrowMessageBegin(CI_arrow_buf *m, uint8_t type, uint64_t body) {
+    static const uint8_t message[4] = { 2, 1, 4, 8 };           // version, header_type, header, bodyLength
+    uint32_t cont = CI_ARROW_CONT;
+    uint64_t f[4];
+
+    m->len = 0;
+    ci_FbBytes(m, &cont, 4);
+    ci_FbBytes(m, NULL, 8);                                     // metadata length, root offset
+    ci_FbRef(m, 8, ci_FbTable(m, 4, message, f));
+    ci_FbSet(m, f[0], CI_ARROW_V5, 2);
+    ci_FbSet(m, f[1], type, 1);
+    ci_FbSet(m, f[3], body, 8);
+    return f[2];
+}
+
+// Pads metadata so that body starts 8 byte aligned.
+static void ci_ArrowMessageEnd(CI_arrow_buf *m) {
+    ci_FbPad(m, 8);
+    ci_FbSet(m, 4, m->len - 8, 4);
+}
+
+// Writes n bytes at offs, whole.
+static int ci_ArrowWrite(CI_arrow *a, const uint8_t *p, uint64_t n, uint64_t offs) {
+    int64_t r;
+    while (n) {
+#ifdef WIN32
+        r = (lseek(a->fd, offs, SEEK_SET) < 0 ? -1 : write(a->fd, p, n));
+#else
+        r = pwrite(a->fd, p, n, offs);
+#endif
+        if (r <= 0) return (a->failed = -1);
+        p += r;
+        offs += r;
+        n -= r;
+    }
+    return 0;
+}
+
+// Creates file at path with schema of given columns. Shared end of file
+// is set up here, so processes forked later write into the same file.
+int ci_ArrowOpen(CI_arrow *a, const char *path, const CI_arrow_col *col, uint32_t cols) {
+    CI_arrow_buf m = { NULL, 0, 0 };
+    uint64_t header;
+    int r;
+
+    memset(a, 0, sizeof(CI_arrow));
+    a->col = col;
+    a->cols = cols;
+    if ((a->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644)) < 0) return -1;
+#ifdef WIN32
+    a->end = (uint64_t *) malloc(sizeof(uint64_t));
+#else
+    a->end = (uint64_t *) mmap(NULL, sizeof(uint64_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (a->end == MAP_FAILED) {
+        close(a->fd);
+        return -1;
+    }
+#endif
+    header = ci_ArrowMessageBegin(&m, CI_FB_MSG_SCHEMA, 0);
+    ci_FbRef(&m, header, ci_ArrowSchema(&m, a));
+    ci_ArrowMessageEnd(&m);
+    r = ci_ArrowWrite(a, (const uint8_t *) CI_ARROW_MAGIC "\0", 8, 0);
+    if (!r) r = ci_ArrowWrite(a, m.p, m.len, 8);
+    *a->end = 8 + m.len;
+    free(m.p);
+    return r;
+}
+
+static int ci_ArrowBlockCmp(const void *x, const void *y) {
+    const CI_arrow_block *a = x, *b = y;
+    return (a->offs > b->offs) - (a->offs < b->offs);
+}
+
+// Ends file: end of stream marker, footer with schema and all batches
+// (in file order), magic. Done once, by process that opened the file,
+// after all others have finished.
+int ci_ArrowClose(CI_arrow *a) {
+    static const uint8_t footer[4] = { 2, 4, 4, 4 };            // version, schema, dictionaries, recordBatches
+    CI_arrow_buf m = { NULL, 0, 0 };
+    uint32_t eos[2] = { CI_ARROW_CONT, 0 }, i;
+    uint64_t f[4], v, pos;
+    int r;
+
+    if (a->blocks) qsort(a->block, a->blocks, sizeof(CI_arrow_block), ci_ArrowBlockCmp);
+    ci_FbBytes(&m, eos, 8);
+    // Footer flatbuffer starts here, 8 byte aligned
+    ci_FbBytes(&m, NULL, 4);
+    ci_FbRef(&m, 8, ci_FbTable(&m, 4, footer, f));
+    ci_FbSet(&m, f[0], CI_ARROW_V5, 2);
+    ci_FbRef(&m, f[2], ci_FbVector(&m, 0, 24, 8));
+    v = ci_FbVector(&m, a->blocks, 24, 8);
+    ci_FbRef(&m, f[3], v);
+    for (i=0; i < a->blocks; i++) {
+        pos = v + 4 + 24*i;
+        ci_FbSet(&m, pos, a->block[i].offs, 8);
+        ci_FbSet(&m, pos + 8, a->block[i].meta, 4);
+        ci_FbSet(&m, pos + 16, a->block[i].body, 8);
+    }
+    ci_FbRef(&m, f[1], ci_ArrowSchema(&m, a));
+    v = m.len - 8;
+    ci_FbBytes(&m, &v, 4);
+    ci_FbBytes(&m, CI_ARROW_MAGIC, 6);
+    r = ci_ArrowWrite(a, m.p, m.len, *a->end);
+    free(m.p);
+    if (close(a->fd)) r = -1;
+#ifdef WIN32
+    free(a->end);
+#else
+    munmap(a->end, sizeof(uint64_t));
+#endif
+    free(a->block);
+    a->block = NULL;
+    return (a->failed ? a->failed : r);
+}
+
+// Batches written by a worker process, for the one to write footer.
+void ci_ArrowSave(CI_arrow *a, FILE *out) {
+    fwrite(&a->blocks, sizeof(uint32_t), 1, out);
+    fwrite(a->block, sizeof(CI_arrow_block), a->blocks, out);
+    fwrite(&a->rows, sizeof(uint64_t), 1, out);
+    fwrite(&a->failed, sizeof(int), 1, out);
+}
+
+void ci_ArrowLoad(CI_arrow *a, FILE *in) {
+    uint32_t n;
+    uint64_t rows;
+    int failed;
+    if (fread(&n, sizeof(uint32_t), 1, in) != 1) return;
+    if (a->blocks + n > a->size_block) {
+        a->size_block = a->blocks + n;
+        a->block = (CI_arrow_block *) realloc(a->block, a->size_block*sizeof(CI_arrow_block));
+    }
+    if (fread(a->block + a->blocks, sizeof(CI_arrow_block), n, in) != n) return;
+    a->blocks += n;
+    if (fread(&rows, sizeof(uint64_t), 1, in) != 1 || fread(&failed, sizeof(int), 1, in) != 1) return;
+    a->rows += rows;
+    if (failed) a->failed = failed;
+}
+
+// --- Record batches ---
+
+// Empties batch, keeps its buffers. Offsets of strings start with 0.
+static void ci_ArrowBatchReset(CI_arrow_batch *b) {
+    uint32_t i, zero = 0;
+    b->rows = 0;
+    for (i=0; i < b->a->cols; i++) {
+        b->nulls[i] = 0;
+        b->valid[i].len = 0;
+        b->data[i].len = 0;
+        b->str[i].len = 0;
+        if (b->a->col[i].type == CI_ARROW_UTF8) ci_FbBytes(&b->data[i], &zero, 4);
+    }
+}
+
+void ci_ArrowBatchInit(CI_arrow_batch *b, CI_arrow *a) {
+    memset(b, 0, sizeof(CI_arrow_batch));
+    b->a = a;
+    ci_ArrowBatchReset(b);
+}
+
+void ci_ArrowBatchFree(CI_arrow_batch *b) {
+    uint32_t i;
+    for (i=0; i < CI_ARROW_COLS; i++) {
+        free(b->valid[i].p);
+        free(b->data[i].p);
+        free(b->str[i].p);
+    }
+    free(b->msg.p);
+    memset(b, 0, sizeof(CI_arrow_batch));
+}
+
+// Validity bit of current row, set if value is there.
+static void ci_ArrowValid(CI_arrow_batch *b, uint32_t col, int valid) {
+    CI_arrow_buf *v = &b->valid[col];
+    if (v->len <= b->rows/8) ci_FbBytes(v, NULL, 1);
+    if (valid) v->p[b->rows/8] |= 1 << (b->rows % 8);
+    else b->nulls[col]++;
+}
+
+// 1 if value of col is set in current row already.
+static int ci_ArrowIsSet(const CI_arrow_batch *b, uint32_t col) {
+    uint32_t type = b->a->col[col].type;
+    return b->data[col].len > (uint64_t) (b->rows + (type == CI_ARROW_UTF8))*ci_arrow_size[type];
+}
+
+void ci_ArrowInt(CI_arrow_batch *b, uint32_t col, uint64_t value) {
+    ci_FbBytes(&b->data[col], &value, ci_arrow_size[b->a->col[col].type]);
+    ci_ArrowValid(b, col, 1);
+}
+
+// NULL str is null value.
+void ci_ArrowStr(CI_arrow_batch *b, uint32_t col, const char *str) {
+    uint32_t end;
+    if (!str) {
+        ci_ArrowNull(b, col);
+        return;
+    }
+    ci_FbBytes(&b->str[col], str, strlen(str));
+    end = b->str[col].len;
+    ci_FbBytes(&b->data[col], &end, 4);
+    ci_ArrowValid(b, col, 1);
+}
+
+void ci_ArrowNull(CI_arrow_batch *b, uint32_t col) {
+    uint32_t end = b->str[col].len;
+    if (b->a->col[col].type == CI_ARROW_UTF8) ci_FbBytes(&b->data[col], &end, 4);
+    else ci_FbBytes(&b->data[col], NULL, ci_arrow_size[b->a->col[col].type]);
+    ci_ArrowValid(b, col, 0);
+}
+
+// Ends row, columns not given are null. Full batch is written.
+int ci_ArrowRow(CI_arrow_batch *b) {
+    uint32_t i;
+    for (i=0; i < b->a->cols; i++)
+        if (!ci_ArrowIsSet(b, i)) ci_ArrowNull(b, i);
+    if (++b->rows < CI_ARROW_BATCH) return 0;
+    return ci_ArrowFlush(b);
+}
+
+// Writes batch as record batch message: buffers of each column are
+// validity bitmap (empty if there are no nulls), values or offsets, and
+// string bytes. Its place in file is taken off shared end of file, so
+// any number of threads and processes write at once.
+int ci_ArrowFlush(CI_arrow_batch *b) {
+    static const uint8_t batch[3] = { 8, 4, 4 };                // length, nodes, buffers
+    CI_arrow *a = b->a;
+    CI_arrow_buf *m = &b->msg, *buf[3];
+    CI_arrow_block block;
+    uint32_t i, j, k, bufs = 0, nbuf;
+    uint64_t f[3], header, nodes, buffers, body = 0, len, offs, meta;
+    int r;
+
+    if (!b->rows) return 0;
+    for (i=0; i < a->cols; i++) {
+        bufs += (a->col[i].type == CI_ARROW_UTF8 ? 3 : 2);
+        body += (b->nulls[i] ? (b->valid[i].len + 7) & ~7ULL : 0) + ((b->data[i].len + 7) & ~7ULL);
+        if (a->col[i].type == CI_ARROW_UTF8) body += (b->str[i].len + 7) & ~7ULL;
+    }
+    header = ci_ArrowMessageBegin(m, CI_FB_MSG_BATCH, body);
+    ci_FbRef(m, header, ci_FbTable(m, 3, batch, f));
+    ci_FbSet(m, f[0], b->rows, 8);
+    nodes = ci_FbVector(m, a->cols, 16, 8);
+    ci_FbRef(m, f[1], nodes);
+    buffers = ci_FbVector(m, bufs, 16, 8);
+    ci_FbRef(m, f[2], buffers);
+    ci_ArrowMessageEnd(m);
+    meta = m->len;
+    // Body follows metadata, every buffer padded to 8 bytes
+    for (i=0, k=0; i < a->cols; i++) {
+        ci_FbSet(m, nodes + 4 + 16*i, b->rows, 8);
+        ci_FbSet(m, nodes + 12 + 16*i, b->nulls[i], 8);
+        buf[0] = &b->valid[i];
+        buf[1] = &b->data[i];
+        buf[2] = &b->str[i];
+        nbuf = (a->col[i].type == CI_ARROW_UTF8 ? 3 : 2);
+        for (j=0; j < nbuf; j++, k++) {
+            len = (j || b->nulls[i] ? buf[j]->len : 0);
+            ci_FbSet(m, buffers + 4 + 16*k, m->len - meta, 8);
+            ci_FbSet(m, buffers + 12 + 16*k, len, 8);
+            ci_FbBytes(m, buf[j]->p, len);
+            ci_FbPad(m, 8);
+        }
+    }
+
+    offs = __sync_fetch_and_add(a->end, m->len);
+    r = ci_ArrowWrite(a, m->p, m->len, offs);
+    block.offs = offs;
+    block.body = body;
+    block.meta = meta;
+    block.rows = b->rows;
+    while (!__sync_bool_compare_and_swap(&a->lock, 0, 1));
+    if (a->blocks == a->size_block) {
+        a->size_block = 2*a->size_block + 16;
+        a->block = (CI_arrow_block *) realloc(a->block, a->size_block*sizeof(CI_arrow_block));
+    }
+    a->block[a->blocks++] = block;
+    a->rows += b->rows;
+    __sync_lock_release(&a->lock);
+    ci_ArrowBatchReset(b);
+    return r;
+}
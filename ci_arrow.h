@@ -0,0 +1,102 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo Arrow IPC file writer of record batches.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_ARROW_H_
+#define _CI_ARROW_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define CI_ARROW_BATCH          65536           // rows of a full record batch
+#define CI_ARROW_COLS           24              // columns of a table at most
+
+// Column types
+enum {
+    CI_ARROW_U8,
+    CI_ARROW_U32,
+    CI_ARROW_U64,
+    CI_ARROW_I32,
+    CI_ARROW_UTF8
+};
+
+typedef struct _CI_arrow_col {
+    const char  *name;
+    uint32_t    type;                           // CI_ARROW_*
+} CI_arrow_col;
+
+// Record batch in file, as listed in footer
+typedef struct _CI_arrow_block {
+    uint64_t    offs;
+    uint64_t    body;                           // body bytes
+    uint32_t    meta;                           // metadata bytes, prefix included
+    uint32_t    rows;
+} CI_arrow_block;
+
+// Table file. Batches are written by any thread or worker process: each
+// reserves its place at the shared end of file, then writes at once.
+// Blocks are those written by this process (and loaded from workers).
+typedef struct _CI_arrow {
+    int             fd;
+    const CI_arrow_col *col;
+    uint32_t        cols;
+    uint64_t        *end;                       // shared by workers
+    CI_arrow_block  *block;
+    uint32_t        blocks;
+    uint32_t        size_block;
+    volatile int    lock;                       // of block[]
+    uint64_t        rows;
+    int             failed;                     // a write failed
+} CI_arrow;
+
+typedef struct _CI_arrow_buf {
+    uint8_t     *p;
+    uint64_t    len;
+    uint64_t    size;
+} CI_arrow_buf;
+
+// Batch being filled by one thread
+typedef struct _CI_arrow_batch {
+    CI_arrow        *a;
+    uint32_t        rows;
+    uint32_t        nulls[CI_ARROW_COLS];
+    CI_arrow_buf    valid[CI_ARROW_COLS];       // validity bitmaps
+    CI_arrow_buf    data[CI_ARROW_COLS];        // values, string offsets
+    CI_arrow_buf    str[CI_ARROW_COLS];         // string bytes
+    CI_arrow_buf    msg;                        // encoded message
+} CI_arrow_batch;
+
+int ci_ArrowOpen(CI_arrow *a, const char *path, const CI_arrow_col *col, uint32_t cols);
+int ci_ArrowClose(CI_arrow *a);
+void ci_ArrowSave(CI_arrow *a, FILE *out);
+void ci_ArrowLoad(CI_arrow *a, FILE *in);
+
+void ci_ArrowBatchInit(CI_arrow_batch *b, CI_arrow *a);
+void ci_ArrowBatchFree(CI_arrow_batch *b);
+void ci_ArrowInt(CI_arrow_batch *b, uint32_t col, uint64_t value);
+void ci_ArrowStr(CI_arrow_batch *b, uint32_t col, const char *str);
+void ci_ArrowNull(CI_arrow_batch *b, uint32_t col);
+int ci_ArrowRow(CI_arrow_batch *b);
+int ci_ArrowFlush(CI_arrow_batch *b);
+
+#endif
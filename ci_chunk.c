@@ -0,0 +1,147 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo chunk schema: zero-copy accessors and serializers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <string.h>
+
+#include "ci_chunk.h"
+
+#define CI_CHUNK_TYPE_ROW(tag, id, flags)   { id, flags, CI_F_##tag },
+#define CI_CHUNK_FIELD_ROW(tag, name, key, kind, offs, count, flags, label) \
+    { CPT9_CHUNK_##tag, kind, flags, count, offs, key, label },
+
+const CI_chunk_type ci_chunk_type[CI_CHUNK_TYPES_NUM+1] = {
+    CI_CHUNK_TYPES(CI_CHUNK_TYPE_ROW, CI_CHUNK_NONE)
+    { 0, 0, CI_CHUNK_FIELDS_NUM }
+};
+
+const CI_chunk_field ci_chunk_field[CI_CHUNK_FIELDS_NUM] = {
+    CI_CHUNK_TYPES(CI_CHUNK_NONE, CI_CHUNK_FIELD_ROW)
+};
+
+// Index of chunk id in ci_chunk_type[], -1 if not known.
+int ci_ChunkType(uint32_t id) {
+    int lo = 0, hi = CI_CHUNK_TYPES_NUM - 1, mid;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ci_chunk_type[mid].id == id) return mid;
+        if (ci_chunk_type[mid].id < id) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return -1;
+}
+
+// Bytes of one element of a field.
+static uint32_t ci_ChunkElem(uint32_t kind) {
+    switch (kind) {
+        case CI_FIELD_U32:
+        case CI_FIELD_I32:
+        case CI_FIELD_X32: return 4;
+        case CI_FIELD_F64: return 8;
+    }
+    return 1;
+}
+
+// Payload bytes of a chunk of given type holding all its fields, rest
+// bytes are given to strings running up to the end of chunk.
+uint32_t ci_ChunkSize(int type, uint32_t rest) {
+    const CI_chunk_field *cf;
+    uint32_t f, end, size = 0;
+    for (f = ci_chunk_type[type].field; f < ci_chunk_type[type+1].field; f++) {
+        cf = &ci_chunk_field[f];
+        end = cf->offs + (cf->count == CI_FIELD_REST ? rest : cf->count * ci_ChunkElem(cf->kind));
+        if (end > size) size = end;
+    }
+    return size;
+}
+
+// Elements of field (bytes of strings) which are in a chunk of len bytes.
+uint32_t ci_ChunkCount(uint32_t field, uint32_t len) {
+    const CI_chunk_field *cf = &ci_chunk_field[field];
+    uint32_t n;
+    if (cf->offs >= len) return 0;
+    n = (len - cf->offs) / ci_ChunkElem(cf->kind);
+    if (cf->count != CI_FIELD_REST && n > cf->count) n = cf->count;
+    return n;
+}
+
+// Offset of i-th element of field in a chunk of len bytes, n gets number
+// of elements from there on. UINT32_MAX if it's not (whole) in chunk.
+static uint32_t ci_ChunkOffs(uint32_t len, uint32_t field, uint32_t i, uint32_t *n) {
+    const CI_chunk_field *cf = &ci_chunk_field[field];
+    uint32_t count = ci_ChunkCount(field, len);
+    if (i >= count) return UINT32_MAX;
+    if (n) *n = count - i;
+    return cf->offs + i * ci_ChunkElem(cf->kind);
+}
+
+// Pointer to i-th element of field in chunk payload buf of len bytes, NULL
+// if it's not (whole) in chunk. Points into buf, so may be unaligned; n
+// gets number of elements (string bytes) from there on, if not NULL.
+const uint8_t *ci_ChunkAt(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, uint32_t *n) {
+    uint32_t offs = ci_ChunkOffs(len, field, i, n);
+    return (offs == UINT32_MAX ? NULL : buf + offs);
+}
+
+// Value of i-th element of a 32-bit field, 0 if not in chunk.
+uint32_t ci_ChunkU32(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i) {
+    const uint8_t *p = ci_ChunkAt(buf, len, field, i, NULL);
+    uint32_t value = 0;
+    if (p) memcpy(&value, p, 4);
+    return value;
+}
+
+// Value of i-th element of a double field, 0 if not in chunk.
+double ci_ChunkF64(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i) {
+    const uint8_t *p = ci_ChunkAt(buf, len, field, i, NULL);
+    double value = 0;
+    if (p) memcpy(&value, p, 8);
+    return value;
+}
+
+// Setters fill fields of a chunk payload being built, zeroed beforehand
+// (see ci_ChunkSize()). They return -1 if the field is not in chunk.
+int ci_ChunkSetU32(uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, uint32_t value) {
+    uint32_t offs = ci_ChunkOffs(len, field, i, NULL);
+    if (offs == UINT32_MAX) return -1;
+    memcpy(buf + offs, &value, 4);
+    return 0;
+}
+
+int ci_ChunkSetF64(uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, double value) {
+    uint32_t offs = ci_ChunkOffs(len, field, i, NULL);
+    if (offs == UINT32_MAX) return -1;
+    memcpy(buf + offs, &value, 8);
+    return 0;
+}
+
+// Copies n bytes of data into a string or GUID field, cut to its size,
+// what's left of the field is zeroed.
+int ci_ChunkSetBytes(uint8_t *buf, uint32_t len, uint32_t field, const void *data, uint32_t n) {
+    uint32_t size, offs = ci_ChunkOffs(len, field, 0, &size);
+    if (offs == UINT32_MAX) return -1;
+    if (n > size) n = size;
+    memcpy(buf + offs, data, n);
+    memset(buf + offs + n, 0, size - n);
+    return 0;
+}
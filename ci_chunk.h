@@ -0,0 +1,173 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo chunk schema: zero-copy accessors and serializers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_CHUNK_H_
+#define _CI_CHUNK_H_
+
+#include <inttypes.h>
+
+// Kinds of chunk fields
+#define CI_FIELD_U32            0       // uint32_t
+#define CI_FIELD_I32            1       // int32_t
+#define CI_FIELD_X32            2       // uint32_t, printed as hex too
+#define CI_FIELD_F64            3       // double
+#define CI_FIELD_ANSI           4       // string in .cpt charset, count bytes
+#define CI_FIELD_UCS2           5       // UCS-2LE string, count bytes
+#define CI_FIELD_GUID           6       // 16 bytes, Windows GUID layout
+
+#define CI_FIELD_REST           0       // count of a string: up to end of chunk
+#define CI_FIELD_HIDE           1       // flag: chunk printer shows it its own way
+
+// Known chunk types, sorted by id. T(tag, id, flags) is a type, followed
+// by F(tag, name, key, kind, offs, count, flags, label) rows of its fields
+// in print order, if it's decoded. Layouts marked [?] are guessed from
+// chunk names only, not seen in real files yet.
+#define CI_CHUNK_TYPES(T, F) \
+    T(AEXT, 0x61657874, 0x02) \
+    T(ANAM, 0x616e616d, 0x02) \
+    F(ANAM, NAME,     "name",     CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "Name ANSI [?]") \
+    T(ANAW, 0x616e6177, 0x02) \
+    F(ANAW, NAME,     "name",     CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "Name UCS-2 [?]") \
+    T(AOVR, 0x616f7672, 0x02) \
+    T(BNAM, 0x626e616d, 0x02) \
+    F(BNAM, NAME,     "name",     CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "Background name ANSI") \
+    T(BNWM, 0x626e776d, 0x02) \
+    F(BNWM, NAME,     "name",     CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "Background name UCS-2") \
+    T(CLPA, 0x636c7061, 0x02) \
+    T(DOCS, 0x646f6373, 0x02) \
+    T(DUOT, 0x64756f74, 0x02) \
+    T(GRID, 0x67726964, 0x02) \
+    F(GRID, XDENSITY, "xdensity", CI_FIELD_F64,  0x08, 1, CI_FIELD_HIDE, "Grid X density") \
+    F(GRID, YDENSITY, "ydensity", CI_FIELD_F64,  0x10, 1, CI_FIELD_HIDE, "Grid Y density") \
+    F(GRID, XUNIT,    "xunit",    CI_FIELD_U32,  0x18, 1, CI_FIELD_HIDE, "Grid X unit") \
+    F(GRID, YUNIT,    "yunit",    CI_FIELD_U32,  0x1C, 1, CI_FIELD_HIDE, "Grid Y unit") \
+    F(GRID, UNK00,    "unk00",    CI_FIELD_X32,  0x00, 2, 0, "Unknown var 00") \
+    F(GRID, UNK01,    "unk01",    CI_FIELD_U32,  0x20, 8, 0, "Unknown var 01") \
+    T(GUID, 0x67756964, 0x02) \
+    F(GUID, GUID,     "guid",     CI_FIELD_GUID, 0x00, 16, 0, "GUID [?]") \
+    T(ISGR, 0x69736772, 0x04) \
+    T(LRES, 0x6c726573, 0x02) \
+    T(LTHM, 0x6c74686d, 0x02) \
+    T(NMPA, 0x6e6d7061, 0x02) \
+    T(NOZZ, 0x6e6f7a7a, 0x02) \
+    T(NUPA, 0x6e757061, 0x02) \
+    T(OBLN, 0x6f626c6e, 0x02) \
+    T(ODUO, 0x6f64756f, 0x02) \
+    T(OINF, 0x6f696e66, 0x02) \
+    F(OINF, NAME_A,   "name_a",   CI_FIELD_ANSI, 0x4C, 112, 0, "Object name ANSI") \
+    F(OINF, NAME_W,   "name_w",   CI_FIELD_UCS2, 0xBC, 128, 0, "Object name UCS-2") \
+    F(OINF, UNK00,    "unk00",    CI_FIELD_I32,  0x00, 6, 0, "Unknown var 00") \
+    F(OINF, UNK01,    "unk01",    CI_FIELD_I32,  0x18, 6, 0, "Unknown var 01") \
+    F(OINF, UNK02,    "unk02",    CI_FIELD_I32,  0x30, 7, 0, "Unknown var 02") \
+    T(OLEX, 0x6f6c6578, 0x02) \
+    T(OLNS, 0x6f6c6e73, 0x02) \
+    T(OSDW, 0x6f736477, 0x02) \
+    T(OT10, 0x6f743130, 0x02) \
+    T(OT12, 0x6f743132, 0x02) \
+    T(OTHM, 0x6f74686d, 0x02) \
+    T(OTPP, 0x6f747070, 0x02) \
+    T(OTX9, 0x6f747839, 0x02) \
+    T(OTXT, 0x6f747874, 0x02) \
+    T(PATH, 0x70617468, 0x02) \
+    F(PATH, NAME,     "name",     CI_FIELD_ANSI, 0x14, CI_FIELD_REST, 0, "Path name ANSI") \
+    F(PATH, UNK,      "unk",      CI_FIELD_I32,  0x00, 5, 0, "Unknown var 00..04") \
+    T(PSDP, 0x70736470, 0x02) \
+    T(PTHW, 0x70746877, 0x02) \
+    F(PTHW, NAME,     "name",     CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "Path name UCS-2") \
+    T(PTHX, 0x70746878, 0x02) \
+    T(ROID, 0x726f6964, 0x02) \
+    T(TGPA, 0x74677061, 0x02) \
+    T(TITL, 0x7469746c, 0x02) \
+    F(TITL, TITLE,    "title",    CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "Title ANSI [?]") \
+    T(URLA, 0x75726c61, 0x02) \
+    F(URLA, URL,      "url",      CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "URL ANSI [?]") \
+    T(URLC, 0x75726c63, 0x02) \
+    F(URLC, COMMENT,  "comment",  CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "URL comment ANSI [?]") \
+    T(URLS, 0x75726c73, 0x02) \
+    F(URLS, STATUS,   "status",   CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "URL status text ANSI [?]") \
+    T(URLT, 0x75726c74, 0x02) \
+    F(URLT, TARGET,   "target",   CI_FIELD_ANSI, 0x00, CI_FIELD_REST, 0, "URL target ANSI [?]") \
+    T(URWA, 0x75727761, 0x02) \
+    F(URWA, URL,      "url",      CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "URL UCS-2 [?]") \
+    T(URWC, 0x75727763, 0x02) \
+    F(URWC, COMMENT,  "comment",  CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "URL comment UCS-2 [?]") \
+    T(URWS, 0x75727773, 0x02) \
+    F(URWS, STATUS,   "status",   CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "URL status text UCS-2 [?]") \
+    T(URWT, 0x75727774, 0x02) \
+    F(URWT, TARGET,   "target",   CI_FIELD_UCS2, 0x00, CI_FIELD_REST, 0, "URL target UCS-2 [?]") \
+    T(VBAI, 0x76626169, 0x02) \
+    T(VBAX, 0x76626178, 0x02) \
+    T(VIAC, 0x76696163, 0x02) \
+    T(VRHS, 0x76726873, 0x02) \
+    T(VSET, 0x76736574, 0x02) \
+    T(WKPA, 0x776b7061, 0x02)
+
+#define CI_CHUNK_NONE(...)
+
+// Chunk ids: CPT9_CHUNK_GRID, ...
+#define CI_CHUNK_ID(tag, id, flags)         CPT9_CHUNK_##tag = id,
+enum { CI_CHUNK_TYPES(CI_CHUNK_ID, CI_CHUNK_NONE) };
+
+// Indexes of ci_chunk_type[]: CI_CHUNK_T_GRID, ...
+#define CI_CHUNK_T(tag, id, flags)          CI_CHUNK_T_##tag,
+enum { CI_CHUNK_TYPES(CI_CHUNK_T, CI_CHUNK_NONE) CI_CHUNK_TYPES_NUM };
+
+// Indexes of ci_chunk_field[]: CI_F_GRID_XDENSITY, ...; CI_F_GRID is the
+// first field of 'grid' (the next type's first field, if not decoded)
+#define CI_CHUNK_F_FIRST(tag, id, flags)    CI_F_##tag, CI_F_##tag##_ = CI_F_##tag - 1,
+#define CI_CHUNK_F(tag, name, ...)          CI_F_##tag##_##name,
+enum { CI_CHUNK_TYPES(CI_CHUNK_F_FIRST, CI_CHUNK_F) CI_CHUNK_FIELDS_NUM };
+
+typedef struct _CI_chunk_type {
+    uint32_t    id;
+    uint8_t     flags;                  // CPT9 chunk flags
+    uint16_t    field;                  // first field, fields end at next type's one
+} CI_chunk_type;
+
+typedef struct _CI_chunk_field {
+    uint32_t    id;                     // of chunk type
+    uint8_t     kind;                   // CI_FIELD_*
+    uint8_t     flags;                  // CI_FIELD_HIDE
+    uint16_t    count;                  // elements; bytes of strings, CI_FIELD_REST
+    uint32_t    offs;                   // in chunk payload
+    const char  *key;                   // JSON key
+    const char  *label;                 // text output label
+} CI_chunk_field;
+
+// Types have a sentinel entry at the end, so fields of type t are
+// ci_chunk_type[t].field .. ci_chunk_type[t+1].field-1
+extern const CI_chunk_type ci_chunk_type[CI_CHUNK_TYPES_NUM+1];
+extern const CI_chunk_field ci_chunk_field[CI_CHUNK_FIELDS_NUM];
+
+int ci_ChunkType(uint32_t id);
+uint32_t ci_ChunkSize(int type, uint32_t rest);
+uint32_t ci_ChunkCount(uint32_t field, uint32_t len);
+const uint8_t *ci_ChunkAt(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, uint32_t *n);
+uint32_t ci_ChunkU32(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i);
+double ci_ChunkF64(const uint8_t *buf, uint32_t len, uint32_t field, uint32_t i);
+int ci_ChunkSetU32(uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, uint32_t value);
+int ci_ChunkSetF64(uint8_t *buf, uint32_t len, uint32_t field, uint32_t i, double value);
+int ci_ChunkSetBytes(uint8_t *buf, uint32_t len, uint32_t field, const void *data, uint32_t n);
+
+#endif
@@ -0,0 +1,323 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo structural diff of two files (block, chunk and tile hashes).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ci_hash.h"
+#include "ci_diff.h"
+
+// Block alignment passes, see ci_DiffAlign()
+enum { CI_DIFF_BY_ALL, CI_DIFF_BY_NAME, CI_DIFF_BY_SIZE };
+
+// Grows array *p of *size items (of isize bytes) to take one more.
+static void *ci_DiffGrow(void *p, uint32_t num, uint32_t *size, size_t isize) {
+    if (num < *size) return p;
+    *size = 2 * *size + 64;
+    return realloc(p, *size * isize);
+}
+
+void ci_DiffInit(CI_diff_file *f) {
+    memset(f, 0, sizeof(CI_diff_file));
+}
+
+void ci_DiffFree(CI_diff_file *f) {
+    uint32_t i;
+    for (i=0; i < f->blocks; i++) free(f->block[i].name);
+    free(f->block);
+    free(f->chunk);
+    free(f->tile);
+    ci_DiffInit(f);
+}
+
+// Notes header field; name has to stay valid (string constant).
+void ci_DiffField(CI_diff_file *f, const char *name, uint64_t value, uint32_t hash) {
+    if (f->fields == CI_DIFF_FIELDS) return;
+    f->field[f->fields].name = name;
+    f->field[f->fields].value = value;
+    f->field[f->fields].hash = hash;
+    f->fields++;
+}
+
+const CI_diff_field *ci_DiffFieldFind(const CI_diff_file *f, const char *name) {
+    uint32_t i;
+    for (i=0; i < f->fields; i++) if (!strcmp(f->field[i].name, name)) return &f->field[i];
+    return NULL;
+}
+
+// Adds block; caller fills in its header fields. Name is copied.
+CI_diff_block *ci_DiffBlock(CI_diff_file *f, uint32_t id, const char *name) {
+    CI_diff_block *b;
+    f->block = (CI_diff_block *) ci_DiffGrow(f->block, f->blocks, &f->blocks_size, sizeof(CI_diff_block));
+    b = &f->block[f->blocks++];
+    memset(b, 0, sizeof(CI_diff_block));
+    b->id = id;
+    if (name) {
+        b->name = (char *) malloc(strlen(name) + 1);
+        strcpy(b->name, name);
+    }
+    b->chunk = f->chunks;
+    b->tile = f->tiles;
+    b->match = CI_DIFF_NONE;
+    f->last = NULL;
+    return b;
+}
+
+void ci_DiffChunk(CI_diff_file *f, uint32_t id, const void *data, uint32_t len) {
+    CI_diff_chunk *c;
+    if (!f->blocks) return;
+    f->chunk = (CI_diff_chunk *) ci_DiffGrow(f->chunk, f->chunks, &f->chunks_size, sizeof(CI_diff_chunk));
+    c = &f->chunk[f->chunks++];
+    c->id = id;
+    c->len = len;
+    c->hash = ci_Hash64(data, len, 0);
+    f->block[f->blocks-1].chunks++;
+}
+
+// Adds tile of last block, data NULL if it isn't in memory. Tiles may
+// share data, such are hashed once.
+void ci_DiffTile(CI_diff_file *f, const void *data, uint32_t len) {
+    CI_diff_tile *t;
+    if (!f->blocks) return;
+    f->tile = (CI_diff_tile *) ci_DiffGrow(f->tile, f->tiles, &f->tiles_size, sizeof(CI_diff_tile));
+    t = &f->tile[f->tiles];
+    t->len = len;
+    t->hashed = (data != NULL);
+    if (!data) {
+        t->hash = 0;
+        f->unhashed++;
+    } else if (data == f->last && len == t[-1].len) {
+        t->hash = t[-1].hash;
+    } else {
+        t->hash = ci_Hash64(data, len, 0);
+        f->hashed += len;
+    }
+    f->last = data;
+    f->tiles++;
+    f->block[f->blocks-1].tiles++;
+}
+
+// Key of block in given pass, equal keys for blocks that may align
+static uint64_t ci_DiffKey(const CI_diff_block *x, uint32_t pass) {
+    uint64_t key = 0, size = ((uint64_t) x->width << 32) | x->height;
+    if (pass != CI_DIFF_BY_SIZE && x->name) key = ci_Hash64(x->name, strlen(x->name), 0);
+    if (pass != CI_DIFF_BY_NAME) key = key * 0x9E3779B97F4A7C15ULL + ci_Hash64(&size, sizeof(size), 1);
+    return key;
+}
+
+static int ci_DiffSame(const CI_diff_block *x, const CI_diff_block *y, uint32_t pass) {
+    if (pass != CI_DIFF_BY_SIZE) {
+        if (!x->name != !y->name) return 0;
+        if (x->name && strcmp(x->name, y->name)) return 0;
+    }
+    if (pass != CI_DIFF_BY_NAME && (x->width != y->width || x->height != y->height)) return 0;
+    return 1;
+}
+
+typedef struct _CI_diff_key {
+    uint64_t    key;
+    uint32_t    idx;
+} CI_diff_key;
+
+static int ci_DiffKeyCmp(const void *a, const void *b) {
+    const CI_diff_key *x = a, *y = b;
+    if (x->key != y->key) return (x->key < y->key ? -1 : 1);
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+// First key at or after p not taken yet; taken ones point past themselves
+static uint32_t ci_DiffNext(uint32_t *next, uint32_t p) {
+    uint32_t r = p, t;
+    while (next[r] != r) r = next[r];
+    while (next[p] != r) { t = next[p]; next[p] = r; p = t; }
+    return r;
+}
+
+// Aligns blocks of a not aligned yet to those of b, in one pass: keys of
+// b sorted, each block of a takes first free block of b with its key, so
+// blocks of same key keep their order.
+static void ci_DiffPass(CI_diff_file *a, CI_diff_file *b, uint32_t pass) {
+    CI_diff_key *key, k;
+    uint32_t *next, i, j, n = 0, lo, hi, p;
+    key = (CI_diff_key *) malloc((b->blocks + 1) * sizeof(CI_diff_key));
+    next = (uint32_t *) malloc((b->blocks + 1) * sizeof(uint32_t));
+    for (j=0; j < b->blocks; j++) {
+        if (b->block[j].match != CI_DIFF_NONE) continue;
+        key[n].key = ci_DiffKey(&b->block[j], pass);
+        key[n].idx = j;
+        n++;
+    }
+    qsort(key, n, sizeof(CI_diff_key), ci_DiffKeyCmp);
+    for (p=0; p <= n; p++) next[p] = p;
+    for (i=0; n && i < a->blocks; i++) {
+        if (a->block[i].match != CI_DIFF_NONE) continue;
+        k.key = ci_DiffKey(&a->block[i], pass);
+        // Lower bound of key
+        for (lo=0, hi=n; lo < hi; ) {
+            p = lo + (hi - lo) / 2;
+            if (key[p].key < k.key) lo = p + 1;
+            else hi = p;
+        }
+        for (p = ci_DiffNext(next, lo); p < n && key[p].key == k.key; p = ci_DiffNext(next, p + 1)) {
+            j = key[p].idx;
+            if (!ci_DiffSame(&a->block[i], &b->block[j], pass)) continue;
+            a->block[i].match = j;
+            b->block[j].match = i;
+            next[p] = p + 1;
+            break;
+        }
+    }
+    free(next);
+    free(key);
+}
+
+// Aligns blocks of two files: same object name and size first, then
+// same name (resized), then same size (renamed). What's left was removed
+// from a or added to b.
+void ci_DiffAlign(CI_diff_file *a, CI_diff_file *b) {
+    ci_DiffPass(a, b, CI_DIFF_BY_ALL);
+    ci_DiffPass(a, b, CI_DIFF_BY_NAME);
+    ci_DiffPass(a, b, CI_DIFF_BY_SIZE);
+}
+
+// Columns of block's tile grid, 0 if its tiles don't make one up.
+uint32_t ci_DiffGrid(const CI_diff_block *x) {
+    uint32_t cols, rows;
+    if (!x->tile_w || !x->tile_h) return 0;
+    cols = (x->width + x->tile_w - 1) / x->tile_w;
+    rows = (x->height + x->tile_h - 1) / x->tile_h;
+    return ((uint64_t) cols * rows == x->tiles ? cols : 0);
+}
+
+// Chunk ids of two aligned blocks that differ, n-th chunk of an id
+// compared to n-th one of the other block. Out takes x->chunks + y->chunks
+// entries. Returns number of entries filled.
+uint32_t ci_DiffChunksCompare(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y, CI_diff_chunks *out) {
+    const CI_diff_chunk *cx = a->chunk + x->chunk, *cy = b->chunk + y->chunk;
+    uint32_t i, j, k, n = 0, ids = 0;
+    // Ids of both, in order of appearance
+    for (k=0; k < x->chunks + y->chunks; k++) {
+        uint32_t id = (k < x->chunks ? cx[k].id : cy[k - x->chunks].id);
+        for (i=0; i < ids; i++) if (out[i].id == id) break;
+        if (i < ids) continue;
+        memset(&out[ids], 0, sizeof(CI_diff_chunks));
+        out[ids++].id = id;
+    }
+    for (k=0; k < ids; k++) {
+        CI_diff_chunks d = out[k];
+        for (i=0, j=0; ; i++, j++) {
+            while (i < x->chunks && cx[i].id != d.id) i++;
+            while (j < y->chunks && cy[j].id != d.id) j++;
+            if (i == x->chunks && j == y->chunks) break;
+            if (j == y->chunks) d.removed++;
+            else if (i == x->chunks) d.added++;
+            else if (cx[i].len != cy[j].len || cx[i].hash != cy[j].hash) d.changed++;
+            if (i == x->chunks) i--;
+            if (j == y->chunks) j--;
+        }
+        if (d.changed || d.added || d.removed) out[n++] = d;
+    }
+    return n;
+}
+
+// Compares tiles of two aligned blocks of same size and tiling, each with
+// the one at same place. Changed ones are merged into rectangles: runs of
+// a row, extended down while next row has same run. Tiles not hashed in
+// either file are counted as unknown. Returns number of regions (array
+// to be freed), CI_DIFF_NONE if blocks aren't tiled alike.
+uint32_t ci_DiffTilesCompare(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y, CI_diff_region **region,
+    uint32_t *changed, uint32_t *unknown) {
+    const CI_diff_tile *tx = a->tile + x->tile, *ty = b->tile + y->tile;
+    uint32_t cols, rows, r, c, c0, i, p, regions = 0, size = 0;
+    uint32_t *open, *prev, nopen = 0, nprev;
+    CI_diff_region *reg = NULL;
+
+    *region = NULL;
+    *changed = 0;
+    *unknown = 0;
+    if (x->tiles != y->tiles || x->width != y->width || x->height != y->height ||
+        x->tile_w != y->tile_w || x->tile_h != y->tile_h) return CI_DIFF_NONE;
+    if (!x->tiles) return 0;
+    if (!(cols = ci_DiffGrid(x))) cols = x->tiles;
+    rows = x->tiles / cols;
+    // Regions still growing: ones that got a run in previous row, by x0
+    open = (uint32_t *) malloc(cols * sizeof(uint32_t));
+    prev = (uint32_t *) malloc(cols * sizeof(uint32_t));
+    for (r=0; r < rows; r++) {
+        memcpy(prev, open, nopen * sizeof(uint32_t));
+        nprev = nopen;
+        nopen = 0;
+        p = 0;
+        for (c=0; c < cols; ) {
+            // Run of changed tiles c0..c-1
+            for (c0=c; c < cols; c++) {
+                i = r*cols + c;
+                if (!tx[i].hashed || !ty[i].hashed) { (*unknown)++; break; }
+                if (tx[i].len == ty[i].len && tx[i].hash == ty[i].hash) break;
+                (*changed)++;
+            }
+            if (c > c0) {
+                while (p < nprev && reg[prev[p]].x0 < c0) p++;
+                if (p < nprev && reg[prev[p]].x0 == c0 && reg[prev[p]].x1 == c) {
+                    reg[prev[p]].y1 = r + 1;
+                    open[nopen++] = prev[p];
+                } else {
+                    reg = (CI_diff_region *) ci_DiffGrow(reg, regions, &size, sizeof(CI_diff_region));
+                    reg[regions].x0 = c0;
+                    reg[regions].x1 = c;
+                    reg[regions].y0 = r;
+                    reg[regions].y1 = r + 1;
+                    open[nopen++] = regions++;
+                }
+            }
+            c++;
+        }
+    }
+    free(prev);
+    free(open);
+    *region = reg;
+    return regions;
+}
+
+static int ci_DiffHashCmp(const void *a, const void *b) {
+    const uint64_t *x = a, *y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+// Tiles of y whose data is among tiles of x, for blocks that aren't tiled
+// alike (resized ones): tells how much of it may be same as before.
+uint32_t ci_DiffTilesReused(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y) {
+    const CI_diff_tile *tx = a->tile + x->tile, *ty = b->tile + y->tile;
+    uint64_t *hash = (uint64_t *) malloc((x->tiles + 1) * sizeof(uint64_t));
+    uint32_t i, n = 0, reused = 0;
+    for (i=0; i < x->tiles; i++) if (tx[i].hashed) hash[n++] = tx[i].hash;
+    qsort(hash, n, sizeof(uint64_t), ci_DiffHashCmp);
+    for (i=0; i < y->tiles; i++)
+        if (ty[i].hashed && bsearch(&ty[i].hash, hash, n, sizeof(uint64_t), ci_DiffHashCmp)) reused++;
+    free(hash);
+    return reused;
+}
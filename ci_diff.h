@@ -0,0 +1,123 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo structural diff of two files (block, chunk and tile hashes).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_DIFF_H_
+#define _CI_DIFF_H_
+
+#include <inttypes.h>
+
+#define CI_DIFF_NONE            0xFFFFFFFF      // block not aligned to any
+#define CI_DIFF_FIELDS          16              // header fields kept per file
+
+// Header field of a file; hashed ones (comments, palette, ICC) can only
+// be told equal or not
+typedef struct _CI_diff_field {
+    const char  *name;
+    uint64_t    value;
+    uint32_t    hash;
+} CI_diff_field;
+
+// Chunk of a block, payload hashed
+typedef struct _CI_diff_chunk {
+    uint32_t    id;
+    uint32_t    len;
+    uint64_t    hash;
+} CI_diff_chunk;
+
+// Tile of a block (data pair list entry), data hashed if it was in memory
+typedef struct _CI_diff_tile {
+    uint64_t    hash;
+    uint32_t    len;
+    uint32_t    hashed;
+} CI_diff_tile;
+
+typedef struct _CI_diff_block {
+    char        *name;          // object name, NULL if block has no 'oinf'
+    uint32_t    id;             // block number in file
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    tile_w;
+    uint32_t    tile_h;
+    uint32_t    bpp;
+    uint64_t    head;           // hash of block header
+    uint32_t    chunk;          // first chunk in file's chunk[]
+    uint32_t    chunks;
+    uint32_t    tile;           // first tile in file's tile[]
+    uint32_t    tiles;
+    uint32_t    match;          // aligned block of other file, CI_DIFF_NONE
+} CI_diff_block;
+
+// What one file is made of. Chunks and tiles are added to last block.
+typedef struct _CI_diff_file {
+    CI_diff_field   field[CI_DIFF_FIELDS];
+    uint32_t        fields;
+    CI_diff_block   *block;
+    uint32_t        blocks;
+    uint32_t        blocks_size;
+    CI_diff_chunk   *chunk;
+    uint32_t        chunks;
+    uint32_t        chunks_size;
+    CI_diff_tile    *tile;
+    uint32_t        tiles;
+    uint32_t        tiles_size;
+    uint32_t        unhashed;       // tiles not in memory
+    uint64_t        hashed;         // bytes of tile data hashed
+    const void      *last;          // data of last tile, tiles may share it
+} CI_diff_file;
+
+// Chunks of one id that differ between two aligned blocks
+typedef struct _CI_diff_chunks {
+    uint32_t    id;
+    uint32_t    changed;
+    uint32_t    added;
+    uint32_t    removed;
+} CI_diff_chunks;
+
+// Rectangle of changed tiles, x0..x1-1 by y0..y1-1 in tile grid; blocks
+// whose tiles don't make up the grid have one row of tiles in list order
+typedef struct _CI_diff_region {
+    uint32_t    x0;
+    uint32_t    y0;
+    uint32_t    x1;
+    uint32_t    y1;
+} CI_diff_region;
+
+void ci_DiffInit(CI_diff_file *f);
+void ci_DiffFree(CI_diff_file *f);
+void ci_DiffField(CI_diff_file *f, const char *name, uint64_t value, uint32_t hash);
+const CI_diff_field *ci_DiffFieldFind(const CI_diff_file *f, const char *name);
+CI_diff_block *ci_DiffBlock(CI_diff_file *f, uint32_t id, const char *name);
+void ci_DiffChunk(CI_diff_file *f, uint32_t id, const void *data, uint32_t len);
+void ci_DiffTile(CI_diff_file *f, const void *data, uint32_t len);
+void ci_DiffAlign(CI_diff_file *a, CI_diff_file *b);
+uint32_t ci_DiffGrid(const CI_diff_block *x);
+uint32_t ci_DiffChunksCompare(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y, CI_diff_chunks *out);
+uint32_t ci_DiffTilesCompare(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y, CI_diff_region **region,
+    uint32_t *changed, uint32_t *unknown);
+uint32_t ci_DiffTilesReused(const CI_diff_file *a, const CI_diff_block *x,
+    const CI_diff_file *b, const CI_diff_block *y);
+
+#endif
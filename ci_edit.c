@@ -0,0 +1,248 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo in-place edit of file fields with undo journal.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef WIN32
+#define _XOPEN_SOURCE 500       // pread(), pwrite() with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef WIN32
+#include <io.h>
+#define fsync(fd)               _commit(fd)
+#else
+#include <unistd.h>
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "ci_hash.h"
+#include "ci_edit.h"
+
+// Journal: magic, number of regions, their (offset, length), old bytes
+// of all of them, hash of all that. A journal that doesn't hash right was
+// cut short by a crash before the file was touched.
+typedef struct _CI_edit_head {
+    char        magic[8];
+    uint32_t    num;
+    uint32_t    reserved;
+} CI_edit_head;
+
+typedef struct _CI_edit_region {
+    uint64_t    offs;
+    uint32_t    len;
+    uint32_t    reserved;
+} CI_edit_region;
+
+// Positioned read of whole buffer, returns 0 if OK.
+static int ci_EditReadAt(int fd, uint64_t offs, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *) buf;
+    ssize_t n;
+#ifdef WIN32
+    if (lseek(fd, offs, SEEK_SET) != (off_t) offs) return -1;
+#endif
+    while (len) {
+#ifdef WIN32
+        n = read(fd, p, len);
+#else
+        n = pread(fd, p, len, offs);
+#endif
+        if (n <= 0) return -1;
+        p += n; len -= n; offs += n;
+    }
+    return 0;
+}
+
+// Positioned write of whole buffer, returns 0 if OK.
+static int ci_EditWriteAt(int fd, uint64_t offs, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+    ssize_t n;
+#ifdef WIN32
+    if (lseek(fd, offs, SEEK_SET) != (off_t) offs) return -1;
+#endif
+    while (len) {
+#ifdef WIN32
+        n = write(fd, p, len);
+#else
+        n = pwrite(fd, p, len, offs);
+#endif
+        if (n <= 0) return -1;
+        p += n; len -= n; offs += n;
+    }
+    return 0;
+}
+
+static char *ci_EditJournalName(const char *path) {
+    char *name = (char *) malloc(strlen(path) + sizeof(CI_EDIT_UNDO));
+    sprintf(name, "%s%s", path, CI_EDIT_UNDO);
+    return name;
+}
+
+// Syncs directory of path, so journal created or removed there stays so
+// after a crash.
+static void ci_EditSyncDir(const char *path) {
+#ifndef WIN32
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    int fd;
+    if (!slash) dir = strdup(".");
+    else {
+        dir = (char *) malloc(slash - path + 2);
+        memcpy(dir, path, slash - path + 1);
+        dir[slash - path + 1] = 0;
+    }
+    if ((fd = open(dir, O_RDONLY)) >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+#endif
+}
+
+static void ci_EditJournalRemove(const char *jname) {
+    remove(jname);
+    ci_EditSyncDir(jname);
+}
+
+// Puts old bytes of regions back (old bytes of all regions one after
+// another). Returns 0 if OK.
+static int ci_EditRestore(int fd, const CI_edit_region *r, uint32_t num, const uint8_t *old) {
+    uint32_t i;
+    int err = 0;
+    for (i=0; i < num; old += r[i].len, i++) err |= ci_EditWriteAt(fd, r[i].offs, old, r[i].len);
+    return (err || fsync(fd) ? -1 : 0);
+}
+
+// Rolls back an edit of path interrupted by a crash, if its journal is
+// there. Returns 1 if rolled back, 0 if there was nothing to do.
+int ci_EditRecover(const char *path) {
+    char *jname = ci_EditJournalName(path);
+    struct stat sb;
+    uint8_t *j = NULL;
+    CI_edit_head *h;
+    CI_edit_region *r;
+    uint64_t hash, len;
+    uint32_t i;
+    int jfd, fd, ret = 0;
+
+    if ((jfd = open(jname, O_RDONLY|O_BINARY)) < 0) { free(jname); return 0; }
+    if (fstat(jfd, &sb) || (uint64_t) sb.st_size < sizeof(CI_edit_head) + 8) goto torn;
+    j = (uint8_t *) malloc(sb.st_size);
+    if (ci_EditReadAt(jfd, 0, j, sb.st_size)) { ret = CI_EDIT_ERR_JOURNAL; goto end; }
+    h = (CI_edit_head *) j;
+    r = (CI_edit_region *) (h+1);
+    memcpy(&hash, j + sb.st_size - 8, 8);
+    if (memcmp(h->magic, CI_EDIT_MAGIC, 8) || h->num > CI_EDIT_PATCHES || hash != ci_Hash64(j, sb.st_size - 8, 0)) goto torn;
+    for (i=0, len=0; i < h->num; i++) len += r[i].len;
+    if (sizeof(CI_edit_head) + h->num*sizeof(CI_edit_region) + len + 8 != (uint64_t) sb.st_size) goto torn;
+    if ((fd = open(path, O_RDWR|O_BINARY)) < 0) { ret = CI_EDIT_ERR_OPEN; goto end; }
+    ret = (ci_EditRestore(fd, r, h->num, (uint8_t *) (r + h->num)) ? CI_EDIT_ERR_WRITE : 1);
+    close(fd);
+    if (ret < 0) goto end;
+torn:
+    // File is as it was before the edit
+    close(jfd);
+    jfd = -1;
+    ci_EditJournalRemove(jname);
+end:
+    if (jfd >= 0) close(jfd);
+    free(j);
+    free(jname);
+    return ret;
+}
+
+// Replaces regions of path, if they hold what's expected. Old bytes go to
+// the journal, synced, before the file is written; the file is synced and
+// read back before the journal goes. Whatever fails, the file is left as
+// it was (or is rolled back by ci_EditRecover() after a crash). Returns
+// number of bytes changed, 0 if none had to be.
+int ci_EditApply(const char *path, const CI_edit_patch *patch, uint32_t num) {
+    char *jname = ci_EditJournalName(path);
+    CI_edit_head *h;
+    CI_edit_region *r;
+    uint8_t *j, *cur, *back;
+    uint64_t hash;
+    size_t len = 0, jlen, k, m;
+    uint32_t i;
+    int fd, jfd, changed = 0, ret = 0;
+
+    if (num > CI_EDIT_PATCHES) num = CI_EDIT_PATCHES;
+    for (i=0; i < num; i++) len += patch[i].len;
+    jlen = sizeof(CI_edit_head) + num*sizeof(CI_edit_region) + len + 8;
+    j = (uint8_t *) calloc(jlen, 1);
+    back = (uint8_t *) malloc(len + 1);
+    h = (CI_edit_head *) j;
+    r = (CI_edit_region *) (h+1);
+    cur = (uint8_t *) (r + num);
+    memcpy(h->magic, CI_EDIT_MAGIC, 8);
+    h->num = num;
+    if ((fd = open(path, O_RDWR|O_BINARY)) < 0) { ret = CI_EDIT_ERR_OPEN; goto end; }
+
+    // Current bytes have to be the parsed ones
+    for (i=0, k=0; i < num; k += patch[i].len, i++) {
+        r[i].offs = patch[i].offs;
+        r[i].len = patch[i].len;
+        if (ci_EditReadAt(fd, patch[i].offs, cur + k, patch[i].len) || memcmp(cur + k, patch[i].old, patch[i].len)) {
+            ret = CI_EDIT_ERR_CHANGED;
+            goto end;
+        }
+        for (m=0; m < patch[i].len; m++) changed += (cur[k+m] != ((const uint8_t *) patch[i].data)[m]);
+    }
+    if (!changed) goto end;
+
+    hash = ci_Hash64(j, jlen - 8, 0);
+    memcpy(j + jlen - 8, &hash, 8);
+    jfd = open(jname, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0644);
+    if (jfd < 0 || ci_EditWriteAt(jfd, 0, j, jlen) || fsync(jfd)) {
+        if (jfd >= 0) close(jfd);
+        ci_EditJournalRemove(jname);
+        ret = CI_EDIT_ERR_JOURNAL;
+        goto end;
+    }
+    close(jfd);
+    ci_EditSyncDir(jname);
+
+    for (i=0; i < num; i++) ret |= ci_EditWriteAt(fd, patch[i].offs, patch[i].data, patch[i].len);
+    if (ret || fsync(fd)) ret = CI_EDIT_ERR_WRITE;
+    else {
+        for (i=0; i < num && !ret; i++) {
+            if (ci_EditReadAt(fd, patch[i].offs, back, patch[i].len) || memcmp(back, patch[i].data, patch[i].len))
+                ret = CI_EDIT_ERR_VERIFY;
+        }
+    }
+    // Journal stays if even old bytes can't be put back
+    if (ret && ci_EditRestore(fd, r, num, cur)) goto end;
+    ci_EditJournalRemove(jname);
+end:
+    if (fd >= 0) close(fd);
+    free(j);
+    free(back);
+    free(jname);
+    return (ret ? ret : changed);
+}
@@ -0,0 +1,52 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo in-place edit of file fields with undo journal.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_EDIT_H_
+#define _CI_EDIT_H_
+
+#include <inttypes.h>
+
+#define CI_EDIT_UNDO            ".undo"         // journal is file name + this
+#define CI_EDIT_MAGIC           "CIUNDO01"
+#define CI_EDIT_PATCHES         8               // max regions per edit
+
+// ci_EditApply() and ci_EditRecover() errors
+#define CI_EDIT_ERR_OPEN        -1              // file can't be opened for writing
+#define CI_EDIT_ERR_CHANGED     -2              // file isn't what was parsed
+#define CI_EDIT_ERR_JOURNAL     -3              // journal can't be written or read
+#define CI_EDIT_ERR_WRITE       -4              // write failed, old bytes put back
+#define CI_EDIT_ERR_VERIFY      -5              // file doesn't read back as written
+
+// Region of file to be replaced
+typedef struct _CI_edit_patch {
+    uint64_t    offs;
+    uint32_t    len;
+    const void  *old;                           // bytes expected there now
+    const void  *data;                          // bytes to put there
+} CI_edit_patch;
+
+int ci_EditRecover(const char *path);
+int ci_EditApply(const char *path, const CI_edit_patch *patch, uint32_t num);
+
+#endif
@@ -0,0 +1,157 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo fast non-cryptographic content hash (XXH64 algorithm).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#include <string.h>
+
+#include "ci_hash.h"
+
+#define CI_HASH_P1  0x9E3779B185EBCA87ULL
+#define CI_HASH_P2  0xC2B2AE3D27D4EB4FULL
+#define CI_HASH_P3  0x165667B19E3779F9ULL
+#define CI_HASH_P4  0x85EBCA77C2B2AE63ULL
+#define CI_HASH_P5  0x27D4EB2F165667C5ULL
+
+#define CI_ROTL64(x,r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+// Unaligned little endian loads; compilers turn these into plain loads
+static inline uint64_t ci_HashRead64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint32_t ci_HashRead32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t ci_HashRound(uint64_t acc, uint64_t input) {
+    acc += input * CI_HASH_P2;
+    acc = CI_ROTL64(acc, 31);
+    return acc * CI_HASH_P1;
+}
+
+static inline uint64_t ci_HashMerge(uint64_t acc, uint64_t val) {
+    acc ^= ci_HashRound(0, val);
+    return acc * CI_HASH_P1 + CI_HASH_P4;
+}
+
+// Main loop: 32-byte stripes go through 4 independent lanes, which keeps
+// all multipliers of the CPU busy at once.
+static const uint8_t *ci_HashStripes(uint64_t *v, const uint8_t *p, const uint8_t *end) {
+    uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    while (p + 32 <= end) {
+        v1 = ci_HashRound(v1, ci_HashRead64(p));
+        v2 = ci_HashRound(v2, ci_HashRead64(p+8));
+        v3 = ci_HashRound(v3, ci_HashRead64(p+16));
+        v4 = ci_HashRound(v4, ci_HashRead64(p+24));
+        p += 32;
+    }
+    v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+    return p;
+}
+
+static uint64_t ci_HashTail(uint64_t h, const uint8_t *p, size_t len) {
+    while (len >= 8) {
+        h ^= ci_HashRound(0, ci_HashRead64(p));
+        h = CI_ROTL64(h, 27) * CI_HASH_P1 + CI_HASH_P4;
+        p += 8; len -= 8;
+    }
+    if (len >= 4) {
+        h ^= (uint64_t) ci_HashRead32(p) * CI_HASH_P1;
+        h = CI_ROTL64(h, 23) * CI_HASH_P2 + CI_HASH_P3;
+        p += 4; len -= 4;
+    }
+    while (len) {
+        h ^= (*p) * CI_HASH_P5;
+        h = CI_ROTL64(h, 11) * CI_HASH_P1;
+        p++; len--;
+    }
+    h ^= h >> 33; h *= CI_HASH_P2;
+    h ^= h >> 29; h *= CI_HASH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t ci_HashLanes(const uint64_t *v) {
+    uint64_t h = CI_ROTL64(v[0], 1) + CI_ROTL64(v[1], 7) + CI_ROTL64(v[2], 12) + CI_ROTL64(v[3], 18);
+    h = ci_HashMerge(h, v[0]);
+    h = ci_HashMerge(h, v[1]);
+    h = ci_HashMerge(h, v[2]);
+    return ci_HashMerge(h, v[3]);
+}
+
+void ci_HashInit(CI_hash *h, uint64_t seed) {
+    memset(h, 0, sizeof(CI_hash));
+    h->seed = seed;
+    h->v[0] = seed + CI_HASH_P1 + CI_HASH_P2;
+    h->v[1] = seed + CI_HASH_P2;
+    h->v[2] = seed;
+    h->v[3] = seed - CI_HASH_P1;
+}
+
+// Hashes whole buffer at once.
+uint64_t ci_Hash64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = (const uint8_t *) data, *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        CI_hash s;
+        ci_HashInit(&s, seed);
+        p = ci_HashStripes(s.v, p, end);
+        h = ci_HashLanes(s.v);
+    } else {
+        h = seed + CI_HASH_P5;
+    }
+    return ci_HashTail(h + len, p, end - p);
+}
+
+void ci_HashUpdate(CI_hash *h, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *) data, *end = p + len;
+    h->total += len;
+    // Not enough for a stripe yet
+    if (h->memsize + len < 32) {
+        memcpy(h->mem + h->memsize, p, len);
+        h->memsize += len;
+        return;
+    }
+    // Complete pending stripe first
+    if (h->memsize) {
+        memcpy(h->mem + h->memsize, p, 32 - h->memsize);
+        p += 32 - h->memsize;
+        ci_HashStripes(h->v, h->mem, h->mem + 32);
+        h->memsize = 0;
+    }
+    p = ci_HashStripes(h->v, p, end);
+    if (p < end) {
+        memcpy(h->mem, p, end - p);
+        h->memsize = end - p;
+    }
+}
+
+uint64_t ci_HashFinal(const CI_hash *h) {
+    uint64_t r;
+    if (h->total >= 32) r = ci_HashLanes(h->v);
+    else r = h->seed + CI_HASH_P5;
+    return ci_HashTail(r + h->total, h->mem, h->memsize);
+}
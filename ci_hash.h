@@ -0,0 +1,44 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo fast non-cryptographic content hash (XXH64 algorithm).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_HASH_H_
+#define _CI_HASH_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+// Incremental hashing state, for data that doesn't come in one piece
+typedef struct _CI_hash {
+    uint64_t    total;                  // bytes hashed so far
+    uint64_t    v[4];                   // 4 independent lanes
+    uint8_t     mem[32];                // partial stripe
+    uint32_t    memsize;
+    uint64_t    seed;
+} CI_hash;
+
+uint64_t ci_Hash64(const void *data, size_t len, uint64_t seed);
+void ci_HashInit(CI_hash *h, uint64_t seed);
+void ci_HashUpdate(CI_hash *h, const void *data, size_t len);
+uint64_t ci_HashFinal(const CI_hash *h);
+
+#endif
@@ -0,0 +1,330 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo low level I/O helpers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef WIN32
+#define _GNU_SOURCE             // syscall() with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>              // posix_fadvise()
+#endif
+#ifdef __linux__
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+
+#include "ci_io.h"
+
+// Copies len bytes at offs of src to current position of dst inside the
+// kernel: as a reflink (shared extents, metadata only) where filesystem
+// and alignment allow, else with copy_file_range(). Returns number of
+// bytes copied, caller writes the rest itself (0 = not supported here).
+uint64_t ci_CopyRange(int src, uint64_t offs, int dst, uint64_t len) {
+    uint64_t done = 0;
+#ifdef __linux__
+    struct stat sb;
+#ifdef FICLONERANGE
+    // Reflink needs block aligned source range (or range up to EOF)
+    if (!fstat(src, &sb) && sb.st_blksize && !(offs % sb.st_blksize) &&
+        (!(len % sb.st_blksize) || offs + len == (uint64_t) sb.st_size)) {
+        struct file_clone_range fcr;
+        off_t pos = lseek(dst, 0, SEEK_CUR);
+        fcr.src_fd = src;
+        fcr.src_offset = offs;
+        fcr.src_length = len;
+        fcr.dest_offset = pos;
+        if (pos >= 0 && !ioctl(dst, FICLONERANGE, &fcr)) {
+            lseek(dst, pos + len, SEEK_SET);
+            return len;
+        }
+    }
+#endif
+#ifdef __NR_copy_file_range
+    while (done < len) {
+        loff_t off_in = offs + done;
+        ssize_t n = syscall(__NR_copy_file_range, src, &off_in, dst, NULL, (size_t) (len - done), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;          // ENOSYS, EXDEV, EINVAL... or EOF
+        }
+        done += n;
+    }
+#endif
+#endif
+    return done;
+}
+
+// Skips len bytes of file: seeks where it can, else (pipes) reads them.
+// Returns number of bytes skipped, less only at end of file.
+uint64_t ci_Skip(FILE *file, uint64_t len) {
+    uint8_t buf[4096];
+    uint64_t done = 0;
+    size_t n;
+#ifndef WIN32
+    off_t pos = ftello(file);
+    struct stat sb;
+    if (pos >= 0 && !fstat(fileno(file), &sb) && S_ISREG(sb.st_mode)) {
+        if (pos + len > (uint64_t) sb.st_size) len = sb.st_size - pos;
+        if (!fseeko(file, pos + len, SEEK_SET)) return len;
+    }
+#endif
+    while (done < len) {
+        n = fread(buf, 1, (len - done < sizeof(buf) ? len - done : sizeof(buf)), file);
+        if (!n) break;
+        done += n;
+    }
+    return done;
+}
+
+// Sets up reading of left bytes (UINT64_MAX: all) from current position
+// of file, decompressed by given method. Returns 0 if OK.
+int ci_InputOpen(CI_input *in, FILE *file, uint32_t method, uint64_t left, uint64_t size) {
+#ifndef WIN32
+    struct stat sb;
+#endif
+    memset(in, 0, sizeof(CI_input));
+    in->file = file;
+    in->fd = -1;
+#ifndef WIN32
+    if (file && !fstat(fileno(file), &sb) && S_ISREG(sb.st_mode)) {
+        in->fd = fileno(file);
+        in->base = ftello(file);
+    }
+#endif
+    in->method = method;
+    in->left = left;
+    in->size = size;
+    in->zbuf = (uint8_t *) malloc(CI_INPUT_BUF);
+    switch (method) {
+        // Negative window bits: no zlib header, as in zip; +16: gzip header
+        case CI_INPUT_DEFLATE: return (inflateInit2(&in->z, -MAX_WBITS) != Z_OK);
+        case CI_INPUT_GZIP: return (inflateInit2(&in->z, 16 + MAX_WBITS) != Z_OK);
+#ifdef CI_ZSTD
+        case CI_INPUT_ZSTD:
+            if (!(in->zs = ZSTD_createDStream())) return -1;
+            return ZSTD_isError(ZSTD_initDStream(in->zs));
+#endif
+    }
+    return 0;
+}
+
+// Reads len bytes (less at end of data) as they are in file.
+static size_t ci_InputRaw(CI_input *in, uint8_t *buf, size_t len) {
+    size_t done = 0, n;
+    uint32_t i;
+    ssize_t r;
+    if (len > in->left) len = in->left;
+    if (!in->ext) done = fread(buf, 1, len, in->file);
+    while (in->ext && done < len) {
+        n = len - done;
+        // Input goes forward only, so do extents
+        for (i=in->cur; i < in->exts && in->ext[i].offs + in->ext[i].len <= in->pos; i++);
+        in->cur = i;
+        if (i < in->exts && in->ext[i].offs <= in->pos) {
+            const CI_extent *e = &in->ext[i];
+            if (n > e->offs + e->len - in->pos) n = e->offs + e->len - in->pos;
+            memcpy(buf + done, e->data + (in->pos - e->offs), n);
+        } else {
+            // Not read ahead: up to next extent from file
+            if (i < in->exts && n > in->ext[i].offs - in->pos) n = in->ext[i].offs - in->pos;
+#ifndef WIN32
+            r = pread(in->fd, buf + done, n, in->pos);
+#else
+            r = -1;
+#endif
+            if (r <= 0) break;
+            n = r;
+        }
+        done += n;
+        in->pos += n;
+    }
+    if (in->left != UINT64_MAX) in->left -= done;
+    return done;
+}
+
+// Reads next compressed (or, for raw, first) bytes into zbuf.
+static uint32_t ci_InputFill(CI_input *in, uint32_t max) {
+    size_t n = ci_InputRaw(in, in->zbuf, max);
+    in->zpos = 0;
+    in->zlen = n;
+    in->z.next_in = in->zbuf;
+    in->z.avail_in = n;
+    return n;
+}
+
+// Looks at first bytes of raw input: gzip or zstd data gets decompressed
+// from there on. Returns method found, -1 if it can't be decompressed.
+int ci_InputDetect(CI_input *in) {
+    static const uint8_t gz[2] = { 0x1F, 0x8B }, zst[4] = { 0x28, 0xB5, 0x2F, 0xFD };
+    uint32_t method = CI_INPUT_RAW;
+    if (in->method != CI_INPUT_RAW || in->zlen) return in->method;
+    ci_InputFill(in, 4);
+    if (in->zlen >= 2 && !memcmp(in->zbuf, gz, 2)) method = CI_INPUT_GZIP;
+    if (in->zlen == 4 && !memcmp(in->zbuf, zst, 4)) method = CI_INPUT_ZSTD;
+    if (method == CI_INPUT_RAW) return method;
+    in->method = method;
+    in->size = UINT64_MAX;
+    if (method == CI_INPUT_GZIP) return (inflateInit2(&in->z, 16 + MAX_WBITS) == Z_OK ? (int) method : -1);
+#ifdef CI_ZSTD
+    if ((in->zs = ZSTD_createDStream()) && !ZSTD_isError(ZSTD_initDStream(in->zs))) return method;
+#endif
+    return -1;
+}
+
+// Reads up to len bytes of input. Returns number of bytes read, less only
+// at end of data (or if compressed data is corrupt).
+uint64_t ci_InputRead(CI_input *in, uint8_t *buf, uint64_t len) {
+    uint64_t done = 0;
+    size_t n;
+    int r;
+    if (in->method == CI_INPUT_RAW) {
+        // Bytes looked at by ci_InputDetect() first
+        if (in->zpos < in->zlen) {
+            done = (len < in->zlen - in->zpos ? len : in->zlen - in->zpos);
+            memcpy(buf, in->zbuf + in->zpos, done);
+            in->zpos += done;
+        }
+        return done + ci_InputRaw(in, buf + done, len - done);
+    }
+#ifdef CI_ZSTD
+    if (in->method == CI_INPUT_ZSTD) {
+        while (done < len && !in->end) {
+            ZSTD_inBuffer zi;
+            ZSTD_outBuffer zo;
+            size_t res;
+            if (in->zpos == in->zlen && !ci_InputFill(in, CI_INPUT_BUF)) break;
+            zi.src = in->zbuf;
+            zi.size = in->zlen;
+            zi.pos = in->zpos;
+            zo.dst = buf + done;
+            zo.size = len - done;
+            zo.pos = 0;
+            res = ZSTD_decompressStream(in->zs, &zo, &zi);
+            in->zpos = zi.pos;
+            done += zo.pos;
+            if (ZSTD_isError(res)) in->end = 1;
+        }
+        return done;
+    }
+#endif
+    while (done < len && !in->end) {
+        if (!in->z.avail_in && !ci_InputFill(in, CI_INPUT_BUF)) break;
+        n = (len - done < UINT_MAX ? len - done : UINT_MAX);
+        in->z.next_out = buf + done;
+        in->z.avail_out = n;
+        r = inflate(&in->z, Z_NO_FLUSH);
+        done += n - in->z.avail_out;
+        if (r == Z_STREAM_END && in->method == CI_INPUT_GZIP) {
+            // Another gzip member may follow
+            if (!in->z.avail_in && !ci_InputFill(in, CI_INPUT_BUF)) in->end = 1;
+            else if (inflateReset(&in->z) != Z_OK) in->end = 1;
+        } else if (r != Z_OK && r != Z_BUF_ERROR) in->end = 1;
+    }
+    return done;
+}
+
+// Skips len bytes of input: raw data in files is seeked over, compressed
+// one has to be decompressed. Returns number of bytes skipped, less only
+// at end of data.
+uint64_t ci_InputSkip(CI_input *in, uint64_t len) {
+    uint8_t buf[16384];
+    uint64_t done = 0, n;
+    if (in->method == CI_INPUT_RAW) {
+        if (in->zpos < in->zlen) {
+            done = (len < in->zlen - in->zpos ? len : in->zlen - in->zpos);
+            in->zpos += done;
+        }
+        n = (len - done < in->left ? len - done : in->left);
+        if (!in->ext) n = ci_Skip(in->file, n);
+        else if (n > in->size - in->pos) n = in->size - in->pos;
+        in->pos += n;
+        if (in->left != UINT64_MAX) in->left -= n;
+        return done + n;
+    }
+    while (done < len && (n = ci_InputRead(in, buf, (len - done < sizeof(buf) ? len - done : sizeof(buf)))))
+        done += n;
+    return done;
+}
+
+// Releases decompression state; file stays open.
+void ci_InputClose(CI_input *in) {
+    if (!in->zbuf) return;
+    if (in->method == CI_INPUT_DEFLATE || in->method == CI_INPUT_GZIP) inflateEnd(&in->z);
+#ifdef CI_ZSTD
+    if (in->zs) ZSTD_freeDStream(in->zs);
+    in->zs = NULL;
+#endif
+    free(in->zbuf);
+    in->zbuf = NULL;
+}
+
+// Plain file under input, -1 if there's none (pipes, compressed data);
+// base is file offset of input's first byte.
+int ci_InputFd(const CI_input *in, uint64_t *base) {
+    if (in->method != CI_INPUT_RAW) return -1;
+    *base = in->base;
+    return in->fd;
+}
+
+void ci_PlanBegin(CI_plan *p, int fd, uint64_t base, uint32_t drop) {
+    p->fd = fd;
+    p->base = base;
+    p->behind = 0;
+    p->drop = drop;
+}
+
+// Range will be read soon: kernel may start reading it now.
+void ci_PlanAhead(CI_plan *p, uint64_t offs, uint64_t len) {
+#ifndef WIN32
+    if (p->fd >= 0 && len) posix_fadvise(p->fd, p->base + offs, len, POSIX_FADV_WILLNEED);
+#endif
+}
+
+// Everything before offs is read (or won't be). Only whole pages are
+// dropped, so the one behind was in goes with next range.
+void ci_PlanBehind(CI_plan *p, uint64_t offs) {
+#ifndef WIN32
+    uint64_t start = p->base + p->behind;
+    if (p->fd < 0 || !p->drop || offs <= p->behind) return;
+    start -= start % sysconf(_SC_PAGESIZE);
+    posix_fadvise(p->fd, start, p->base + offs - start, POSIX_FADV_DONTNEED);
+#endif
+    p->behind = offs;
+}
+
+// Done with the file: drops all of it, up to len. Large folios that
+// straddled ranges dropped before only go now.
+void ci_PlanEnd(CI_plan *p, uint64_t len) {
+    p->behind = 0;
+    ci_PlanBehind(p, len);
+    p->fd = -1;
+}
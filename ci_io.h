@@ -0,0 +1,95 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo low level I/O helpers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_IO_H_
+#define _CI_IO_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <zlib.h>
+#ifdef CI_ZSTD
+#include <zstd.h>
+#endif
+
+#define CI_INPUT_BUF            (64 << 10)      // compressed data read at once
+
+// Input methods
+#define CI_INPUT_RAW            0               // data as it is in file
+#define CI_INPUT_DEFLATE        1               // raw deflate (zip members)
+#define CI_INPUT_GZIP           2               // gzip, members one after another
+#define CI_INPUT_ZSTD           3               // zstd frames, built with CI_ZSTD only
+
+// Part of a file read ahead, see ci_uring.c
+typedef struct _CI_extent {
+    uint64_t    offs;
+    uint32_t    len;
+    uint8_t     *data;
+} CI_extent;
+
+// Forward only input: rest of a file, or member of an archive. Prefetched
+// input has no file: extents read ahead (sorted by offs), rest by pread().
+typedef struct _CI_input {
+    FILE        *file;
+    int         fd;             // plain file under input (or prefetched one), -1: none
+    uint64_t    base;           // ... file offset of data start
+    uint64_t    pos;            // offset of prefetched input
+    const CI_extent *ext;
+    uint32_t    exts;
+    uint32_t    cur;            // first extent not passed yet
+    uint32_t    method;
+    uint32_t    end;            // compressed data ended (or was corrupt)
+    uint64_t    left;           // bytes left to read from file, UINT64_MAX: up to its end
+    uint64_t    size;           // size of data read, UINT64_MAX if not known
+    uint8_t     *zbuf;          // compressed data read ahead (raw: first bytes)
+    uint32_t    zpos;           // ... used of it
+    uint32_t    zlen;
+    z_stream    z;
+#ifdef CI_ZSTD
+    ZSTD_DStream *zs;
+#endif
+} CI_input;
+
+// Readahead planner of a plain file read in known order: kernel is told
+// about ranges about to be read (WILLNEED); with drop, pages read are
+// dropped from page cache behind (DONTNEED). Offsets are of data start.
+typedef struct _CI_plan {
+    int         fd;             // -1: nothing to plan
+    uint64_t    base;           // file offset of data start
+    uint64_t    behind;         // dropped up to here
+    uint32_t    drop;
+} CI_plan;
+
+uint64_t ci_CopyRange(int src, uint64_t offs, int dst, uint64_t len);
+uint64_t ci_Skip(FILE *file, uint64_t len);
+int ci_InputOpen(CI_input *in, FILE *file, uint32_t method, uint64_t left, uint64_t size);
+int ci_InputDetect(CI_input *in);
+uint64_t ci_InputRead(CI_input *in, uint8_t *buf, uint64_t len);
+uint64_t ci_InputSkip(CI_input *in, uint64_t len);
+void ci_InputClose(CI_input *in);
+int ci_InputFd(const CI_input *in, uint64_t *base);
+void ci_PlanBegin(CI_plan *p, int fd, uint64_t base, uint32_t drop);
+void ci_PlanAhead(CI_plan *p, uint64_t offs, uint64_t len);
+void ci_PlanBehind(CI_plan *p, uint64_t offs);
+void ci_PlanEnd(CI_plan *p, uint64_t len);
+
+#endif
@@ -0,0 +1,301 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo perceptual hashes of blocks, Hamming distance search.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ci_phash.h"
+
+// Returns 0 if OK, -1 if bpp isn't known.
+int ci_PhashInit(CI_phash *p, uint32_t bpp, uint32_t flags, uint32_t width, uint32_t height, const uint8_t *lut) {
+    uint32_t i;
+    memset(p, 0, sizeof(CI_phash));
+    if (bpp != 1 && bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32 && bpp != 48 && bpp != 64) return -1;
+    p->bpp = bpp;
+    p->flags = flags;
+    p->width = width;
+    p->height = height;
+    p->lut = lut;
+    // First column of cell c is the first x with x*W/width == c
+    for (i=0; i <= CI_PHASH_W; i++) p->xb[i] = ((uint64_t) i * width + CI_PHASH_W - 1) / CI_PHASH_W;
+    for (i=0; i <= CI_PHASH_H; i++) p->yb[i] = ((uint64_t) i * height + CI_PHASH_H - 1) / CI_PHASH_H;
+    return 0;
+}
+
+// Sum of luma of pixels from..to-1 of a row. RGB ones (any byte order)
+// weigh green twice, 16-bit channels count by high byte.
+static uint64_t ci_PhashRun(const CI_phash *p, const uint8_t *row, uint32_t from, uint32_t to) {
+    uint64_t s = 0;
+    uint32_t i;
+    const uint8_t *q;
+    switch (p->bpp) {
+        case 1:
+            for (i=from; i < to; i++) s += (row[i >> 3] >> (7 - (i & 7))) & 1;
+            return s * 255;
+        case 8:
+            if (p->lut) for (i=from; i < to; i++) s += p->lut[row[i]];
+            else for (i=from; i < to; i++) s += row[i];
+            return s;
+        case 16:
+            for (i=from, q=row+2*from; i < to; i++, q+=2) s += q[1];
+            return s;
+        case 24:
+            if (p->flags & CI_PHASH_LAB) for (i=from, q=row+3*from; i < to; i++, q+=3) s += q[0];
+            else for (i=from, q=row+3*from; i < to; i++, q+=3) s += q[0] + 2*q[1] + q[2];
+            return s;
+        case 32:
+            if (p->flags & CI_PHASH_CMYK)
+                for (i=from, q=row+4*from; i < to; i++, q+=4) s += (765 - q[0] - q[1] - q[2]) * (255 - q[3]);
+            else for (i=from, q=row+4*from; i < to; i++, q+=4) s += q[0] + 2*q[1] + q[2];
+            return s;
+        case 48:
+            for (i=from, q=row+6*from; i < to; i++, q+=6) s += q[1] + 2*q[3] + q[5];
+            return s;
+        case 64:
+            for (i=from, q=row+8*from; i < to; i++, q+=8) s += q[1] + 2*q[3] + q[5];
+            return s;
+    }
+    return 0;
+}
+
+// Adds tile with top left pixel at x, y of block: data NULL if it's not
+// in memory, len not of raw tile (maybe with marker dword first) if it's
+// compressed; such ones are only counted, the block gets no hash then.
+// Each row is summed in runs, one per cell it crosses.
+void ci_PhashTile(CI_phash *p, const uint8_t *data, uint32_t len,
+    uint32_t tile_w, uint32_t tile_h, uint32_t x, uint32_t y) {
+    uint64_t raw = (((uint64_t) tile_w * p->bpp + 7) / 8) * tile_h, stride = raw / (tile_h ? tile_h : 1);
+    uint32_t w, h, r = 0, c, c0 = 0, ry, from, to;
+    if (data && raw && len == raw + 4) data += 4;
+    else if (!data || !raw || len != raw) {
+        p->tiles_skipped++;
+        return;
+    }
+    if (x >= p->width || y >= p->height) return;
+    w = (tile_w < p->width - x ? tile_w : p->width - x);
+    h = (tile_h < p->height - y ? tile_h : p->height - y);
+    while (c0 < CI_PHASH_W-1 && p->xb[c0+1] <= x) c0++;
+    for (ry=0; ry < h; ry++, data += stride) {
+        while (r < CI_PHASH_H-1 && p->yb[r+1] <= y + ry) r++;
+        for (c=c0, from=0; from < w; c++, from=to) {
+            to = (c < CI_PHASH_W-1 && p->xb[c+1] - x < w ? p->xb[c+1] - x : w);
+            if (to > from) p->sum[r][c] += ci_PhashRun(p, data, from, to);
+        }
+    }
+    p->tiles++;
+}
+
+// Difference hash of luma grid: bit set where a cell is darker than its
+// right neighbour, first row in high byte. Returns -1 if the block has
+// no hash: it's smaller than the grid, or not all of its tiles are raw.
+int ci_PhashFinish(const CI_phash *p, uint64_t *hash) {
+    double mean[CI_PHASH_W];
+    uint32_t r, c, rows, cols;
+    uint64_t h = 0;
+    if (!p->tiles || p->tiles_skipped) return -1;
+    for (r=0; r < CI_PHASH_H; r++) {
+        if (!(rows = p->yb[r+1] - p->yb[r])) return -1;
+        for (c=0; c < CI_PHASH_W; c++) {
+            if (!(cols = p->xb[c+1] - p->xb[c])) return -1;
+            mean[c] = p->sum[r][c] / ((double) rows * cols);
+        }
+        for (c=0; c+1 < CI_PHASH_W; c++) h = (h << 1) | (mean[c] < mean[c+1]);
+    }
+    *hash = h;
+    return 0;
+}
+
+// Without popcnt instruction the builtin is a call, slower than counting
+// inline.
+static inline uint32_t ci_PhashPop64(uint64_t x) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+uint32_t ci_PhashDistance(uint64_t a, uint64_t b) {
+    return ci_PhashPop64(a ^ b);
+}
+
+// --- Clusters of near hashes ---
+
+typedef struct _CI_phash_key {
+    uint64_t    key;
+    uint32_t    idx;
+} CI_phash_key;
+
+// Distinct hash by value of one of its bands; whole hash is kept here
+// too, so hashes of a band value are compared reading memory in turn.
+typedef struct _CI_phash_band {
+    uint64_t    hash;
+    uint32_t    band;
+    uint32_t    idx;                    // to root[]
+} CI_phash_band;
+
+// Hashes of one band value: band[start..start+count-1]
+typedef struct _CI_phash_slot {
+    uint32_t    band;
+    uint32_t    start;
+    uint32_t    count;                  // 0: free slot
+} CI_phash_slot;
+
+// Search of hashes near to one of them, by one band
+typedef struct _CI_phash_search {
+    uint32_t            *root;
+    CI_phash_band       *band;          // grouped by band value
+    CI_phash_slot       *slot;          // open addressing table of band[] runs
+    uint32_t            mask;           // slots - 1
+    uint32_t            bits;           // of band
+    uint32_t            maxdist;
+    uint64_t            hash;           // one searched for
+    uint32_t            idx;            // ... its index to root[]
+    uint32_t            joins;
+} CI_phash_search;
+
+static int ci_PhashKeyCmp(const void *a, const void *b) {
+    const CI_phash_key *x = a, *y = b;
+    if (x->key != y->key) return (x->key < y->key ? -1 : 1);
+    return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static uint32_t ci_PhashFind(uint32_t *root, uint32_t i) {
+    while (root[i] != i) {
+        root[i] = root[root[i]];
+        i = root[i];
+    }
+    return i;
+}
+
+// Joins sets of a and b, smaller index is the root. Returns 1 if they
+// were apart.
+static uint32_t ci_PhashJoin(uint32_t *root, uint32_t a, uint32_t b) {
+    a = ci_PhashFind(root, a);
+    b = ci_PhashFind(root, b);
+    if (a == b) return 0;
+    if (a < b) root[b] = a;
+    else root[a] = b;
+    return 1;
+}
+
+static uint32_t ci_PhashSlot(const CI_phash_search *s, uint32_t band) {
+    uint32_t i = (uint32_t) ((band * 0x9E3779B97F4A7C15ULL) >> 32) & s->mask;
+    while (s->slot[i].count && s->slot[i].band != band) i = (i+1) & s->mask;
+    return i;
+}
+
+// Compares the hash with later ones whose band differs from given one in
+// at most left more bits, from bit on (so each is looked up once).
+static void ci_PhashProbe(CI_phash_search *s, uint32_t band, uint32_t bit, uint32_t left) {
+    const CI_phash_slot *b = &s->slot[ci_PhashSlot(s, band)];
+    const CI_phash_band *y = s->band + b->start, *end = y + b->count;
+    // Distance first: near ones are few, so it's the branch predicted well
+    for (; y < end; y++) {
+        if (ci_PhashPop64(s->hash ^ y->hash) > s->maxdist || y->idx <= s->idx) continue;
+        s->joins += ci_PhashJoin(s->root, s->idx, y->idx);
+    }
+    if (left) for (; bit < s->bits; bit++) ci_PhashProbe(s, band ^ (1U << bit), bit+1, left-1);
+}
+
+// Work of search by given number of bands, per hash: band values looked
+// up (each a cache miss, worth some 16 hashes compared) times hashes
+// having one of them.
+static double ci_PhashCost(uint32_t bands, uint32_t n, uint32_t maxdist) {
+    uint32_t bits = 64 / bands, r = maxdist / bands, k;
+    double lookups = 0, c = 1;
+    for (k=0; k <= r && k <= bits; k++) {
+        lookups += c;
+        c = c * (bits - k) / (k + 1);
+    }
+    return bands * lookups * (16 + n / (double) (1ULL << bits));
+}
+
+// Puts n hashes into clusters, hashes at most maxdist bits apart (and
+// hashes near those) being in the same one: root[i] is the smallest index
+// of cluster of i. Equal hashes are joined first, search runs on one of
+// each. Multi-index search: hashes split into bands, two ones within
+// maxdist have some band within maxdist/bands bits, so only band values
+// that near are looked up. Wide bands mean more values to look up, narrow
+// ones more hashes per value; the cheaper is taken. Returns number of
+// joins made.
+uint32_t ci_PhashCluster(const uint64_t *hash, uint32_t n, uint32_t maxdist, uint32_t *root) {
+    CI_phash_search s;
+    CI_phash_key *k;
+    uint32_t i, j, m = 0, band, bands = 2, lo, slots;
+    uint64_t mask;
+    if (!n) return 0;
+    memset(&s, 0, sizeof(s));
+    k = (CI_phash_key *) malloc(n*sizeof(CI_phash_key));
+    for (i=0; i < n; i++) {
+        root[i] = i;
+        k[i].key = hash[i];
+        k[i].idx = i;
+    }
+    qsort(k, n, sizeof(CI_phash_key), ci_PhashKeyCmp);
+    for (i=0; i < n; i++) {
+        if (m && k[i].key == k[m-1].key) s.joins += ci_PhashJoin(root, k[m-1].idx, k[i].idx);
+        else k[m++] = k[i];
+    }
+    for (i=3; i <= 16; i++) if (ci_PhashCost(i, m, maxdist) < ci_PhashCost(bands, m, maxdist)) bands = i;
+    for (slots=1; slots < 2*m; slots <<= 1);
+    s.root = root;
+    s.maxdist = maxdist;
+    s.mask = slots - 1;
+    s.band = (CI_phash_band *) malloc(m*sizeof(CI_phash_band));
+    s.slot = (CI_phash_slot *) malloc(slots*sizeof(CI_phash_slot));
+    for (band=0; band < bands && maxdist; band++) {
+        lo = band*64 / bands;
+        s.bits = (band+1)*64 / bands - lo;
+        mask = (1ULL << s.bits) - 1;
+        // Hashes counted by band value, then put in its run from the end
+        memset(s.slot, 0, slots*sizeof(CI_phash_slot));
+        for (i=0; i < m; i++) {
+            CI_phash_slot *x = &s.slot[ci_PhashSlot(&s, (uint32_t) ((k[i].key >> lo) & mask))];
+            x->band = (uint32_t) ((k[i].key >> lo) & mask);
+            x->count++;
+        }
+        for (i=0, j=0; i < slots; i++) s.slot[i].start = (j += s.slot[i].count);
+        for (i=0; i < m; i++) {
+            CI_phash_slot *x = &s.slot[ci_PhashSlot(&s, (uint32_t) ((k[i].key >> lo) & mask))];
+            CI_phash_band *y = &s.band[--x->start];
+            y->hash = k[i].key;
+            y->band = x->band;
+            y->idx = k[i].idx;
+        }
+        for (i=0; i < m; i++) {
+            s.hash = k[i].key;
+            s.idx = k[i].idx;
+            ci_PhashProbe(&s, (uint32_t) ((s.hash >> lo) & mask), 0, maxdist / bands);
+        }
+    }
+    for (i=0; i < n; i++) root[i] = ci_PhashFind(root, i);
+    free(s.slot);
+    free(s.band);
+    free(k);
+    return s.joins;
+}
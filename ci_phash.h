@@ -0,0 +1,62 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo perceptual hashes of blocks, Hamming distance search.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_PHASH_H_
+#define _CI_PHASH_H_
+
+#include <inttypes.h>
+
+#define CI_PHASH_W              9               // cells of luma grid, dHash
+#define CI_PHASH_H              8               // compares horizontal neighbours
+#define CI_PHASH_DIST           4               // default bits apart of near hashes
+
+// Pixel layouts needing more than bpp to get luma from
+#define CI_PHASH_CMYK           1               // 32 bpp is CMYK, not RGB + alpha
+#define CI_PHASH_LAB            2               // 24 bpp is L*a*b*, L first
+
+// Luma grid of one block: its pixels averaged into CI_PHASH_W x
+// CI_PHASH_H cells. Cell c covers columns xb[c]..xb[c+1]-1 (rows alike),
+// so cells of small blocks may be empty. Luma is of any scale, the hash
+// only compares cells of the same block.
+typedef struct _CI_phash {
+    uint32_t        bpp;
+    uint32_t        flags;
+    uint32_t        width;
+    uint32_t        height;
+    const uint8_t   *lut;                   // luma of 8 bpp values (palette), NULL: value itself
+    uint32_t        xb[CI_PHASH_W+1];
+    uint32_t        yb[CI_PHASH_H+1];
+    uint64_t        tiles;                  // raw tiles added
+    uint64_t        tiles_skipped;          // ... not raw or not in memory
+    double          sum[CI_PHASH_H][CI_PHASH_W];
+} CI_phash;
+
+int ci_PhashInit(CI_phash *p, uint32_t bpp, uint32_t flags, uint32_t width, uint32_t height, const uint8_t *lut);
+void ci_PhashTile(CI_phash *p, const uint8_t *data, uint32_t len,
+    uint32_t tile_w, uint32_t tile_h, uint32_t x, uint32_t y);
+int ci_PhashFinish(const CI_phash *p, uint64_t *hash);
+uint32_t ci_PhashDistance(uint64_t a, uint64_t b);
+uint32_t ci_PhashCluster(const uint64_t *hash, uint32_t n, uint32_t maxdist, uint32_t *root);
+
+#endif
@@ -0,0 +1,334 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo pixel statistics of raw tiles (histograms, min/max, coverage).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ci_pstat.h"
+
+#define CI_PSTAT_PENDING_MAX    0x7FFFFFFF      // pixels in part[] before folding
+
+static const uint8_t ci_pstat_bpp[CI_PSTAT_LAYOUTS] = { 1, 8, 16, 24, 32, 48, 64 };
+
+// Index of pixel layout of given bpp, -1 if it's not known.
+int ci_PstatLayout(uint32_t bpp) {
+    int i;
+    for (i=0; i < CI_PSTAT_LAYOUTS; i++) if (ci_pstat_bpp[i] == bpp) return i;
+    return -1;
+}
+
+// Returns 0 if OK, -1 if bpp isn't known.
+int ci_PstatInit(CI_pstat *s, uint32_t bpp) {
+    uint32_t i;
+    memset(s, 0, sizeof(CI_pstat));
+    if (ci_PstatLayout(bpp) < 0) return -1;
+    s->bpp = bpp;
+    s->depth = (bpp == 1 ? 1 : (bpp == 16 || bpp == 48 || bpp == 64 ? 16 : 8));
+    s->channels = (bpp == 1 ? 1 : bpp / s->depth);
+    for (i=0; i < CI_PSTAT_CHANNELS; i++) s->min[i] = UINT32_MAX;
+    return 0;
+}
+
+// Inits array of all CI_PSTAT_LAYOUTS layouts, in order of bpp.
+void ci_PstatInitAll(CI_pstat *s) {
+    int i;
+    for (i=0; i < CI_PSTAT_LAYOUTS; i++) ci_PstatInit(&s[i], ci_pstat_bpp[i]);
+}
+
+// Bytes of uncompressed tile, rows padded to whole bytes.
+uint64_t ci_PstatRawSize(uint32_t tile_w, uint32_t tile_h, uint32_t bpp) {
+    return (((uint64_t) tile_w * bpp + 7) / 8) * tile_h;
+}
+
+static uint32_t ci_PstatPop64(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+// 1 bpp row of n pixels, first pixel in high bit: bits set counted
+// 64 at a time.
+static void ci_PstatRow1(CI_pstat *s, const uint8_t *p, uint32_t n) {
+    uint32_t i, full = n / 8;
+    uint64_t w, ones = 0;
+    for (i=0; i+8 <= full; i+=8) {
+        memcpy(&w, p+i, 8);
+        ones += ci_PstatPop64(w);
+    }
+    for (; i < full; i++) ones += ci_PstatPop64(p[i]);
+    if (n & 7) ones += ci_PstatPop64(p[full] & (0xFF00 >> (n & 7)));
+    s->part[0][1] += ones;
+    s->part[0][0] += n - ones;
+}
+
+// Counts n pixels of 8-bit channels. One channel goes to four tables in
+// turn, so increments of neighbouring pixels don't wait for each other.
+static void ci_PstatCount8(CI_pstat *s, const uint8_t *q, uint32_t n) {
+    uint32_t i;
+    switch (s->channels) {
+        case 1:
+            for (i=0; i+4 <= n; i+=4) {
+                s->part[0][q[i]]++;
+                s->part[1][q[i+1]]++;
+                s->part[2][q[i+2]]++;
+                s->part[3][q[i+3]]++;
+            }
+            for (; i < n; i++) s->part[0][q[i]]++;
+            break;
+        case 2:
+            for (i=0; i < n; i++, q+=2) {
+                s->part[0][q[0]]++;
+                s->part[1][q[1]]++;
+            }
+            break;
+        case 3:
+            for (i=0; i < n; i++, q+=3) {
+                s->part[0][q[0]]++;
+                s->part[1][q[1]]++;
+                s->part[2][q[2]]++;
+            }
+            break;
+        case 4:
+            for (i=0; i < n; i++, q+=4) {
+                s->part[0][q[0]]++;
+                s->part[1][q[1]]++;
+                s->part[2][q[2]]++;
+                s->part[3][q[3]]++;
+            }
+            break;
+    }
+}
+
+// Row of n pixels of 8-bit channels. Flat areas (backgrounds, masks) are
+// common: 16 bytes (48 for 3 channels) equal to previous pixel repeated
+// are found by one compare and counted at once, rest goes one by one.
+static void ci_PstatRow8(CI_pstat *s, const uint8_t *p, uint32_t n) {
+    uint32_t c = s->channels, i = 0;
+#ifdef __SSE2__
+    uint32_t step = (c == 3 ? 48 : 16), px = step / c, k;
+    uint64_t run = 0;
+    uint8_t pat[48];
+    __m128i v0, v1, v2;
+    const uint8_t *q;
+    if (n >= px) {
+        // Pattern of first pixel, doubled up to 48 bytes
+        memcpy(pat, p, c);
+        for (k=c; k < 48; k *= 2) memcpy(pat+k, pat, (2*k <= 48 ? k : 48-k));
+        v0 = _mm_loadu_si128((const __m128i *) pat);
+        v1 = _mm_loadu_si128((const __m128i *) (pat+16));
+        v2 = _mm_loadu_si128((const __m128i *) (pat+32));
+        for (; i + px <= n; i += px) {
+            q = p + i*c;
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) q), v0)) == 0xFFFF &&
+                (c != 3 || (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (q+16)), v1)) == 0xFFFF &&
+                            _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (q+32)), v2)) == 0xFFFF))) {
+                run += px;
+                continue;
+            }
+            ci_PstatCount8(s, q, px);
+            // Run goes on from last pixel of this one, if at all
+            if (run) {
+                for (k=0; k < c; k++) s->part[k][pat[k]] += run;
+                run = 0;
+            }
+            q += (px-1)*c;
+            if (memcmp(pat, q, c)) {
+                memcpy(pat, q, c);
+                for (k=c; k < 48; k *= 2) memcpy(pat+k, pat, (2*k <= 48 ? k : 48-k));
+                v0 = _mm_loadu_si128((const __m128i *) pat);
+                v1 = _mm_loadu_si128((const __m128i *) (pat+16));
+                v2 = _mm_loadu_si128((const __m128i *) (pat+32));
+            }
+        }
+        for (k=0; k < c; k++) s->part[k][pat[k]] += run;
+    }
+#endif
+    ci_PstatCount8(s, p + i*c, n - i);
+}
+
+// Row of n pixels of 16-bit channels (little endian). Min, max and sum
+// are kept per vector lane, 8 values at a time; lane j of vector k holds
+// channel (8k+j) % c, so 3 channels take three vectors. Histogram (high
+// bytes) and zeros are counted one by one.
+static void ci_PstatRow16(CI_pstat *s, const uint8_t *p, uint32_t n) {
+    uint32_t c = s->channels, vals = n*c, i = 0, ch = 0;
+    uint16_t v;
+#ifdef __SSE2__
+    uint32_t vecs = (c == 3 ? 3 : 1), j, k, iter = 0;
+    const __m128i sign = _mm_set1_epi16((short) 0x8000), zero = _mm_setzero_si128();
+    __m128i mn[3], mx[3], slo[3], shi[3], x;
+    uint16_t lmin[24], lmax[24];
+    uint32_t lsum[24];
+    for (k=0; k < 3; k++) {
+        mn[k] = _mm_set1_epi16(0x7FFF);
+        mx[k] = _mm_set1_epi16((short) 0x8000);
+        slo[k] = shi[k] = zero;
+    }
+    for (; i + 8*vecs <= vals; i += 8*vecs) {
+        for (k=0; k < vecs; k++) {
+            x = _mm_loadu_si128((const __m128i *) (p + 2*(i + 8*k)));
+            mn[k] = _mm_min_epi16(mn[k], _mm_xor_si128(x, sign));
+            mx[k] = _mm_max_epi16(mx[k], _mm_xor_si128(x, sign));
+            slo[k] = _mm_add_epi32(slo[k], _mm_unpacklo_epi16(x, zero));
+            shi[k] = _mm_add_epi32(shi[k], _mm_unpackhi_epi16(x, zero));
+        }
+        for (j=0; j < 8*vecs; j++) {
+            memcpy(&v, p + 2*(i+j), 2);
+            s->part[ch][v >> 8]++;
+            s->zeros[ch] += !v;
+            if (++ch == c) ch = 0;
+        }
+        // 32-bit lane sums flushed before they could overflow
+        if (++iter == 0x8000 || i + 16*vecs > vals) {
+            for (k=0; k < vecs; k++) {
+                _mm_storeu_si128((__m128i *) (lsum + 8*k), slo[k]);
+                _mm_storeu_si128((__m128i *) (lsum + 8*k + 4), shi[k]);
+                slo[k] = shi[k] = zero;
+            }
+            for (j=0; j < 8*vecs; j++) s->sum[j % c] += lsum[j];
+            iter = 0;
+        }
+    }
+    if (i) {
+        for (k=0; k < vecs; k++) {
+            _mm_storeu_si128((__m128i *) (lmin + 8*k), _mm_xor_si128(mn[k], sign));
+            _mm_storeu_si128((__m128i *) (lmax + 8*k), _mm_xor_si128(mx[k], sign));
+        }
+        for (j=0; j < 8*vecs; j++) {
+            if (lmin[j] < s->min[j % c]) s->min[j % c] = lmin[j];
+            if (lmax[j] > s->max[j % c]) s->max[j % c] = lmax[j];
+        }
+    }
+#endif
+    for (; i < vals; i++) {
+        memcpy(&v, p + 2*i, 2);
+        s->part[ch][v >> 8]++;
+        s->zeros[ch] += !v;
+        s->sum[ch] += v;
+        if (v < s->min[ch]) s->min[ch] = v;
+        if (v > s->max[ch]) s->max[ch] = v;
+        if (++ch == c) ch = 0;
+    }
+}
+
+// Moves counts of part[] to hist[].
+static void ci_PstatFold(CI_pstat *s) {
+    uint32_t ch, v;
+    if (!s->pending) return;
+    if (s->depth == 8 && s->channels == 1) {
+        for (v=0; v < CI_PSTAT_BINS; v++)
+            s->hist[0][v] += (uint64_t) s->part[0][v] + s->part[1][v] + s->part[2][v] + s->part[3][v];
+    } else {
+        for (ch=0; ch < s->channels; ch++)
+            for (v=0; v < CI_PSTAT_BINS; v++) s->hist[ch][v] += s->part[ch][v];
+    }
+    memset(s->part, 0, sizeof(s->part));
+    s->pending = 0;
+}
+
+// Adds tile of block: data NULL if it's not in memory, len not of raw
+// tile (maybe with marker dword first) if it's compressed; such ones
+// are only counted. Width and height are of its part inside the block.
+void ci_PstatTile(CI_pstat *s, const uint8_t *data, uint32_t len,
+    uint32_t tile_w, uint32_t tile_h, uint32_t width, uint32_t height) {
+    uint64_t raw = ci_PstatRawSize(tile_w, tile_h, s->bpp), stride = raw / (tile_h ? tile_h : 1);
+    uint32_t y;
+    if (!data) {
+        s->tiles_missing++;
+        return;
+    }
+    if (raw && len == raw + 4) data += 4;
+    else if (!raw || len != raw) {
+        s->tiles_packed++;
+        return;
+    }
+    if (width > tile_w) width = tile_w;
+    if (height > tile_h) height = tile_h;
+    for (y=0; y < height; y++, data += stride) {
+        if (s->pending + (uint64_t) width > CI_PSTAT_PENDING_MAX) ci_PstatFold(s);
+        switch (s->depth) {
+            case 1: ci_PstatRow1(s, data, width); break;
+            case 8: ci_PstatRow8(s, data, width); break;
+            case 16: ci_PstatRow16(s, data, width); break;
+        }
+        s->pending += width;
+    }
+    s->pixels += (uint64_t) width * height;
+    s->tiles++;
+}
+
+// Makes hist[], sum, min, max and zeros complete.
+void ci_PstatFinish(CI_pstat *s) {
+    uint32_t ch, v;
+    ci_PstatFold(s);
+    if (s->depth == 16) return;
+    for (ch=0; ch < s->channels; ch++) {
+        s->sum[ch] = 0;
+        s->min[ch] = UINT32_MAX;
+        s->max[ch] = 0;
+        for (v=0; v < CI_PSTAT_BINS; v++) {
+            if (!s->hist[ch][v]) continue;
+            s->sum[ch] += (uint64_t) v * s->hist[ch][v];
+            if (v < s->min[ch]) s->min[ch] = v;
+            s->max[ch] = v;
+        }
+        s->zeros[ch] = s->hist[ch][0];
+    }
+}
+
+// Adds src (of same bpp) to dst; call ci_PstatFinish() on dst after.
+void ci_PstatMerge(CI_pstat *dst, CI_pstat *src) {
+    uint32_t ch, v;
+    ci_PstatFold(dst);
+    ci_PstatFold(src);
+    for (ch=0; ch < src->channels; ch++) {
+        for (v=0; v < CI_PSTAT_BINS; v++) dst->hist[ch][v] += src->hist[ch][v];
+        if (src->depth == 16) {
+            dst->sum[ch] += src->sum[ch];
+            dst->zeros[ch] += src->zeros[ch];
+            if (src->min[ch] < dst->min[ch]) dst->min[ch] = src->min[ch];
+            if (src->max[ch] > dst->max[ch]) dst->max[ch] = src->max[ch];
+        }
+    }
+    dst->pixels += src->pixels;
+    dst->tiles += src->tiles;
+    dst->tiles_packed += src->tiles_packed;
+    dst->tiles_missing += src->tiles_missing;
+}
+
+double ci_PstatMean(const CI_pstat *s, uint32_t channel) {
+    return (s->pixels ? (double) s->sum[channel] / s->pixels : 0);
+}
+
+// Pixels whose given channel isn't 0: coverage of mask or alpha.
+uint64_t ci_PstatNonzero(const CI_pstat *s, uint32_t channel) {
+    return s->pixels - s->zeros[channel];
+}
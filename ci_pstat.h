@@ -0,0 +1,66 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo pixel statistics of raw tiles (histograms, min/max, coverage).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_PSTAT_H_
+#define _CI_PSTAT_H_
+
+#include <inttypes.h>
+
+#define CI_PSTAT_CHANNELS       4
+#define CI_PSTAT_BINS           256
+#define CI_PSTAT_LAYOUTS        7               // 1, 8, 16, 24, 32, 48, 64 bpp
+
+// Statistics of pixels of one layout. Values of 16-bit channels go to
+// histogram by high byte. Counts are gathered in part[] first (32-bit,
+// so cache friendly), moved to hist[] by ci_PstatFinish(), which also
+// works out sum, min, max and zeros of 1 and 8-bit channels from it.
+typedef struct _CI_pstat {
+    uint32_t    bpp;
+    uint32_t    channels;
+    uint32_t    depth;                  // bits per channel: 1, 8 or 16
+    uint64_t    pixels;
+    uint64_t    sum[CI_PSTAT_CHANNELS];
+    uint64_t    zeros[CI_PSTAT_CHANNELS];
+    uint32_t    min[CI_PSTAT_CHANNELS];
+    uint32_t    max[CI_PSTAT_CHANNELS];
+    uint64_t    hist[CI_PSTAT_CHANNELS][CI_PSTAT_BINS];
+    uint64_t    tiles;                  // raw tiles counted
+    uint64_t    tiles_packed;           // ... not raw, not decoded
+    uint64_t    tiles_missing;          // ... not in memory
+    uint32_t    pending;                // pixels in part[]
+    uint32_t    part[CI_PSTAT_CHANNELS][CI_PSTAT_BINS];
+} CI_pstat;
+
+int ci_PstatLayout(uint32_t bpp);
+int ci_PstatInit(CI_pstat *s, uint32_t bpp);
+void ci_PstatInitAll(CI_pstat *s);
+uint64_t ci_PstatRawSize(uint32_t tile_w, uint32_t tile_h, uint32_t bpp);
+void ci_PstatTile(CI_pstat *s, const uint8_t *data, uint32_t len,
+    uint32_t tile_w, uint32_t tile_h, uint32_t width, uint32_t height);
+void ci_PstatFinish(CI_pstat *s);
+void ci_PstatMerge(CI_pstat *dst, CI_pstat *src);
+double ci_PstatMean(const CI_pstat *s, uint32_t channel);
+uint64_t ci_PstatNonzero(const CI_pstat *s, uint32_t channel);
+
+#endif
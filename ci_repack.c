@@ -0,0 +1,195 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo repacked file writer (parallel gzip/zstd segments).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef CI_ZSTD
+#include <zstd.h>
+#endif
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include "ci_repack.h"
+
+#define CI_REPACK_GZIP_LEVEL    9
+#define CI_REPACK_ZSTD_LEVEL    19
+
+// Segments of one window: compressed by all threads, then written in order
+typedef struct _CI_repack_job {
+    const CI_repack_piece *piece;
+    const uint64_t  *start;             // output offset of each piece, total last
+    uint32_t        pieces;
+    uint32_t        method;
+    uint32_t        first;              // first segment of window
+    uint32_t        next;               // next segment to take
+    uint32_t        end;
+    uint8_t         **in;               // slots of window
+    uint8_t         **out;
+    uint64_t        *out_len;           // 0: compression failed
+    uint64_t        out_size;
+} CI_repack_job;
+
+static uint64_t ci_RepackBound(uint32_t method) {
+#ifdef CI_ZSTD
+    if (method == CI_REPACK_ZSTD) return ZSTD_compressBound(CI_REPACK_SEGMENT);
+#else
+    (void) method;
+#endif
+    // gzip header and trailer are 12 bytes more than zlib ones
+    return compressBound(CI_REPACK_SEGMENT) + 12;
+}
+
+// Copies bytes offs..offs+len of output into p.
+static void ci_RepackGather(const CI_repack_job *j, uint8_t *p, uint64_t offs, uint64_t len) {
+    uint32_t lo = 0, hi = j->pieces, i;
+    uint64_t n, from;
+    // Last piece starting at or before offs
+    while (hi - lo > 1) {
+        i = (lo + hi) / 2;
+        if (j->start[i] <= offs) lo = i;
+        else hi = i;
+    }
+    for (i=lo; len && i < j->pieces; i++) {
+        from = offs - j->start[i];
+        if (from >= j->piece[i].len) continue;
+        n = j->piece[i].len - from;
+        if (n > len) n = len;
+        memcpy(p, j->piece[i].data + from, n);
+        p += n;
+        offs += n;
+        len -= n;
+    }
+}
+
+// Compresses k-th segment into its slot, as a gzip member or zstd frame
+// of its own.
+static void ci_RepackSegment(CI_repack_job *j, uint32_t k) {
+    uint32_t s = k - j->first;
+    uint64_t offs = (uint64_t) k * CI_REPACK_SEGMENT, total = j->start[j->pieces];
+    uint64_t len = (total - offs < CI_REPACK_SEGMENT ? total - offs : CI_REPACK_SEGMENT);
+    z_stream z;
+
+    ci_RepackGather(j, j->in[s], offs, len);
+    j->out_len[s] = 0;
+#ifdef CI_ZSTD
+    if (j->method == CI_REPACK_ZSTD) {
+        size_t r = ZSTD_compress(j->out[s], j->out_size, j->in[s], len, CI_REPACK_ZSTD_LEVEL);
+        if (!ZSTD_isError(r)) j->out_len[s] = r;
+        return;
+    }
+#endif
+    memset(&z, 0, sizeof(z));
+    // +16: gzip header and trailer
+    if (deflateInit2(&z, CI_REPACK_GZIP_LEVEL, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+    z.next_in = j->in[s];
+    z.avail_in = len;
+    z.next_out = j->out[s];
+    z.avail_out = j->out_size;
+    if (deflate(&z, Z_FINISH) == Z_STREAM_END) j->out_len[s] = z.total_out;
+    deflateEnd(&z);
+}
+
+static void *ci_RepackThread(void *arg) {
+    CI_repack_job *j = (CI_repack_job *) arg;
+    uint32_t k;
+    while ((k = __sync_fetch_and_add(&j->next, 1)) < j->end) ci_RepackSegment(j, k);
+    return NULL;
+}
+
+// Writes pieces one after another into out, compressed. Output is cut
+// into segments compressed independently (gzip members or zstd frames,
+// which decompress as one stream), so threads compress a window of them
+// at once; they're written in order as the window is done, so out can be
+// a pipe, and memory taken doesn't depend on file size.
+int ci_RepackWrite(FILE *out, const CI_repack_piece *piece, uint32_t pieces,
+    uint32_t method, uint32_t threads, uint64_t *written) {
+    CI_repack_job j;
+    uint64_t *start = (uint64_t *) malloc((pieces+1)*sizeof(uint64_t));
+    uint32_t i, k, segs, window;
+    int r = 0;
+#ifndef WIN32
+    pthread_t *thread;
+#endif
+
+    if (!threads) threads = 1;
+#ifdef WIN32
+    threads = 1;
+#endif
+    start[0] = 0;
+    for (i=0; i < pieces; i++) start[i+1] = start[i] + piece[i].len;
+    segs = (start[pieces] + CI_REPACK_SEGMENT-1) / CI_REPACK_SEGMENT;
+    window = threads*CI_REPACK_WINDOW;
+    if (window > segs) window = (segs ? segs : 1);
+    if (threads > window) threads = window;
+
+    memset(&j, 0, sizeof(j));
+    j.piece = piece;
+    j.start = start;
+    j.pieces = pieces;
+    j.method = method;
+    j.out_size = ci_RepackBound(method);
+    j.in = (uint8_t **) malloc(window*sizeof(uint8_t *));
+    j.out = (uint8_t **) malloc(window*sizeof(uint8_t *));
+    j.out_len = (uint64_t *) malloc(window*sizeof(uint64_t));
+    for (i=0; i < window; i++) {
+        j.in[i] = (uint8_t *) malloc(CI_REPACK_SEGMENT);
+        j.out[i] = (uint8_t *) malloc(j.out_size);
+    }
+#ifndef WIN32
+    thread = (pthread_t *) malloc(threads*sizeof(pthread_t));
+#endif
+    *written = 0;
+
+    for (j.first=0; j.first < segs && !r; j.first += window) {
+        j.next = j.first;
+        j.end = (segs - j.first < window ? segs : j.first + window);
+        // This thread compresses too
+#ifndef WIN32
+        for (i=1; i < threads; i++)
+            if (pthread_create(&thread[i], NULL, ci_RepackThread, &j)) break;
+        ci_RepackThread(&j);
+        for (k=1; k < i; k++) pthread_join(thread[k], NULL);
+#else
+        ci_RepackThread(&j);
+#endif
+        for (k=0; k < j.end - j.first && !r; k++) {
+            if (!j.out_len[k] || fwrite(j.out[k], 1, j.out_len[k], out) != j.out_len[k]) r = -1;
+            *written += j.out_len[k];
+        }
+    }
+
+#ifndef WIN32
+    free(thread);
+#endif
+    for (i=0; i < window; i++) {
+        free(j.in[i]);
+        free(j.out[i]);
+    }
+    free(j.in);
+    free(j.out);
+    free(j.out_len);
+    free(start);
+    return r;
+}
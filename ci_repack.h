@@ -0,0 +1,47 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo repacked file writer (parallel gzip/zstd segments).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_REPACK_H_
+#define _CI_REPACK_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define CI_REPACK_SEGMENT       (256 << 10)     // bytes compressed as one gzip member / zstd frame
+#define CI_REPACK_WINDOW        4               // segments in flight per thread
+
+// Output methods
+#define CI_REPACK_GZIP          0
+#define CI_REPACK_ZSTD          1               // built with CI_ZSTD only
+
+// Piece of output file: bytes of input file in memory or new ones
+typedef struct _CI_repack_piece {
+    const uint8_t   *data;
+    uint64_t        len;
+} CI_repack_piece;
+
+int ci_RepackWrite(FILE *out, const CI_repack_piece *piece, uint32_t pieces,
+    uint32_t method, uint32_t threads, uint64_t *written);
+
+#endif
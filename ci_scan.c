@@ -0,0 +1,162 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo signature scanner for block headers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ci_scan.h"
+
+// CPT9_Block fields (see cpt.h)
+#define CI_SCAN_HEAD            60              // size of CPT9_Block
+#define CI_SCAN_BPP             0x10
+#define CI_SCAN_UNK00           0x14            // always 0
+#define CI_SCAN_SIZE1           0x20
+#define CI_SCAN_UNK03           0x28            // 5 x 0
+
+static uint32_t ci_ScanGet32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// Bitmap of zero bytes of 64*words bytes: bit i%64 of z[i/64] is set if
+// p[i] is 0. The only pass over all the bytes, 64 at once.
+static void ci_ScanZeros(const uint8_t *p, uint32_t words, uint64_t *z) {
+    uint32_t i;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t m0, m1, m2, m3;
+    for (i=0; i < words; i++, p += 64) {
+        m0 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p), zero));
+        m1 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p+16)), zero));
+        m2 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p+32)), zero));
+        m3 = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p+48)), zero));
+        z[i] = m0 | m1 << 16 | m2 << 32 | m3 << 48;
+    }
+#else
+    // 8 bytes at once: high bit of each zero byte, gathered by multiply
+    uint64_t x, t;
+    uint32_t j;
+    for (i=0; i < words; i++) {
+        z[i] = 0;
+        for (j=0; j < 8; j++, p += 8) {
+            memcpy(&x, p, 8);
+            t = ~(((x & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | x) & 0x8080808080808080ULL;
+            z[i] |= ((t >> 7) * 0x0102040810204080ULL >> 56) << 8*j;
+        }
+    }
+#endif
+}
+
+// 64 bits of bitmap starting at given bit.
+static uint64_t ci_ScanBits(const uint64_t *z, uint32_t bit) {
+    uint32_t w = bit >> 6, s = bit & 63;
+    return (s ? (z[w] >> s) | (z[w+1] << (64-s)) : z[w]);
+}
+
+// Positions k*64..k*64+63 of bitmap where CPT9_Block may start: nonzero
+// bpp byte, zeros up to end of unk00, unk03[] all zeros.
+static uint64_t ci_ScanCandidates(const uint64_t *z, uint32_t k) {
+    uint64_t c = ~ci_ScanBits(z, 64*k + CI_SCAN_BPP);
+    uint32_t j;
+    for (j=CI_SCAN_BPP+1; c && j < CI_SCAN_UNK00+4; j++) c &= ci_ScanBits(z, 64*k + j);
+    for (j=CI_SCAN_UNK03; c && j < CI_SCAN_HEAD; j++) c &= ci_ScanBits(z, 64*k + j);
+    return c;
+}
+
+// Returns end of tile data of block whose header would be at offs, 0 if
+// the header isn't plausible: sane dimensions and bpp, known id of first
+// chunk, tile list of (offset, length) pairs ending at first tile, tiles
+// in file.
+static uint32_t ci_ScanCheck9(const uint8_t *data, uint32_t size, uint32_t offs, CI_scan_chunk_fn is_chunk) {
+    const uint8_t *b = data + offs;
+    uint32_t i, q, first, o, l, end, size1;
+    if (size - offs < CI_SCAN_HEAD + 8) return 0;
+    for (i=0; i < 16; i += 4) {
+        o = ci_ScanGet32(b+i);
+        if (!o || o > CI_SCAN_DIM_MAX) return 0;
+    }
+    switch (ci_ScanGet32(b+CI_SCAN_BPP)) {
+        case 1: case 8: case 16: case 24: case 32: case 48: case 64: break;
+        default: return 0;
+    }
+    size1 = ci_ScanGet32(b+CI_SCAN_SIZE1);
+    if (size1 > size - offs - CI_SCAN_HEAD - 8) return 0;
+    // Chunk area: its size, 1, then length and id of first chunk
+    if (size1 >= 16) {
+        l = ci_ScanGet32(b+CI_SCAN_HEAD+8);
+        if (!l || l > size1 - 16 || !is_chunk(ci_ScanGet32(b+CI_SCAN_HEAD+12))) return 0;
+    }
+    q = offs + CI_SCAN_HEAD + size1;
+    first = ci_ScanGet32(data+q);
+    if (first < q || (first - q) % 8 || first > size) return 0;
+    for (i=q, end=first; i < first; i += 8) {
+        o = ci_ScanGet32(data+i);
+        l = ci_ScanGet32(data+i+4);
+        if (o < first || o > size || l > size - o) return 0;
+        if (o + l > end) end = o + l;
+    }
+    return end;
+}
+
+// Finds plausible CPT9 block headers at or after 'from', in file order.
+// Each one has to be past tile data of the one before, so tile data isn't
+// scanned (and headers that happen to be in it don't count). is_chunk
+// tells chunk ids known. *block is malloc()ed. Returns number of blocks.
+uint32_t ci_ScanBlocks9(const uint8_t *data, uint32_t size, uint32_t from, CI_scan_chunk_fn is_chunk, CI_scan_block **block) {
+    uint64_t z[CI_SCAN_WINDOW/64 + 2], c;
+    uint8_t tail[CI_SCAN_WINDOW + 128];
+    const uint8_t *p;
+    uint32_t base, k, offs, end, next = from, num = 0, max = 0;
+
+    *block = NULL;
+    for (base = from; base < size; base = (next > base + CI_SCAN_WINDOW ? next : base + CI_SCAN_WINDOW)) {
+        // Bitmap covers window and header of its last position; last
+        // window is padded with non-zero bytes
+        if (size - base >= sizeof(tail)) p = data + base;
+        else {
+            memset(tail, 0xFF, sizeof(tail));
+            memcpy(tail, data + base, size - base);
+            p = tail;
+        }
+        ci_ScanZeros(p, CI_SCAN_WINDOW/64 + 2, z);
+        for (k=0; k < CI_SCAN_WINDOW/64; k++) {
+            for (c = ci_ScanCandidates(z, k); c; c &= c-1) {
+                offs = base + 64*k + __builtin_ctzll(c);
+                if (offs < next || !(end = ci_ScanCheck9(data, size, offs, is_chunk))) continue;
+                if (num == max) {
+                    max = (max ? 2*max : 64);
+                    *block = (CI_scan_block *) realloc(*block, max*sizeof(CI_scan_block));
+                }
+                (*block)[num].offs = offs;
+                (*block)[num++].end = end;
+                next = end;
+            }
+        }
+    }
+    return num;
+}
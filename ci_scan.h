@@ -0,0 +1,44 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo signature scanner for block headers.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_SCAN_H_
+#define _CI_SCAN_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define CI_SCAN_WINDOW          4096            // positions tested per zero bitmap
+#define CI_SCAN_DIM_MAX         0x100000        // max plausible width, height, tile size
+
+// Block header found by scan
+typedef struct _CI_scan_block {
+    uint32_t    offs;                           // of CPT9_Block
+    uint32_t    end;                            // end of its tile list and tile data
+} CI_scan_block;
+
+typedef uint32_t (*CI_scan_chunk_fn)(uint32_t id);
+
+uint32_t ci_ScanBlocks9(const uint8_t *data, uint32_t size, uint32_t from, CI_scan_chunk_fn is_chunk, CI_scan_block **block);
+
+#endif
@@ -0,0 +1,150 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo bounded memory value sketches (top-k + HyperLogLog).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "ci_sketch.h"
+
+// 64-bit finalizer (splitmix64), spreads field values for HyperLogLog.
+static uint64_t ci_SketchMix(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+void ci_SketchInit(CI_sketch *s) {
+    memset(s, 0, sizeof(CI_sketch));
+    s->min = UINT64_MAX;
+}
+
+void ci_SketchAdd(CI_sketch *s, uint64_t value) {
+    uint32_t i, lo = 0;
+    uint64_t h = ci_SketchMix(value);
+    uint32_t idx = h >> (64 - CI_SKETCH_HLL_BITS);
+    uint8_t rank = 1;
+    // Rank = position of first 1 bit in the remaining hash bits
+    h <<= CI_SKETCH_HLL_BITS;
+    while (rank <= 64 - CI_SKETCH_HLL_BITS && !(h & 0x8000000000000000ULL)) { rank++; h <<= 1; }
+    if (s->hll[idx] < rank) s->hll[idx] = rank;
+
+    s->count++;
+    if (value < s->min) s->min = value;
+    if (value > s->max) s->max = value;
+    // Space-Saving: bump known value, else take a free slot, else
+    // replace the least frequent one and remember the possible error
+    for (i=0; i < s->items; i++) {
+        if (s->item[i].value == value) { s->item[i].count++; return; }
+        if (s->item[i].count < s->item[lo].count) lo = i;
+    }
+    if (s->items < CI_SKETCH_TOPK) {
+        s->item[s->items].value = value;
+        s->item[s->items].count = 1;
+        s->item[s->items].error = 0;
+        s->items++;
+        return;
+    }
+    s->evicted = 1;
+    s->item[lo].value = value;
+    s->item[lo].error = s->item[lo].count;
+    s->item[lo].count++;
+}
+
+static int ci_SketchItemCmp(const void *a, const void *b) {
+    const CI_sketch_item *x = a, *y = b;
+    if (x->count != y->count) return (x->count < y->count ? 1 : -1);
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+// Sorts heavy hitters, most frequent first.
+void ci_SketchSort(CI_sketch *s) {
+    qsort(s->item, s->items, sizeof(CI_sketch_item), ci_SketchItemCmp);
+}
+
+// Returns smallest count of a full (lossy) summary, 0 otherwise.
+static uint64_t ci_SketchFloor(const CI_sketch *s) {
+    uint32_t i;
+    uint64_t m;
+    if (s->items < CI_SKETCH_TOPK) return 0;
+    m = s->item[0].count;
+    for (i=1; i < s->items; i++) if (s->item[i].count < m) m = s->item[i].count;
+    return m;
+}
+
+// Merges src into dst. HyperLogLog registers merge exactly, heavy hitters
+// follow the mergeable summaries rule: a value missing from a full summary
+// could have had up to its smallest count there.
+void ci_SketchMerge(CI_sketch *dst, const CI_sketch *src) {
+    CI_sketch_item all[2*CI_SKETCH_TOPK];
+    uint64_t fd = ci_SketchFloor(dst), fs = ci_SketchFloor(src);
+    uint32_t i, j, n = 0;
+
+    if (!src->count) return;
+    for (i=0; i < CI_SKETCH_HLL_REGS; i++)
+        if (dst->hll[i] < src->hll[i]) dst->hll[i] = src->hll[i];
+    for (i=0; i < dst->items; i++) {
+        all[n] = dst->item[i];
+        for (j=0; j < src->items; j++) if (src->item[j].value == all[n].value) break;
+        if (j < src->items) {
+            all[n].count += src->item[j].count;
+            all[n].error += src->item[j].error;
+        } else {
+            all[n].count += fs;
+            all[n].error += fs;
+        }
+        n++;
+    }
+    for (j=0; j < src->items; j++) {
+        for (i=0; i < dst->items; i++) if (dst->item[i].value == src->item[j].value) break;
+        if (i < dst->items) continue;
+        all[n] = src->item[j];
+        all[n].count += fd;
+        all[n].error += fd;
+        n++;
+    }
+    qsort(all, n, sizeof(CI_sketch_item), ci_SketchItemCmp);
+    if (n > CI_SKETCH_TOPK) { n = CI_SKETCH_TOPK; dst->evicted = 1; }
+    memcpy(dst->item, all, n*sizeof(CI_sketch_item));
+    dst->items = n;
+    dst->evicted |= src->evicted;
+    dst->count += src->count;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+// Number of distinct values. Exact while all values fit into item[],
+// HyperLogLog estimate (with small range correction) otherwise.
+double ci_SketchDistinct(const CI_sketch *s) {
+    uint32_t i, zeros = 0;
+    double sum = 0, m = CI_SKETCH_HLL_REGS, est;
+    if (!s->evicted) return s->items;
+    for (i=0; i < CI_SKETCH_HLL_REGS; i++) {
+        sum += ldexp(1.0, -s->hll[i]);
+        if (!s->hll[i]) zeros++;
+    }
+    est = (0.7213/(1.0 + 1.079/m)) * m * m / sum;
+    if (est <= 2.5*m && zeros) est = m * log(m/zeros);
+    return est;
+}
@@ -0,0 +1,59 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo bounded memory value sketches (top-k + HyperLogLog).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_SKETCH_H_
+#define _CI_SKETCH_H_
+
+#include <inttypes.h>
+
+#define CI_SKETCH_TOPK          16              // heavy hitters kept per field
+#define CI_SKETCH_HLL_BITS      10              // HyperLogLog index bits
+#define CI_SKETCH_HLL_REGS      (1 << CI_SKETCH_HLL_BITS)
+
+// Single heavy hitter entry; count may be overestimated by at most error
+typedef struct _CI_sketch_item {
+    uint64_t    value;
+    uint64_t    count;
+    uint64_t    error;
+} CI_sketch_item;
+
+// Value sketch of one field: count/min/max are exact, items hold the
+// most frequent values (Space-Saving), hll estimates number of distinct
+// values. Fixed size, so whole corpus fits in constant memory.
+typedef struct _CI_sketch {
+    uint64_t        count;
+    uint64_t        min;
+    uint64_t        max;
+    uint32_t        items;                  // used entries of item[]
+    uint32_t        evicted;                // 1 if item[] is not exact anymore
+    CI_sketch_item  item[CI_SKETCH_TOPK];
+    uint8_t         hll[CI_SKETCH_HLL_REGS];
+} CI_sketch;
+
+void ci_SketchInit(CI_sketch *s);
+void ci_SketchAdd(CI_sketch *s, uint64_t value);
+void ci_SketchMerge(CI_sketch *dst, const CI_sketch *src);
+void ci_SketchSort(CI_sketch *s);
+double ci_SketchDistinct(const CI_sketch *s);
+
+#endif
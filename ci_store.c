@@ -0,0 +1,251 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo content-addressed dump store (pack file + index).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef WIN32
+#define _GNU_SOURCE             // flock(), strdup() with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef WIN32
+#include <io.h>
+#define ci_StoreLock(fd)
+#define ci_StoreUnlock(fd)
+#else
+#include <unistd.h>
+#include <sys/file.h>
+// Several worker processes may share one store, index lock serializes appends
+#define ci_StoreLock(fd)        flock(fd, LOCK_EX)
+#define ci_StoreUnlock(fd)      flock(fd, LOCK_UN)
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "ci_hash.h"
+#include "ci_store.h"
+
+// Table entries of blobs not yet appended have offs = flag | pending index
+#define CI_STORE_PENDING        0x8000000000000000ULL
+
+// Writes whole buffer, returns 0 if OK.
+static int ci_StoreWrite(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+    ssize_t n;
+    while (len) {
+        if ((n = write(fd, p, len)) <= 0) return -1;
+        p += n; len -= n;
+    }
+    return 0;
+}
+
+static int ci_StoreOpenFile(CI_store *st, const char *name, int flags) {
+    char *path = (char *) malloc(strlen(st->dir) + strlen(name) + 2);
+    int fd;
+    sprintf(path, "%s/%s", st->dir, name);
+    fd = open(path, flags | O_BINARY, 0644);
+    free(path);
+    return fd;
+}
+
+// Returns table slot of given blob, or free slot where it belongs.
+static CI_store_entry *ci_StoreFind(CI_store *st, uint64_t hash, uint64_t size) {
+    uint32_t i = (uint32_t) hash & (st->table_size-1);
+    while (st->table[i].size) {
+        if (st->table[i].hash == hash && st->table[i].size == size) break;
+        i = (i+1) & (st->table_size-1);
+    }
+    return &st->table[i];
+}
+
+// Adds blob to hash table. If another process stored a blob we still have
+// pending, its entry wins and ours gets dropped at next flush.
+static void ci_StoreInsert(CI_store *st, const CI_store_entry *e) {
+    CI_store_entry *slot;
+    // Keep load factor under 1/2
+    if (2*(st->table_used+1) > st->table_size) {
+        CI_store_entry *old = st->table;
+        uint32_t i, n = st->table_size;
+        st->table_size = (n ? 2*n : 4096);
+        st->table = (CI_store_entry *) calloc(st->table_size, sizeof(CI_store_entry));
+        st->table_used = 0;
+        for (i=0; i < n; i++) if (old[i].size) ci_StoreInsert(st, &old[i]);
+        free(old);
+    }
+    slot = ci_StoreFind(st, e->hash, e->size);
+    if (!slot->size) { *slot = *e; st->table_used++; }
+    else if ((slot->offs & CI_STORE_PENDING) && !(e->offs & CI_STORE_PENDING)) slot->offs = e->offs;
+}
+
+// Loads index entries appended (also by other processes) since last time.
+static void ci_StoreRefresh(CI_store *st) {
+    CI_store_entry e[256];
+    struct stat sb;
+    ssize_t n, i;
+    if (fstat(st->index, &sb) || (uint64_t) sb.st_size <= st->index_seen) return;
+    lseek(st->index, st->index_seen, SEEK_SET);
+    while ((n = read(st->index, e, sizeof(e))) >= (ssize_t) sizeof(CI_store_entry)) {
+        n /= sizeof(CI_store_entry);
+        for (i=0; i < n; i++) if (e[i].size) ci_StoreInsert(st, &e[i]);
+        st->index_seen += n * sizeof(CI_store_entry);
+    }
+}
+
+// Appends pending blobs (and 'big', which doesn't fit into batch buffer)
+// to pack, their entries to index and manifest lines. All in three writes,
+// under index lock. Returns 0 if OK.
+static int ci_StoreAppend(CI_store *st, const void *big) {
+    CI_store_entry *slot, *e = st->pending;
+    uint64_t pack_end;
+    size_t len = 0, big_len = 0;
+    uint32_t i, n = 0;
+    int err = 0;
+
+    ci_StoreLock(st->index);
+    ci_StoreRefresh(st);
+    pack_end = lseek(st->pack, 0, SEEK_END);
+    for (i=0; i < st->pending_num; i++) {
+        slot = ci_StoreFind(st, e[i].hash, e[i].size);
+        // Stored by somebody else in the meantime
+        if (slot->offs != (CI_STORE_PENDING | i)) {
+            st->blobs_new--; st->bytes_new -= e[i].size;
+            st->blobs_dup++; st->bytes_dup += e[i].size;
+            continue;
+        }
+        if (e[i].offs == CI_STORE_PENDING) {
+            // Big blob, always the only one pending
+            big_len = e[i].size;
+            slot->offs = pack_end;
+        } else {
+            memmove(st->batch + len, st->batch + e[i].offs, e[i].size);
+            slot->offs = pack_end + len;
+            len += e[i].size;
+        }
+        e[n++] = *slot;
+    }
+    err |= ci_StoreWrite(st->pack, st->batch, len);
+    if (big_len) err |= ci_StoreWrite(st->pack, big, big_len);
+    lseek(st->index, 0, SEEK_END);
+    err |= ci_StoreWrite(st->index, e, n*sizeof(CI_store_entry));
+    st->index_seen = lseek(st->index, 0, SEEK_CUR);
+    err |= ci_StoreWrite(st->manifest, st->lines, st->lines_len);
+    ci_StoreUnlock(st->index);
+
+    st->batch_len = 0;
+    st->pending_num = 0;
+    st->lines_len = 0;
+    return err;
+}
+
+// Opens (creates if needed) store in given directory. Returns 0 if OK.
+int ci_StoreOpen(CI_store *st, const char *dir) {
+    memset(st, 0, sizeof(CI_store));
+#ifdef WIN32
+    mkdir(dir);
+#else
+    mkdir(dir, 0755);
+#endif
+    st->dir = strdup(dir);
+    st->pack = ci_StoreOpenFile(st, CI_STORE_PACK, O_RDWR|O_CREAT);
+    st->index = ci_StoreOpenFile(st, CI_STORE_INDEX, O_RDWR|O_CREAT);
+    st->manifest = ci_StoreOpenFile(st, CI_STORE_MANIFEST, O_WRONLY|O_CREAT|O_APPEND);
+    if (st->pack < 0 || st->index < 0 || st->manifest < 0) {
+        ci_StoreClose(st);
+        return -1;
+    }
+    st->batch = (uint8_t *) malloc(CI_STORE_BATCH);
+    ci_StoreLock(st->index);
+    ci_StoreRefresh(st);
+    ci_StoreUnlock(st->index);
+    return 0;
+}
+
+// Stores a blob unless an identical one (same hash and size) is already
+// there. Label is recorded in manifest either way. Returns 1 if the blob
+// was new, 0 if duplicate, -1 on error.
+int ci_StorePut(CI_store *st, const void *data, size_t size, const char *label) {
+    CI_store_entry e, *slot;
+    size_t need;
+    if (st->lines_len > CI_STORE_BATCH && ci_StoreAppend(st, NULL)) return -1;
+    e.hash = ci_Hash64(data, size, 0);
+    e.size = size;
+
+    // Manifest line
+    need = strlen(label) + 48;
+    if (st->lines_len + need > st->lines_max) {
+        st->lines_max = 2*st->lines_max + need;
+        st->lines = (char *) realloc(st->lines, st->lines_max);
+    }
+    st->lines_len += sprintf(st->lines + st->lines_len, "%016"PRIx64" %"PRIu64" %s\n", e.hash, e.size, label);
+
+    if (size && st->table_size) {
+        slot = ci_StoreFind(st, e.hash, e.size);
+        if (slot->size) {
+            st->blobs_dup++;
+            st->bytes_dup += size;
+            return 0;
+        }
+    }
+    if (!size) return 0;
+    // Make room; blob bigger than whole batch buffer is written directly
+    if (st->batch_len + size > CI_STORE_BATCH && st->pending_num && ci_StoreAppend(st, NULL)) return -1;
+    st->pending = (CI_store_entry *) realloc(st->pending, (st->pending_num+1)*sizeof(CI_store_entry));
+    e.offs = CI_STORE_PENDING | st->pending_num;
+    ci_StoreInsert(st, &e);
+    e.offs = (size > CI_STORE_BATCH ? CI_STORE_PENDING : st->batch_len);
+    st->pending[st->pending_num++] = e;
+    st->blobs_new++;
+    st->bytes_new += size;
+    if (size > CI_STORE_BATCH) return (ci_StoreAppend(st, data) ? -1 : 1);
+    memcpy(st->batch + st->batch_len, data, size);
+    st->batch_len += size;
+    return 1;
+}
+
+// Appends everything pending. Returns 0 if OK.
+int ci_StoreFlush(CI_store *st) {
+    if (!st->pending_num && !st->lines_len) return 0;
+    return ci_StoreAppend(st, NULL);
+}
+
+void ci_StoreClose(CI_store *st) {
+    if (st->pack >= 0 && st->index >= 0 && st->manifest >= 0) ci_StoreFlush(st);
+    if (st->pack >= 0) close(st->pack);
+    if (st->index >= 0) close(st->index);
+    if (st->manifest >= 0) close(st->manifest);
+    free(st->table);
+    free(st->batch);
+    free(st->pending);
+    free(st->lines);
+    free(st->dir);
+    st->pack = st->index = st->manifest = -1;
+    st->table = NULL;
+    st->batch = NULL;
+    st->pending = NULL;
+    st->lines = NULL;
+    st->dir = NULL;
+}
@@ -0,0 +1,74 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo content-addressed dump store (pack file + index).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_STORE_H_
+#define _CI_STORE_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define CI_STORE_PACK           "pack"          // all blobs, appended
+#define CI_STORE_INDEX          "index"         // CI_store_entry records
+#define CI_STORE_MANIFEST       "manifest"      // "hash size label" lines
+#define CI_STORE_BATCH          (8 << 20)       // bytes buffered before append
+
+// Index record of one stored blob
+typedef struct _CI_store_entry {
+    uint64_t    hash;
+    uint64_t    offs;           // offset in pack
+    uint64_t    size;
+} CI_store_entry;
+
+// Content-addressed store: every distinct blob is kept once in a single
+// pack file. New blobs are collected in memory and appended in batches.
+typedef struct _CI_store {
+    char            *dir;
+    int             pack;               // file descriptors
+    int             index;
+    int             manifest;
+    uint64_t        index_seen;         // bytes of index already loaded
+    // In-memory hash table of known blobs
+    CI_store_entry  *table;
+    uint32_t        table_size;         // power of 2
+    uint32_t        table_used;
+    // Pending (not yet appended) blobs, index entries and manifest lines
+    uint8_t         *batch;
+    size_t          batch_len;
+    CI_store_entry  *pending;
+    uint32_t        pending_num;
+    char            *lines;
+    size_t          lines_len;
+    size_t          lines_max;
+    // Statistics
+    uint64_t        blobs_new;
+    uint64_t        blobs_dup;
+    uint64_t        bytes_new;
+    uint64_t        bytes_dup;
+} CI_store;
+
+int ci_StoreOpen(CI_store *st, const char *dir);
+int ci_StorePut(CI_store *st, const void *data, size_t size, const char *label);
+int ci_StoreFlush(CI_store *st);
+void ci_StoreClose(CI_store *st);
+
+#endif
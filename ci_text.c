@@ -0,0 +1,519 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo inverted text index of names and comments.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef WIN32
+#define _GNU_SOURCE             // flock(), strdup() with -std=c99
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef WIN32
+#include <io.h>
+#define ci_TextLock(fd)
+#define ci_TextUnlock(fd)
+#else
+#include <unistd.h>
+#include <sys/file.h>
+// Indexing processes may share one index, files table lock serializes appends
+#define ci_TextLock(fd)         flock(fd, LOCK_EX)
+#define ci_TextUnlock(fd)       flock(fd, LOCK_UN)
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "ci_hash.h"
+#include "ci_text.h"
+
+#define CI_TEXT_MAGIC           0x58544943      // "CITX"
+#define CI_TEXT_SEED            0x74657874      // term hash seed
+
+// Writes whole buffer, returns 0 if OK.
+static int ci_TextWrite(int fd, const void *buf, size_t len) {
+    const uint8_t *p = (const uint8_t *) buf;
+    ssize_t n;
+    while (len) {
+        if ((n = write(fd, p, len)) <= 0) return -1;
+        p += n; len -= n;
+    }
+    return 0;
+}
+
+// Reads len bytes at offs, returns 0 if all of them were there.
+static int ci_TextReadAt(int fd, uint64_t offs, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *) buf;
+    ssize_t n;
+    if (lseek(fd, offs, SEEK_SET) != (off_t) offs) return -1;
+    while (len) {
+        if ((n = read(fd, p, len)) <= 0) return -1;
+        p += n; len -= n;
+    }
+    return 0;
+}
+
+static char *ci_TextPath(CI_text *t, const char *name) {
+    char *path = (char *) malloc(strlen(t->dir) + strlen(name) + 2);
+    sprintf(path, "%s/%s", t->dir, name);
+    return path;
+}
+
+static int ci_TextOpenFile(CI_text *t, const char *name, int flags) {
+    char *path = ci_TextPath(t, name);
+    int fd = open(path, flags | O_BINARY, 0644);
+    free(path);
+    return fd;
+}
+
+// Returns path table slot of given path, or free slot where it belongs.
+static uint32_t *ci_TextFind(CI_text *t, const char *path) {
+    uint32_t i = (uint32_t) ci_Hash64(path, strlen(path), 0) & (t->table_size-1);
+    while (t->table[i] && strcmp(t->file[t->table[i]-1].path, path))
+        i = (i+1) & (t->table_size-1);
+    return &t->table[i];
+}
+
+// Adds next id; the path now points at it. Takes ownership of path.
+static void ci_TextInsert(CI_text *t, uint64_t mtime, uint64_t size, char *path) {
+    uint32_t *slot;
+    if (t->files_num == t->files_max) {
+        t->files_max = (t->files_max ? 2*t->files_max : 1024);
+        t->file = (CI_text_file *) realloc(t->file, t->files_max*sizeof(CI_text_file));
+    }
+    t->file[t->files_num].mtime = mtime;
+    t->file[t->files_num].size = size;
+    t->file[t->files_num].path = path;
+    t->files_num++;
+    // Keep load factor under 1/2 (dead ids don't take slots)
+    if (2*t->files_num > t->table_size) {
+        uint32_t i;
+        free(t->table);
+        t->table_size = (t->table_size ? 2*t->table_size : 2048);
+        t->table = (uint32_t *) calloc(t->table_size, sizeof(uint32_t));
+        for (i=0; i < t->files_num; i++) *ci_TextFind(t, t->file[i].path) = i+1;
+    } else {
+        slot = ci_TextFind(t, path);
+        *slot = t->files_num;
+    }
+}
+
+// Id is live if it's the latest one of its path.
+static int ci_TextLive(CI_text *t, uint32_t id) {
+    return (id < t->files_num && *ci_TextFind(t, t->file[id].path) == id+1);
+}
+
+// Loads files table lines appended (also by other processes) since last
+// time. Incomplete last line is left for later.
+static void ci_TextRefresh(CI_text *t) {
+    struct stat sb;
+    char *buf, *p, *nl;
+    size_t len;
+    uint64_t mtime, size;
+    unsigned id;
+    int pos;
+    if (fstat(t->files, &sb) || (uint64_t) sb.st_size <= t->files_seen) return;
+    len = sb.st_size - t->files_seen;
+    buf = (char *) malloc(len+1);
+    if (ci_TextReadAt(t->files, t->files_seen, buf, len)) { free(buf); return; }
+    for (p = buf; (nl = (char *) memchr(p, '\n', buf + len - p)); p = nl+1) {
+        *nl = 0;
+        // Ids are line numbers, one in the line is informative only
+        if (sscanf(p, "%u %"SCNu64" %"SCNu64" %n", &id, &mtime, &size, &pos) < 3) {
+            mtime = size = 0;
+            pos = nl - p;
+        }
+        ci_TextInsert(t, mtime, size, strdup(p + pos));
+    }
+    t->files_seen += p - buf;
+    free(buf);
+}
+
+static int ci_TextWordByte(uint8_t c) {
+    return ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80);
+}
+
+// Splits UTF-8 text into words (runs of ASCII letters and digits and of
+// any non-ASCII characters) and returns their hashes. ASCII is lowercased,
+// the rest is expected to be case folded by caller.
+static uint32_t ci_TextTerms(const char *text, size_t len, uint64_t **hash) {
+    uint8_t term[CI_TEXT_TERM_MAX];
+    uint32_t num = 0, max = 0, n;
+    size_t i = 0;
+    *hash = NULL;
+    while (i < len) {
+        while (i < len && !ci_TextWordByte(text[i])) i++;
+        for (n=0; i < len && ci_TextWordByte(text[i]); i++) {
+            if (n < CI_TEXT_TERM_MAX) term[n++] = (text[i] >= 'A' && text[i] <= 'Z' ? text[i] + 32 : text[i]);
+        }
+        if (!n) continue;
+        if (num == max) {
+            max = (max ? 2*max : 16);
+            *hash = (uint64_t *) realloc(*hash, max*sizeof(uint64_t));
+        }
+        (*hash)[num++] = ci_Hash64(term, n, CI_TEXT_SEED);
+    }
+    return num;
+}
+
+static int ci_TextPostCmp(const void *a, const void *b) {
+    const CI_text_post *x = a, *y = b;
+    if (x->hash != y->hash) return (x->hash > y->hash ? 1 : -1);
+    if (x->file != y->file) return (x->file > y->file ? 1 : -1);
+    return (x->where > y->where) - (x->where < y->where);
+}
+
+static int ci_TextHitCmp(const void *a, const void *b) {
+    const CI_text_hit *x = a, *y = b;
+    if (x->file != y->file) return (x->file > y->file ? 1 : -1);
+    return (x->where > y->where) - (x->where < y->where);
+}
+
+// Builds segment of sorted postings (duplicates dropped), file ids moved
+// by base. Returns its size, *seg is malloc()ed.
+static size_t ci_TextBuild(const CI_text_post *post, uint32_t num, uint32_t base, uint8_t **seg) {
+    CI_text_seg *head;
+    CI_text_term *term;
+    CI_text_hit *hit;
+    uint32_t i, terms = 0, hits = 0;
+    for (i=0; i < num; i++) {
+        if (i && !ci_TextPostCmp(&post[i-1], &post[i])) continue;
+        if (!i || post[i-1].hash != post[i].hash) terms++;
+        hits++;
+    }
+    *seg = (uint8_t *) malloc(sizeof(CI_text_seg) + terms*sizeof(CI_text_term) + hits*sizeof(CI_text_hit));
+    head = (CI_text_seg *) *seg;
+    term = (CI_text_term *) (head+1);
+    hit = (CI_text_hit *) (term+terms);
+    head->magic = CI_TEXT_MAGIC;
+    head->terms = terms;
+    head->hits = hits;
+    head->reserved = 0;
+    for (i=0, terms=0, hits=0; i < num; i++) {
+        if (i && !ci_TextPostCmp(&post[i-1], &post[i])) continue;
+        if (!i || post[i-1].hash != post[i].hash) {
+            term[terms].hash = post[i].hash;
+            term[terms].first = hits;
+            term[terms++].num = 0;
+        }
+        term[terms-1].num++;
+        hit[hits].file = post[i].file + base;
+        hit[hits++].where = post[i].where;
+    }
+    return (uint8_t *) (hit+hits) - *seg;
+}
+
+// Opens index in given directory, creates it if asked to. Returns 0 if OK.
+int ci_TextOpen(CI_text *t, const char *dir, int create) {
+    memset(t, 0, sizeof(CI_text));
+    if (create) {
+#ifdef WIN32
+        mkdir(dir);
+#else
+        mkdir(dir, 0755);
+#endif
+    }
+    t->dir = strdup(dir);
+    t->files = ci_TextOpenFile(t, CI_TEXT_FILES, O_RDWR | (create ? O_CREAT : 0));
+    if (t->files < 0) {
+        ci_TextClose(t);
+        return -1;
+    }
+    ci_TextLock(t->files);
+    ci_TextRefresh(t);
+    ci_TextUnlock(t->files);
+    return 0;
+}
+
+// Returns 1 if the file was indexed with the same mtime and size, so it
+// can be skipped. Files without mtime are never fresh.
+int ci_TextFresh(CI_text *t, const char *path, uint64_t mtime, uint64_t size) {
+    uint32_t id;
+    if (!mtime || !t->table_size || !(id = *ci_TextFind(t, path))) return 0;
+    if (t->file[id-1].mtime != mtime || t->file[id-1].size != size) return 0;
+    t->files_fresh++;
+    return 1;
+}
+
+// Starts (re)indexing of a file, returns its handle for ci_TextAdd().
+// Appends what was collected so far if there's enough of it.
+uint32_t ci_TextBegin(CI_text *t, const char *path, uint64_t mtime, uint64_t size) {
+    char *p;
+    if (t->posts >= CI_TEXT_BATCH && ci_TextFlush(t)) t->error = 1;
+    if (t->pend_num == t->pend_max) {
+        t->pend_max = (t->pend_max ? 2*t->pend_max : 256);
+        t->pend = (CI_text_file *) realloc(t->pend, t->pend_max*sizeof(CI_text_file));
+    }
+    // Files table is line based
+    p = strdup(path);
+    if (strpbrk(p, "\r\n")) {
+        char *c;
+        for (c = p; *c; c++) if (*c == '\r' || *c == '\n') *c = '?';
+        mtime = 0;
+    }
+    t->pend[t->pend_num].mtime = mtime;
+    t->pend[t->pend_num].size = size;
+    t->pend[t->pend_num].path = p;
+    t->files_new++;
+    return t->pend_num++;
+}
+
+// Adds words of UTF-8 text found at 'where' of given file. Returns 0 if OK.
+int ci_TextAdd(CI_text *t, uint32_t file, uint32_t where, const char *text, size_t len) {
+    uint64_t *hash;
+    uint32_t i, num = ci_TextTerms(text, len, &hash);
+    if (t->posts + num > t->posts_max) {
+        t->posts_max = 2*t->posts_max + num + 1024;
+        t->post = (CI_text_post *) realloc(t->post, t->posts_max*sizeof(CI_text_post));
+    }
+    for (i=0; i < num; i++) {
+        t->post[t->posts].hash = hash[i];
+        t->post[t->posts].file = file;
+        t->post[t->posts++].where = where;
+    }
+    free(hash);
+    return 0;
+}
+
+// Appends pending files to files table and their postings as a new
+// segment, under files table lock. Returns 0 if OK.
+int ci_TextFlush(CI_text *t) {
+    uint8_t *seg = NULL;
+    char *lines;
+    size_t len = 0, seg_len = 0;
+    uint32_t i, base;
+    int fd, err = 0;
+
+    if (!t->pend_num) return t->error ? -1 : 0;
+    if (t->posts) qsort(t->post, t->posts, sizeof(CI_text_post), ci_TextPostCmp);
+    for (i=0; i < t->pend_num; i++) len += strlen(t->pend[i].path) + 64;
+    lines = (char *) malloc(len);
+
+    ci_TextLock(t->files);
+    ci_TextRefresh(t);
+    base = t->files_num;
+    for (i=0, len=0; i < t->pend_num; i++) {
+        len += sprintf(lines + len, "%u %"PRIu64" %"PRIu64" %s\n", base+i, t->pend[i].mtime, t->pend[i].size, t->pend[i].path);
+    }
+    if (t->posts) {
+        seg_len = ci_TextBuild(t->post, t->posts, base, &seg);
+        fd = ci_TextOpenFile(t, CI_TEXT_POSTINGS, O_WRONLY|O_CREAT|O_APPEND);
+        if (fd < 0 || ci_TextWrite(fd, seg, seg_len)) err = -1;
+        if (fd >= 0) close(fd);
+        t->hits_new += ((CI_text_seg *) seg)->hits;
+    }
+    // Files go in only with their postings
+    if (!err) {
+        lseek(t->files, 0, SEEK_END);
+        err = ci_TextWrite(t->files, lines, len);
+        ci_TextRefresh(t);
+    }
+    ci_TextUnlock(t->files);
+
+    for (i=0; i < t->pend_num; i++) free(t->pend[i].path);
+    free(lines);
+    free(seg);
+    t->pend_num = 0;
+    t->posts = 0;
+    if (err) t->error = 1;
+    return t->error ? -1 : 0;
+}
+
+// Merges all segments into one if there are at least min_segments of
+// them. Postings of dead ids and of files not there anymore are dropped.
+// Returns number of merged segments, -1 on error.
+int ci_TextMerge(CI_text *t, uint32_t min_segments) {
+    struct stat sb;
+    CI_text_seg *head;
+    CI_text_term *term;
+    CI_text_hit *hit;
+    CI_text_post *post = NULL;
+    uint8_t *buf = NULL, *seg = NULL, *alive = NULL;
+    uint64_t offs;
+    size_t len, seg_len;
+    uint32_t i, j, k, segs = 0, num = 0, max = 0;
+    char *path, *tmp;
+    int fd, ret = -1;
+
+    ci_TextLock(t->files);
+    ci_TextRefresh(t);
+    if ((fd = ci_TextOpenFile(t, CI_TEXT_POSTINGS, O_RDONLY)) < 0) { ret = 0; goto end; }
+    if (fstat(fd, &sb)) goto end;
+    len = sb.st_size;
+    buf = (uint8_t *) malloc(len+1);
+    if (ci_TextReadAt(fd, 0, buf, len)) goto end;
+    close(fd);
+    fd = -1;
+    for (offs = 0; offs + sizeof(CI_text_seg) <= len; segs++) {
+        head = (CI_text_seg *) (buf + offs);
+        if (head->magic != CI_TEXT_MAGIC) goto end;
+        offs += sizeof(CI_text_seg) + head->terms*(uint64_t) sizeof(CI_text_term) + head->hits*(uint64_t) sizeof(CI_text_hit);
+    }
+    if (offs != len) goto end;
+    if (segs < min_segments) { ret = 0; goto end; }
+
+    // 0 unknown, 1 alive, 2 dead
+    alive = (uint8_t *) calloc(t->files_num+1, 1);
+    for (offs = 0; offs < len; ) {
+        head = (CI_text_seg *) (buf + offs);
+        term = (CI_text_term *) (head+1);
+        hit = (CI_text_hit *) (term + head->terms);
+        for (i=0; i < head->terms; i++) {
+            if (term[i].first + (uint64_t) term[i].num > head->hits) goto end;
+            for (j=0; j < term[i].num; j++) {
+                k = hit[term[i].first + j].file;
+                if (k >= t->files_num) continue;
+                if (!alive[k]) {
+                    alive[k] = 2;
+                    if (ci_TextLive(t, k) && (!t->file[k].mtime || !stat(t->file[k].path, &sb))) alive[k] = 1;
+                }
+                if (alive[k] != 1) continue;
+                if (num == max) {
+                    max = 2*max + 4096;
+                    post = (CI_text_post *) realloc(post, max*sizeof(CI_text_post));
+                }
+                post[num].hash = term[i].hash;
+                post[num].file = k;
+                post[num++].where = hit[term[i].first + j].where;
+            }
+        }
+        offs += sizeof(CI_text_seg) + head->terms*sizeof(CI_text_term) + head->hits*sizeof(CI_text_hit);
+    }
+    if (num) qsort(post, num, sizeof(CI_text_post), ci_TextPostCmp);
+    seg_len = (num ? ci_TextBuild(post, num, 0, &seg) : 0);
+
+    // New file replaces the old one, readers keep what they have open
+    if ((fd = ci_TextOpenFile(t, CI_TEXT_POSTINGS ".tmp", O_WRONLY|O_CREAT|O_TRUNC)) < 0) goto end;
+    if (ci_TextWrite(fd, seg, seg_len)) goto end;
+    close(fd);
+    fd = -1;
+    tmp = ci_TextPath(t, CI_TEXT_POSTINGS ".tmp");
+    path = ci_TextPath(t, CI_TEXT_POSTINGS);
+#ifdef WIN32
+    remove(path);
+#endif
+    ret = (rename(tmp, path) ? -1 : (int) segs);
+    free(tmp);
+    free(path);
+end:
+    if (fd >= 0) close(fd);
+    ci_TextUnlock(t->files);
+    free(buf);
+    free(seg);
+    free(post);
+    free(alive);
+    return ret;
+}
+
+// Appends hits of given term in one segment to list.
+static int ci_TextLookup(int fd, uint64_t offs, const CI_text_seg *head, uint64_t hash, CI_text_hit **list, uint32_t *num) {
+    CI_text_term term;
+    uint32_t lo = 0, hi = head->terms, mid;
+    while (lo < hi) {
+        mid = lo + (hi-lo)/2;
+        if (ci_TextReadAt(fd, offs + sizeof(CI_text_seg) + mid*(uint64_t) sizeof(CI_text_term), &term, sizeof(term))) return -1;
+        if (term.hash == hash) {
+            if (term.first + (uint64_t) term.num > head->hits) return -1;
+            *list = (CI_text_hit *) realloc(*list, (*num + term.num + 1)*sizeof(CI_text_hit));
+            offs += sizeof(CI_text_seg) + head->terms*(uint64_t) sizeof(CI_text_term) + term.first*(uint64_t) sizeof(CI_text_hit);
+            if (ci_TextReadAt(fd, offs, *list + *num, term.num*sizeof(CI_text_hit))) return -1;
+            *num += term.num;
+            return 0;
+        }
+        if (term.hash < hash) lo = mid+1; else hi = mid;
+    }
+    return 0;
+}
+
+// Finds places (file and block) having all words of UTF-8 (case folded)
+// text, only latest ids of files count. *hits is malloc()ed, sorted by
+// file and where. Returns 0 if OK.
+int ci_TextQuery(CI_text *t, const char *text, size_t len, CI_text_hit **hits, uint32_t *num) {
+    CI_text_seg head;
+    CI_text_hit *list;
+    uint64_t *hash, offs;
+    uint32_t i, j, k, n, terms = ci_TextTerms(text, len, &hash);
+    int fd, err = 0;
+
+    *hits = NULL;
+    *num = 0;
+    ci_TextRefresh(t);
+    if (!terms || (fd = ci_TextOpenFile(t, CI_TEXT_POSTINGS, O_RDONLY)) < 0) { free(hash); return 0; }
+    for (i=0; i < terms && !err; i++) {
+        list = NULL;
+        n = 0;
+        for (offs = 0; !ci_TextReadAt(fd, offs, &head, sizeof(head)); ) {
+            if (head.magic != CI_TEXT_MAGIC) { err = -1; break; }
+            if ((err = ci_TextLookup(fd, offs, &head, hash[i], &list, &n))) break;
+            offs += sizeof(CI_text_seg) + head.terms*(uint64_t) sizeof(CI_text_term) + head.hits*(uint64_t) sizeof(CI_text_hit);
+        }
+        if (n) qsort(list, n, sizeof(CI_text_hit), ci_TextHitCmp);
+        if (!i) {
+            *hits = list;
+            *num = n;
+        } else {
+            // Intersection of two sorted lists, in place
+            for (j=0, k=0, len=0; j < *num && k < n; ) {
+                int c = ci_TextHitCmp(&(*hits)[j], &list[k]);
+                if (!c) (*hits)[len++] = (*hits)[j];
+                if (c <= 0) j++;
+                if (c >= 0) k++;
+            }
+            *num = len;
+            free(list);
+        }
+        if (!*num) break;
+    }
+    close(fd);
+    free(hash);
+    // Live ids only, each place once
+    for (j=0, len=0; j < *num; j++) {
+        if (len && !ci_TextHitCmp(&(*hits)[len-1], &(*hits)[j])) continue;
+        if (ci_TextLive(t, (*hits)[j].file)) (*hits)[len++] = (*hits)[j];
+    }
+    *num = len;
+    return err;
+}
+
+void ci_TextClose(CI_text *t) {
+    uint32_t i;
+    if (t->files >= 0 && t->pend_num) ci_TextFlush(t);
+    if (t->files >= 0) close(t->files);
+    for (i=0; i < t->files_num; i++) free(t->file[i].path);
+    for (i=0; i < t->pend_num; i++) free(t->pend[i].path);
+    free(t->file);
+    free(t->table);
+    free(t->pend);
+    free(t->post);
+    free(t->dir);
+    t->files = -1;
+    t->file = NULL;
+    t->table = NULL;
+    t->pend = NULL;
+    t->post = NULL;
+    t->dir = NULL;
+    t->files_num = t->pend_num = t->posts = 0;
+}
@@ -0,0 +1,120 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo inverted text index of names and comments.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_TEXT_H_
+#define _CI_TEXT_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define CI_TEXT_FILES           "files"         // "id mtime size path" lines, also index lock
+#define CI_TEXT_POSTINGS        "postings"      // segments, appended
+#define CI_TEXT_BATCH           (1 << 20)       // postings collected before segment is appended
+#define CI_TEXT_SEGMENTS        8               // more segments are merged into one
+#define CI_TEXT_TERM_MAX        64              // longer words are cut
+
+// What a posting points at: block and kind of text in it
+#define CI_TEXT_WHERE(block, kind)  ((uint32_t) (block) << 4 | (kind))
+#define CI_TEXT_BLOCK(where)        ((where) >> 4)
+#define CI_TEXT_KIND(where)         ((where) & 15)
+#define CI_TEXT_NO_BLOCK            0x0FFFFFFF  // file level (comments)
+
+enum {
+    CI_TEXT_COMMENT,
+    CI_TEXT_OBJECT,                             // 'oinf'
+    CI_TEXT_BACKGROUND,                         // 'bnam', 'bnwm'
+    CI_TEXT_PATH                                // 'path', 'pthw'
+};
+
+// Segment in postings file: header, terms sorted by hash, hits of each
+// term sorted by file and where
+typedef struct _CI_text_seg {
+    uint32_t    magic;
+    uint32_t    terms;
+    uint32_t    hits;
+    uint32_t    reserved;
+} CI_text_seg;
+
+typedef struct _CI_text_term {
+    uint64_t    hash;
+    uint32_t    first;                          // first hit of term in segment
+    uint32_t    num;
+} CI_text_term;
+
+typedef struct _CI_text_hit {
+    uint32_t    file;                           // id, line of files table
+    uint32_t    where;                          // CI_TEXT_WHERE()
+} CI_text_hit;
+
+// Posting not yet appended
+typedef struct _CI_text_post {
+    uint64_t    hash;
+    uint32_t    file;                           // pending file (until appended)
+    uint32_t    where;
+} CI_text_post;
+
+// File as indexed; mtime 0 if it can't be stat()ed (archive member, pipe)
+typedef struct _CI_text_file {
+    uint64_t    mtime;
+    uint64_t    size;
+    char        *path;
+} CI_text_file;
+
+// Text index: every indexing run of a file gets a new id, its postings go
+// to a new segment; older ids of the same path are dead and dropped by
+// merge, as are files no longer there. Appends of several processes are
+// serialized by lock of files table.
+typedef struct _CI_text {
+    char            *dir;
+    int             files;                      // file descriptor
+    uint64_t        files_seen;                 // bytes of files table loaded
+    CI_text_file    *file;                      // all ids
+    uint32_t        files_num;
+    uint32_t        files_max;
+    uint32_t        *table;                     // path -> latest id+1
+    uint32_t        table_size;                 // power of 2
+    // Pending (not yet appended) files and postings
+    CI_text_file    *pend;
+    uint32_t        pend_num;
+    uint32_t        pend_max;
+    CI_text_post    *post;
+    uint32_t        posts;
+    uint32_t        posts_max;
+    int             error;                      // append failed
+    // Statistics
+    uint64_t        files_new;
+    uint64_t        files_fresh;
+    uint64_t        hits_new;
+} CI_text;
+
+int ci_TextOpen(CI_text *t, const char *dir, int create);
+int ci_TextFresh(CI_text *t, const char *path, uint64_t mtime, uint64_t size);
+uint32_t ci_TextBegin(CI_text *t, const char *path, uint64_t mtime, uint64_t size);
+int ci_TextAdd(CI_text *t, uint32_t file, uint32_t where, const char *text, size_t len);
+int ci_TextFlush(CI_text *t);
+int ci_TextMerge(CI_text *t, uint32_t min_segments);
+int ci_TextQuery(CI_text *t, const char *text, size_t len, CI_text_hit **hits, uint32_t *num);
+void ci_TextClose(CI_text *t);
+
+#endif
@@ -0,0 +1,327 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo io_uring prefetch of many files.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef WIN32
+#define _GNU_SOURCE             // syscall(), struct statx with -std=c99
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ci_uring.h"
+
+#ifdef CI_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Probing many small files is bound by latency of open, stat and a few
+// small reads each. Here they are kept in flight for up to depth files
+// at once, in a single io_uring (raw syscalls, no liburing): open and
+// statx go together, head read when both are done, dependent reads (block
+// table, block heads) when head is there. Files are handed out in order
+// they were added; the parser reads them from the extents, anything it
+// needs beyond them by pread().
+
+#define CI_URING_OP_OPEN        0xFFFFFFFF      // user_data: slot << 32 | op,
+#define CI_URING_OP_STATX       0xFFFFFFFE      // ... or read's extent index
+
+typedef struct _CI_uring_slot {
+    CI_uring_file   f;
+    struct statx    stx;
+} CI_uring_slot;
+
+static struct {
+    int         fd;
+    uint32_t    *sq_head, *sq_tail, *sq_array, sq_mask, sq_entries;
+    uint32_t    *cq_head, *cq_tail, cq_mask, cq_entries;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    uint8_t     *sq_ring, *cq_ring;
+    size_t      sq_ring_sz, cq_ring_sz, sqes_sz;
+    uint32_t    queued;         // sqes not submitted yet
+    uint32_t    inflight;       // submitted or queued, not reaped
+    uint32_t    broken;         // io_uring_enter() failed
+} ci_ring;
+
+static CI_uring_slot *ci_uring_slot = NULL;
+static uint32_t ci_uring_depth;
+static uint32_t ci_uring_first;             // oldest file
+static uint32_t ci_uring_files;             // files added, not done
+static CI_uring_plan ci_uring_plan;
+
+// Sets up ring for depth files in flight. Returns 0 if OK, -1 if io_uring
+// isn't there (old kernel, seccomp).
+int ci_UringInit(uint32_t depth, CI_uring_plan plan) {
+    struct io_uring_params p;
+    uint32_t entries = 8;
+    int fd;
+    while (entries < 4*depth && entries < 4096) entries <<= 1;
+    memset(&p, 0, sizeof(p));
+    if ((fd = syscall(__NR_io_uring_setup, entries, &p)) < 0) return -1;
+    memset(&ci_ring, 0, sizeof(ci_ring));
+    ci_ring.fd = fd;
+    ci_ring.sq_ring_sz = p.sq_off.array + p.sq_entries*sizeof(uint32_t);
+    ci_ring.cq_ring_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ci_ring.cq_ring_sz > ci_ring.sq_ring_sz) ci_ring.sq_ring_sz = ci_ring.cq_ring_sz;
+        ci_ring.cq_ring_sz = ci_ring.sq_ring_sz;
+    }
+    ci_ring.sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+    ci_ring.sq_ring = mmap(NULL, ci_ring.sq_ring_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ci_ring.cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP ? ci_ring.sq_ring :
+        mmap(NULL, ci_ring.cq_ring_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING));
+    ci_ring.sqes = mmap(NULL, ci_ring.sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ci_ring.sq_ring == MAP_FAILED || ci_ring.cq_ring == MAP_FAILED || ci_ring.sqes == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    ci_ring.sq_head = (uint32_t *) (ci_ring.sq_ring + p.sq_off.head);
+    ci_ring.sq_tail = (uint32_t *) (ci_ring.sq_ring + p.sq_off.tail);
+    ci_ring.sq_array = (uint32_t *) (ci_ring.sq_ring + p.sq_off.array);
+    ci_ring.sq_mask = *(uint32_t *) (ci_ring.sq_ring + p.sq_off.ring_mask);
+    ci_ring.sq_entries = p.sq_entries;
+    ci_ring.cq_head = (uint32_t *) (ci_ring.cq_ring + p.cq_off.head);
+    ci_ring.cq_tail = (uint32_t *) (ci_ring.cq_ring + p.cq_off.tail);
+    ci_ring.cqes = (struct io_uring_cqe *) (ci_ring.cq_ring + p.cq_off.cqes);
+    ci_ring.cq_mask = *(uint32_t *) (ci_ring.cq_ring + p.cq_off.ring_mask);
+    ci_ring.cq_entries = p.cq_entries;
+
+    ci_uring_slot = (CI_uring_slot *) calloc(depth, sizeof(CI_uring_slot));
+    ci_uring_depth = depth;
+    ci_uring_first = ci_uring_files = 0;
+    ci_uring_plan = plan;
+    return 0;
+}
+
+// Submits queued sqes, waiting for wait completions.
+static void ci_RingEnter(uint32_t wait) {
+    int r;
+    if (ci_ring.broken || (!ci_ring.queued && !wait)) return;
+    r = syscall(__NR_io_uring_enter, ci_ring.fd, ci_ring.queued, wait, (wait ? IORING_ENTER_GETEVENTS : 0), NULL, 0);
+    if (r >= 0) ci_ring.queued -= r;
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) ci_ring.broken = 1;
+}
+
+// Next free sqe, zeroed, NULL if rings are full. Tail is only looked at
+// by kernel in io_uring_enter() (no SQPOLL), so it's moved right away.
+static struct io_uring_sqe *ci_RingSqe(uint64_t user_data) {
+    uint32_t tail = *ci_ring.sq_tail, idx = tail & ci_ring.sq_mask;
+    struct io_uring_sqe *sqe;
+    // Completions have to fit into cq
+    if (ci_ring.broken || ci_ring.inflight == ci_ring.cq_entries) return NULL;
+    if (tail - __atomic_load_n(ci_ring.sq_head, __ATOMIC_ACQUIRE) == ci_ring.sq_entries) {
+        ci_RingEnter(0);
+        if (tail - __atomic_load_n(ci_ring.sq_head, __ATOMIC_ACQUIRE) == ci_ring.sq_entries) return NULL;
+    }
+    sqe = &ci_ring.sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->user_data = user_data;
+    ci_ring.sq_array[idx] = idx;
+    __atomic_store_n(ci_ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ci_ring.queued++;
+    ci_ring.inflight++;
+    return sqe;
+}
+
+static int ci_UringExtentCmp(const void *a, const void *b) {
+    const CI_extent *x = a, *y = b;
+    return (x->offs > y->offs) - (x->offs < y->offs);
+}
+
+// All operations of slot s are done: plans next round of reads, or
+// makes file ready if there are none.
+static void ci_UringRound(CI_uring_slot *s) {
+    CI_uring_file *u = &s->f;
+    uint32_t exts = u->exts;
+    if (u->name && !u->err && u->regular) {
+        if (!u->round++) ci_UringRead(u, 0, CI_URING_HEAD);
+        else if (u->round <= CI_URING_ROUNDS) ci_uring_plan(u);
+    }
+    if (u->exts > exts) return;
+    if (u->exts) qsort(u->ext, u->exts, sizeof(CI_extent), ci_UringExtentCmp);
+    u->ready = 1;
+}
+
+// Takes completions off cq.
+static void ci_UringReap(void) {
+    uint32_t head = *ci_ring.cq_head, tail = __atomic_load_n(ci_ring.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &ci_ring.cqes[head & ci_ring.cq_mask];
+        CI_uring_slot *s = &ci_uring_slot[cqe->user_data >> 32];
+        uint32_t op = (uint32_t) cqe->user_data;
+        ci_ring.inflight--;
+        s->f.pending--;
+        if (op == CI_URING_OP_OPEN) {
+            if (cqe->res < 0) s->f.err = -cqe->res;
+            else s->f.fd = cqe->res;
+        } else if (op == CI_URING_OP_STATX) {
+            if (cqe->res < 0) s->f.err = -cqe->res;
+            else {
+                s->f.size = s->stx.stx_size;
+                s->f.regular = S_ISREG(s->stx.stx_mode);
+            }
+        } else {
+            // Failed or short reads are redone by pread() when parsed
+            s->f.ext[op].len = (cqe->res > 0 ? (uint32_t) cqe->res : 0);
+        }
+        if (!s->f.pending) ci_UringRound(s);
+    }
+    __atomic_store_n(ci_ring.cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Queues operations of files not submitted yet, oldest files first, as
+// far as rings take them.
+static void ci_UringPump(void) {
+    struct io_uring_sqe *sqe;
+    CI_uring_slot *s;
+    CI_uring_file *u;
+    uint32_t i, k;
+    for (i=0; i < ci_uring_files; i++) {
+        k = (ci_uring_first + i) % ci_uring_depth;
+        s = &ci_uring_slot[k];
+        u = &s->f;
+        if (u->ready) continue;
+        if (!u->issued) {
+            if (ci_ring.sq_entries - (*ci_ring.sq_tail - *ci_ring.sq_head) < 2 ||
+                ci_ring.cq_entries - ci_ring.inflight < 2) return;
+            sqe = ci_RingSqe((uint64_t) k << 32 | CI_URING_OP_OPEN);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) u->name;
+            sqe->open_flags = O_RDONLY;
+            sqe = ci_RingSqe((uint64_t) k << 32 | CI_URING_OP_STATX);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t) u->name;
+            sqe->len = STATX_TYPE | STATX_SIZE;
+            sqe->off = (uintptr_t) &s->stx;
+            u->issued = 1;
+            u->pending = 2;
+        }
+        for (; u->exts_issued < u->exts; u->exts_issued++) {
+            CI_extent *e = &u->ext[u->exts_issued];
+            if (!(sqe = ci_RingSqe((uint64_t) k << 32 | u->exts_issued))) return;
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = u->fd;
+            sqe->addr = (uintptr_t) e->data;
+            sqe->len = e->len;
+            sqe->off = e->offs;
+            u->pending++;
+        }
+    }
+}
+
+// Queues file name for prefetching; NULL: file is taken as it is (by
+// caller). At most depth files can be added before ci_UringDone().
+void ci_UringAdd(char *name) {
+    CI_uring_file *u = &ci_uring_slot[(ci_uring_first + ci_uring_files++) % ci_uring_depth].f;
+    memset(u, 0, sizeof(CI_uring_file));
+    u->name = name;
+    u->fd = -1;
+    u->ready = !name;
+}
+
+// Waits for oldest file added. Returns input with its reads, NULL if it
+// isn't prefetched (not a regular file, or open or stat failed): then
+// caller reads it the usual way, and so reports the error.
+CI_input *ci_UringNext(void) {
+    CI_uring_file *u = &ci_uring_slot[ci_uring_first].f;
+    ci_UringPump();
+    while (!u->ready && !ci_ring.broken) {
+        ci_RingEnter(1);
+        ci_UringReap();
+        ci_UringPump();
+    }
+    // Get reads of following files going while this one is parsed
+    ci_RingEnter(0);
+    if (!u->ready || !u->name || u->err || !u->regular) return NULL;
+    ci_InputOpen(&u->in, NULL, CI_INPUT_RAW, UINT64_MAX, u->size);
+    u->in.fd = u->fd;
+    u->in.ext = u->ext;
+    u->in.exts = u->exts;
+    return &u->in;
+}
+
+// Oldest file is processed: releases it.
+void ci_UringDone(void) {
+    CI_uring_file *u = &ci_uring_slot[ci_uring_first].f;
+    uint32_t i;
+    ci_InputClose(&u->in);
+    if (u->fd >= 0) close(u->fd);
+    // Buffers of a broken ring may still be written to
+    if (!u->pending) {
+        for (i=0; i < u->exts; i++) free(u->ext[i].data);
+        free(u->ext);
+    }
+    ci_uring_first = (ci_uring_first + 1) % ci_uring_depth;
+    ci_uring_files--;
+}
+
+void ci_UringEnd(void) {
+    if (!ci_uring_slot) return;
+    while (ci_uring_files) {
+        if (ci_uring_slot[ci_uring_first].f.pending) ci_UringNext();
+        ci_UringDone();
+    }
+    munmap(ci_ring.sqes, ci_ring.sqes_sz);
+    if (ci_ring.cq_ring != ci_ring.sq_ring) munmap(ci_ring.cq_ring, ci_ring.cq_ring_sz);
+    munmap(ci_ring.sq_ring, ci_ring.sq_ring_sz);
+    close(ci_ring.fd);
+    free(ci_uring_slot);
+    ci_uring_slot = NULL;
+}
+
+// Bytes at offs of file u, if a done read has them all, else NULL.
+const uint8_t *ci_UringData(const CI_uring_file *u, uint64_t offs, uint32_t len) {
+    uint32_t i;
+    for (i=0; i < u->exts; i++) {
+        const CI_extent *e = &u->ext[i];
+        if (e->offs <= offs && offs - e->offs <= e->len && len <= e->len - (offs - e->offs))
+            return e->data + (offs - e->offs);
+    }
+    return NULL;
+}
+
+// Asks for len bytes at offs of file u (as far as it's long) to be read
+// in next round, unless they are read already.
+void ci_UringRead(CI_uring_file *u, uint64_t offs, uint32_t len) {
+    CI_extent *e;
+    if (offs >= u->size || u->exts == CI_URING_READS) return;
+    if (len > u->size - offs) len = u->size - offs;
+    if (ci_UringData(u, offs, len)) return;
+    if (u->exts == u->exts_size) {
+        u->exts_size = 2*u->exts_size + 8;
+        u->ext = (CI_extent *) realloc(u->ext, u->exts_size*sizeof(CI_extent));
+    }
+    e = &u->ext[u->exts++];
+    e->offs = offs;
+    e->len = len;
+    e->data = (uint8_t *) malloc(len);
+}
+
+#endif
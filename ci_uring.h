@@ -0,0 +1,73 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo io_uring prefetch of many files.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#ifndef _CI_URING_H_
+#define _CI_URING_H_
+
+#include <inttypes.h>
+
+#include "ci_io.h"
+
+#ifdef __linux__
+#define CI_URING                // files prefetched through io_uring (--uring)
+#endif
+
+#define CI_URING_DEPTH          64              // files in flight by default
+#define CI_URING_HEAD           (64 << 10)      // file head read at once
+#define CI_URING_BLOCK          4096            // ... and head of each block
+#define CI_URING_READS          1024            // reads per file at most
+#define CI_URING_ROUNDS         4               // rounds of dependent reads
+
+// File prefetched by ci_Uring*(): opened and stat'ed, then its head read,
+// then further reads in rounds, each planned when the previous one is
+// done (see CI_uring_plan). Reads end up as extents of in.
+typedef struct _CI_uring_file {
+    char        *name;          // NULL: not to be prefetched
+    int         fd;
+    int         err;            // errno of failed open or stat
+    uint32_t    regular;        // is a regular file
+    uint64_t    size;
+    uint32_t    pending;        // operations in flight
+    uint32_t    issued;         // open and stat submitted
+    uint32_t    round;          // rounds of reads done
+    uint32_t    ready;
+    CI_extent   *ext;           // reads, sorted by offs when ready
+    uint32_t    exts;
+    uint32_t    exts_size;
+    uint32_t    exts_issued;    // ... submitted
+    CI_input    in;
+} CI_uring_file;
+
+// Called when all reads of a file are done, asks for next ones (using
+// ci_UringData() and ci_UringRead()). None: file is ready.
+typedef void (*CI_uring_plan)(CI_uring_file *u);
+
+int ci_UringInit(uint32_t depth, CI_uring_plan plan);
+void ci_UringAdd(char *name);
+CI_input *ci_UringNext(void);
+void ci_UringDone(void);
+void ci_UringEnd(void);
+const uint8_t *ci_UringData(const CI_uring_file *u, uint64_t offs, uint32_t len);
+void ci_UringRead(CI_uring_file *u, uint64_t offs, uint32_t len);
+
+#endif
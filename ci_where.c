@@ -0,0 +1,384 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo --where filter expressions.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ci_where.h"
+
+// Expression is like: model == CMYK32 && dpi > 300 && icc
+//                     count(object && bpp == 32) > 50 || has(oinf)
+// Operators: || or, && and, ! not, == (=) != < <= > >=, ( ).
+// Bare value is true if non-zero; has(xxxx) outside any() is any(has(xxxx)),
+// objects is count(object).
+
+#define CI_WHERE_DEPTH          64              // max nesting of ( and functions
+
+enum {
+    CI_WOP_NUM,
+    CI_WOP_FILE,                                // file field
+    CI_WOP_BLOCK,                               // block field
+    CI_WOP_HAS,                                 // block has chunk
+    CI_WOP_COUNT,                               // blocks counted by aggregate
+    CI_WOP_NOT,
+    CI_WOP_AND,
+    CI_WOP_OR,
+    CI_WOP_EQ,
+    CI_WOP_NE,
+    CI_WOP_LT,
+    CI_WOP_LE,
+    CI_WOP_GT,
+    CI_WOP_GE
+};
+
+typedef struct _CI_where_name {
+    const char  *name;
+    int64_t     value;
+} CI_where_name;
+
+static const CI_where_name ci_where_file_field[] = {
+    { "version", CI_WF_VERSION }, { "model", CI_WF_MODEL }, { "xdpi", CI_WF_XDPI },
+    { "ydpi", CI_WF_YDPI }, { "dpi", CI_WF_DPI }, { "icc", CI_WF_ICC },
+    { "wcomment", CI_WF_WCOMMENT }, { "flags", CI_WF_FLAGS }, { "palette", CI_WF_PALETTE },
+    { "blocks", CI_WF_BLOCKS }, { NULL, 0 }
+};
+
+static const CI_where_name ci_where_block_field[] = {
+    { "width", CI_WB_WIDTH }, { "height", CI_WB_HEIGHT }, { "bpp", CI_WB_BPP },
+    { "tile_w", CI_WB_TILE_W }, { "tile_h", CI_WB_TILE_H }, { "object", CI_WB_OBJECT },
+    { "chunks", CI_WB_CHUNKS }, { NULL, 0 }
+};
+
+// Color models (CPT_ColorModels of cpt.h), named as in -s output
+static const CI_where_name ci_where_const[] = {
+    { "RGB24", 0x01 }, { "CMYK32", 0x03 }, { "GRAY8", 0x05 }, { "BW1", 0x06 },
+    { "PAL8", 0x0A }, { "LAB24", 0x0B }, { "RGB48", 0x0C }, { "GRAY16", 0x0E },
+    { NULL, 0 }
+};
+
+typedef struct _CI_where_parser {
+    CI_where    *w;
+    const char  *p;
+    int         block;                          // inside any()/count()
+    int         depth;
+    int         err;
+    const char  *err_at;
+} CI_where_parser;
+
+static int ci_WhereFind(const CI_where_name *t, const char *name, size_t len, int64_t *value) {
+    for (; t->name; t++)
+        if (strlen(t->name) == len && !strncmp(t->name, name, len)) { *value = t->value; return 1; }
+    return 0;
+}
+
+static void ci_WhereError(CI_where_parser *ps, int err, const char *at) {
+    if (ps->err) return;
+    ps->err = err;
+    ps->err_at = at;
+}
+
+static uint32_t ci_WhereNode(CI_where_parser *ps, int op, uint32_t a, uint32_t b, int64_t value) {
+    CI_where_node *n;
+    if (ps->w->nodes == CI_WHERE_NODES) {
+        ci_WhereError(ps, CI_WHERE_ERR_FULL, ps->p);
+        return 0;
+    }
+    n = &ps->w->node[ps->w->nodes];
+    n->op = op;
+    n->field = 0;
+    n->a = a;
+    n->b = b;
+    n->value = value;
+    return ps->w->nodes++;
+}
+
+// New aggregate counting blocks matching node a; returns count(a) > 0
+// if any, else count(a).
+static uint32_t ci_WhereAgg(CI_where_parser *ps, uint32_t a, int any) {
+    uint32_t n;
+    if (ps->w->aggs == CI_WHERE_AGGS) {
+        ci_WhereError(ps, CI_WHERE_ERR_FULL, ps->p);
+        return 0;
+    }
+    ps->w->agg[ps->w->aggs] = a;
+    n = ci_WhereNode(ps, CI_WOP_COUNT, 0, 0, ps->w->aggs++);
+    if (any) n = ci_WhereNode(ps, CI_WOP_GT, n, ci_WhereNode(ps, CI_WOP_NUM, 0, 0, 0), 0);
+    return n;
+}
+
+static void ci_WhereSpace(CI_where_parser *ps) {
+    while (isspace((unsigned char) *ps->p)) ps->p++;
+}
+
+// Is next token given word (not just its prefix)?
+static int ci_WhereWord(CI_where_parser *ps, const char *word) {
+    size_t len = strlen(word);
+    ci_WhereSpace(ps);
+    if (strncmp(ps->p, word, len) || isalnum((unsigned char) ps->p[len]) || ps->p[len] == '_') return 0;
+    ps->p += len;
+    return 1;
+}
+
+static int ci_WhereSym(CI_where_parser *ps, const char *sym) {
+    size_t len = strlen(sym);
+    ci_WhereSpace(ps);
+    if (strncmp(ps->p, sym, len)) return 0;
+    ps->p += len;
+    return 1;
+}
+
+static uint32_t ci_WhereOr(CI_where_parser *ps);
+
+static uint32_t ci_WherePrimary(CI_where_parser *ps) {
+    const char *name;
+    size_t len;
+    int64_t value;
+    uint32_t n;
+    char *end;
+
+    ci_WhereSpace(ps);
+    name = ps->p;
+    if (ps->err) return 0;
+    if (ps->depth == CI_WHERE_DEPTH) {
+        ci_WhereError(ps, CI_WHERE_ERR_FULL, name);
+        return 0;
+    }
+    if (isdigit((unsigned char) *name) || (*name == '-' && isdigit((unsigned char) name[1]))) {
+        value = strtoll(name, &end, (!strncmp(name, "0x", 2) || !strncmp(name, "0X", 2) ? 16 : 10));
+        ps->p = end;
+        return ci_WhereNode(ps, CI_WOP_NUM, 0, 0, value);
+    }
+    if (ci_WhereSym(ps, "(")) {
+        ps->depth++;
+        n = ci_WhereOr(ps);
+        ps->depth--;
+        if (!ci_WhereSym(ps, ")")) ci_WhereError(ps, CI_WHERE_ERR_SYNTAX, ps->p);
+        return n;
+    }
+    while (isalnum((unsigned char) *ps->p) || *ps->p == '_') ps->p++;
+    len = ps->p - name;
+    if (!len) {
+        ci_WhereError(ps, CI_WHERE_ERR_SYNTAX, name);
+        return 0;
+    }
+
+    // Functions
+    if (ci_WhereSym(ps, "(")) {
+        if (len == 3 && !strncmp(name, "has", 3)) {
+            const char *id;
+            ci_WhereSpace(ps);
+            id = ps->p;
+            while (isalnum((unsigned char) *ps->p)) ps->p++;
+            if (ps->p - id != 4 || !ci_WhereSym(ps, ")")) {
+                ci_WhereError(ps, CI_WHERE_ERR_SYNTAX, id);
+                return 0;
+            }
+            ps->w->chunks = 1;
+            value = ((uint32_t) (uint8_t) id[0] << 24) | ((uint32_t) (uint8_t) id[1] << 16) |
+                    ((uint32_t) (uint8_t) id[2] << 8) | (uint8_t) id[3];
+            n = ci_WhereNode(ps, CI_WOP_HAS, 0, 0, value);
+            return (ps->block ? n : ci_WhereAgg(ps, n, 1));
+        }
+        if ((len == 3 && !strncmp(name, "any", 3)) || (len == 5 && !strncmp(name, "count", 5))) {
+            if (ps->block) {
+                ci_WhereError(ps, CI_WHERE_ERR_SCOPE, name);
+                return 0;
+            }
+            ps->block = 1;
+            ps->depth++;
+            n = ci_WhereOr(ps);
+            ps->depth--;
+            ps->block = 0;
+            if (!ci_WhereSym(ps, ")")) ci_WhereError(ps, CI_WHERE_ERR_SYNTAX, ps->p);
+            return ci_WhereAgg(ps, n, len == 3);
+        }
+        ci_WhereError(ps, CI_WHERE_ERR_NAME, name);
+        return 0;
+    }
+
+    // Fields and constants
+    if (ci_WhereFind(ci_where_const, name, len, &value))
+        return ci_WhereNode(ps, CI_WOP_NUM, 0, 0, value);
+    if (ci_WhereFind(ci_where_file_field, name, len, &value)) {
+        if (ps->block) ci_WhereError(ps, CI_WHERE_ERR_SCOPE, name);
+        n = ci_WhereNode(ps, CI_WOP_FILE, 0, 0, 0);
+        ps->w->node[n].field = value;
+        return n;
+    }
+    if (ci_WhereFind(ci_where_block_field, name, len, &value)) {
+        if (!ps->block) ci_WhereError(ps, CI_WHERE_ERR_SCOPE, name);
+        if (value == CI_WB_CHUNKS) ps->w->chunks = 1;
+        n = ci_WhereNode(ps, CI_WOP_BLOCK, 0, 0, 0);
+        ps->w->node[n].field = value;
+        return n;
+    }
+    if (!ps->block && len == 7 && !strncmp(name, "objects", 7)) {
+        n = ci_WhereNode(ps, CI_WOP_BLOCK, 0, 0, 0);
+        ps->w->node[n].field = CI_WB_OBJECT;
+        return ci_WhereAgg(ps, n, 0);
+    }
+    ci_WhereError(ps, CI_WHERE_ERR_NAME, name);
+    return 0;
+}
+
+static uint32_t ci_WhereCmp(CI_where_parser *ps) {
+    static const struct { const char *sym; int op; } cmp[] = {
+        { "==", CI_WOP_EQ }, { "!=", CI_WOP_NE }, { "<=", CI_WOP_LE }, { ">=", CI_WOP_GE },
+        { "<", CI_WOP_LT }, { ">", CI_WOP_GT }, { "=", CI_WOP_EQ }
+    };
+    uint32_t a = ci_WherePrimary(ps), i;
+    for (i=0; i < sizeof(cmp)/sizeof(cmp[0]); i++)
+        if (ci_WhereSym(ps, cmp[i].sym)) return ci_WhereNode(ps, cmp[i].op, a, ci_WherePrimary(ps), 0);
+    return a;
+}
+
+static uint32_t ci_WhereNot(CI_where_parser *ps) {
+    uint32_t a;
+    ci_WhereSpace(ps);
+    if (ps->p[0] == '!' && ps->p[1] != '=') ps->p++;
+    else if (!ci_WhereWord(ps, "not")) return ci_WhereCmp(ps);
+    if (ps->depth == CI_WHERE_DEPTH) {
+        ci_WhereError(ps, CI_WHERE_ERR_FULL, ps->p);
+        return 0;
+    }
+    ps->depth++;
+    a = ci_WhereNot(ps);
+    ps->depth--;
+    return ci_WhereNode(ps, CI_WOP_NOT, a, 0, 0);
+}
+
+static uint32_t ci_WhereAnd(CI_where_parser *ps) {
+    uint32_t a = ci_WhereNot(ps);
+    while (!ps->err && (ci_WhereSym(ps, "&&") || ci_WhereWord(ps, "and")))
+        a = ci_WhereNode(ps, CI_WOP_AND, a, ci_WhereNot(ps), 0);
+    return a;
+}
+
+static uint32_t ci_WhereOr(CI_where_parser *ps) {
+    uint32_t a = ci_WhereAnd(ps);
+    while (!ps->err && (ci_WhereSym(ps, "||") || ci_WhereWord(ps, "or")))
+        a = ci_WhereNode(ps, CI_WOP_OR, a, ci_WhereAnd(ps), 0);
+    return a;
+}
+
+// Compiles expr into w. Returns 0, or CI_WHERE_ERR_* with *err_at set
+// to where in expr it went wrong.
+int ci_WhereCompile(CI_where *w, const char *expr, const char **err_at) {
+    CI_where_parser ps;
+    memset(w, 0, sizeof(CI_where));
+    memset(&ps, 0, sizeof(ps));
+    ps.w = w;
+    ps.p = expr;
+    w->root = ci_WhereOr(&ps);
+    ci_WhereSpace(&ps);
+    if (!ps.err && *ps.p) ci_WhereError(&ps, CI_WHERE_ERR_SYNTAX, ps.p);
+    if (ps.err && err_at) *err_at = ps.err_at;
+    return ps.err;
+}
+
+// Truth of value range lo..hi: 1 or 0 if all of it agrees, -1 if not.
+static int ci_WhereTruth(int64_t lo, int64_t hi) {
+    if (lo > 0 || hi < 0) return 1;
+    if (!lo && !hi) return 0;
+    return -1;
+}
+
+// Range lo..hi the value of node n is known to be in; lo == hi once it
+// is known. Counts may grow by blocks left not counted yet (all of them
+// if count is NULL). Block nodes are evaluated with b only.
+static void ci_WhereVal(const CI_where *w, uint32_t n, const CI_where_file *f, const CI_where_block *b,
+                        const uint64_t *count, uint64_t left, int64_t *lo, int64_t *hi) {
+    const CI_where_node *nd = &w->node[n];
+    int64_t xl, xh, yl, yh;
+    int tx, ty;
+    switch (nd->op) {
+        case CI_WOP_NUM: *lo = *hi = nd->value; return;
+        case CI_WOP_FILE: *lo = *hi = f->v[nd->field]; return;
+        case CI_WOP_BLOCK: *lo = *hi = b->v[nd->field]; return;
+        case CI_WOP_HAS: *lo = *hi = b->has(b->ctx, (uint32_t) nd->value); return;
+        case CI_WOP_COUNT:
+            *lo = (count ? (int64_t) count[nd->value] : 0);
+            *hi = (count && left < (uint64_t) (INT64_MAX - *lo) ? *lo + (int64_t) left : INT64_MAX);
+            return;
+        case CI_WOP_NOT:
+            ci_WhereVal(w, nd->a, f, b, count, left, &xl, &xh);
+            tx = ci_WhereTruth(xl, xh);
+            *lo = (tx < 0 ? 0 : !tx);
+            *hi = (tx < 0 ? 1 : !tx);
+            return;
+        // Kleene logic: false && unknown is false, true || unknown is true
+        case CI_WOP_AND:
+        case CI_WOP_OR:
+            ci_WhereVal(w, nd->a, f, b, count, left, &xl, &xh);
+            tx = ci_WhereTruth(xl, xh);
+            if (tx == (nd->op == CI_WOP_OR)) { *lo = *hi = tx; return; }
+            ci_WhereVal(w, nd->b, f, b, count, left, &yl, &yh);
+            ty = ci_WhereTruth(yl, yh);
+            if (ty == (nd->op == CI_WOP_OR)) { *lo = *hi = ty; return; }
+            *lo = (tx < 0 || ty < 0 ? 0 : (nd->op == CI_WOP_AND));
+            *hi = (tx < 0 || ty < 0 ? 1 : (nd->op == CI_WOP_AND));
+            return;
+    }
+    ci_WhereVal(w, nd->a, f, b, count, left, &xl, &xh);
+    ci_WhereVal(w, nd->b, f, b, count, left, &yl, &yh);
+    // Comparison is 1 if it holds for all values of ranges, 0 if for none
+    *lo = 0;
+    *hi = 1;
+    switch (nd->op) {
+        case CI_WOP_EQ:
+        case CI_WOP_NE:
+            if (xl == xh && yl == yh && xl == yl) *lo = *hi = 1;
+            else if (xh < yl || yh < xl) *lo = *hi = 0;
+            else return;
+            if (nd->op == CI_WOP_NE) *lo = *hi = !*lo;
+            return;
+        case CI_WOP_LT: if (xh < yl) *lo = 1; else if (xl >= yh) *hi = 0; return;
+        case CI_WOP_LE: if (xh <= yl) *lo = 1; else if (xl > yh) *hi = 0; return;
+        case CI_WOP_GT: if (xl > yh) *lo = 1; else if (xh <= yl) *hi = 0; return;
+        case CI_WOP_GE: if (xl >= yh) *lo = 1; else if (xh < yl) *hi = 0; return;
+    }
+    *lo = *hi = 0;
+}
+
+// Does block b match aggregate agg (so it's counted)?
+int ci_WhereBlock(const CI_where *w, uint32_t agg, const CI_where_block *b) {
+    int64_t lo, hi;
+    ci_WhereVal(w, w->agg[agg], NULL, b, NULL, 0, &lo, &hi);
+    return lo != 0;
+}
+
+// Evaluates expression for file f; count are blocks counted so far for
+// each aggregate, NULL if blocks weren't processed yet, and left is how
+// many blocks may still be counted. Returns CI_WHERE_TRUE, CI_WHERE_FALSE,
+// or CI_WHERE_UNKNOWN if it depends on blocks left.
+int ci_WhereEval(const CI_where *w, const CI_where_file *f, const uint64_t *count, uint64_t left) {
+    int64_t lo, hi;
+    ci_WhereVal(w, w->root, f, NULL, count, left, &lo, &hi);
+    switch (ci_WhereTruth(lo, hi)) {
+        case 1: return CI_WHERE_TRUE;
+        case 0: return CI_WHERE_FALSE;
+    }
+    return CI_WHERE_UNKNOWN;
+}
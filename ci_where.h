@@ -0,0 +1,103 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo --where filter expressions.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+
+#ifndef _CI_WHERE_H_
+#define _CI_WHERE_H_
+
+#include <inttypes.h>
+
+#define CI_WHERE_NODES          256             // max nodes of compiled expression
+#define CI_WHERE_AGGS           16              // max any()/count() per expression
+
+#define CI_WHERE_FALSE          0
+#define CI_WHERE_TRUE           1
+#define CI_WHERE_UNKNOWN        -1              // depends on blocks not seen yet
+
+#define CI_WHERE_ERR_SYNTAX     -1
+#define CI_WHERE_ERR_NAME       -2              // unknown field, constant or function
+#define CI_WHERE_ERR_SCOPE      -3              // block field outside any()/count() or nested
+#define CI_WHERE_ERR_FULL       -4              // expression too long
+
+// File fields, known once file header is read
+enum {
+    CI_WF_VERSION,                              // 0x700, 0x701, 0x800, 0x900
+    CI_WF_MODEL,                                // color model
+    CI_WF_XDPI,
+    CI_WF_YDPI,
+    CI_WF_DPI,                                  // smaller of both
+    CI_WF_ICC,                                  // embedded ICC profile
+    CI_WF_WCOMMENT,                             // embedded wide comment
+    CI_WF_FLAGS,
+    CI_WF_PALETTE,                              // palette entries
+    CI_WF_BLOCKS,
+    CI_WF_NUM
+};
+
+// Block fields, only inside any() and count()
+enum {
+    CI_WB_WIDTH,
+    CI_WB_HEIGHT,
+    CI_WB_BPP,
+    CI_WB_TILE_W,
+    CI_WB_TILE_H,
+    CI_WB_OBJECT,                               // object block
+    CI_WB_CHUNKS,                               // number of chunks
+    CI_WB_NUM
+};
+
+typedef struct _CI_where_file {
+    int64_t     v[CI_WF_NUM];
+} CI_where_file;
+
+// Block values; has() asks if block has chunk of given id
+typedef struct _CI_where_block {
+    int64_t     v[CI_WB_NUM];
+    int         (*has)(const void *ctx, uint32_t id);
+    const void  *ctx;
+} CI_where_block;
+
+typedef struct _CI_where_node {
+    uint8_t     op;
+    uint8_t     field;
+    uint16_t    a;                              // operands
+    uint16_t    b;
+    int64_t     value;                          // number, chunk id or aggregate
+} CI_where_node;
+
+// Compiled expression. Each any()/count() is an aggregate: a block
+// expression whose matching blocks are counted by caller (per file).
+typedef struct _CI_where {
+    CI_where_node   node[CI_WHERE_NODES];
+    uint32_t        nodes;
+    uint32_t        root;
+    uint32_t        aggs;
+    uint32_t        agg[CI_WHERE_AGGS];         // root node of each aggregate
+    uint32_t        chunks;                     // has() or chunks used, chunks needed
+} CI_where;
+
+int ci_WhereCompile(CI_where *w, const char *expr, const char **err_at);
+int ci_WhereBlock(const CI_where *w, uint32_t agg, const CI_where_block *b);
+int ci_WhereEval(const CI_where *w, const CI_where_file *f, const uint64_t *count, uint64_t left);
+
+#endif
@@ -54,11 +54,7 @@
 #define CPT_ICC_EMBEDDED        0xFFFFFFFF      // type val if ICC embedded as file
 #define CPT_ICC_INTERNAL_NUM    8               // how many internal types of ICC
 
-// Corel PHOTO-PAINT 9.0+ constants
-#define CPT9_CHUNK_NUM          50              // CPT9 known chunk types number
-
-#define CPT9_OINF_NAME_LEN_A     112             // Object info ansi name bytes
-#define CPT9_OINF_NAME_LEN_W     128             // Object info wide name bytes
+// Corel PHOTO-PAINT 9.0+ chunk types and their layouts: see ci_chunk.h
 
 typedef uint16_t CPT_wchar;      // UCS-2 encoded character
 
@@ -170,39 +166,6 @@ typedef struct _CPT9_Block {
     uint32_t    unk03[5];       // 0x028 [5] always 0
 } CPT9_Block;
 
-// ---- Chunks ----
-
-typedef struct _CPT9_CGrid {
-    uint32_t    unk00[2];
-    double      xdensity;
-    double      ydensity;
-    uint32_t    xunit;
-    uint32_t    yunit;
-    uint32_t    unk01[8];
-} CPT9_CGrid;
-
-typedef struct _CPT9_CPath {
-    uint32_t    unk00;
-    uint32_t    unk01;
-    uint32_t    unk02;
-    uint32_t    unk03;
-    uint32_t    unk04;
-    char        *name;
-} CPT9_CPath;
-
-typedef struct _CPT9_CPthw {
-    char        *name;
-} CPT9_CPthw;
-
-typedef struct _CPT9_COinf {
-    uint32_t    unk00[6];
-    uint32_t    unk01[6];
-    uint32_t    unk02[7];
-    char        name_a[CPT9_OINF_NAME_LEN_A];
-    char        name_w[CPT9_OINF_NAME_LEN_W];
-} CPT9_COinf;
-
-
 // CPT version structure
 typedef struct _CPT_Version {
     const char *magic;                  // buffer
@@ -210,13 +173,6 @@ typedef struct _CPT_Version {
     uint32_t    version;                // assigned version
 } CPT_Version;
 
-// CPT9 CPTInfo chunk structure
-typedef struct _CPT9_ChunkName {
-    uint32_t    id;                     // 32-bit identifier
-    uint8_t     flags;                  // CPT9_CHUNK_FLAGS
-} CPT9_ChunkName;
-
-
 // ---------- Constant values ----------
 
 // used in DPI calculations [FIXME - which one is correct?]
@@ -261,69 +217,6 @@ const double cpt9_grid_table[] = {
     1.0/(0.37591999999999998*10000) // ?? didot
 };
 
-#define CPT9_CHUNK_GRID 0x67726964
-#define CPT9_CHUNK_BNAM 0x626e616d
-#define CPT9_CHUNK_BNWM 0x626e776d
-#define CPT9_CHUNK_PATH 0x70617468
-#define CPT9_CHUNK_PTHW 0x70746877
-#define CPT9_CHUNK_OINF 0x6f696e66
-
-// CPT9 CPTInfo known chunk list
-const CPT9_ChunkName cpt9_chunk_name[CPT9_CHUNK_NUM] = {  
-    { 0x61657874, 0x02 }, // "aext"
-    { 0x616e6177, 0x02 }, // "anaw"
-    { 0x616e616d, 0x02 }, // "anam"
-    { 0x616f7672, 0x02 }, // "aovr"
-    { CPT9_CHUNK_BNAM, 0x02 }, // "bnam"
-    { CPT9_CHUNK_BNWM, 0x02 }, // "bnwm"
-    { 0x636c7061, 0x02 }, // "clpa"
-    { 0x646f6373, 0x02 }, // "docs"
-    { 0x64756f74, 0x02 }, // "duot"
-    { CPT9_CHUNK_GRID, 0x02 }, // "grid"
-    { 0x67756964, 0x02 }, // "guid"
-    { 0x69736772, 0x04 }, // "isgr"
-    { 0x6c726573, 0x02 }, // "lres"
-    { 0x6c74686d, 0x02 }, // "lthm"
-    { 0x6e6d7061, 0x02 }, // "nmpa"
-    { 0x6e6f7a7a, 0x02 }, // "nozz"
-    { 0x6e757061, 0x02 }, // "nupa"
-    { 0x6f626c6e, 0x02 }, // "obln"
-    { 0x6f64756f, 0x02 }, // "oduo"
-    { CPT9_CHUNK_OINF, 0x02 }, // "oinf"
-    { 0x6f6c6578, 0x02 }, // "olex"
-    { 0x6f6c6e73, 0x02 }, // "olns"
-    { 0x6f736477, 0x02 }, // "osdw"
-    { 0x6f743130, 0x02 }, // "ot10"
-    { 0x6f743132, 0x02 }, // "ot12"
-    { 0x6f74686d, 0x02 }, // "othm"
-    { 0x6f747070, 0x02 }, // "otpp"
-    { 0x6f747839, 0x02 }, // "otx9"
-    { 0x6f747874, 0x02 }, // "otxt"
-    { 0x726f6964, 0x02 }, // "roid"
-    { CPT9_CHUNK_PATH, 0x02 }, // "path"
-    { 0x70736470, 0x02 }, // "psdp"
-    { CPT9_CHUNK_PTHW, 0x02 }, // "pthw"
-    { 0x70746878, 0x02 }, // "pthx"
-    { 0x74677061, 0x02 }, // "tgpa"
-    { 0x7469746c, 0x02 }, // "titl"
-    { 0x75726c61, 0x02 }, // "urla"
-    { 0x75726c63, 0x02 }, // "urlc"
-    { 0x75726c73, 0x02 }, // "urls"
-    { 0x75726c74, 0x02 }, // "urlt"
-    { 0x75727761, 0x02 }, // "urwa"
-    { 0x75727763, 0x02 }, // "urwc"
-    { 0x75727773, 0x02 }, // "urws"
-    { 0x75727774, 0x02 }, // "urwt"
-    { 0x76626169, 0x02 }, // "vbai"
-    { 0x76626178, 0x02 }, // "vbax"
-    { 0x76696163, 0x02 }, // "viac"
-    { 0x76726873, 0x02 }, // "vrhs"
-    { 0x76736574, 0x02 }, // "vset"
-    { 0x776b7061, 0x02 }  // "wkpa"
-};
-
-
-
 // Structure/constans sizes
 #define CPT_RGB_sz              sizeof(CPT_RGB)
 #define CPT_BlockTableEntry_sz  sizeof(CPT_BlockTableEntry)
@@ -0,0 +1,362 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTGen - synthetic .cpt corpus generator, used by 'make bench'.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <sys/stat.h>           // mkdir()
+#include <sys/types.h>
+
+#include "cpt.h"
+#include "ci_chunk.h"
+
+#ifdef WIN32
+#define CG_PATH_SEPARATOR       '\\'
+#define mkdir(path, mode)       mkdir(path)
+#else
+#define CG_PATH_SEPARATOR       '/'
+#endif
+
+#define CG_COLOR_MODELS_NUM     8
+#define CG_ICC_PROFILE_SZ       3144        // like sRGB profile of Windows
+
+// Generator settings
+typedef struct _CG_cfg {
+    uint32_t    files;          // number of files to write
+    uint32_t    version;        // 0x700/0x800/0x900, 0 = all in turn
+    uint32_t    color_model;    // CPT_ColorModels, 0 = all in turn
+    uint32_t    blocks;         // blocks per file
+    uint32_t    chunks;         // chunks per block (CPT9 chunk area)
+    uint32_t    width;          // block dimensions
+    uint32_t    height;
+    uint32_t    tile;           // tile width and height
+    uint32_t    tile_size;      // bytes of data per tile, 0 = raw tile size
+    uint32_t    icc;            // embed ICC profile where color model allows
+    uint32_t    wcomment;       // embed wide comment
+    uint32_t    seed;
+} CG_cfg;
+
+// Color models with their bits per pixel
+typedef struct _CG_model {
+    uint32_t    model;
+    uint32_t    bpp;
+} CG_model;
+
+const CG_model cg_model[CG_COLOR_MODELS_NUM] = {
+    { CPT_RGB24, 24 }, { CPT_CMYK32, 32 }, { CPT_GRAY8, 8 }, { CPT_BW1, 1 },
+    { CPT_RGB8, 8 }, { CPT_LAB24, 24 }, { CPT_RGB48, 48 }, { CPT_GRAY16, 16 }
+};
+
+// Tile markers seen in real files
+const uint32_t cg_marker[] = { 0, 1, 4, 5, 0x00030005 };
+
+CG_cfg cg_cfg = { 100, 0, 0, 4, 8, 256, 256, 64, 0, 1, 1, 1 };
+
+uint64_t cg_rnd_state;
+
+// xorshift64*, so the same seed always gives the same corpus
+uint32_t cg_Rand(void) {
+    cg_rnd_state ^= cg_rnd_state >> 12;
+    cg_rnd_state ^= cg_rnd_state << 25;
+    cg_rnd_state ^= cg_rnd_state >> 27;
+    return (uint32_t) ((cg_rnd_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+void cg_RandFill(uint8_t *buf, uint32_t len) {
+    uint32_t i;
+    for (i=0; i < len; i++) buf[i] = cg_Rand() & 0xFF;
+}
+
+// Growing output buffer of a single file
+typedef struct _CG_buf {
+    uint8_t     *data;
+    uint32_t    len;
+    uint32_t    size;
+} CG_buf;
+
+// Appends len bytes of data (zeroes if NULL), returns their offset. May
+// move b->data, so take pointers into it only after the call.
+uint32_t cg_Put(CG_buf *b, const void *data, uint32_t len) {
+    uint32_t offs = b->len;
+    if (b->len + len > b->size) {
+        while (b->len + len > b->size) b->size = 2*b->size + 4096;
+        b->data = (uint8_t *) realloc(b->data, b->size);
+    }
+    if (data) memcpy(b->data + offs, data, len);
+    else memset(b->data + offs, 0, len);
+    b->len += len;
+    return offs;
+}
+
+void cg_Put32(CG_buf *b, uint32_t val) {
+    cg_Put(b, &val, 4);
+}
+
+// Writes ASCII string as UCS-2LE into dst (max bytes).
+void cg_Wide(uint8_t *dst, const char *src, uint32_t max) {
+    uint32_t i;
+    for (i=0; src[i] && 2*i+1 < max; i++) {
+        dst[2*i] = src[i];
+        dst[2*i+1] = 0;
+    }
+}
+
+// Chunk types written first, so even blocks of few chunks have them
+const uint32_t cg_chunk_first[] = {
+    CI_CHUNK_T_GRID, CI_CHUNK_T_OINF, CI_CHUNK_T_BNAM,
+    CI_CHUNK_T_BNWM, CI_CHUNK_T_PATH, CI_CHUNK_T_PTHW
+};
+#define CG_CHUNK_FIRST_NUM      (sizeof(cg_chunk_first)/sizeof(uint32_t))
+
+// Type of i-th chunk of a block: cg_chunk_first[], then the other known
+// ones in turn.
+int cg_ChunkType(uint32_t i) {
+    uint32_t j, t;
+    i %= CI_CHUNK_TYPES_NUM;
+    if (i < CG_CHUNK_FIRST_NUM) return cg_chunk_first[i];
+    i -= CG_CHUNK_FIRST_NUM;
+    for (t=0;; t++) {
+        for (j=0; j < CG_CHUNK_FIRST_NUM; j++) if (cg_chunk_first[j] == t) break;
+        if (j == CG_CHUNK_FIRST_NUM && !i--) return t;
+    }
+}
+
+// Appends i-th chunk of a block. Decoded types are written through their
+// schema: strings get the object name, GUIDs random bytes, grid density
+// is 1 mm, other numbers 0. Other types get random contents.
+void cg_PutChunk(CG_buf *b, uint32_t block, uint32_t i) {
+    const CI_chunk_field *cf;
+    int t = cg_ChunkType(i);
+    char name[64];
+    uint8_t wide[128], guid[16], *p;
+    uint32_t f, len, rest = 0, name_len;
+    sprintf(name, "Object %u.%u", block, i);
+    name_len = strlen(name);
+    memset(wide, 0, sizeof(wide));
+    cg_Wide(wide, name, sizeof(wide));
+    if (ci_chunk_type[t].field == ci_chunk_type[t+1].field) {
+        len = 4 + (cg_Rand() % 60);
+        cg_Put32(b, len);
+        cg_Put32(b, ci_chunk_type[t].id);
+        cg_RandFill(b->data + cg_Put(b, NULL, len), len);
+        return;
+    }
+    // Strings running up to the end of chunk are \0 terminated
+    for (f = ci_chunk_type[t].field; f < ci_chunk_type[t+1].field; f++) {
+        cf = &ci_chunk_field[f];
+        if (cf->count != CI_FIELD_REST) continue;
+        rest = (cf->kind == CI_FIELD_UCS2 ? 2 : 1) * (name_len + 1);
+    }
+    len = ci_ChunkSize(t, rest);
+    cg_Put32(b, len);
+    cg_Put32(b, ci_chunk_type[t].id);
+    p = b->data + cg_Put(b, NULL, len);
+    for (f = ci_chunk_type[t].field; f < ci_chunk_type[t+1].field; f++) {
+        switch (ci_chunk_field[f].kind) {
+            case CI_FIELD_ANSI: ci_ChunkSetBytes(p, len, f, name, name_len); break;
+            case CI_FIELD_UCS2: ci_ChunkSetBytes(p, len, f, wide, 2*name_len); break;
+            case CI_FIELD_GUID:
+                cg_RandFill(guid, sizeof(guid));
+                ci_ChunkSetBytes(p, len, f, guid, sizeof(guid));
+                break;
+        }
+    }
+    if (ci_chunk_type[t].id == CPT9_CHUNK_GRID) {
+        ci_ChunkSetF64(p, len, CI_F_GRID_XDENSITY, 0, 10000.0);
+        ci_ChunkSetF64(p, len, CI_F_GRID_YDENSITY, 0, 10000.0);
+        ci_ChunkSetU32(p, len, CI_F_GRID_XUNIT, 0, CPT9_GRID_UNIT_MM);
+        ci_ChunkSetU32(p, len, CI_F_GRID_YUNIT, 0, CPT9_GRID_UNIT_MM);
+    }
+}
+
+// Appends CPT9-like block: header, chunk area, data pair table and tiles.
+void cg_PutBlock(CG_buf *b, uint32_t idx, uint32_t bpp) {
+    CPT9_Block block;
+    uint32_t i, hdr, area, pairs, tiles, tile_size;
+    memset(&block, 0, sizeof(block));
+    block.width = cg_cfg.width;
+    block.height = cg_cfg.height;
+    block.tile_w = cg_cfg.tile;
+    block.tile_h = cg_cfg.tile;
+    block.bpp = bpp;
+    block.unk01 = 1;
+    block.unk02 = (idx ? 1 : 0);            // first block is background
+    hdr = cg_Put(b, &block, CPT9_Block_sz);
+
+    // Chunk area: size, unknown (1), chunks
+    if (cg_cfg.chunks) {
+        area = b->len;
+        cg_Put32(b, 0);
+        cg_Put32(b, 1);
+        for (i=0; i < cg_cfg.chunks; i++) cg_PutChunk(b, idx, i);
+        *(uint32_t *) (b->data + area) = b->len - area;
+        ((CPT9_Block *) (b->data + hdr))->size1 = b->len - area;
+    }
+
+    // Data pair table (file offset, length), then tiles
+    tiles = ((cg_cfg.width + cg_cfg.tile-1) / cg_cfg.tile) * ((cg_cfg.height + cg_cfg.tile-1) / cg_cfg.tile);
+    tile_size = cg_cfg.tile_size;
+    if (!tile_size) tile_size = (cg_cfg.tile * cg_cfg.tile * bpp + 7) / 8;
+    if (tile_size < 4) tile_size = 4;
+    pairs = cg_Put(b, NULL, tiles*8);
+    for (i=0; i < tiles; i++) {
+        uint32_t offs = cg_Put(b, NULL, tile_size);
+        *(uint32_t *) (b->data + pairs + i*8) = offs;
+        *(uint32_t *) (b->data + pairs + i*8 + 4) = tile_size;
+        *(uint32_t *) (b->data + offs) = cg_marker[cg_Rand() % (sizeof(cg_marker)/sizeof(uint32_t))];
+        cg_RandFill(b->data + offs + 4, tile_size - 4);
+    }
+}
+
+// Builds n-th file of the corpus.
+void cg_MakeFile(CG_buf *b, uint32_t n) {
+    CPT_FileHeader hdr;
+    uint32_t i, vi, version, model, bpp = 0, app, icc, table, offs;
+    const double dpi[] = { 72, 96, 150, 300, 600 };
+
+    cg_rnd_state = ((uint64_t) cg_cfg.seed << 32) ^ (n + 1) ^ 0x9E3779B97F4A7C15ULL;
+    b->len = 0;
+    // Walk through all version and color model combinations
+    vi = (cg_cfg.version ? cg_cfg.version / 0x100 - 7 : n % CPT_VERSIONS_NUM);
+    version = cpt_version[vi].version;
+    model = cg_cfg.color_model;
+    if (!model) model = cg_model[(n / CPT_VERSIONS_NUM) % CG_COLOR_MODELS_NUM].model;
+    for (i=0; i < CG_COLOR_MODELS_NUM; i++) if (cg_model[i].model == model) bpp = cg_model[i].bpp;
+    app = (version == 0x700 ? CPT_AV_7 : version == 0x800 ? CPT_AV_8 : CPT_AV_9);
+    icc = cg_cfg.icc && CPT_ICC_ALLOWED(model);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, cpt_version[vi].magic, cpt_version[vi].len);
+    hdr.color_model = model;
+    hdr.palette_entries = (model == CPT_RGB8 ? 256*3 : 0);
+    hdr.xdpi = hdr.ydpi = lround(dpi[n % 5] / cpt_dpi_scale);
+    hdr.blocks_num = cg_cfg.blocks;
+    hdr.unk00 = 0x00010000;
+    hdr.flags = app | (icc ? CPT_EMB_ICC_PROFILE : 0) | (cg_cfg.wcomment ? CPT_EMB_WIDE_COMMENT : 0);
+    sprintf(hdr.notes, "Synthetic file %u", n);
+    cg_Put(b, &hdr, CPT_FileHeader_sz);
+
+    // 'After header' data: ICC, palette, wide comment
+    if (icc) {
+        CPT_ICC ih;
+        memset(&ih, 0, sizeof(ih));
+        ih.magic = CPT_ICC_MAGIC;
+        ih.type = CPT_ICC_EMBEDDED;
+        ih.len = CG_ICC_PROFILE_SZ;
+        cg_Put(b, &ih, CPT_ICC_sz);
+        offs = cg_Put(b, NULL, CG_ICC_PROFILE_SZ);
+        cg_RandFill(b->data + offs, CG_ICC_PROFILE_SZ);
+    }
+    if (hdr.palette_entries) {
+        offs = cg_Put(b, NULL, hdr.palette_entries);
+        cg_RandFill(b->data + offs, hdr.palette_entries);
+    }
+    if (cg_cfg.wcomment) {
+        CPT_WideComment wc;
+        memset(&wc, 0, sizeof(wc));
+        wc.magic = CPT_WIDE_COMMENT_MAGIC;
+        cg_Wide((uint8_t *) wc.notes, hdr.notes, CPT_NOTE_LEN_W);
+        cg_Put(b, &wc, CPT_WideComment_sz);
+    }
+
+    // Block table, then blocks. CPT7/8 files keep table offset 0
+    // unless ICC moves the table (what PhotoPaint 9 does, too).
+    table = cg_Put(b, NULL, cg_cfg.blocks * CPT_BlockTableEntry_sz);
+    if (version == 0x900 || icc) ((CPT_FileHeader *) b->data)->blocks_table_offs = table;
+    for (i=0; i < cg_cfg.blocks; i++) {
+        ((CPT_BlockTableEntry *) (b->data + table))[i].offs = b->len;
+        cg_PutBlock(b, i, bpp);
+    }
+}
+
+void cg_Usage(const char *name) {
+    printf("Usage: %s [options...] <dir>\n", name);
+    printf("Writes synthetic .cpt files dir/gen00000.cpt, dir/gen00001.cpt, ...\n");
+    printf("   -n <n>      number of files (default: %u)\n", cg_cfg.files);
+    printf("   -V <7|8|9>  file version (default: all in turn)\n");
+    printf("   -m <hex>    color model (default: all in turn)\n");
+    printf("   -b <n>      blocks per file (default: %u)\n", cg_cfg.blocks);
+    printf("   -c <n>      chunks per block (default: %u)\n", cg_cfg.chunks);
+    printf("   -W <n>      block width (default: %u)\n", cg_cfg.width);
+    printf("   -H <n>      block height (default: %u)\n", cg_cfg.height);
+    printf("   -T <n>      tile width/height (default: %u)\n", cg_cfg.tile);
+    printf("   -z <n>      bytes per tile (default: raw tile size)\n");
+    printf("   -noicc      no embedded ICC profiles\n");
+    printf("   -nowc       no wide comments\n");
+    printf("   -seed <n>   random seed (default: %u)\n", cg_cfg.seed);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    CG_buf b = { NULL, 0, 0 };
+    char *dir = NULL, *path;
+    uint64_t total = 0;
+    uint32_t i;
+    FILE *w;
+
+    for (i=1; i < argc; i++) {
+        if (!strcmp(argv[i], "-noicc")) cg_cfg.icc = 0;
+        else if (!strcmp(argv[i], "-nowc")) cg_cfg.wcomment = 0;
+        else if (argv[i][0] == '-' && i+1 < argc) {
+            uint32_t val = strtoul(argv[i+1], NULL, (!strcmp(argv[i], "-m") ? 16 : 10));
+            if (!strcmp(argv[i], "-n")) cg_cfg.files = val;
+            else if (!strcmp(argv[i], "-V")) cg_cfg.version = val << 8;
+            else if (!strcmp(argv[i], "-m")) cg_cfg.color_model = val;
+            else if (!strcmp(argv[i], "-b")) cg_cfg.blocks = val;
+            else if (!strcmp(argv[i], "-c")) cg_cfg.chunks = val;
+            else if (!strcmp(argv[i], "-W")) cg_cfg.width = val;
+            else if (!strcmp(argv[i], "-H")) cg_cfg.height = val;
+            else if (!strcmp(argv[i], "-T")) cg_cfg.tile = val;
+            else if (!strcmp(argv[i], "-z")) cg_cfg.tile_size = val;
+            else if (!strcmp(argv[i], "-seed")) cg_cfg.seed = val;
+            else cg_Usage(argv[0]);
+            i++;
+        } else if (!dir && argv[i][0] != '-') dir = argv[i];
+        else cg_Usage(argv[0]);
+    }
+    if (!dir || !cg_cfg.blocks || !cg_cfg.tile || !cg_cfg.width || !cg_cfg.height) cg_Usage(argv[0]);
+    if (cg_cfg.version && (cg_cfg.version < 0x700 || cg_cfg.version > 0x900)) cg_Usage(argv[0]);
+    if (cg_cfg.color_model) {
+        for (i=0; i < CG_COLOR_MODELS_NUM; i++) if (cg_model[i].model == cg_cfg.color_model) break;
+        if (i == CG_COLOR_MODELS_NUM) cg_Usage(argv[0]);
+    }
+
+    mkdir(dir, 0755);
+    path = (char *) malloc(strlen(dir) + 16);
+    for (i=0; i < cg_cfg.files; i++) {
+        cg_MakeFile(&b, i);
+        sprintf(path, "%s%cgen%05u.cpt", dir, CG_PATH_SEPARATOR, i);
+        if (!(w = fopen(path, "wb")) || fwrite(b.data, 1, b.len, w) != b.len) {
+            printf("ERROR: Can't write %s!\n", path);
+            return EXIT_FAILURE;
+        }
+        fclose(w);
+        total += b.len;
+    }
+    printf("%u file(s), %"PRIu64" bytes written to %s\n", cg_cfg.files, total, dir);
+    free(path);
+    free(b.data);
+    return EXIT_SUCCESS;
+}
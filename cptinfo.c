@@ -19,6 +19,10 @@
   * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
   */
 
+#ifndef WIN32
+#define _GNU_SOURCE             // fork(), mmap() & co. with -std=c99
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -29,15 +33,46 @@
 #include <string.h>
 #include <sys/stat.h>           // mkdir()
 #include <sys/types.h>
+#include <setjmp.h>             // ci_Abort()
+#include <time.h>               // clock_gettime()
+#include <stddef.h>             // offsetof()
+#include <errno.h>
 #ifdef WIN32
 #include <windows.h>
+#include <io.h>                 // _setmode()
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <sys/resource.h>       // getrusage()
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <sched.h>              // sched_yield()
+#define CI_THREADS              // blocks of a file processed by -t threads
 #endif
 
 
 #include "cpt.h"
 #include "cpt6.h"
+#include "ci_chunk.h"
+#include "ci_sketch.h"
+#include "ci_hash.h"
+#include "ci_store.h"
+#include "ci_text.h"
+#include "ci_scan.h"
+#include "ci_edit.h"
+#include "ci_diff.h"
+#include "ci_pstat.h"
+#include "ci_phash.h"
+#include "ci_io.h"
+#include "ci_arch.h"
+#include "ci_uring.h"
+#include "ci_arena.h"
+#include "ci_where.h"
+#include "ci_arrow.h"
+#include "ci_repack.h"
 
-#define CI_VERSION              "0.039"     // CPTInfo version
+#define CI_VERSION              "0.064"     // CPTInfo version
 
 #ifdef WIN32
 #define CI_PATH_SEPARATOR       '\\'
@@ -45,6 +80,14 @@
 #define CI_PATH_SEPARATOR       '/'
 #endif
 
+#ifdef CI_THREADS
+#define CI_TLS                  __thread    // per thread variable
+#define CI_STAT_ADD(var, n)     __sync_fetch_and_add(&(var), (n))
+#else
+#define CI_TLS
+#define CI_STAT_ADD(var, n)     ((var) += (n))
+#endif
+
 // Command line arguments
 #define CI_ARG_CHARSET          "-c"
 #define CI_ARG_SHORT_OUTPUT     "-s"
@@ -57,13 +100,58 @@
 #define CI_ARG_OUTPUT_RESV      "-or"
 #define CI_ARG_OUTPUT_CHUNK     "-oc"
 #define CI_ARG_SHORT_NOHEAD     "-sh"
+#define CI_ARG_FILE_LIST        "-l"
+#define CI_ARG_WORKERS          "-j"
+#define CI_ARG_CENSUS           "-cs"
+#define CI_ARG_DUP_REPORT       "-dr"
+#define CI_ARG_DUMP_STORE       "-ds"
+#define CI_ARG_THREADS          "-t"
+#define CI_ARG_STATS            "--stats"
+#define CI_ARG_STATS_JSON       "--stats-json"
+#define CI_ARG_STREAM           "--stream"
+#define CI_ARG_ARCHIVE          "-a"
+#define CI_ARG_URING            "--uring"
+#define CI_ARG_NOCACHE          "--nocache"
+#define CI_ARG_OBJECT_NAMES     "-on"
+#define CI_ARG_CHUNKS_JSON      "--chunks-json"
+#define CI_ARG_ARROW            "--arrow"
+#define CI_ARG_WHERE            "--where"
+#define CI_ARG_TEXT_INDEX       "-ti"
+#define CI_ARG_TEXT_QUERY       "-tq"
+#define CI_ARG_RECOVER          "--recover"
+#define CI_ARG_REPACK           "--repack"
+#define CI_ARG_SET_DPI          "--set-dpi"
+#define CI_ARG_SET_COMMENT      "--set-comment"
+#define CI_ARG_DIFF             "--diff"
+#define CI_ARG_PIXEL_STATS      "-ps"
+#define CI_ARG_PHASH            "-ph"
+#define CI_ARG_PHASH_DIST       "-phd"
 
 // Macros to retrieve 32-bit or 16-bit unsigned/signed
-// value from (buf+addr) byte offset 
-#define GETu32(buf,addr) (*((uint32_t *) (buf+addr)))
-#define GETu16(buf,addr) (*((uint16_t *) (buf+addr)))
-#define GETs32(buf,addr) (*((int32_t *) (buf+addr)))
-#define GETs16(buf,addr) (*((int16_t *) (buf+addr)))
+// value from (buf+addr) byte offset, checked against file bounds
+#define GETu32(buf,addr) ci_Get32((const uint8_t *) (buf), (addr))
+#define GETu16(buf,addr) ci_Get16((const uint8_t *) (buf), (addr))
+#define GETs32(buf,addr) ((int32_t) ci_Get32((const uint8_t *) (buf), (addr)))
+#define GETs16(buf,addr) ((int16_t) ci_Get16((const uint8_t *) (buf), (addr)))
+
+#ifdef __GNUC__
+#define CI_UNLIKELY(x)          __builtin_expect(!!(x), 0)
+#else
+#define CI_UNLIKELY(x)          (x)
+#endif
+
+// Streamed input buffer: file head + head of one block; tile data of
+// blocks is read through the scratch part after it
+#define CI_STREAM_BUF           (16 << 20)
+#define CI_STREAM_SCRATCH       (64 << 10)
+
+// Readahead of plain files: block head hinted this far before it's read,
+// tile markers this many ahead
+#define CI_PLAN_BLOCK           (64 << 10)
+#define CI_PLAN_MARKERS         32
+
+// Charset converters kept open per thread (pairs used for .cpt strings)
+#define CI_CONVS                4
 
 #define CI_CPTVER_78(ver) (ver == 0x700 || ver == 0x701 || ver == 0x800)
 
@@ -100,19 +188,121 @@ typedef struct _CI_config {
     uint32_t    verbosity_level;
     uint32_t    silent_header;
     uint32_t    silent_blocks;
+    uint32_t    census;         // aggregate field statistics over all files
+    uint32_t    dedup;          // hash blocks, ICC and palettes, report duplicates
+    uint32_t    workers;        // number of worker processes in batch mode
+    uint32_t    threads;        // number of threads processing blocks of a file
+    uint32_t    quiet;          // no per-file output at all
+    uint32_t    stats;          // timings and counters: 1 text, 2 NDJSON
+    uint32_t    stream;         // read files forward only, in bounded memory
+    uint32_t    archive;        // files are tar/zip archives of .cpt files
+    uint32_t    uring;          // files prefetched through io_uring, in flight
+    uint32_t    nocache;        // drop pages of files read from page cache
+    uint32_t    object_names;   // list object names of blocks only
+    uint32_t    chunks_json;    // list chunks of blocks as NDJSON only
+    uint32_t    where;          // list names of files matching ci_where only
+    uint32_t    recover;        // rebuild damaged block table by scanning file
+    uint32_t    edit;           // patch header fields in place, nothing else
+    uint32_t    diff;           // compare structure of two files
+    uint32_t    pixel_stats;    // per block statistics of raw tile pixels
+    uint32_t    phash;          // perceptual hashes of blocks and files
+    uint32_t    phash_dist;     // ... near if at most this many bits differ
+    uint32_t    set_xdpi;       // new resolution, 0 if not set
+    uint32_t    set_ydpi;
     char        *charset;
+    char        *store;         // content-addressed dump store directory
+    char        *text_index;    // text index directory names are added to
+    char        *set_comment;   // new comment, in terminal charset
+    char        *arrow;         // directory of Arrow tables of files, blocks, chunks
+    char        *repack;        // directory repacked files are written to
 } CI_cfg;
 
 // Structure of argument array member
 typedef struct _CI_arg {
     const uint8_t   subnum;     // number of subparameters
-    uint8_t         pos;        // found at position pos of command line
+    uint32_t        pos;        // found at position pos of command line
     const char      *name;      // name of command line arg (w/o '-' prefix)
     const char      *help;      // use one-liner
     uint32_t        *var;       // variable assigned to argument, NULL if none
     const uint32_t  val;        // variable value if argument found
 } CI_arg;
 
+// Timings (ns) and counters of one file, or summed over files
+typedef struct _CI_stats {
+    uint64_t    files;
+    uint64_t    failed;
+    uint64_t    t_total;
+    uint64_t    t_read;         // ci_ReadFileContents()
+    uint64_t    t_header;       // ci_ProcessFileHeader()
+    uint64_t    t_blocks;       // ci_ProcessFileBlocks(), dumps included
+    uint64_t    t_convert;      // of which in ci_Convert() (all threads)
+    uint64_t    t_output;       // of which printing
+    uint64_t    bytes;          // bytes read
+    uint64_t    pages;          // pages read into
+    uint64_t    faults;         // page faults (minor + major)
+    uint64_t    blocks;
+    uint64_t    chunks;
+    uint64_t    tiles;          // data pairs
+    uint64_t    converts;
+    uint64_t    peak_rss;       // kB, max
+} CI_stats;
+
+// Census value recorded by a block thread, added in block order later
+typedef struct _CI_census_op {
+    uint32_t    field;
+    uint32_t    idx;
+    uint64_t    value;
+} CI_census_op;
+
+// Output of a block processed by a -t thread; kept until all blocks
+// before it are printed, so output is the same as without threads
+typedef struct _CI_blockout {
+    char            *text;
+    uint32_t        len;
+    uint32_t        size;
+    CI_census_op    *census;
+    uint32_t        census_len;
+    uint32_t        census_size;
+    uint32_t        done;           // block was processed
+    uint32_t        aborted;        // ... and ended with ci_Abort(status)
+    int             status;
+    jmp_buf         jmp;            // where ci_Abort() returns to in thread
+} CI_blockout;
+
+// Open charset converter, g_convert() would open and close one per string
+typedef struct _CI_conv {
+    const gchar     *to;
+    const gchar     *from;
+    GIConv          cd;
+} CI_conv;
+
+// Tile marker picked up while streamed input is read through tile data
+typedef struct _CI_tile_marker {
+    uint32_t    offs;           // file offset of tile data
+    uint32_t    got;            // bytes of value read so far
+    uint32_t    value;
+} CI_tile_marker;
+
+// Chunk of CPT9 block, payload at offs in block
+typedef struct _CI_chunk {
+    uint32_t    id;
+    uint32_t    offs;
+    uint32_t    len;
+} CI_chunk;
+
+// How walk of chunk area ended
+#define CI_CHUNKS_AREA          0   // chunk area size reached
+#define CI_CHUNKS_BLOCK         1   // end of block reached
+#define CI_CHUNKS_LEN0          2   // chunk of zero length found
+#define CI_CHUNKS_CORRUPT       3   // chunk not (whole) in file
+
+// Chunks of a block, in ci_arena
+typedef struct _CI_chunk_index {
+    CI_chunk    *chunk;
+    uint32_t    num;
+    uint32_t    end;            // CI_CHUNKS_*
+} CI_chunk_index;
+
 
 // --- Global Variables and Named Contants ---
 
@@ -143,23 +333,92 @@ CI_arg ci_arg[] = {
     { 0, 0, CI_ARG_DUMP_ICC,     "dump ICC profile if present as file.icc", &ci_cfg.dump_icc, 1 },
     { 0, 0, CI_ARG_DUMP_BLOCKS,  "dump blocks as files (file.000, file.001, ...)", &ci_cfg.dump_blocks, 1 },
     { 0, 0, CI_ARG_DUMP_PAL,     "dump palette as file.pal (8-bit RGB only)", &ci_cfg.dump_palette, 1 },
+    { 1, 0, CI_ARG_DUMP_STORE,   "<dir> put dumps into content-addressed store in dir (each blob once)", NULL, 0 },
+    { 1, 0, CI_ARG_TEXT_INDEX,   "<dir> add object, background and path names and comments to text index in dir (unchanged files skipped)", NULL, 0 },
+    { 2, 0, CI_ARG_TEXT_QUERY,   "<dir> <words> list places (file block kind) in text index whose names or comments have all words, no files needed", NULL, 0 },
     { 0, 0, CI_ARG_OUTPUT_DATA,  "output data block pairs", &ci_cfg.output_data, 1 },
     { 0, 0, CI_ARG_OUTPUT_RESV,  "output reserved fields info (default: unusual only)", &ci_cfg.output_reserved, 1 },
+    { 0, 0, CI_ARG_PIXEL_STATS,  "pixel statistics of blocks and file: channel min/max/mean, histogram (256 bins with -v), mask/alpha coverage; raw tiles only, compressed ones not decoded", &ci_cfg.pixel_stats, 1 },
+    { 0, 0, CI_ARG_PHASH,        "perceptual hashes (64-bit dHash) of blocks and file, report clusters of near ones over all files; raw tiles only", &ci_cfg.phash, 1 },
+    { 1, 0, CI_ARG_PHASH_DIST,   "<n> hashes at most n bits apart are near (default: 4), implies "CI_ARG_PHASH, NULL, 0 },
     { 0, 0, CI_ARG_OUTPUT_CHUNK, "output chunks information", &ci_cfg.output_chunks, 1 },
+    { 0, 0, CI_ARG_OBJECT_NAMES, "list object names of blocks only (file block name)", &ci_cfg.object_names, 1 },
+    { 0, 0, CI_ARG_CHUNKS_JSON,  "list chunks of blocks only, as NDJSON records with fields of decoded ones", &ci_cfg.chunks_json, 1 },
+    { 1, 0, CI_ARG_ARROW,        "<dir> write files, blocks and chunks tables as Arrow IPC files into dir (files.arrow, blocks.arrow, chunks.arrow) only", NULL, 0 },
+    { 1, 0, CI_ARG_WHERE,        "<expr> list names of files matching expr only, e.g. 'model == CMYK32 && dpi > 300 && icc' or 'objects > 50'", NULL, 0 },
+    { 1, 0, CI_ARG_SET_DPI,      "<n|XxY> set resolution of files in place (header only written)", NULL, 0 },
+    { 1, 0, CI_ARG_SET_COMMENT,  "<text> set comment of files in place, ANSI and UCS-2 one if there is", NULL, 0 },
+    { 0, 0, CI_ARG_DIFF,         "compare two files: header fields, blocks (aligned by object name and size), their chunks and tiles (hashed, not decoded)", &ci_cfg.diff, 1 },
+    { 1, 0, CI_ARG_REPACK,       "<dir> rewrite CPT9 files into dir compacted (tiles right after their blocks, unreferenced bytes left out) and compressed as .cpt.gz (.cpt.zst with zstd) by -t threads; tile data copied as it is (not streamed input)", NULL, 0 },
+    { 0, 0, CI_ARG_RECOVER,      "rebuild damaged block table of CPT9 file from block headers found by scanning it (not streamed input)", &ci_cfg.recover, 1 },
+    { 0, 0, CI_ARG_ARCHIVE,      "files are tar or zip archives, process .cpt files in them (as archive:member)", &ci_cfg.archive, 1 },
+    { 1, 0, CI_ARG_FILE_LIST,    "<file|-> read names of .cpt files to process from file (one per line)", NULL, 0 },
+    { 1, 0, CI_ARG_WORKERS,      "<n> process files using n worker processes (0: one per CPU)", NULL, 0 },
+    { 1, 0, CI_ARG_THREADS,      "<n> process blocks of a file using n threads (0: one per CPU)", NULL, 0 },
+    { 0, 0, CI_ARG_CENSUS,       "corpus statistics of header, block and chunk fields over all files", &ci_cfg.census, 1 },
+    { 0, 0, CI_ARG_DUP_REPORT,   "report duplicate blocks, ICC profiles and palettes over all files", &ci_cfg.dedup, 1 },
+    { 0, 0, CI_ARG_STATS,        "print phase timings and counters per file and in total (to stderr)", &ci_cfg.stats, 1 },
+    { 0, 0, CI_ARG_STATS_JSON,   "like "CI_ARG_STATS", but as NDJSON records", &ci_cfg.stats, 2 },
+    { 0, 0, CI_ARG_STREAM,       "read files forward only in bounded memory (always for pipes, '-' = stdin and gzip/zstd files)", &ci_cfg.stream, 1 },
+    { 0, 0, CI_ARG_NOCACHE,      "drop pages of files read from page cache (long batch runs)", &ci_cfg.nocache, 1 },
+#ifdef CI_URING
+    { 1, 0, CI_ARG_URING,        "<n> prefetch heads of n files at once through io_uring (0: 64; not with -a, -db, -dr)", NULL, 0 },
+#endif
     { 0, 0, NULL, NULL }
 };
 
-uint32_t ci_filename_pos;               // argc of filename
+uint32_t ci_filename_pos;               // argc of (first) filename
+char **ci_files = NULL;                 // All file names given
+uint32_t ci_files_num = 0;              // Number of file names given
+uint32_t ci_file_idx;                   // Index of current file in ci_files
 char *ci_filename = NULL;               // Full file name with path
 char *ci_filename_short = NULL;         // File name with path stripped
 char *ci_filename_short__ = NULL;       // Like above, ' ' -> '_'
 char *ci_basename = NULL;               // Like ci_filename_short, but .ext stripped
 char *ci_tempname = NULL;               // Like basename + 4 bytes for new '.ext' 
 uint8_t *ci_data = NULL;                // raw file data
+uint32_t ci_data_len;                   // bytes of file in ci_data (all, unless streamed)
 const gchar *ci_charset;                // Default charset to use if not specified via -c
 FILE *f = NULL;                         // .cpt file handle
-int32_t ci_filesize;                    // .cpt file size
+int32_t ci_filesize;                    // .cpt file size, -1 if not known (pipe)
+CI_input *ci_stream = NULL;             // streamed (forward only) input, if any
+CI_input ci_input;                      // ... when it's a file
+CI_input *ci_member = NULL;             // archive member to be processed
+char *ci_member_path = NULL;            // ... its path in archive, if it is one
+uint8_t *ci_stream_buf = NULL;          // its fixed buffer, kept for all files
+uint32_t ci_stream_head;                // reading file head, views read on
+uint32_t ci_stream_head_len;            // bytes of file head in buffer
+uint32_t ci_stream_full;                // a view didn't fit into buffer
+uint64_t ci_stream_pos;                 // bytes of input read
+uint32_t ci_stream_offs;                // file offset of block in ci_data
+uint32_t ci_stream_size;                // ... and its size
+uint32_t ci_stream_lazy;                // block head read as far as viewed
+uint32_t ci_stream_keep;                // ... up to this many bytes
+CI_tile_marker *ci_stream_marker = NULL;    // tiles of block past ci_data
+CI_hash *ci_stream_hash = NULL;         // hash of block skipped past ci_data, if -dr
+CI_plan ci_plan = { -1 };               // readahead of plain file being read
+CI_where ci_where;                      // compiled --where expression
+CI_where_file ci_where_file;            // ... file fields of current file
+uint64_t ci_where_count[CI_WHERE_AGGS]; // ... and its blocks counted by any()/count()
+uint64_t ci_where_blocks;               // ... out of blocks to be processed
+uint64_t ci_where_done;                 // ... by blocks counted so far
+int ci_where_match;                     // CI_WHERE_* of current file
+uint32_t ci_stream_markers;
+uint32_t ci_stream_markers_size;
 uint32_t ci_blocks_table_offs_eval;     // evaluated block_table_offs value, for comparision
+jmp_buf ci_abort_jmp;                   // where ci_Abort() returns to in batch mode
+uint32_t ci_abort_armed = 0;            // is ci_abort_jmp valid?
+int ci_abort_status;                    // exit status of aborted file
+CI_TLS CI_blockout *ci_out = NULL;      // output buffer of block thread, if any
+CI_blockout *ci_report = NULL;          // output of file, in -j worker
+uint32_t *ci_report_lock;               // ... written by one worker at a time
+CI_TLS CI_arena ci_arena;               // temporaries of current file, reset by ci_FinishFile()
+CI_TLS CI_conv ci_conv[CI_CONVS];       // charset converters of this thread
+CI_TLS uint32_t ci_convs;
+CI_stats ci_stats;                      // --stats of current file
+CI_stats ci_stats_total;                // --stats of all files
+uint64_t *ci_stats_phase = NULL;        // phase time accumulator running
+uint64_t ci_stats_mark;                 // ... since this time
 
 CI_info ci;
 
@@ -178,18 +437,236 @@ CPT_WideComment         *ci_wcomment;
 // 4 == silent header
 // 8 == silent blocks
 
+void ci_OutVprintf(CI_blockout *o, const char *msg, va_list ap);
+int ci_StreamNeed(const void *buf, uint64_t offs, uint64_t len);
+
+// Monotonic clock in nanoseconds.
+uint64_t ci_Now(void) {
+#ifdef WIN32
+    LARGE_INTEGER c, f;
+    QueryPerformanceCounter(&c);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t) ((double) c.QuadPart * 1e9 / f.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// Message output; timed as output phase with --stats.
+void ci_Vprintf(const char *msg, va_list ap) {
+    uint64_t t = 0;
+    if (ci_out) { ci_OutVprintf(ci_out, msg, ap); return; }
+    if (ci_report) { ci_OutVprintf(ci_report, msg, ap); return; }
+    if (ci_cfg.stats) t = ci_Now();
+    vprintf(msg, ap);
+    if (ci_cfg.stats) ci_stats.t_output += ci_Now() - t;
+}
+
 void ci_msg(uint32_t level, const char *msg, ...) {
 #ifndef SHUT_UP
     va_list ap;
+    if (ci_cfg.quiet) return;
     if ((level & ci_cfg.verbosity_level) == level) {
         va_start(ap, msg);
-        vprintf(msg, ap);
+        ci_Vprintf(msg, ap);
         va_end(ap);
     }
 #endif
 }
 
+// Like printf(), but goes to block output buffer in block threads.
+void ci_print(const char *msg, ...) {
+    va_list ap;
+    va_start(ap, msg);
+    ci_Vprintf(msg, ap);
+    va_end(ap);
+}
+
+// Returns converter of this thread for given charsets, (GIConv) -1 if
+// there is none. When all are taken, the last one is replaced.
+GIConv ci_Converter(const gchar *to, const gchar *from) {
+    uint32_t i;
+    CI_conv *c;
+    for (i=0; i < ci_convs; i++)
+        if (!strcmp(ci_conv[i].to, to) && !strcmp(ci_conv[i].from, from)) return ci_conv[i].cd;
+    if (ci_convs < CI_CONVS) c = &ci_conv[ci_convs++];
+    else {
+        c = &ci_conv[CI_CONVS-1];
+        if (c->cd != (GIConv) -1) g_iconv_close(c->cd);
+    }
+    c->to = to;
+    c->from = from;
+    c->cd = g_iconv_open(to, from);
+    return c->cd;
+}
+
+// Closes converters of this thread.
+void ci_ConvertersClose(void) {
+    uint32_t i;
+    for (i=0; i < ci_convs; i++)
+        if (ci_conv[i].cd != (GIConv) -1) g_iconv_close(ci_conv[i].cd);
+    ci_convs = 0;
+}
+
+// Converts .cpt string like g_convert() does (NULL if not convertible),
+// but into ci_arena, so the result is never freed by the caller.
+gchar *ci_ConvertTo(const gchar *str, gsize len, const gchar *to, const gchar *from) {
+    GIConv cd = ci_Converter(to, from);
+    gsize size, in_left, out_left;
+    gchar *in, *out, *res;
+    if (cd == (GIConv) -1) return NULL;
+    // Output of 4x input fits UTF-8 from any charset, else it's retried
+    for (size = 4*len + 4;; size *= 2) {
+        if (!(res = (gchar *) ci_ArenaAlloc(&ci_arena, size))) return NULL;
+        in = (gchar *) str;
+        in_left = len;
+        out = res;
+        out_left = size - 4;                        // room for wide \0
+        g_iconv(cd, NULL, NULL, NULL, NULL);
+        if (g_iconv(cd, &in, &in_left, &out, &out_left) != (gsize) -1 &&
+            g_iconv(cd, NULL, NULL, &out, &out_left) != (gsize) -1) break;
+        if (errno != E2BIG) return NULL;
+    }
+    memset(out, 0, 4);
+    return res;
+}
+
+// Charset conversion of .cpt strings, counted and timed for --stats.
+gchar *ci_Convert(const gchar *str, gssize len, const gchar *to, const gchar *from) {
+    uint64_t t;
+    gchar *res;
+    if (!ci_cfg.stats) return ci_ConvertTo(str, len, to, from);
+    t = ci_Now();
+    res = ci_ConvertTo(str, len, to, from);
+    CI_STAT_ADD(ci_stats.t_convert, ci_Now() - t);
+    CI_STAT_ADD(ci_stats.converts, 1);
+    return res;
+}
+
+// Appends formatted text to output buffer (of block thread or file).
+void ci_OutVprintf(CI_blockout *o, const char *msg, va_list ap) {
+    va_list aq;
+    int n;
+    va_copy(aq, ap);
+    n = vsnprintf(NULL, 0, msg, aq);
+    va_end(aq);
+    if (n <= 0) return;
+    if (o->len + n + 1 > o->size) {
+        o->size = 2*o->size + n + 1;
+        o->text = (char *) realloc(o->text, o->size);
+    }
+    vsnprintf(o->text + o->len, n + 1, msg, ap);
+    o->len += n;
+}
+
+// Appends text of block thread to file output buffer.
+void ci_OutWrite(CI_blockout *o, const char *text, uint32_t len) {
+    if (o->len + len + 1 > o->size) {
+        o->size = 2*o->size + len + 1;
+        o->text = (char *) realloc(o->text, o->size);
+    }
+    memcpy(o->text + o->len, text, len);
+    o->len += len;
+}
+
+// Writes output of file gathered by -j worker at once: other workers
+// wait, so reports of files don't get mixed however long they are.
+void ci_ReportFlush(void) {
+#ifndef WIN32
+    uint32_t done = 0;
+    ssize_t n;
+    if (!ci_report || !ci_report->len) return;
+    while (__sync_lock_test_and_set(ci_report_lock, 1)) sched_yield();
+    fflush(stdout);
+    for (; done < ci_report->len; done += n)
+        if ((n = write(STDOUT_FILENO, ci_report->text + done, ci_report->len - done)) <= 0) break;
+    __sync_lock_release(ci_report_lock);
+    ci_report->len = 0;
+#endif
+}
+
+// Records census value in block thread, see ci_CensusAdd().
+void ci_OutCensus(uint32_t field, uint32_t idx, uint64_t value) {
+    if (ci_out->census_len == ci_out->census_size) {
+        ci_out->census_size = 2*ci_out->census_size + 64;
+        ci_out->census = (CI_census_op *) realloc(ci_out->census, ci_out->census_size*sizeof(CI_census_op));
+    }
+    ci_out->census[ci_out->census_len].field = field;
+    ci_out->census[ci_out->census_len].idx = idx;
+    ci_out->census[ci_out->census_len].value = value;
+    ci_out->census_len++;
+}
+
+
+
+// Stops processing of current file with given exit status. In batch mode
+// goes back to ci_ProcessFile() and continues with next file. In block
+// thread stops the block only, file is stopped when its output is printed.
+void ci_Abort(int status) {
+    if (ci_out) {
+        ci_out->status = status;
+        longjmp(ci_out->jmp, 1);
+    }
+    if (ci_abort_armed) {
+        ci_abort_status = status;
+        longjmp(ci_abort_jmp, 1);
+    }
+    exit(status);
+}
+
+// --- Checked file views ---
+// Every read at an offset taken from the file goes through these, so
+// a corrupt file ends in ci_Abort() instead of a crash. The check is a few
+// compares with a never taken branch and loads are memcpy(), so on the
+// fast path it all compiles to plain (unaligned) loads.
+
+// Stops current file as corrupt.
+void ci_Corrupt(void) {
+    if (ci_stream_full) ci_msg(0, "%s File is corrupt, or its %s doesn't fit into stream buffer (%u bytes)!\n",
+        ci_error_str, (ci_stream_head ? "head" : "block head"), CI_STREAM_BUF);
+    else ci_msg(0, ci_error_file_corrupt_str, ci_error_str);
+    ci_Abort(EXIT_FAILURE);
+}
+
+// Is [buf+offs, buf+offs+len) inside the file data? No pointer is formed
+// before the check, so offsets may be anything. Streamed input reads on
+// if it can, see ci_StreamNeed().
+static inline int ci_InFileAt(const void *buf, uint64_t offs, uint64_t len) {
+    uint64_t base = (uintptr_t) buf - (uintptr_t) ci_data;
+    uint64_t size = ci_data_len;
+    if ((uintptr_t) buf < (uintptr_t) ci_data) return 0;
+    if (CI_UNLIKELY(base > size || offs > size - base || len > size - base - offs))
+        return ci_stream && ci_StreamNeed(buf, offs, len);
+    return 1;
+}
+
+static inline int ci_InFile(const void *p, uint64_t len) {
+    return ci_InFileAt(p, 0, len);
+}
+
+// Returns buf+offs if len bytes there are inside the file.
+static inline const uint8_t *ci_ViewAt(const void *buf, uint64_t offs, uint64_t len) {
+    if (CI_UNLIKELY(!ci_InFileAt(buf, offs, len))) ci_Corrupt();
+    return (const uint8_t *) buf + offs;
+}
+
+static inline const uint8_t *ci_View(const void *p, uint64_t len) {
+    return ci_ViewAt(p, 0, len);
+}
+
+static inline uint32_t ci_Get32(const uint8_t *buf, uint64_t offs) {
+    uint32_t val;
+    memcpy(&val, ci_ViewAt(buf, offs, 4), 4);
+    return val;
+}
 
+static inline uint16_t ci_Get16(const uint8_t *buf, uint64_t offs) {
+    uint16_t val;
+    memcpy(&val, ci_ViewAt(buf, offs, 2), 2);
+    return val;
+}
 
 // Measures length of UCS-2 string.
 uint32_t ci_strlen_w(const CPT_wchar *buf) {
@@ -206,9 +683,21 @@ int32_t ci_FileSize(FILE *file) {
     return size;
 }
 
+// Version of file format as header report shows it, "" if not known.
+const char *ci_VersionName(uint32_t version) {
+    switch (version) {
+        case 0x600: return "6.0";
+        case 0x700: return "7.0";
+        case 0x701: return "7.01";
+        case 0x800: return "8.0";
+        case 0x900: return "9.0-13.0";
+    }
+    return "";
+}
+
 // Displays 32-bit dword as ASCII.
 char *ci_Ascii32(uint32_t x) {
-    static char a[5];
+    static CI_TLS char a[5];
     uint32_t mask = 0x000000FF;
     a[3] = x & mask;
     a[2] = (x >> 8) & mask;
@@ -251,14 +740,769 @@ uint32_t ci_IsSubArg(uint32_t argnum) {
     return 0;
 }
 
+// Appends file name to list of files to process.
+void ci_AddFileName(char *name) {
+    if (!(ci_files_num & 63))
+        ci_files = (char **) realloc(ci_files, (ci_files_num+64)*sizeof(char *));
+    ci_files[ci_files_num++] = name;
+}
+
+// Reads file names (one per line) from given list file, '-' means stdin.
+void ci_ReadFileList(const char *listname) {
+    char line[4096];
+    uint32_t len;
+    FILE *l = (strcmp(listname, "-") ? fopen(listname, "r") : stdin);
+    if (!l) {
+        printf("%s Can't open file list %s!\n", ci_error_str, listname);
+        exit(EXIT_FAILURE);
+    }
+    while (fgets(line, sizeof(line), l)) {
+        len = strlen(line);
+        while (len && (line[len-1] == '\n' || line[len-1] == '\r')) line[--len] = '\0';
+        if (len) ci_AddFileName(strdup(line));
+    }
+    if (l != stdin) fclose(l);
+}
+
+// --- Corpus statistics (census) ---
+
+// Census fields, see ci_census_field[]
+enum {
+    CI_CS_VERSION, CI_CS_COLOR_MODEL, CI_CS_PALETTE, CI_CS_XDPI, CI_CS_YDPI,
+    CI_CS_BLOCKS, CI_CS_UNK00, CI_CS_FLAGS, CI_CS_RESERVED00, CI_CS_RESERVED01,
+    CI_CS_RESERVED02, CI_CS_ICC_TYPE, CI_CS_ICC_LEN, CI_CS_ICC_UNK,
+    CI_CS_WIDTH, CI_CS_HEIGHT, CI_CS_TILE_W, CI_CS_TILE_H, CI_CS_BPP,
+    CI_CS_BLOCK_UNK00, CI_CS_BLOCK_UNK01, CI_CS_BLOCK_UNK02, CI_CS_SIZE1,
+    CI_CS_PAL_SIZE, CI_CS_BLOCK_UNK03, CI_CS_AREA_UNK, CI_CS_CHUNKS,
+    CI_CS_CHUNK_LEN, CI_CS_GRID_UNK00, CI_CS_GRID_UNIT, CI_CS_GRID_UNK01,
+    CI_CS_OINF_UNK00, CI_CS_OINF_UNK01, CI_CS_OINF_UNK02, CI_CS_PAIRS,
+    CI_CS_MARKER, CI_CS_FIELDS_NUM
+};
+#define CI_CS_CHUNK_ID          CI_CS_FIELDS_NUM    // chunk_known[]/chunk_unknown
+
+// Census field description
+typedef struct _CI_census_field {
+    const char  *name;
+    uint32_t    num;            // array fields get one sketch per element
+    uint32_t    hex;            // print values as hex
+} CI_census_field;
+
+const CI_census_field ci_census_field[CI_CS_FIELDS_NUM] = {
+    { "file.version",        1, 1 },
+    { "header.color_model",  1, 1 },
+    { "header.palette_entries", 1, 0 },
+    { "header.xdpi",         1, 0 },
+    { "header.ydpi",         1, 0 },
+    { "header.blocks_num",   1, 0 },
+    { "header.unk00",        1, 1 },
+    { "header.flags",        1, 1 },
+    { "header.reserved00",   2, 1 },
+    { "header.reserved01",   2, 1 },
+    { "header.reserved02",   1, 1 },
+    { "icc.type",            1, 1 },
+    { "icc.len",             1, 0 },
+    { "icc.unk",             3, 1 },
+    { "block.width",         1, 0 },
+    { "block.height",        1, 0 },
+    { "block.tile_w",        1, 0 },
+    { "block.tile_h",        1, 0 },
+    { "block.bpp",           1, 0 },
+    { "block.unk00",         1, 1 },
+    { "block.unk01",         1, 1 },
+    { "block.unk02",         1, 1 },
+    { "block.size1",         1, 0 },
+    { "block.pal_size",      1, 0 },
+    { "block.unk03",         5, 1 },
+    { "block.area_unk",      1, 1 },
+    { "block.chunks",        1, 0 },
+    { "chunk.len",           1, 0 },
+    { "grid.unk00",          2, 1 },
+    { "grid.unit",           2, 1 },
+    { "grid.unk01",          8, 1 },
+    { "oinf.unk00",          6, 1 },
+    { "oinf.unk01",          6, 1 },
+    { "oinf.unk02",          7, 1 },
+    { "data.pairs",          1, 0 },
+    { "data.marker",         1, 1 }
+};
+
+// Census partial (per worker) or merged results
+typedef struct _CI_census {
+    uint64_t    files;
+    uint64_t    files_ok;
+    uint64_t    files_failed;
+    uint64_t    files_cpt6;
+    uint64_t    chunk_known[CI_CHUNK_TYPES_NUM];
+    CI_sketch   chunk_unknown;
+    uint32_t    base[CI_CS_FIELDS_NUM];     // index of field's first sketch
+    uint32_t    sketches;
+    CI_sketch   *sketch;
+} CI_census;
+
+CI_census ci_census;
+
+void ci_CensusInit(CI_census *c) {
+    uint32_t i;
+    memset(c, 0, sizeof(CI_census));
+    for (i=0; i < CI_CS_FIELDS_NUM; i++) {
+        c->base[i] = c->sketches;
+        c->sketches += ci_census_field[i].num;
+    }
+    c->sketch = (CI_sketch *) malloc(c->sketches * sizeof(CI_sketch));
+    for (i=0; i < c->sketches; i++) ci_SketchInit(&c->sketch[i]);
+    ci_SketchInit(&c->chunk_unknown);
+}
+
+void ci_CensusAdd(uint32_t field, uint32_t idx, uint64_t value) {
+    int type;
+    if (ci_out) { ci_OutCensus(field, idx, value); return; }
+    if (field == CI_CS_CHUNK_ID) {
+        type = ci_ChunkType((uint32_t) value);
+        if (type >= 0) ci_census.chunk_known[type]++;
+        else ci_SketchAdd(&ci_census.chunk_unknown, value);
+        return;
+    }
+    ci_SketchAdd(&ci_census.sketch[ci_census.base[field] + idx], value);
+}
+
+// Raw header fields, before any fixups done by ci_ProcessFileHeader()
+void ci_CensusHeader(void) {
+    ci_CensusAdd(CI_CS_COLOR_MODEL, 0, ci_f_header->color_model);
+    ci_CensusAdd(CI_CS_PALETTE, 0, ci_f_header->palette_entries);
+    ci_CensusAdd(CI_CS_XDPI, 0, lround((double) (ci_f_header->xdpi) * cpt_dpi_scale));
+    ci_CensusAdd(CI_CS_YDPI, 0, lround((double) (ci_f_header->ydpi) * cpt_dpi_scale));
+    ci_CensusAdd(CI_CS_BLOCKS, 0, ci_f_header->blocks_num);
+    ci_CensusAdd(CI_CS_UNK00, 0, ci_f_header->unk00);
+    ci_CensusAdd(CI_CS_FLAGS, 0, ci_f_header->flags);
+    ci_CensusAdd(CI_CS_RESERVED00, 0, ci_f_header->reserved00[0]);
+    ci_CensusAdd(CI_CS_RESERVED00, 1, ci_f_header->reserved00[1]);
+    ci_CensusAdd(CI_CS_RESERVED01, 0, ci_f_header->reserved01[0]);
+    ci_CensusAdd(CI_CS_RESERVED01, 1, ci_f_header->reserved01[1]);
+    ci_CensusAdd(CI_CS_RESERVED02, 0, ci_f_header->reserved02);
+}
+
+void ci_CensusIcc(void) {
+    ci_CensusAdd(CI_CS_ICC_TYPE, 0, ci_icc->type);
+    if (ci_icc->type == CPT_ICC_EMBEDDED) ci_CensusAdd(CI_CS_ICC_LEN, 0, ci_icc->len);
+    ci_CensusAdd(CI_CS_ICC_UNK, 0, ci_icc->unk[0]);
+    ci_CensusAdd(CI_CS_ICC_UNK, 1, ci_icc->unk[1]);
+    ci_CensusAdd(CI_CS_ICC_UNK, 2, ci_icc->unk[2]);
+}
+
+void ci_CensusBlock(CPT9_Block *block) {
+    uint32_t i;
+    ci_CensusAdd(CI_CS_WIDTH, 0, block->width);
+    ci_CensusAdd(CI_CS_HEIGHT, 0, block->height);
+    ci_CensusAdd(CI_CS_TILE_W, 0, block->tile_w);
+    ci_CensusAdd(CI_CS_TILE_H, 0, block->tile_h);
+    ci_CensusAdd(CI_CS_BPP, 0, block->bpp);
+    ci_CensusAdd(CI_CS_BLOCK_UNK00, 0, block->unk00);
+    ci_CensusAdd(CI_CS_BLOCK_UNK01, 0, block->unk01);
+    ci_CensusAdd(CI_CS_BLOCK_UNK02, 0, block->unk02);
+    ci_CensusAdd(CI_CS_SIZE1, 0, block->size1);
+    ci_CensusAdd(CI_CS_PAL_SIZE, 0, block->pal_size);
+    for (i=0; i < 5; i++) ci_CensusAdd(CI_CS_BLOCK_UNK03, i, block->unk03[i]);
+}
+
+// Chunk id frequency, plus unknown fields of decoded chunks
+void ci_CensusChunk(uint32_t chnk, uint8_t *buf, uint32_t len) {
+    uint32_t i;
+    ci_CensusAdd(CI_CS_CHUNK_ID, 0, chnk);
+    ci_CensusAdd(CI_CS_CHUNK_LEN, 0, len);
+    if (chnk == CPT9_CHUNK_GRID && len >= ci_ChunkSize(CI_CHUNK_T_GRID, 0)) {
+        for (i=0; i < 2; i++) ci_CensusAdd(CI_CS_GRID_UNK00, i, ci_ChunkU32(buf, len, CI_F_GRID_UNK00, i));
+        ci_CensusAdd(CI_CS_GRID_UNIT, 0, ci_ChunkU32(buf, len, CI_F_GRID_XUNIT, 0));
+        ci_CensusAdd(CI_CS_GRID_UNIT, 1, ci_ChunkU32(buf, len, CI_F_GRID_YUNIT, 0));
+        for (i=0; i < 8; i++) ci_CensusAdd(CI_CS_GRID_UNK01, i, ci_ChunkU32(buf, len, CI_F_GRID_UNK01, i));
+    }
+    if (chnk == CPT9_CHUNK_OINF && len >= ci_ChunkSize(CI_CHUNK_T_OINF, 0)) {
+        for (i=0; i < 6; i++) ci_CensusAdd(CI_CS_OINF_UNK00, i, ci_ChunkU32(buf, len, CI_F_OINF_UNK00, i));
+        for (i=0; i < 6; i++) ci_CensusAdd(CI_CS_OINF_UNK01, i, ci_ChunkU32(buf, len, CI_F_OINF_UNK01, i));
+        for (i=0; i < 7; i++) ci_CensusAdd(CI_CS_OINF_UNK02, i, ci_ChunkU32(buf, len, CI_F_OINF_UNK02, i));
+    }
+}
+
+void ci_CensusFile(int status) {
+    ci_census.files++;
+    if (ci.version) ci_CensusAdd(CI_CS_VERSION, 0, ci.version);
+    if (ci.version == 0x600) ci_census.files_cpt6++;
+    else if (status == EXIT_SUCCESS) ci_census.files_ok++;
+    else ci_census.files_failed++;
+}
+
+// Writes partial results of a worker.
+void ci_CensusSave(FILE *out) {
+    fwrite(&ci_census, sizeof(CI_census), 1, out);
+    fwrite(ci_census.sketch, sizeof(CI_sketch), ci_census.sketches, out);
+}
+
+// Reads partial results of a worker and merges them.
+void ci_CensusLoad(FILE *in) {
+    CI_census part;
+    CI_sketch sk;
+    uint32_t i;
+    if (fread(&part, sizeof(CI_census), 1, in) != 1) return;
+    ci_census.files += part.files;
+    ci_census.files_ok += part.files_ok;
+    ci_census.files_failed += part.files_failed;
+    ci_census.files_cpt6 += part.files_cpt6;
+    for (i=0; i < CI_CHUNK_TYPES_NUM; i++) ci_census.chunk_known[i] += part.chunk_known[i];
+    ci_SketchMerge(&ci_census.chunk_unknown, &part.chunk_unknown);
+    for (i=0; i < ci_census.sketches; i++) {
+        if (fread(&sk, sizeof(CI_sketch), 1, in) != 1) break;
+        ci_SketchMerge(&ci_census.sketch[i], &sk);
+    }
+}
+
+// Prints up to 'max' most frequent values of a sketch.
+void ci_CensusPrintTop(CI_sketch *s, uint32_t hex, uint32_t max, uint32_t fourcc) {
+    uint32_t i;
+    ci_SketchSort(s);
+    for (i=0; i < s->items && i < max; i++) {
+        if (fourcc) printf(" '%s'", ci_Ascii32(s->item[i].value));
+        else if (hex) printf(" 0x%08"PRIx64, s->item[i].value);
+        else printf(" %"PRIu64, s->item[i].value);
+        printf(" (%s%"PRIu64")", (s->item[i].error ? "~" : ""), s->item[i].count);
+    }
+    if (s->items > max || s->evicted) printf(" ...");
+    printf("\n");
+}
+
+void ci_CensusReport(void) {
+    uint32_t i, j;
+    char name[64];
+    CI_sketch *s;
+    printf("Census: %"PRIu64" file(s), %"PRIu64" OK, %"PRIu64" failed, %"PRIu64" CPT6\n",
+        ci_census.files, ci_census.files_ok, ci_census.files_failed, ci_census.files_cpt6);
+    printf("%-22s %10s %10s %10s %9s  top values (count)\n", "Field", "count", "min", "max", "distinct");
+    for (i=0; i < CI_CS_FIELDS_NUM; i++) {
+        for (j=0; j < ci_census_field[i].num; j++) {
+            s = &ci_census.sketch[ci_census.base[i] + j];
+            if (!s->count) continue;
+            if (ci_census_field[i].num > 1) sprintf(name, "%s[%u]", ci_census_field[i].name, j);
+            else sprintf(name, "%s", ci_census_field[i].name);
+            printf("%-22s %10"PRIu64, name, s->count);
+            if (ci_census_field[i].hex) printf(" 0x%08"PRIx64" 0x%08"PRIx64, s->min, s->max);
+            else printf(" %10"PRIu64" %10"PRIu64, s->min, s->max);
+            printf(" %s%8.0f ", (s->evicted ? "~" : " "), ci_SketchDistinct(s));
+            ci_CensusPrintTop(s, ci_census_field[i].hex, 5, 0);
+        }
+    }
+    printf("Chunks:");
+    for (i=0, j=0; i < CI_CHUNK_TYPES_NUM; i++) {
+        if (!ci_census.chunk_known[i]) continue;
+        printf("%s '%s' %"PRIu64, (j++ % 6 ? "" : "\n "), ci_Ascii32(ci_chunk_type[i].id), ci_census.chunk_known[i]);
+    }
+    printf("\n");
+    if (ci_census.chunk_unknown.count) {
+        printf("Unknown chunks: %"PRIu64", %s%.0f distinct:", ci_census.chunk_unknown.count,
+            (ci_census.chunk_unknown.evicted ? "~" : ""), ci_SketchDistinct(&ci_census.chunk_unknown));
+        ci_CensusPrintTop(&ci_census.chunk_unknown, 1, 10, 1);
+    }
+}
+
+// --- Names of archive members in reports (-dr, -ph) ---
+// ci_files[] has only the archive, so entries of members keep index to
+// member names too (1-based, 0 for files).
+
+char **ci_member_name = NULL;
+uint32_t ci_member_names = 0;
+uint32_t ci_member_base = 0;            // names there were before last ci_MemberLoad()
+
+// Returns index of name of current file if it's an archive member.
+uint32_t ci_MemberName(void) {
+    if (!ci_member_path) return 0;
+    if (ci_member_names && !strcmp(ci_member_name[ci_member_names-1], ci_filename)) return ci_member_names;
+    if (!(ci_member_names & 63))
+        ci_member_name = (char **) realloc(ci_member_name, (ci_member_names+64)*sizeof(char *));
+    ci_member_name[ci_member_names++] = strdup(ci_filename);
+    return ci_member_names;
+}
+
+// Name of hashed file or member for reports.
+const char *ci_HashedName(uint32_t file, uint32_t member) {
+    return (member ? ci_member_name[member-1] : ci_files[file]);
+}
+
+void ci_MemberSave(FILE *out) {
+    uint32_t i, len;
+    fwrite(&ci_member_names, sizeof(uint32_t), 1, out);
+    for (i=0; i < ci_member_names; i++) {
+        len = strlen(ci_member_name[i]);
+        fwrite(&len, sizeof(uint32_t), 1, out);
+        fwrite(ci_member_name[i], 1, len, out);
+    }
+}
+
+// Loaded names follow ones there are; entries loaded next add ci_member_base.
+void ci_MemberLoad(FILE *in) {
+    uint32_t i, n, len;
+    ci_member_base = ci_member_names;
+    if (fread(&n, sizeof(uint32_t), 1, in) != 1) return;
+    for (i=0; i < n; i++) {
+        if (fread(&len, sizeof(uint32_t), 1, in) != 1) return;
+        if (!(ci_member_names & 63))
+            ci_member_name = (char **) realloc(ci_member_name, (ci_member_names+64)*sizeof(char *));
+        ci_member_name[ci_member_names] = (char *) malloc(len+1);
+        ci_member_name[ci_member_names][fread(ci_member_name[ci_member_names], 1, len, in)] = '\0';
+        ci_member_names++;
+    }
+}
+
+// --- Content hashes, duplicate report ---
+
+// Kinds of hashed data
+enum { CI_DUP_BLOCK, CI_DUP_ICC, CI_DUP_PALETTE };
+const char *ci_dup_kind[] = { "block", "ICC profile", "palette" };
+
+// Hash of one piece of data found in one of the files
+typedef struct _CI_dup {
+    uint64_t    hash;
+    uint32_t    size;
+    uint32_t    kind;
+    uint32_t    file;           // index to ci_files[]
+    uint32_t    member;         // ... and to ci_member_name[] (1-based), 0 if none
+    uint32_t    index;          // block number
+} CI_dup;
+
+CI_dup *ci_dup = NULL;
+uint32_t ci_dup_num = 0;
+
+// Adds data hashed already (streamed blocks, see ci_StreamBlock()).
+void ci_DedupAddHash(uint32_t kind, uint64_t hash, uint32_t size, uint32_t index) {
+    if (!(ci_dup_num & 1023)) ci_dup = (CI_dup *) realloc(ci_dup, (ci_dup_num+1024)*sizeof(CI_dup));
+    ci_dup[ci_dup_num].hash = hash;
+    ci_dup[ci_dup_num].size = size;
+    ci_dup[ci_dup_num].kind = kind;
+    ci_dup[ci_dup_num].file = ci_file_idx;
+    ci_dup[ci_dup_num].member = ci_MemberName();
+    ci_dup[ci_dup_num].index = index;
+    ci_dup_num++;
+}
+
+void ci_DedupAdd(uint32_t kind, const uint8_t *data, uint32_t size, uint32_t index) {
+    ci_DedupAddHash(kind, ci_Hash64(data, size, 0), size, index);
+}
+
+void ci_DedupSave(FILE *out) {
+    fwrite(&ci_dup_num, sizeof(uint32_t), 1, out);
+    fwrite(ci_dup, sizeof(CI_dup), ci_dup_num, out);
+}
+
+void ci_DedupLoad(FILE *in) {
+    uint32_t i, n;
+    if (fread(&n, sizeof(uint32_t), 1, in) != 1) return;
+    ci_dup = (CI_dup *) realloc(ci_dup, ((ci_dup_num+n+1024) & ~1023)*sizeof(CI_dup));
+    n = fread(ci_dup+ci_dup_num, sizeof(CI_dup), n, in);
+    for (i=0; i < n; i++) if (ci_dup[ci_dup_num+i].member) ci_dup[ci_dup_num+i].member += ci_member_base;
+    ci_dup_num += n;
+}
+
+int ci_DedupCmp(const void *a, const void *b) {
+    const CI_dup *x = a, *y = b;
+    if (x->kind != y->kind) return (x->kind < y->kind ? -1 : 1);
+    if (x->hash != y->hash) return (x->hash < y->hash ? -1 : 1);
+    if (x->size != y->size) return (x->size < y->size ? -1 : 1);
+    if (x->file != y->file) return (x->file < y->file ? -1 : 1);
+    if (x->member != y->member) return (x->member < y->member ? -1 : 1);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Groups equal hashes (of equal size) and prints groups with 2+ members.
+void ci_DedupReport(void) {
+    uint32_t i, j, k, groups = 0;
+    uint64_t dups = 0, bytes = 0;
+    if (ci_dup_num) qsort(ci_dup, ci_dup_num, sizeof(CI_dup), ci_DedupCmp);
+    for (i=0; i < ci_dup_num; i = j) {
+        for (j=i+1; j < ci_dup_num; j++) {
+            if (ci_dup[j].kind != ci_dup[i].kind || ci_dup[j].hash != ci_dup[i].hash ||
+                ci_dup[j].size != ci_dup[i].size) break;
+        }
+        if (j-i < 2) continue;
+        groups++;
+        dups += j-i-1;
+        bytes += (uint64_t) (j-i-1) * ci_dup[i].size;
+        printf("%s %016"PRIx64" (%u bytes): %u copies\n", ci_dup_kind[ci_dup[i].kind],
+            ci_dup[i].hash, ci_dup[i].size, j-i);
+        for (k=i; k < j; k++) {
+            printf("    %s", ci_HashedName(ci_dup[k].file, ci_dup[k].member));
+            if (ci_dup[k].kind == CI_DUP_BLOCK) printf(" %04x", ci_dup[k].index);
+            printf("\n");
+        }
+    }
+    printf("Duplicates: %u hashed, %u group(s), %"PRIu64" redundant copies, %"PRIu64" bytes reclaimable\n",
+        ci_dup_num, groups, dups, bytes);
+}
+
+// --- Dumping, optionally into content-addressed store ---
+
+CI_store ci_store;
+uint32_t ci_store_open = 0;
+
+// Writes dumped data to its own file, or into the store given with -ds.
+// Label names the data in store manifest. Data always is a slice of
+// ci_data, so own files are filled by the kernel from the source file
+// where it can (reflink or copy_file_range), rest is written from memory.
+void ci_DumpData(const char *pathname, const char *label, const uint8_t *data, uint32_t size) {
+    FILE *w;
+    uint64_t done = 0;
+    if (ci_cfg.store) {
+        char *line = ci_ArenaPrintf(&ci_arena, "%s %s", label, ci_filename);
+        if (!ci_store_open) {
+            if (ci_StoreOpen(&ci_store, ci_cfg.store)) {
+                ci_msg(0, "%s Can't open dump store %s!\n", ci_error_str, ci_cfg.store);
+                exit(EXIT_FAILURE);
+            }
+            ci_store_open = 1;
+        }
+        if (ci_StorePut(&ci_store, data, size, line) < 0) {
+            ci_msg(0, "%s Can't write to dump store %s!\n", ci_error_str, ci_cfg.store);
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (!(w = fopen(pathname, "wb"))) {
+        ci_msg(1, "%s can't create %s, not dumped!\n", ci_warning_str, pathname);
+        return;
+    }
+    if (f) done = ci_CopyRange(fileno(f), data - ci_data, fileno(w), size);
+    if (done < size) {
+        fseek(w, done, SEEK_SET);
+        fwrite(data + done, 1, size - done, w);
+    }
+    fclose(w);
+}
+
+// Flushes pending store appends, must be done before process ends.
+void ci_StoreEnd(void) {
+    if (!ci_store_open) return;
+    if (ci_StoreFlush(&ci_store)) ci_msg(0, "%s Can't write to dump store %s!\n", ci_error_str, ci_cfg.store);
+    ci_StoreClose(&ci_store);
+    ci_store_open = 0;
+}
+
+void ci_StoreSave(FILE *out) {
+    fwrite(&ci_store.blobs_new, sizeof(uint64_t), 4, out);
+}
+
+void ci_StoreLoad(FILE *in) {
+    uint64_t n[4];
+    if (fread(n, sizeof(uint64_t), 4, in) != 4) return;
+    ci_store.blobs_new += n[0];
+    ci_store.blobs_dup += n[1];
+    ci_store.bytes_new += n[2];
+    ci_store.bytes_dup += n[3];
+}
+
+void ci_StoreReport(void) {
+    printf("Dump store %s: %"PRIu64" new blob(s), %"PRIu64" bytes written, "
+        "%"PRIu64" duplicate(s), %"PRIu64" bytes saved\n", ci_cfg.store,
+        ci_store.blobs_new, ci_store.bytes_new, ci_store.blobs_dup, ci_store.bytes_dup);
+}
+
+// --- Text index of names and comments (-ti, -tq) ---
+
+CI_text ci_text;
+uint32_t ci_text_open = 0;
+uint32_t ci_text_file;                  // handle of file being indexed
+int ci_text_merged = 0;                 // segments merged after the batch
+
+// Case folded copy of UTF-8 text, in ci_arena.
+gchar *ci_TextFold(const gchar *s) {
+    gchar *res = (gchar *) ci_ArenaAlloc(&ci_arena, 4*strlen(s) + 1), *out = res;
+    for (; *s; s = g_utf8_next_char(s)) out += g_unichar_to_utf8(g_unichar_tolower(g_utf8_get_char(s)), out);
+    *out = 0;
+    return res;
+}
+
+// Adds .cpt string in given charset, found at 'where' of current file.
+void ci_TextString(uint32_t where, const gchar *str, gsize len, const gchar *from) {
+    gchar *utf = ci_Convert(str, len, "UTF-8", from);
+    if (!utf || !*utf) return;
+    utf = ci_TextFold(utf);
+    ci_TextAdd(&ci_text, ci_text_file, where, utf, strlen(utf));
+}
+
+// Starts indexing of a file. Returns 1 if it didn't change since it was
+// indexed, so it can be skipped. Archive members and pipes are always
+// indexed again.
+int ci_TextFileBegin(const char *name) {
+    struct stat sb;
+    uint64_t mtime = 0, size = 0;
+    if (!ci_text_open) {
+        if (ci_TextOpen(&ci_text, ci_cfg.text_index, 1)) {
+            ci_msg(0, "%s Can't open text index %s!\n", ci_error_str, ci_cfg.text_index);
+            exit(EXIT_FAILURE);
+        }
+        ci_text_open = 1;
+    }
+    if (!ci_member && strcmp(name, "-") && !stat(name, &sb) && S_ISREG(sb.st_mode)) {
+        mtime = sb.st_mtime;
+        size = sb.st_size;
+        if (ci_TextFresh(&ci_text, name, mtime, size)) return 1;
+    }
+    ci_text_file = ci_TextBegin(&ci_text, name, mtime, size);
+    return 0;
+}
+
+// Object, background and path names of CPT9 block: string fields of
+// their chunks.
+void ci_TextBlock9(uint32_t id, uint8_t *buf, const CI_chunk_index *idx) {
+    const CI_chunk_field *cf;
+    const uint8_t *str;
+    uint32_t i, f, n, len, kind;
+    int type;
+    uint8_t *p;
+    for (i=0; i < idx->num; i++) {
+        p = buf + idx->chunk[i].offs;
+        len = idx->chunk[i].len;
+        switch (idx->chunk[i].id) {
+            case CPT9_CHUNK_OINF: kind = CI_TEXT_OBJECT; break;
+            case CPT9_CHUNK_BNAM:
+            case CPT9_CHUNK_BNWM: kind = CI_TEXT_BACKGROUND; break;
+            case CPT9_CHUNK_PATH:
+            case CPT9_CHUNK_PTHW: kind = CI_TEXT_PATH; break;
+            default: continue;
+        }
+        type = ci_ChunkType(idx->chunk[i].id);
+        for (f = ci_chunk_type[type].field; f < ci_chunk_type[type+1].field; f++) {
+            cf = &ci_chunk_field[f];
+            if (cf->kind != CI_FIELD_ANSI && cf->kind != CI_FIELD_UCS2) continue;
+            if (!(str = ci_ChunkAt(p, len, f, 0, &n))) continue;
+            ci_TextString(CI_TEXT_WHERE(id, kind), (const gchar *) str, n,
+                (cf->kind == CI_FIELD_ANSI ? ci_cfg.charset : CPT_WIDE_CHARSET));
+        }
+    }
+}
+
+// Appends what's left, must be done before process ends.
+void ci_TextEnd(void) {
+    if (!ci_text_open) return;
+    if (ci_TextFlush(&ci_text)) ci_msg(0, "%s Can't write to text index %s!\n", ci_error_str, ci_cfg.text_index);
+    ci_TextClose(&ci_text);
+    ci_text_open = 0;
+}
+
+// Merges segments once there are many of them. Only after all workers
+// are done, by main process.
+void ci_TextCompact(void) {
+    CI_text t;
+    if (ci_TextOpen(&t, ci_cfg.text_index, 0)) return;
+    if ((ci_text_merged = ci_TextMerge(&t, CI_TEXT_SEGMENTS)) < 0)
+        ci_msg(0, "%s Can't merge text index %s!\n", ci_error_str, ci_cfg.text_index);
+    ci_TextClose(&t);
+}
+
+void ci_TextSave(FILE *out) {
+    fwrite(&ci_text.files_new, sizeof(uint64_t), 3, out);
+}
+
+void ci_TextLoad(FILE *in) {
+    uint64_t n[3];
+    if (fread(n, sizeof(uint64_t), 3, in) != 3) return;
+    ci_text.files_new += n[0];
+    ci_text.files_fresh += n[1];
+    ci_text.hits_new += n[2];
+}
+
+void ci_TextReport(void) {
+    printf("Text index %s: %"PRIu64" file(s) indexed, %"PRIu64" unchanged, %"PRIu64" posting(s) added",
+        ci_cfg.text_index, ci_text.files_new, ci_text.files_fresh, ci_text.hits_new);
+    if (ci_text_merged > 0) printf(", %d segments merged", ci_text_merged);
+    printf("\n");
+}
+
+// Lists places having all words (given in terminal charset) found in text
+// index in dir; comments are file level, so without block.
+int ci_TextQueryRun(const char *dir, const char *words) {
+    static const char *kind[] = { "comment", "object", "background", "path" };
+    CI_text_hit *hit;
+    uint32_t i, num;
+    gchar *utf;
+    int err;
+    if (ci_TextOpen(&ci_text, dir, 0)) {
+        printf("%s Can't open text index %s!\n", ci_error_str, dir);
+        return EXIT_FAILURE;
+    }
+    if (!(utf = ci_Convert(words, strlen(words), "UTF-8", ci_charset))) {
+        printf("%s Can't convert %s to UTF-8!\n", ci_error_str, words);
+        return EXIT_FAILURE;
+    }
+    utf = ci_TextFold(utf);
+    if ((err = ci_TextQuery(&ci_text, utf, strlen(utf), &hit, &num)))
+        printf("%s Text index %s is corrupt!\n", ci_error_str, dir);
+    for (i=0; i < num; i++) {
+        printf("%s ", ci_text.file[hit[i].file].path);
+        if (CI_TEXT_BLOCK(hit[i].where) == CI_TEXT_NO_BLOCK) printf("-");
+        else printf("%04x", CI_TEXT_BLOCK(hit[i].where));
+        printf(" %s\n", (CI_TEXT_KIND(hit[i].where) <= CI_TEXT_PATH ? kind[CI_TEXT_KIND(hit[i].where)] : "?"));
+    }
+    free(hit);
+    ci_TextClose(&ci_text);
+    return (err ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+// --- Timings and counters (--stats) ---
+
+// Peak resident set size of this process, or of finished workers, kB.
+uint64_t ci_PeakRss(uint32_t children) {
+#ifndef WIN32
+    struct rusage ru;
+    if (!getrusage(children ? RUSAGE_CHILDREN : RUSAGE_SELF, &ru)) return ru.ru_maxrss;
+#endif
+    return 0;
+}
+
+uint64_t ci_Faults(void) {
+#ifndef WIN32
+    struct rusage ru;
+    if (!getrusage(RUSAGE_SELF, &ru)) return ru.ru_minflt + ru.ru_majflt;
+#endif
+    return 0;
+}
+
+// Ends running phase (adding its time) and starts next one, if any.
+void ci_StatsPhase(uint64_t *next) {
+    uint64_t now;
+    if (!ci_cfg.stats) return;
+    now = ci_Now();
+    if (ci_stats_phase) *ci_stats_phase += now - ci_stats_mark;
+    ci_stats_phase = next;
+    ci_stats_mark = now;
+}
+
+void ci_StatsBegin(void) {
+    memset(&ci_stats, 0, sizeof(ci_stats));
+    ci_stats.files = 1;
+    ci_stats.faults = ci_Faults();
+    ci_stats.t_total = ci_Now();
+}
+
+// Prints string as JSON string literal.
+void ci_JsonString(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') fprintf(out, "\\%c", *str);
+        else if ((uint8_t) *str < 0x20) fprintf(out, "\\u%04x", (uint8_t) *str);
+        else fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+// Like ci_JsonString(), but through ci_print().
+void ci_JsonPrint(const char *str) {
+    char out[256];
+    uint32_t n = 0;
+    out[n++] = '"';
+    for (; *str; str++) {
+        if (n > sizeof(out) - 8) {
+            out[n] = 0;
+            ci_print("%s", out);
+            n = 0;
+        }
+        if (*str == '"' || *str == '\\') { out[n++] = '\\'; out[n++] = *str; }
+        else if ((uint8_t) *str < 0x20) n += sprintf(out + n, "\\u%04x", (uint8_t) *str);
+        else out[n++] = *str;
+    }
+    out[n++] = '"';
+    out[n] = 0;
+    ci_print("%s", out);
+}
+
+// Prints stats s (of a file or total) on stderr.
+void ci_StatsPrint(const char *name, const CI_stats *s, int status) {
+    uint64_t ms = 1000000;
+    if (ci_cfg.stats == 2) {
+        fprintf(stderr, "{\"type\":\"%s\",", (name ? "file" : "total"));
+        if (name) {
+            fprintf(stderr, "\"file\":");
+            ci_JsonString(stderr, name);
+            fprintf(stderr, ",\"status\":%d,", status);
+        } else {
+            fprintf(stderr, "\"files\":%"PRIu64",\"failed\":%"PRIu64",", s->files, s->failed);
+        }
+        fprintf(stderr, "\"ns\":{\"total\":%"PRIu64",\"read\":%"PRIu64",\"header\":%"PRIu64","
+            "\"blocks\":%"PRIu64",\"convert\":%"PRIu64",\"output\":%"PRIu64"},",
+            s->t_total, s->t_read, s->t_header, s->t_blocks, s->t_convert, s->t_output);
+        fprintf(stderr, "\"bytes\":%"PRIu64",\"pages\":%"PRIu64",\"faults\":%"PRIu64",\"blocks\":%"PRIu64","
+            "\"chunks\":%"PRIu64",\"tiles\":%"PRIu64",\"converts\":%"PRIu64",\"peak_rss_kb\":%"PRIu64"}\n",
+            s->bytes, s->pages, s->faults, s->blocks, s->chunks, s->tiles, s->converts, s->peak_rss);
+        return;
+    }
+    if (name) fprintf(stderr, "Stats %s:", name);
+    else fprintf(stderr, "Stats total (%"PRIu64" file(s), %"PRIu64" failed, %.3f ms wall):",
+        s->files, s->failed, (double) ci_stats_total.t_total / ms);
+    fprintf(stderr, " %.3f ms (read %.3f, header %.3f, blocks %.3f; convert %.3f, output %.3f),"
+        " %"PRIu64" bytes, %"PRIu64" pages, %"PRIu64" faults, %"PRIu64" blocks, %"PRIu64" chunks,"
+        " %"PRIu64" tiles, %"PRIu64" conversions, peak RSS %"PRIu64" kB\n",
+        (double) (name ? s->t_total : s->t_read + s->t_header + s->t_blocks) / ms,
+        (double) s->t_read / ms, (double) s->t_header / ms, (double) s->t_blocks / ms,
+        (double) s->t_convert / ms, (double) s->t_output / ms,
+        s->bytes, s->pages, s->faults, s->blocks, s->chunks, s->tiles, s->converts, s->peak_rss);
+}
+
+// Adds s to total t, wall time excluded.
+void ci_StatsAdd(CI_stats *t, const CI_stats *s) {
+    t->files += s->files;
+    t->failed += s->failed;
+    t->t_read += s->t_read;
+    t->t_header += s->t_header;
+    t->t_blocks += s->t_blocks;
+    t->t_convert += s->t_convert;
+    t->t_output += s->t_output;
+    t->bytes += s->bytes;
+    t->pages += s->pages;
+    t->faults += s->faults;
+    t->blocks += s->blocks;
+    t->chunks += s->chunks;
+    t->tiles += s->tiles;
+    t->converts += s->converts;
+    if (s->peak_rss > t->peak_rss) t->peak_rss = s->peak_rss;
+}
+
+// Completes stats of current file, prints them and adds to total.
+void ci_StatsEnd(int status) {
+    CI_stats *s = &ci_stats;
+#ifndef WIN32
+    uint64_t page = sysconf(_SC_PAGESIZE);
+#else
+    uint64_t page = 4096;
+#endif
+    s->t_total = ci_Now() - s->t_total;
+    s->pages = (s->bytes + page-1) / page;
+    s->faults = ci_Faults() - s->faults;
+    s->peak_rss = ci_PeakRss(0);
+    s->failed = (status != EXIT_SUCCESS);
+    ci_StatsPrint(ci_filename, s, status);
+    ci_StatsAdd(&ci_stats_total, s);
+}
+
+// Total of a worker; its wall time isn't needed.
+void ci_StatsSave(FILE *out) {
+    fwrite(&ci_stats_total, sizeof(CI_stats), 1, out);
+}
+
+void ci_StatsLoad(FILE *in) {
+    CI_stats s;
+    if (fread(&s, sizeof(CI_stats), 1, in) == 1) ci_StatsAdd(&ci_stats_total, &s);
+}
+
+void ci_StatsReport(void) {
+    uint64_t rss = ci_PeakRss(1);
+    ci_stats_total.t_total = ci_Now() - ci_stats_total.t_total;
+    if (rss > ci_stats_total.peak_rss) ci_stats_total.peak_rss = rss;
+    fflush(stdout);
+    ci_StatsPrint(NULL, &ci_stats_total, 0);
+}
+
 // ------------------------- PROGRAM BODY -------------------------
 
 void ci_ProcessArguments(int argc, char **argv) {
-    uint32_t i, j, k, found, err = 0;
+    uint32_t i, j, found, err = 0;
     // Not enough arguments - no fun
     if (argc < 2) {
         printf(ci_msg_welcome);
-        printf("Usage: %s [options...] <file.cpt>\n", argv[0]);
+        printf("Usage: %s [options...] <file.cpt> [file.cpt...]\n", argv[0]);
         uint8_t maxlen = 0;
         for (i=0; ci_arg[i].name; i++) if (strlen(ci_arg[i].name) > maxlen) maxlen = strlen(ci_arg[i].name);
         for (i=0; ci_arg[i].name; i++) {
@@ -283,42 +1527,147 @@ void ci_ProcessArguments(int argc, char **argv) {
         }
         // If argument found, look up next one
         if (found) continue;
-        // Not found, so probably it's a filename
-        // However if already filename found, it's an error
-        if (!found && ci_filename)  {
-            ci_filename = NULL;
-            break;
-        }
-        // This is a filename then
-        ci_filename_pos = i;
-        ci_filename = argv[i];
+        // Not found, so it's a filename
+        if (!ci_files_num) ci_filename_pos = i;
+        ci_AddFileName(argv[i]);
     }
-    // If no file name provided, report as error
-    if (!ci_filename) {
+
+    // Get -l <file> value, append names from list
+    uint32_t arg_pos;
+    arg_pos = ci_FindArg(CI_ARG_FILE_LIST);
+    if (arg_pos && ++arg_pos < argc) ci_ReadFileList(argv[arg_pos]);
+
+    // Get -tq <dir> <words> values, query needs no files
+    arg_pos = ci_FindArg(CI_ARG_TEXT_QUERY);
+    if (arg_pos && arg_pos+2 < argc) exit(ci_TextQueryRun(argv[arg_pos+1], argv[arg_pos+2]));
+
+    // If no file name provided, report as error
+    if (!ci_files_num) {
         printf("%s Invalid command line parameters given!\n", ci_error_str);
         exit(EXIT_FAILURE);
     }
-    // Get short file name
-    ci_filename_short = strrchr(ci_filename, ci_path_separator);
-    if (!ci_filename_short) ci_filename_short = ci_filename;
-    else ci_filename_short++;
-    // Make short file name with '_'
-    k = strlen(ci_filename_short);
-    ci_filename_short__ = (char *) malloc(k+1);
-    strcpy(ci_filename_short__, ci_filename_short);
-    for (i=0; i < k; i++) if (ci_filename_short__[i] == ' ') ci_filename_short__[i] = '_';
 
-    char *dot = strrchr(ci_filename_short, '.');
-    uint32_t dotpos;
-    if (dot) dotpos = dot - ci_filename_short;
-	else dotpos = strlen(ci_filename_short);
-    ci_basename = (char *) malloc(dotpos+1);            // basename + \0
-    ci_tempname = (char *) malloc(dotpos+1+4);          // basename + .ext + \0
-    memcpy(ci_basename, ci_filename_short, dotpos);
-    ci_basename[dotpos] = '\0';
+    // Get -j <n> value
+    ci_cfg.workers = 1;
+    arg_pos = ci_FindArg(CI_ARG_WORKERS);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.workers = atoi(argv[arg_pos]);
+#ifndef WIN32
+        if (!ci_cfg.workers) ci_cfg.workers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (!ci_cfg.workers) ci_cfg.workers = 1;
+    }
+
+    // Get -t <n> value
+    ci_cfg.threads = 1;
+    arg_pos = ci_FindArg(CI_ARG_THREADS);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.threads = atoi(argv[arg_pos]);
+#ifndef WIN32
+        if (!ci_cfg.threads) ci_cfg.threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (!ci_cfg.threads) ci_cfg.threads = 1;
+    }
+
+    // Get -phd <n> value
+    ci_cfg.phash_dist = CI_PHASH_DIST;
+    arg_pos = ci_FindArg(CI_ARG_PHASH_DIST);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.phash_dist = atoi(argv[arg_pos]);
+        if (ci_cfg.phash_dist > 64) ci_cfg.phash_dist = 64;
+        ci_cfg.phash = 1;
+    }
+
+#ifdef CI_URING
+    // Get --uring <n> value; whole files are needed by -db, -dr
+    arg_pos = ci_FindArg(CI_ARG_URING);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.uring = atoi(argv[arg_pos]);
+        if (!ci_cfg.uring) ci_cfg.uring = CI_URING_DEPTH;
+        if (ci_cfg.archive || ci_cfg.dump_blocks || ci_cfg.dedup) ci_cfg.uring = 0;
+    }
+#endif
+
+    // Get --where <expr> value
+    arg_pos = ci_FindArg(CI_ARG_WHERE);
+    if (arg_pos && ++arg_pos < argc) {
+        const char *at = argv[arg_pos];
+        switch (ci_WhereCompile(&ci_where, argv[arg_pos], &at)) {
+            case 0: ci_cfg.where = 1; break;
+            case CI_WHERE_ERR_NAME:
+                printf("%s Unknown name in "CI_ARG_WHERE" expression: %s\n", ci_error_str, at);
+                exit(EXIT_FAILURE);
+            case CI_WHERE_ERR_SCOPE:
+                printf("%s Block field outside any()/count(), or file field or any()/count() inside, in "CI_ARG_WHERE" expression: %s\n", ci_error_str, at);
+                exit(EXIT_FAILURE);
+            case CI_WHERE_ERR_FULL:
+                printf("%s "CI_ARG_WHERE" expression too long or too deep: %s\n", ci_error_str, at);
+                exit(EXIT_FAILURE);
+            default:
+                printf("%s Syntax error in "CI_ARG_WHERE" expression at: %s\n", ci_error_str, at);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    // Get -ds <dir> value
+    arg_pos = ci_FindArg(CI_ARG_DUMP_STORE);
+    if (arg_pos && ++arg_pos < argc) ci_cfg.store = argv[arg_pos];
+
+    // Get --set-dpi <n|XxY>, --set-comment <text> values; edits need
+    // file header only, which streamed input reads and no more
+    arg_pos = ci_FindArg(CI_ARG_SET_DPI);
+    if (arg_pos && ++arg_pos < argc) {
+        // <n> or <X>x<Y> and nothing else, files are written in place
+        char *p = argv[arg_pos], *end = p;
+        unsigned long x = 0, y = 0;
+        if (*p >= '0' && *p <= '9') {
+            x = y = strtoul(p, &end, 10);
+            if (*end == 'x' && end[1] >= '0' && end[1] <= '9') y = strtoul(end+1, &end, 10);
+        }
+        if (*end || x < CPT_DPI_MIN || x > CPT_DPI_MAX || y < CPT_DPI_MIN || y > CPT_DPI_MAX) {
+            printf("%s "CI_ARG_SET_DPI" takes resolution of %u-%u DPI!\n", ci_error_str, CPT_DPI_MIN, CPT_DPI_MAX);
+            exit(EXIT_FAILURE);
+        }
+        ci_cfg.set_xdpi = x;
+        ci_cfg.set_ydpi = y;
+        ci_cfg.edit = 1;
+    }
+    arg_pos = ci_FindArg(CI_ARG_SET_COMMENT);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.set_comment = argv[arg_pos];
+        ci_cfg.edit = 1;
+    }
+    if (ci_cfg.edit) ci_cfg.stream = 1;
+
+    // Get -ti <dir> value; blocks of a file are indexed in order, by one thread
+    arg_pos = ci_FindArg(CI_ARG_TEXT_INDEX);
+    if (arg_pos && ++arg_pos < argc) {
+        ci_cfg.text_index = argv[arg_pos];
+        ci_cfg.threads = 1;
+    }
+
+    // Get --arrow <dir> value
+    arg_pos = ci_FindArg(CI_ARG_ARROW);
+    if (arg_pos && ++arg_pos < argc) ci_cfg.arrow = argv[arg_pos];
+
+    // Get --repack <dir> value
+    arg_pos = ci_FindArg(CI_ARG_REPACK);
+    if (arg_pos && ++arg_pos < argc) ci_cfg.repack = argv[arg_pos];
+
+    // --diff collects both files in order, in one process and thread
+    if (ci_cfg.diff) {
+        if (ci_files_num != 2 && !ci_cfg.archive) {
+            printf("%s "CI_ARG_DIFF" takes two files!\n", ci_error_str);
+            exit(EXIT_FAILURE);
+        }
+        ci_cfg.workers = 1;
+        ci_cfg.threads = 1;
+#ifdef CI_URING
+        ci_cfg.uring = 0;
+#endif
+    }
 
     // Get -c <charset> value
-    uint32_t arg_pos;
     arg_pos = ci_FindArg(CI_ARG_CHARSET);
     if (arg_pos) ci_cfg.charset = argv[++arg_pos];
 
@@ -357,28 +1706,412 @@ void ci_ProcessArguments(int argc, char **argv) {
     ci_cfg.verbosity_level |= ci_cfg.verbose2 << 1;
     ci_cfg.verbosity_level |= ci_cfg.silent_header << 2;
     ci_cfg.verbosity_level |= ci_cfg.silent_blocks << 3;
+
+    // Aggregating and listing modes print their report only
+    if (ci_cfg.census || ci_cfg.dedup || ci_cfg.object_names || ci_cfg.chunks_json || ci_cfg.where || ci_cfg.text_index || ci_cfg.arrow) {
+        ci_cfg.quiet = 1;
+        ci_cfg.verbose = 1;
+        ci_cfg.silent_header = 0;
+        ci_cfg.silent_blocks = 0;
+        ci_cfg.verbosity_level = 0;
+    }
+    // Edits, --diff and --repack print errors and their own lines only
+    if (ci_cfg.edit || ci_cfg.diff || ci_cfg.repack) {
+        ci_cfg.verbose = 1;
+        ci_cfg.silent_header = 0;
+        ci_cfg.silent_blocks = 0;
+        ci_cfg.verbosity_level = 0;
+    }
+}
+
+// Sets up all file name variants for the file about to be processed.
+void ci_SetFileName(char *name) {
+    uint32_t i, k;
+    ci_filename = name;
+    // Get short file name
+    ci_filename_short = strrchr(ci_filename, ci_path_separator);
+    if (!ci_filename_short) ci_filename_short = ci_filename;
+    else ci_filename_short++;
+    // Archive member: short names of both archive and member (paths in
+    // tar and zip use '/'), so members stay apart
+    if (ci_member_path) {
+        char *archive = ci_filename, *member = strrchr(ci_member_path, '/');
+        k = strlen(ci_filename) - strlen(ci_member_path) - 1;
+        for (i=0; i < k; i++) if (ci_filename[i] == ci_path_separator) archive = ci_filename + i + 1;
+        ci_filename_short = ci_ArenaPrintf(&ci_arena, "%.*s:%s", (int) (ci_filename + k - archive), archive,
+            (member ? member + 1 : ci_member_path));
+    }
+    // Make short file name with '_'
+    k = strlen(ci_filename_short);
+    ci_filename_short__ = ci_ArenaStrdup(&ci_arena, ci_filename_short);
+    for (i=0; i < k; i++) if (ci_filename_short__[i] == ' ') ci_filename_short__[i] = '_';
+
+    char *dot = strrchr(ci_filename_short, '.');
+    uint32_t dotpos;
+    if (dot) dotpos = dot - ci_filename_short;
+	else dotpos = strlen(ci_filename_short);
+    ci_basename = (char *) ci_ArenaAlloc(&ci_arena, dotpos+1);      // basename + \0
+    ci_tempname = (char *) ci_ArenaAlloc(&ci_arena, dotpos+1+4);    // basename + .ext + \0
+    memcpy(ci_basename, ci_filename_short, dotpos);
+    ci_basename[dotpos] = '\0';
+}
+
+// Releases everything allocated for the current file.
+void ci_FinishFile(void) {
+    // Names and strings of the file all go at once
+    ci_ArenaReset(&ci_arena);
+    if (!ci_basename) return;
+    if (!ci_cfg.verbose && ci_cfg.silent_header) ci_print("\n");
+    // Done with the file, its pages can go (--nocache)
+    if (ci_plan.fd >= 0) ci_PlanEnd(&ci_plan, (ci_filesize >= 0 ? (uint64_t) ci_filesize : ci_stream_pos));
+    if (f) { fclose(f); f = NULL; }
+    if (ci_stream) {
+        // ci_data is in ci_stream_buf; members are closed by their archive
+        if (ci_stream == &ci_input) {
+            ci_InputClose(&ci_input);
+            if (ci_input.file != stdin) fclose(ci_input.file);
+        }
+        ci_stream = NULL;
+        ci_data = NULL;
+    }
+    ci_filename_short__ = NULL;
+    ci_tempname = NULL;
+    ci_basename = NULL;
+    free(ci_data); ci_data = NULL;
+}
+
+void ci_IdentifyFile(void);
+void ci_WhereHeader(void);
+void ci_ArrowHeader(void);
+uint32_t ci_IsChunk(uint32_t chunk);
+
+// --- Streamed input ---
+// Files read forward only: '-' (stdin), pipes, gzip/zstd compressed files
+// and all with --stream. File head (header, ICC, palette, comment, block
+// table) is read as far as header parser views it and stays in buffer.
+// Then each block is read in turn: its head (block header, chunks, tile
+// list) is kept in rest of buffer, its tile data skipped, or read through
+// when tile markers are needed. So memory needed is fixed, whatever the
+// file size, but blocks have to be stored in file order. Nothing past the
+// last block looked at is read, header only probes stop early.
+
+// Reads up to len bytes of streamed input, less only at end of input.
+uint64_t ci_StreamRead(uint8_t *buf, uint64_t len) {
+    uint64_t n = ci_InputRead(ci_stream, buf, len);
+    ci_stream_pos += n;
+    ci_stats.bytes += n;
+    return n;
+}
+
+// Drops len bytes of streamed input (files are seeked over).
+uint64_t ci_StreamSeek(uint64_t len) {
+    uint64_t n = ci_InputSkip(ci_stream, len);
+    ci_stream_pos += n;
+    return n;
+}
+
+// Drops len bytes of plain file, reading just tile markers in them: their
+// order is known from tile list, so kernel is told about next ones ahead.
+uint64_t ci_StreamSkipMarkers(uint64_t len) {
+    uint64_t start = ci_stream_pos, end = ci_stream_pos + len, o, n;
+    uint32_t k;
+    CI_tile_marker *m;
+    for (k=0; k < CI_PLAN_MARKERS && k < ci_stream_markers; k++)
+        ci_PlanAhead(&ci_plan, ci_stream_marker[k].offs, 4);
+    for (k=0; k < ci_stream_markers; k++) {
+        m = &ci_stream_marker[k];
+        if (k + CI_PLAN_MARKERS < ci_stream_markers)
+            ci_PlanAhead(&ci_plan, ci_stream_marker[k + CI_PLAN_MARKERS].offs, 4);
+        // Tiles sharing data
+        if (k && m->offs == m[-1].offs) {
+            m->value = m[-1].value;
+            m->got = m[-1].got;
+        }
+        o = (uint64_t) m->offs + m->got;
+        if (m->got == 4 || o < ci_stream_pos) continue;
+        if (o >= end || ci_StreamSeek(o - ci_stream_pos) < o - ci_stream_pos) break;
+        n = (end - o < 4u - m->got ? end - o : 4u - m->got);
+        m->got += ci_StreamRead((uint8_t *) &m->value + m->got, n);
+    }
+    if (ci_stream_pos < end) ci_StreamSeek(end - ci_stream_pos);
+    return ci_stream_pos - start;
+}
+
+// Drops len bytes of streamed input, picking up tile markers in them.
+// Returns number of bytes dropped, less only at end of input.
+uint64_t ci_StreamSkip(uint64_t len) {
+    uint8_t *scratch = ci_stream_buf + CI_STREAM_BUF;
+    uint64_t done = 0, pos, o;
+    uint32_t k, first = 0;
+    size_t n;
+    if (!ci_stream_markers && !ci_stream_hash) return ci_StreamSeek(len);
+    if (ci_plan.fd >= 0 && !ci_stream_hash) return ci_StreamSkipMarkers(len);
+    while (done < len) {
+        pos = ci_stream_pos;
+        n = ci_StreamRead(scratch, (len - done < CI_STREAM_SCRATCH ? len - done : CI_STREAM_SCRATCH));
+        if (!n) break;
+        done += n;
+        if (ci_stream_hash) ci_HashUpdate(ci_stream_hash, scratch, n);
+        // Markers are sorted; one may span two reads
+        for (k=first; k < ci_stream_markers && ci_stream_marker[k].offs < pos + n; k++) {
+            CI_tile_marker *m = &ci_stream_marker[k];
+            for (; m->got < 4 && (o = (uint64_t) m->offs + m->got) < pos + n; m->got++)
+                if (o >= pos) ((uint8_t *) &m->value)[m->got] = scratch[o - pos];
+            if (k == first && m->got == 4) first++;
+        }
+    }
+    return done;
+}
+
+int ci_TileMarkerCmp(const void *a, const void *b) {
+    const CI_tile_marker *x = a, *y = b;
+    return (x->offs > y->offs) - (x->offs < y->offs);
+}
+
+// Notes tiles of CPT9 block in ci_data whose markers are past its head
+// in buffer (up to end), ci_StreamSkip() picks them up. Tile list is
+// found as in ci_ProcessBlock9(), but only as far as it's in buffer.
+void ci_StreamMarkers(uint64_t end) {
+    uint64_t kept = (uint64_t) ci_stream_offs + ci_data_len, offset, data_start, o, i;
+    CI_tile_marker *m;
+    ci_stream_markers = 0;
+    if (ci.version != 0x900 || ci_data_len < CPT9_Block_sz) return;
+    offset = CPT9_Block_sz + (uint64_t) ((CPT9_Block *) ci_data)->size1;
+    if (offset + 4 > ci_data_len) return;
+    data_start = GETu32(ci_data, offset);
+    for (i=0; ci_stream_offs + offset + i < data_start && offset + i + 4 <= ci_data_len; i+=8) {
+        o = GETu32(ci_data, offset+i);
+        if (o + 4 <= kept || o < ci_stream_offs || o >= end) continue;
+        if (ci_stream_markers == ci_stream_markers_size) {
+            ci_stream_markers_size = 2*ci_stream_markers_size + 256;
+            ci_stream_marker = (CI_tile_marker *) realloc(ci_stream_marker, ci_stream_markers_size*sizeof(CI_tile_marker));
+        }
+        m = &ci_stream_marker[ci_stream_markers++];
+        m->offs = o;
+        m->value = 0;
+        // Marker may start at end of kept head
+        for (m->got=0; o + m->got < kept; m->got++)
+            ((uint8_t *) &m->value)[m->got] = ci_data[o + m->got - ci_stream_offs];
+    }
+    if (ci_stream_markers) qsort(ci_stream_marker, ci_stream_markers, sizeof(CI_tile_marker), ci_TileMarkerCmp);
+}
+
+// Makes len bytes at buf+offs available, called when they aren't in
+// ci_data: file head is read on (up to buffer size), so is block head
+// read lazily (up to rest of buffer). Returns 1 if the bytes are in
+// ci_data now.
+int ci_StreamNeed(const void *buf, uint64_t offs, uint64_t len) {
+    uint64_t base = (uintptr_t) buf - (uintptr_t) ci_data, end;
+    uint64_t cap = (ci_stream_head ? CI_STREAM_BUF : ci_stream_size);
+    if (base > cap || offs > cap - base || len > cap - base - offs) {
+        // Might be in file, but too far to keep
+        if (ci_stream_head) ci_stream_full = 1;
+        return 0;
+    }
+    end = base + offs + len;
+    // Inside the block, but dropped as tile data
+    if (!ci_stream_head && !(ci_stream_lazy && end <= ci_stream_keep)) {
+        ci_stream_full = 1;
+        return 0;
+    }
+    ci_data_len += ci_StreamRead(ci_data + ci_data_len, end - ci_data_len);
+    return (end <= ci_data_len);
+}
+
+// Starts reading file from in forward only: file header.
+void ci_StreamBegin(CI_input *in) {
+    struct stat sb;
+    uint64_t size = in->size, base;
+    int fd;
+    if (!ci_stream_buf) ci_stream_buf = (uint8_t *) malloc(CI_STREAM_BUF + CI_STREAM_SCRATCH);
+    ci_stream = in;
+    ci_stream_pos = 0;
+    ci_stream_head = 1;
+    ci_stream_full = 0;
+    ci_stream_markers = 0;
+    ci_stream_lazy = 0;
+    if (ci_InputDetect(in) < 0) {
+        ci_msg(0, "%s %s is zstd compressed, CPTInfo built without zstd support!\n", ci_error_str, ci_filename);
+        ci_Abort(EXIT_FAILURE);
+    }
+    if ((fd = ci_InputFd(in, &base)) >= 0) ci_PlanBegin(&ci_plan, fd, base, ci_cfg.nocache);
+    // Size is known for uncompressed files and archive members only
+    if (in->method != CI_INPUT_RAW) size = in->size;
+    else if (size == UINT64_MAX && !fstat(fileno(in->file), &sb) && S_ISREG(sb.st_mode)) size = sb.st_size;
+    ci_filesize = (size <= INT32_MAX ? (int32_t) size : -1);
+    ci_data = ci_stream_buf;
+    ci_data_len = ci_StreamRead(ci_data, CPT_FileHeader_sz);
+    if (ci_data_len < CPT_FileHeader_sz) ci_Corrupt();
+    ci_IdentifyFile();
+}
+
+// File head is done, it stays where it is; blocks go after it.
+void ci_StreamHeadEnd(void) {
+    ci_stream_head = 0;
+    ci_stream_head_len = ci_data_len;
+}
+
+// Reads block i of streamed input: drops input up to it, keeps block head
+// (as much as rest of buffer takes) in ci_data. Without tile markers to
+// pick up only block header is read, rest of head when it's viewed (see
+// ci_StreamNeed()), tile data is skipped by next block. Otherwise tile
+// data is read through, picking up markers. Last block ends with input.
+// Returns size.
+uint32_t ci_StreamBlock(uint32_t i) {
+    uint64_t offs = ci_blocks_table[i].offs;
+    uint64_t end = (i < ci.blocks_num-1 ? ci_blocks_table[i+1].offs : UINT64_MAX);
+    uint64_t keep = CI_STREAM_BUF - ci_stream_head_len, have = 0, want;
+    CI_hash h;
+    ci_stream_markers = 0;
+    if (end == UINT64_MAX && ci_filesize >= 0) end = ci_filesize;
+    if (end < offs) ci_Corrupt();
+    if (end - offs < keep) keep = end - offs;
+    ci_data = ci_stream_buf + ci_stream_head_len;
+    ci_stream_offs = offs;
+    if (offs < ci_stream_pos) {
+        // Header parser may have read on into blocks (wide comment check)
+        if (ci_stream_pos != ci_stream_head_len) {
+            ci_msg(0, "%s Block %04x isn't stored in file order, can't read it from stream!\n", ci_error_str, i);
+            ci_Abort(EXIT_FAILURE);
+        }
+        have = ci_stream_pos - offs;
+        if (have > keep) {
+            // Rest of it is read already and can't be kept
+            if (keep < end - offs) {
+                ci_stream_full = 1;
+                ci_Corrupt();
+            }
+            have = keep;
+        }
+        memcpy(ci_data, ci_stream_buf + offs, have);
+    } else if (ci_StreamSkip(offs - ci_stream_pos) < offs - ci_stream_pos) ci_Corrupt();
+    ci_PlanBehind(&ci_plan, ci_stream_pos);
+    // Size of block has to be known to read it lazily
+    ci_stream_lazy = (end != UINT64_MAX && !ci_cfg.output_data && !ci_cfg.census && !ci_cfg.diff && !ci_cfg.pixel_stats && !ci_cfg.phash && !ci_cfg.dedup);
+    ci_stream_keep = keep;
+    want = (ci_stream_lazy && keep > CPT9_Block_sz ? CPT9_Block_sz : keep);
+    ci_data_len = have + (want > have ? ci_StreamRead(ci_data + have, want - have) : 0);
+    if (ci_stream_lazy) {
+        if (ci_data_len < want || end - offs > UINT32_MAX) ci_Corrupt();
+        ci_stream_size = end - offs;
+        return ci_stream_size;
+    }
+    // -dr: block is hashed as it goes, whole of it doesn't fit
+    if (ci_cfg.dedup) {
+        ci_HashInit(&h, 0);
+        ci_HashUpdate(&h, ci_data, ci_data_len);
+    }
+    if (ci_data_len == keep && ci_stream_pos < end) {
+        if (ci_cfg.output_data || ci_cfg.census) ci_StreamMarkers(end);
+        if (ci_cfg.dedup) ci_stream_hash = &h;
+        ci_StreamSkip(end - ci_stream_pos);
+        ci_stream_hash = NULL;
+    }
+    if ((end != UINT64_MAX && ci_stream_pos < end) || ci_stream_pos - offs > UINT32_MAX) ci_Corrupt();
+    ci_stream_size = ci_stream_pos - offs;
+    if (ci_cfg.dedup) ci_DedupAddHash(CI_DUP_BLOCK, ci_HashFinal(&h), ci_stream_size, i);
+    return ci_stream_size;
+}
+
+// Block of size bytes at file offset offs. Streamed input has it (or its
+// head only) in ci_data already, see ci_StreamBlock().
+const uint8_t *ci_BlockView(uint32_t offs, uint32_t size) {
+    if (ci_stream) return ci_data;
+    return ci_ViewAt(ci_data, offs, size);
+}
+
+// Marker (first dword) of tile data at file offset offs.
+uint32_t ci_TileMarker(uint32_t offs) {
+    CI_tile_marker key, *m;
+    if (!ci_stream) return GETu32(ci_data, offs);
+    if (offs >= ci_stream_offs && offs - ci_stream_offs < ci_data_len)
+        return GETu32(ci_data, offs - ci_stream_offs);
+    key.offs = offs;
+    m = (ci_stream_markers ? (CI_tile_marker *) bsearch(&key, ci_stream_marker, ci_stream_markers, sizeof(CI_tile_marker), ci_TileMarkerCmp) : NULL);
+    if (!m) {
+        ci_msg(0, "%s Tile data @ 0x%08x is out of its block, can't read it from stream!\n", ci_error_str, offs);
+        ci_Abort(EXIT_FAILURE);
+    }
+    if (m->got < 4) ci_Corrupt();
+    return m->value;
+}
+
+// Tile data of len bytes at file offset offs, NULL if it's not in memory:
+// out of file, or streamed block didn't fit into buffer.
+const uint8_t *ci_TileView(uint32_t offs, uint32_t len) {
+    if (!ci_stream) return (offs <= ci_data_len && len <= ci_data_len - offs ? ci_data + offs : NULL);
+    if (offs < ci_stream_offs || offs - ci_stream_offs > ci_data_len || len > ci_data_len - (offs - ci_stream_offs)) return NULL;
+    return ci_data + (offs - ci_stream_offs);
+}
+
+// Opens plain file for streamed reading.
+void ci_StreamFile(FILE *file) {
+#ifdef WIN32
+    if (file == stdin) _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    ci_InputOpen(&ci_input, file, CI_INPUT_RAW, UINT64_MAX, UINT64_MAX);
+    ci_StreamBegin(&ci_input);
+}
+
+// Does (regular) file start with gzip or zstd magic? Rewinds it.
+int ci_IsCompressed(FILE *file) {
+    CI_input in;
+    int method;
+    ci_InputOpen(&in, file, CI_INPUT_RAW, 4, UINT64_MAX);
+    method = ci_InputDetect(&in);
+    ci_InputClose(&in);
+    rewind(file);
+    return method != CI_INPUT_RAW;
 }
 
 void ci_ReadFileContents(void) {
-    uint32_t i, is_cpt = 0;
+    struct stat sb;
+    memset(&ci, 0, sizeof(ci));
+    if (ci_member) {
+        ci_StreamBegin(ci_member);
+        return;
+    }
+    // '-' is standard input
+    if (!strcmp(ci_filename, "-")) {
+        ci_StreamFile(stdin);
+        return;
+    }
     // Try to open .cpt file, get file size.
     if (!(f = fopen(ci_filename, "rb"))) {
-        printf("%s Can't open file %s!\n", ci_error_str, ci_filename);
-        exit(EXIT_FAILURE);
+        ci_msg(0, "%s Can't open file %s!\n", ci_error_str, ci_filename);
+        ci_Abort(EXIT_FAILURE);
+    }
+    // Pipes can't be read whole, only forward; neither can compressed files
+    if (ci_cfg.stream || fstat(fileno(f), &sb) || !S_ISREG(sb.st_mode) || ci_IsCompressed(f)) {
+        FILE *in = f;
+        f = NULL;
+        ci_StreamFile(in);
+        return;
     }
     ci_filesize = ci_FileSize(f);
+    ci_PlanBegin(&ci_plan, fileno(f), 0, ci_cfg.nocache);
     // If filesize smaller then size of header, file
     // is corrupt for sure. Will check more later
     if (ci_filesize < CPT_FileHeader_sz) {
-        printf(ci_error_file_corrupt_str, ci_error_str);
-        exit(EXIT_FAILURE);
+        ci_msg(0, ci_error_file_corrupt_str, ci_error_str);
+        ci_Abort(EXIT_FAILURE);
     }
-    
-    printf("%d costam\n");
-    
+
     // Read the header
     ci_data = (uint8_t *) malloc(CPT_FileHeader_sz);
-    fread(ci_data, 1, CPT_FileHeader_sz, f);
+    ci_stats.bytes += fread(ci_data, 1, CPT_FileHeader_sz, f);
+    ci_IdentifyFile();
+    // Read the rest of the file
+    ci_data = (uint8_t *) realloc(ci_data, ci_filesize);
+    ci_f_header = (CPT_FileHeader *) ci_data;
+    ci_stats.bytes += fread(ci_data+CPT_FileHeader_sz, 1, ci_filesize-CPT_FileHeader_sz, f);
+    ci_data_len = ci_filesize;
+    // File stays open until ci_FinishFile(), dumps copy straight from it
+}
+
+// Sets ci.version from the header in ci_data, stops if it's not CPT.
+void ci_IdentifyFile(void) {
+    uint32_t i, is_cpt = 0;
     ci_f_header = (CPT_FileHeader *) ci_data;
     // Is it CPT7-CPT9 file?    
     for (i=0; i < CPT_VERSIONS_NUM; i++) {
@@ -401,45 +2134,426 @@ void ci_ReadFileContents(void) {
     }
     // It's not CPT, thus an error
     if (!is_cpt) {
-        printf(ci_error_file_notcpt_str, ci_error_str);
-        exit(EXIT_FAILURE);
+        ci_msg(0, ci_error_file_notcpt_str, ci_error_str);
+        ci_Abort(EXIT_FAILURE);
     }
-    // Read the rest of the file
-    ci_data = (uint8_t *) realloc(ci_data, ci_filesize);
-    ci_f_header = (CPT_FileHeader *) ci_data;
-    fread(ci_data+CPT_FileHeader_sz, 1, ci_filesize-CPT_FileHeader_sz, f);
-    
-    fclose(f); f = NULL;
+    if (ci_cfg.arrow) ci_ArrowHeader();
+    if (ci_cfg.where) ci_WhereHeader();
+}
+
+// Header probe of --where, right after file header is read: if its
+// fields decide the expression, the file is done, nothing else of it is
+// read. Otherwise its blocks are counted (ci_WhereBlock9()).
+void ci_WhereHeader(void) {
+    CI_where_file *wf = &ci_where_file;
+    memset(ci_where_count, 0, sizeof(ci_where_count));
+    ci_where_blocks = ci_where_done = 0;
+    // CPT6 header is different, those files are not handled
+    if (ci.version == 0x600) ci_Abort(EXIT_SUCCESS);
+    wf->v[CI_WF_VERSION] = ci.version;
+    wf->v[CI_WF_MODEL] = ci_f_header->color_model;
+    wf->v[CI_WF_XDPI] = lround((double) (ci_f_header->xdpi) * cpt_dpi_scale);
+    wf->v[CI_WF_YDPI] = lround((double) (ci_f_header->ydpi) * cpt_dpi_scale);
+    wf->v[CI_WF_DPI] = (wf->v[CI_WF_XDPI] < wf->v[CI_WF_YDPI] ? wf->v[CI_WF_XDPI] : wf->v[CI_WF_YDPI]);
+    wf->v[CI_WF_ICC] = !!(ci_f_header->flags & CPT_EMB_ICC_PROFILE);
+    wf->v[CI_WF_WCOMMENT] = !!(ci_f_header->flags & CPT_EMB_WIDE_COMMENT);
+    wf->v[CI_WF_FLAGS] = ci_f_header->flags;
+    wf->v[CI_WF_PALETTE] = ci_f_header->palette_entries;
+    wf->v[CI_WF_BLOCKS] = ci_f_header->blocks_num;
+    ci_where_match = ci_WhereEval(&ci_where, wf, NULL, 0);
+    if (ci_where_match != CI_WHERE_UNKNOWN) ci_Abort(EXIT_SUCCESS);
+}
+
+// --- In-place edit of header fields (--set-dpi, --set-comment) ---
+
+// Rolls back an edit of the file cut short by a crash, before it's read.
+void ci_EditBegin(void) {
+    int r;
+    if (ci_member || !strcmp(ci_filename, "-")) {
+        ci_msg(0, "%s %s can't be edited in place!\n", ci_error_str, ci_filename);
+        ci_Abort(EXIT_FAILURE);
+    }
+    if ((r = ci_EditRecover(ci_filename)) < 0) {
+        ci_msg(0, "%s Can't roll back interrupted edit of %s (journal %s"CI_EDIT_UNDO" kept)!\n", ci_error_str, ci_filename, ci_filename);
+        ci_Abort(EXIT_FAILURE);
+    }
+    if (r) ci_msg(0, "%s Interrupted edit of %s rolled back\n", ci_warning_str, ci_filename);
+}
+
+// Writes new DPI and comments over the ones of parsed header, then the
+// file is done. New values are checked to read back as given first.
+void ci_EditHeader(void) {
+    CI_edit_patch p[3];
+    uint32_t dpi[2], n = 0, len;
+    gchar *conv, *ansi, *wide;
+    int r;
+    if (ci_cfg.set_xdpi) {
+        dpi[0] = lround(ci_cfg.set_xdpi / cpt_dpi_scale);
+        dpi[1] = lround(ci_cfg.set_ydpi / cpt_dpi_scale);
+        if (lround((double) dpi[0] * cpt_dpi_scale) != ci_cfg.set_xdpi || lround((double) dpi[1] * cpt_dpi_scale) != ci_cfg.set_ydpi) {
+            ci_msg(0, "%s %ux%u DPI can't be stored exactly!\n", ci_error_str, ci_cfg.set_xdpi, ci_cfg.set_ydpi);
+            ci_Abort(EXIT_FAILURE);
+        }
+        p[n].offs = offsetof(CPT_FileHeader, xdpi);
+        p[n].len = 2*sizeof(uint32_t);
+        p[n].old = &ci_f_header->xdpi;
+        p[n++].data = dpi;
+    }
+    if (ci_cfg.set_comment) {
+        conv = ci_Convert(ci_cfg.set_comment, strlen(ci_cfg.set_comment), ci_cfg.charset, ci_charset);
+        if (!conv || strlen(conv) >= CPT_NOTE_LEN_A) {
+            ci_msg(0, "%s Comment can't be converted to %s, or is longer than %u bytes!\n", ci_error_str, ci_cfg.charset, CPT_NOTE_LEN_A-1);
+            ci_Abort(EXIT_FAILURE);
+        }
+        ansi = (gchar *) ci_ArenaAlloc(&ci_arena, CPT_NOTE_LEN_A);
+        memset(ansi, 0, CPT_NOTE_LEN_A);
+        strcpy(ansi, conv);
+        p[n].offs = offsetof(CPT_FileHeader, notes);
+        p[n].len = CPT_NOTE_LEN_A;
+        p[n].old = ci_f_header->notes;
+        p[n++].data = ansi;
+        // Wide comment block can't be added, only one there rewritten
+        ci_wcomment = (CPT_WideComment *) (ci_data + ci.wcomment_offs);
+        if (ci.emb_wcomment && ci_InFileAt(ci_data, ci.wcomment_offs, CPT_WideComment_sz) && ci_wcomment->magic == CPT_WIDE_COMMENT_MAGIC) {
+            conv = ci_Convert(ci_cfg.set_comment, strlen(ci_cfg.set_comment), CPT_WIDE_CHARSET, ci_charset);
+            for (len=0; conv && len < CPT_NOTE_LEN_W && (conv[len] || conv[len+1]); len += 2);
+            if (!conv || len >= CPT_NOTE_LEN_W) {
+                ci_msg(0, "%s Comment can't be converted to %s, or is longer than %u characters!\n", ci_error_str, CPT_WIDE_CHARSET, CPT_NOTE_LEN_W/2-1);
+                ci_Abort(EXIT_FAILURE);
+            }
+            wide = (gchar *) ci_ArenaAlloc(&ci_arena, CPT_NOTE_LEN_W);
+            memset(wide, 0, CPT_NOTE_LEN_W);
+            memcpy(wide, conv, len);
+            p[n].offs = ci.wcomment_offs + offsetof(CPT_WideComment, notes);
+            p[n].len = CPT_NOTE_LEN_W;
+            p[n].old = ci_wcomment->notes;
+            p[n++].data = wide;
+        }
+    }
+    switch (r = ci_EditApply(ci_filename, p, n)) {
+        case CI_EDIT_ERR_OPEN:
+            ci_msg(0, "%s Can't open %s for writing!\n", ci_error_str, ci_filename);
+            break;
+        case CI_EDIT_ERR_CHANGED:
+            ci_msg(0, "%s %s is compressed or changed while read!\n", ci_error_str, ci_filename);
+            break;
+        case CI_EDIT_ERR_JOURNAL:
+            ci_msg(0, "%s Can't write journal %s"CI_EDIT_UNDO"!\n", ci_error_str, ci_filename);
+            break;
+        case CI_EDIT_ERR_WRITE:
+        case CI_EDIT_ERR_VERIFY:
+            ci_msg(0, "%s Write to %s failed, old header put back!\n", ci_error_str, ci_filename);
+            break;
+        default:
+            ci_print("%s %s\n", ci_filename, (r ? "updated" : "unchanged"));
+            ci_Abort(EXIT_SUCCESS);
+    }
+    ci_Abort(EXIT_FAILURE);
+}
+
+// --- Repacking into compact compressed files (--repack) ---
+// Whole CPT9 file is rewritten into given directory: file head as it is,
+// block table right after it, then blocks in table order, each with its
+// tiles one after another right after its data pair list, pairs pointing
+// to their new place. Whatever no offset points to is left out. Encodings
+// of tiles (markers) aren't known well enough to re-encode their data, so
+// it's copied as it is and whole file is compressed instead, by -t
+// threads; CPTInfo reads the result like any .cpt.gz (.cpt.zst) file.
+
+#ifdef CI_ZSTD
+#define CI_REPACK_METHOD        CI_REPACK_ZSTD
+#define CI_REPACK_EXT           ".cpt.zst"
+#else
+#define CI_REPACK_METHOD        CI_REPACK_GZIP
+#define CI_REPACK_EXT           ".cpt.gz"
+#endif
+
+uint64_t ci_repack_files, ci_repack_in, ci_repack_out;
+
+// Pieces of repacked file, in ci_arena
+typedef struct _CI_repack_list {
+    CI_repack_piece *piece;
+    uint32_t        num;
+    uint32_t        size;
+} CI_repack_list;
+
+// Adds piece, joined with previous one if it follows that in memory
+// (tiles usually do).
+void ci_RepackAdd(CI_repack_list *l, const uint8_t *data, uint64_t len) {
+    CI_repack_piece *p;
+    if (!len) return;
+    if (l->num && l->piece[l->num-1].data + l->piece[l->num-1].len == data) {
+        l->piece[l->num-1].len += len;
+        return;
+    }
+    if (l->num == l->size) {
+        p = (CI_repack_piece *) ci_ArenaAlloc(&ci_arena, 2*(l->size+16)*sizeof(CI_repack_piece));
+        if (l->num) memcpy(p, l->piece, l->num*sizeof(CI_repack_piece));
+        l->piece = p;
+        l->size = 2*(l->size+16);
+    }
+    l->piece[l->num].data = data;
+    l->piece[l->num].len = len;
+    l->num++;
+}
+
+// Tile of data pair list, sorted by source offset
+typedef struct _CI_repack_tile {
+    uint32_t    src;
+    uint32_t    len;
+    uint64_t    out;            // offset in repacked file, 0 until written
+} CI_repack_tile;
+
+int ci_RepackTileCmp(const void *a, const void *b) {
+    const CI_repack_tile *x = a, *y = b;
+    if (x->src != y->src) return (x->src > y->src) - (x->src < y->src);
+    return (x->len > y->len) - (x->len < y->len);
+}
+
+// Gives data pair list of i-th block: list offset, offset of first data
+// (where the list ends) and end of block. Returns 0 if block has no list.
+uint32_t ci_RepackList(uint32_t i, uint64_t *list, uint32_t *first, uint64_t *end) {
+    uint64_t src = ci_blocks_table[i].offs;
+    const CPT9_Block *block = (const CPT9_Block *) ci_ViewAt(ci_data, src, CPT9_Block_sz);
+    *list = src + CPT9_Block_sz + block->size1;
+    *first = GETu32(ci_data, *list);
+    *end = (i < ci.blocks_num-1 ? ci_blocks_table[i+1].offs : (uint64_t) ci_filesize);
+    if (*end <= src) ci_Corrupt();
+    if (*first <= *list) return 0;
+    if ((*first - *list) % 8 || *first > *end) {
+        ci_msg(0, "%s Data pair list of block %04x not understood!\n", ci_error_str, i);
+        ci_Abort(EXIT_FAILURE);
+    }
+    return 1;
+}
+
+// Lays out blocks anew, then writes them. Goes back through ci_Abort()
+// if the file can't be repacked, nothing is left in dir then. Only bytes
+// of blocks that tiles cover are rewritten; a list that may go on (as
+// -od warns) or bytes no tile points at may be a part of the format not
+// known yet, so such files are not repacked rather than losing them.
+// Tiles several pairs point at are written once.
+void ci_RepackFile(void) {
+    CI_repack_list l = { NULL, 0, 0 };
+    CPT_FileHeader *h;
+    CPT_BlockTableEntry *table;
+    CI_repack_tile *all, *t, key;
+    const uint8_t *tile;
+    uint32_t i, k, n, tiles, *pair, first;
+    uint64_t head, pos, src, list, end, cur, size, written;
+    char *path, *temp;
+    FILE *out;
+
+    if (ci.version != 0x900) {
+        ci_msg(0, "%s Only CPT9 files can be repacked (this one is CPT %s)!\n", ci_error_str, ci_VersionName(ci.version));
+        ci_Abort(EXIT_FAILURE);
+    }
+    if (ci_stream || ci_filesize < 0) {
+        ci_msg(0, "%s Streamed input can't be repacked, whole file is needed!\n", ci_error_str);
+        ci_Abort(EXIT_FAILURE);
+    }
+    // Check that tiles cover the rest of each block, end to end
+    for (i=0, n=0; i < ci.blocks_num; i++)
+        if (ci_RepackList(i, &list, &first, &end)) n += (first - list) / 8;
+    all = (CI_repack_tile *) ci_ArenaAlloc(&ci_arena, (n+1)*sizeof(CI_repack_tile));
+    for (i=0, t=all; i < ci.blocks_num; i++, t+=tiles) {
+        tiles = 0;
+        if (!ci_RepackList(i, &list, &first, &end)) continue;
+        tiles = (first - list) / 8;
+        for (k=0; k < tiles; k++) {
+            t[k].src = GETu32(ci_data, list + 8*k);
+            t[k].len = GETu32(ci_data, list + 8*k + 4);
+            t[k].out = 0;
+        }
+        if ((uint64_t) first + 12 <= end && (uint64_t) t[tiles-1].src + t[tiles-1].len == GETu32(ci_data, first + 8)) {
+            ci_msg(0, "%s Data pair list of block %04x may go on!\n", ci_error_str, i);
+            ci_Abort(EXIT_FAILURE);
+        }
+        qsort(t, tiles, sizeof(CI_repack_tile), ci_RepackTileCmp);
+        cur = first;
+        for (k=0; k < tiles && t[k].src < end; k++) {
+            if (t[k].src > cur) break;
+            if ((uint64_t) t[k].src + t[k].len > cur) cur = (uint64_t) t[k].src + t[k].len;
+        }
+        if (cur < end) {
+            ci_msg(0, "%s Bytes 0x%08"PRIx64"-0x%08"PRIx64" of block %04x are in no tile!\n", ci_error_str, cur,
+                (k < tiles && t[k].src < end ? t[k].src : end) - 1, i);
+            ci_Abort(EXIT_FAILURE);
+        }
+    }
+    // One entry per tile, however many pairs point at it
+    if (n) qsort(all, n, sizeof(CI_repack_tile), ci_RepackTileCmp);
+    for (i=1, k=0; i < n; i++)
+        if (ci_RepackTileCmp(&all[k], &all[i])) all[++k] = all[i];
+    if (n) n = k+1;
+
+    // Head ends where block table is, or where it should be if the
+    // table was rebuilt by --recover
+    head = ((const uint8_t *) ci_blocks_table == ci_data + ci.blocks_table_offs ? ci.blocks_table_offs : ci_blocks_table_offs_eval);
+    h = (CPT_FileHeader *) ci_ArenaAlloc(&ci_arena, head);
+    memcpy(h, ci_ViewAt(ci_data, 0, head), head);
+    h->blocks_num = ci.blocks_num;
+    h->blocks_table_offs = head;
+    table = (CPT_BlockTableEntry *) ci_ArenaAlloc(&ci_arena, ci.blocks_num*CPT_BlockTableEntry_sz);
+    ci_RepackAdd(&l, (const uint8_t *) h, head);
+    ci_RepackAdd(&l, (const uint8_t *) table, (uint64_t) ci.blocks_num*CPT_BlockTableEntry_sz);
+    pos = head + (uint64_t) ci.blocks_num*CPT_BlockTableEntry_sz;
+
+    for (i=0; i < ci.blocks_num; i++) {
+        src = ci_blocks_table[i].offs;
+        table[i].offs = pos;
+        table[i].reserved = 0;
+        // No data pair list, nothing points out of block: as it is
+        if (!ci_RepackList(i, &list, &first, &end)) {
+            size = end - src;
+            ci_RepackAdd(&l, ci_ViewAt(ci_data, src, size), size);
+            pos += size;
+            continue;
+        }
+        tiles = (first - list) / 8;
+        pair = (uint32_t *) ci_ArenaAlloc(&ci_arena, tiles*8);
+        ci_RepackAdd(&l, ci_ViewAt(ci_data, src, list - src), list - src);
+        ci_RepackAdd(&l, (const uint8_t *) pair, tiles*8);
+        pos += list - src + tiles*8;
+        for (k=0; k < tiles; k++) {
+            key.src = GETu32(ci_data, list + 8*k);
+            key.len = GETu32(ci_data, list + 8*k + 4);
+            t = (CI_repack_tile *) bsearch(&key, all, n, sizeof(CI_repack_tile), ci_RepackTileCmp);
+            pair[2*k+1] = key.len;
+            if (t->out) {
+                pair[2*k] = t->out;
+                continue;
+            }
+            if (!(tile = ci_TileView(key.src, key.len))) {
+                ci_msg(0, "%s Tile %u of block %04x is out of file!\n", ci_error_str, k, i);
+                ci_Abort(EXIT_FAILURE);
+            }
+            t->out = pair[2*k] = pos;
+            ci_RepackAdd(&l, tile, key.len);
+            pos += key.len;
+        }
+    }
+    if (pos > UINT32_MAX) {
+        ci_msg(0, "%s Repacked file would be over 4 GB!\n", ci_error_str);
+        ci_Abort(EXIT_FAILURE);
+    }
+
+    // Written under temporary name, renamed once complete
+    path = ci_ArenaPrintf(&ci_arena, "%s%c%s"CI_REPACK_EXT, ci_cfg.repack, ci_path_separator, ci_basename);
+    temp = ci_ArenaPrintf(&ci_arena, "%s.tmp", path);
+    if (!(out = fopen(temp, "wb"))) {
+        ci_msg(0, "%s Can't create %s!\n", ci_error_str, temp);
+        ci_Abort(EXIT_FAILURE);
+    }
+    if (ci_RepackWrite(out, l.piece, l.num, CI_REPACK_METHOD, ci_cfg.threads, &written) | fclose(out)) {
+        remove(temp);
+        ci_msg(0, "%s Can't write %s!\n", ci_error_str, temp);
+        ci_Abort(EXIT_FAILURE);
+    }
+#ifdef WIN32
+    remove(path);
+#endif
+    if (rename(temp, path)) {
+        remove(temp);
+        ci_msg(0, "%s Can't rename %s to %s!\n", ci_error_str, temp, path);
+        ci_Abort(EXIT_FAILURE);
+    }
+    ci_print("%s -> %s: %u -> %"PRIu64" bytes (%"PRIu64" uncompressed)\n", ci_filename, path, (uint32_t) ci_filesize, written, pos);
+    ci_repack_files++;
+    ci_repack_in += ci_filesize;
+    ci_repack_out += written;
+}
+
+void ci_RepackSave(FILE *out) {
+    fwrite(&ci_repack_files, sizeof(uint64_t), 1, out);
+    fwrite(&ci_repack_in, sizeof(uint64_t), 1, out);
+    fwrite(&ci_repack_out, sizeof(uint64_t), 1, out);
+}
+
+void ci_RepackLoad(FILE *in) {
+    uint64_t n[3];
+    if (fread(n, sizeof(uint64_t), 3, in) != 3) return;
+    ci_repack_files += n[0];
+    ci_repack_in += n[1];
+    ci_repack_out += n[2];
+}
+
+void ci_RepackReport(void) {
+    printf("Repack %s: %"PRIu64" file(s), %"PRIu64" -> %"PRIu64" bytes", ci_cfg.repack, ci_repack_files, ci_repack_in, ci_repack_out);
+    if (ci_repack_in) printf(" (%.1f%%)", 100.0 * ci_repack_out / ci_repack_in);
+    printf("\n");
+}
+
+// --- Recovery of damaged block table (--recover) ---
+
+// Can block table of current file be rebuilt? Needs whole CPT9 file.
+uint32_t ci_Recoverable(void) {
+    return (ci_cfg.recover && ci.version == 0x900 && !ci_stream && ci_filesize >= 0);
+}
+
+// Block table entries in file order and in file (checked with --recover).
+uint32_t ci_BlockTableSane(void) {
+    uint32_t i;
+    for (i=0; i < ci.blocks_num; i++) {
+        if (ci_blocks_table[i].offs > (uint32_t) ci_filesize - CPT9_Block_sz) return 0;
+        if (i && ci_blocks_table[i].offs <= ci_blocks_table[i-1].offs) return 0;
+    }
+    return 1;
+}
+
+// Replaces block table of damaged file with one of block headers found by
+// scanning it. Goes back through ci_Abort() if it can't.
+void ci_RecoverBlocks(void) {
+    CI_scan_block *found;
+    uint32_t i, n;
+    if (!ci_Recoverable()) ci_Abort(EXIT_FAILURE);
+    n = ci_ScanBlocks9(ci_data, ci_filesize, CPT_FileHeader_sz, ci_IsChunk, &found);
+    if (!n) {
+        ci_msg(1, "%s No blocks found by scan!\n", ci_error_str);
+        ci_msg(4, " rcv!");
+        ci_Abort(EXIT_FAILURE);
+    }
+    ci_blocks_table = (CPT_BlockTableEntry *) ci_ArenaAlloc(&ci_arena, n*CPT_BlockTableEntry_sz);
+    for (i=0; i < n; i++) {
+        ci_blocks_table[i].offs = found[i].offs;
+        ci_blocks_table[i].reserved = 0;
+    }
+    free(found);
+    ci.blocks_num = n;
+    ci_msg(1, "%s Block table rebuilt by scan: %u block(s) found\n", ci_warning_str, n);
+    ci_msg(4, " rcv%u", n);
 }
 
 
 void ci_ProcessFileHeader(void) {
     uint32_t is_mask = 1, dpi_warn = 0, pal_warn = 0;
-    uint32_t bt_warn = 0, bt_cpt9 = 2, bn_warn = 0;
+    uint32_t bt_warn = 0, bt_cpt9 = 2, bn_warn = 0, wc_ok;
     uint32_t res_warn[5] = { 0, 0, 0, 0, 0};
     uint32_t unk_warn[3] = { 0, 0, 0 };
     uint32_t i;
     
-    ci_msg(1, "CPT file: %s (%d bytes)\n", ci_filename, ci_filesize);
+    if (ci_filesize < 0) ci_msg(1, "CPT file: %s (streamed)\n", ci_filename);
+    else ci_msg(1, "CPT file: %s (%d bytes)\n", ci_filename, ci_filesize);
     ci_msg(4, "%s %d", ci_filename_short__, ci_filesize);
     // --- Version detection
-    ci_msg(1, "CPT file format: ");
+    ci_msg(1, "CPT file format: %s", ci_VersionName(ci.version));
     switch (ci.version) {
-        case 0x600: ci_msg(1, "6.0"); ci_msg(4, " CPT6"); break;
-        case 0x700: ci_msg(1, "7.0"); ci_msg(4, " CPT7"); break;
-        case 0x701: ci_msg(1, "7.01"); ci_msg(4, " CPT701"); break;
-        case 0x800: ci_msg(1, "8.0"); ci_msg(4, " CPT8"); break;
-        case 0x900: ci_msg(1, "9.0-13.0"); ci_msg(4, " CPT9"); break;
+        case 0x600: ci_msg(4, " CPT6"); break;
+        case 0x700: ci_msg(4, " CPT7"); break;
+        case 0x701: ci_msg(4, " CPT701"); break;
+        case 0x800: ci_msg(4, " CPT8"); break;
+        case 0x900: ci_msg(4, " CPT9"); break;
     }
     ci_msg(1,"\n");
     // TODO: handle Corel PhotoPaint 6 files.
     if (ci.version == 0x600) {
         ci_msg(1, "This version of CPTInfo doesn't handle CPT 6.0 files yet. :(\n");
         ci_msg(12, " ver!");
-        exit(EXIT_SUCCESS);
+        ci_Abort(EXIT_SUCCESS);
     }
     ci.flag_hi = (uint8_t) (ci_f_header->flags & 0xFF00) >> 8;
     ci.flag_lo = (uint8_t) (ci_f_header->flags & 0x00FF);
+    if (ci_cfg.census) ci_CensusHeader();
     ci_msg(1, "CPT creator version: ");
     switch (ci.flag_lo) {
         case CPT_AV_7: 
@@ -512,12 +2626,13 @@ void ci_ProcessFileHeader(void) {
     if (!CPT_ICC_ALLOWED(ci_f_header->color_model) && ci.emb_icc) {
         ci_msg(1, "%s ICC embedded bit set, but color model doesn't allow ICC data!\n", ci_error_str);
         ci_msg(12, " iccbit!");
-        exit(EXIT_FAILURE);
+        ci_Abort(EXIT_FAILURE);
     }
     if (ci.emb_icc) {
         // It seems to be the first 'after header' block
-        ci_icc = (CPT_ICC *) (ci_data + CPT_FileHeader_sz);
+        ci_icc = (CPT_ICC *) ci_View(ci_data + CPT_FileHeader_sz, CPT_ICC_sz);
         if (ci_icc->magic == CPT_ICC_MAGIC) {
+            if (ci_cfg.census) ci_CensusIcc();
             // If magic ok, increase comment offset
             ci.wcomment_offs += CPT_ICC_sz;
             // Print some data
@@ -540,13 +2655,15 @@ void ci_ProcessFileHeader(void) {
                 ci_msg(1, "CPT ICC profile file size: %u bytes\n", ci_icc->len);
                 // Increase comment offset by length of embedded file
                 ci.wcomment_offs += ci_icc->len;
+                if (ci_cfg.dedup && ci_InFile(&ci_icc->data, ci_icc->len))
+                    ci_DedupAdd(CI_DUP_ICC, (uint8_t *)&ci_icc->data, ci_icc->len, 0);
             }
             ci_msg(1, "CPT ICC unknown vars: 0x%08x 0x%08x 0x%08x\n",
                 ci_icc->unk[0], ci_icc->unk[1], ci_icc->unk[2]);
         } else {
             ci_msg(1, "%s ICC magic incorrect!\n", ci_error_str);
             ci_msg(12, " iccmagic!");
-            exit(EXIT_FAILURE);
+            ci_Abort(EXIT_FAILURE);
         }
     }
     // ICC dumping
@@ -555,12 +2672,11 @@ void ci_ProcessFileHeader(void) {
             ci_msg(1,"%s image doesn't have ICC profile, file not dumped!\n", ci_warning_str);
         } else if (ci_icc->type != CPT_ICC_EMBEDDED) {
             ci_msg(1,"%s image has internal ICC or unknown magic, file not dumped!\n", ci_warning_str);
+        } else if (!ci_InFile(&ci_icc->data, ci_icc->len)) {
+            ci_msg(1,"%s ICC profile out of file, not dumped!\n", ci_warning_str);
         } else {
-            // TODO: check len if not too big / too small
             sprintf(ci_tempname, "%s.icc", ci_basename);
-            FILE *w = fopen(ci_tempname, "wb");
-            fwrite(&ci_icc->data, 1, ci_icc->len, w);
-            fclose(w);
+            ci_DumpData(ci_tempname, "icc", (uint8_t *)&ci_icc->data, ci_icc->len);
         }
     }
         
@@ -572,6 +2688,8 @@ void ci_ProcessFileHeader(void) {
 	pal_warn |= (ci_f_header->palette_entries % 3);
 	ci.pal_entries = ci_f_header->palette_entries / 3;
         ci_palette = (CPT_Palette *) (ci_data + CPT_FileHeader_sz);
+        if (ci_cfg.dedup && ci.pal_entries && ci_InFile(ci_palette, ci.pal_entries*CPT_RGB_sz))
+            ci_DedupAdd(CI_DUP_PALETTE, (uint8_t *)ci_palette, ci.pal_entries*CPT_RGB_sz, 0);
         // Increase wide comment offset
         ci.wcomment_offs += ci_f_header->palette_entries;
     }
@@ -584,9 +2702,7 @@ void ci_ProcessFileHeader(void) {
         } else {
             if (pal_warn) ci_msg(1, "%s strange number of palette entries, dumping anyway...\n", ci_warning_str);
             sprintf(ci_tempname, "%s.pal", ci_basename);
-            FILE *w = fopen(ci_tempname, "wb");
-            fwrite(ci_palette, CPT_RGB_sz, ci.pal_entries, w);
-            fclose(w);
+            if (ci_InFile(ci_palette, ci.pal_entries*CPT_RGB_sz)) ci_DumpData(ci_tempname, "pal", (uint8_t *)ci_palette, ci.pal_entries*CPT_RGB_sz);
         }
     }
     
@@ -597,26 +2713,33 @@ void ci_ProcessFileHeader(void) {
     
     // --- File comment if present
     ci_wcomment = (CPT_WideComment *) (ci_data + ci.wcomment_offs);
+    wc_ok = ci_InFileAt(ci_data, ci.wcomment_offs, CPT_WideComment_sz) &&
+        ci_wcomment->magic == CPT_WIDE_COMMENT_MAGIC;
     // acomment
     if (*ci_f_header->notes) {
-        gchar *com_ansi = g_convert(ci_f_header->notes, CPT_NOTE_LEN_A, ci_charset, ci_cfg.charset, NULL, NULL, NULL);
+        gchar *com_ansi = ci_Convert(ci_f_header->notes, CPT_NOTE_LEN_A, ci_charset, ci_cfg.charset);
         ci_msg(1, "CPT comment (ANSI): ");
-        if (com_ansi) { ci_msg(1, "%s\n", com_ansi); g_free(com_ansi); }
+        if (com_ansi) ci_msg(1, "%s\n", com_ansi);
         else ci_msg(1, "[conv failed]\n"); 
         // wcomment
-        if (ci_wcomment->magic == CPT_WIDE_COMMENT_MAGIC) {
-            gchar *com_wide = g_convert((gchar *)&ci_wcomment->notes, CPT_NOTE_LEN_W, ci_charset, CPT_WIDE_CHARSET, NULL, NULL, NULL);
+        if (wc_ok) {
+            gchar *com_wide = ci_Convert((gchar *)&ci_wcomment->notes, CPT_NOTE_LEN_W, ci_charset, CPT_WIDE_CHARSET);
             ci_msg(1, "CPT comment (UCS-2): ");
-            if (com_wide) { ci_msg(1, "%s\n", com_wide); g_free(com_wide); }
+            if (com_wide) ci_msg(1, "%s\n", com_wide);
             else ci_msg(1, "[conv failed]\n"); 
         }
     }
+    if (ci_cfg.text_index) {
+        ci_TextString(CI_TEXT_WHERE(CI_TEXT_NO_BLOCK, CI_TEXT_COMMENT), ci_f_header->notes, CPT_NOTE_LEN_A, ci_cfg.charset);
+        if (wc_ok) ci_TextString(CI_TEXT_WHERE(CI_TEXT_NO_BLOCK, CI_TEXT_COMMENT), (gchar *)&ci_wcomment->notes, CPT_NOTE_LEN_W, CPT_WIDE_CHARSET);
+    }
     // If number of colors incorrect, stop. Not stopping here
     // could break up block table offset calculation for CPT7
     if (pal_warn) {
         ci_msg(1, "%s Palette entries number is incorrect!\n", ci_error_str);
         ci_msg(4, " palnum!");
-        exit(EXIT_FAILURE);
+        // Palette doesn't move CPT9 blocks, recovery can do without it
+        if (!ci_Recoverable()) ci_Abort(EXIT_FAILURE);
     }
     
     // --- Block table position
@@ -626,7 +2749,7 @@ void ci_ProcessFileHeader(void) {
     ci_blocks_table_offs_eval =
         CPT_FileHeader_sz +
         ci_f_header->palette_entries +  // may be 0
-        (ci.emb_wcomment && ci_wcomment->magic == CPT_WIDE_COMMENT_MAGIC ? CPT_WideComment_sz : 0);
+        (ci.emb_wcomment && wc_ok ? CPT_WideComment_sz : 0);
 
     if (CI_CPTVER_78(ci.version)) {
         // CPT7 offset table = always 0, workaround this case. However, files
@@ -637,31 +2760,37 @@ void ci_ProcessFileHeader(void) {
         // If address is earlier than header and 'after header' data, it's an error
         if (ci.blocks_table_offs < ci_blocks_table_offs_eval) bt_warn = 1;
         // Address has to be smaller than filesize minus size of 1 entry
-        if (ci.blocks_table_offs > ci_filesize - CPT9_Block_sz) bt_warn = 1;
+        if (ci_filesize >= 0 && ci.blocks_table_offs > ci_filesize - CPT9_Block_sz) bt_warn = 1;
     }
     ci_msg(1, "CPT block table offset: 0x%08x%s%s\n", ci.blocks_table_offs, (bt_warn?ci_msg_wnmark:""), (bt_cpt9?ci_msg_9mark:""));
     ci_msg(4, " %x%s", ci.blocks_table_offs,(bt_warn?" !":""));
 
     if (bt_warn) {
         ci_msg(1, "%s Incorrect block table offset!\n", ci_error_str);
-        exit(EXIT_FAILURE);
-    }
-    // BIG [TODO] check the 'lthm' case - are the following offsets relative?
-    // Hope so. Calculate the memory address. 
-    ci_blocks_table = (CPT_BlockTableEntry *) (ci_data + ci.blocks_table_offs);
-    // --- Blocks number
-    ci.blocks_num = ci_f_header->blocks_num;
-    if (!ci.blocks_num) bn_warn = 1;
-    if (!ci_blocks_table[0].offs) bn_warn = 1;
-    // Number of blocks from header should be equal with real number of blocks
-    if (ci.blocks_num * CPT_BlockTableEntry_sz + ci.blocks_table_offs != ci_blocks_table[0].offs) bn_warn = 1;
-    ci_msg(1, "CPT blocks number: %u%s\n", ci.blocks_num, (bn_warn ? ci_msg_wnmark:""));
-    if (bn_warn) {
-        ci_msg(4," !");
-        ci_msg(1, "%s Block number from header doesn't equal real block number!\n", ci_error_str);
-        exit(EXIT_FAILURE);
+        ci_RecoverBlocks();
     } else {
-        ci_msg(4," %u", ci.blocks_num);
+        // BIG [TODO] check the 'lthm' case - are the following offsets relative?
+        // Hope so. Calculate the memory address. 
+        ci_blocks_table = (CPT_BlockTableEntry *) ci_ViewAt(ci_data, ci.blocks_table_offs, CPT_BlockTableEntry_sz);
+        // --- Blocks number
+        ci.blocks_num = ci_f_header->blocks_num;
+        if (!ci.blocks_num) bn_warn = 1;
+        if (!ci_blocks_table[0].offs) bn_warn = 1;
+        // Number of blocks from header should be equal with real number of blocks
+        if (ci.blocks_num * CPT_BlockTableEntry_sz + ci.blocks_table_offs != ci_blocks_table[0].offs) bn_warn = 1;
+        ci_msg(1, "CPT blocks number: %u%s\n", ci.blocks_num, (bn_warn ? ci_msg_wnmark:""));
+        if (bn_warn) {
+            ci_msg(4," !");
+            ci_msg(1, "%s Block number from header doesn't equal real block number!\n", ci_error_str);
+            ci_RecoverBlocks();
+        } else {
+            ci_msg(4," %u", ci.blocks_num);
+            ci_View(ci_blocks_table, (uint64_t) ci.blocks_num * CPT_BlockTableEntry_sz);
+            if (ci_Recoverable() && !ci_BlockTableSane()) {
+                ci_msg(1, "%s Block table entries out of order or out of file!\n", ci_error_str);
+                ci_RecoverBlocks();
+            }
+        }
     }
 
     // --- Unknown fields
@@ -700,145 +2829,939 @@ void ci_ProcessFileHeader(void) {
 
 // Check if a chunk is a chunk ;-)
 uint32_t ci_IsChunk(uint32_t chunk) {
-    uint32_t i;
-    for (i=0; i < CPT9_CHUNK_NUM; i++) {
-        if (chunk == cpt9_chunk_name[i].id) return 1;
+    return ci_ChunkType(chunk) >= 0;
+}
+
+// Grid unit scale, 0 for units out of cpt9_grid_table.
+double ci_GridScale(uint32_t unit) {
+    if (unit >= sizeof(cpt9_grid_table)/sizeof(double)) return 0;
+    return cpt9_grid_table[unit];
+}
+
+const char *ci_GridUnitName(uint32_t unit) {
+    switch (unit) {
+        case CPT9_GRID_UNIT_INCH: return "inch";
+        case CPT9_GRID_UNIT_MM: return "mm";
+        case CPT9_GRID_UNIT_PICA_POINT: return "pica;point";
+        case CPT9_GRID_UNIT_POINT: return "point";
+        case CPT9_GRID_UNIT_CM: return "cm";
+        case CPT9_GRID_UNIT_PIXEL: return "pixel";
+        case CPT9_GRID_UNIT_CICERO_DIDOT: return "cicero;didot";
+        case CPT9_GRID_UNIT_DIDOT: return "didot";
     }
-    return 0;
+    return "unknown [!]";
 }
 
+// 'grid' density and units are shown together, scaled to the unit.
 // TODO: verify calculations precision
-void ci_ProcessChunkGrid(uint8_t *buf, uint32_t len) {
-    CPT9_CGrid *grid = (CPT9_CGrid *) buf;
-    ci_msg(3,"%sGrid density:", ci_msg_chunk_var_tab);
+void ci_ChunkGridPrint(const uint8_t *buf, uint32_t len) {
+    uint32_t xunit = ci_ChunkU32(buf, len, CI_F_GRID_XUNIT, 0);
+    uint32_t yunit = ci_ChunkU32(buf, len, CI_F_GRID_YUNIT, 0);
     double gridx, gridy;
-    gridx = cpt9_grid_table[grid->xunit]*grid->xdensity;
-    if (grid->xunit == CPT9_GRID_UNIT_PIXEL) gridx *= ci.xdpi;
-    gridy = cpt9_grid_table[grid->yunit]*grid->ydensity;
-    if (grid->yunit == CPT9_GRID_UNIT_PIXEL) gridy *= ci.ydpi;
-
-    ci_msg(3," %.4f ", gridx);
-    switch (grid->xunit) {
-        case CPT9_GRID_UNIT_INCH: ci_msg(3, "inch"); break;
-        case CPT9_GRID_UNIT_MM: ci_msg(3, "mm"); break;
-        case CPT9_GRID_UNIT_PICA_POINT: ci_msg(3, "pica;point"); break;
-        case CPT9_GRID_UNIT_POINT: ci_msg(3, "point"); break;
-        case CPT9_GRID_UNIT_CM: ci_msg(3, "cm"); break;
-        case CPT9_GRID_UNIT_PIXEL: ci_msg(3, "pixel"); break;
-        case CPT9_GRID_UNIT_CICERO_DIDOT: ci_msg(3, "cicero;didot"); break;
-        case CPT9_GRID_UNIT_DIDOT: ci_msg(3, "didot"); break;
-        default: ci_msg(3, "unknown [!]"); break;
-    }
-    ci_msg(3," /");
-    ci_msg(3," %.4f ", gridy);
-    switch (grid->yunit) {
-        case CPT9_GRID_UNIT_INCH: ci_msg(3, "inch"); break;
-        case CPT9_GRID_UNIT_MM: ci_msg(3, "mm"); break;
-        case CPT9_GRID_UNIT_PICA_POINT: ci_msg(3, "pica;point"); break;
-        case CPT9_GRID_UNIT_POINT: ci_msg(3, "point"); break;
-        case CPT9_GRID_UNIT_CM: ci_msg(3, "cm"); break;
-        case CPT9_GRID_UNIT_PIXEL: ci_msg(3, "pixel"); break;
-        case CPT9_GRID_UNIT_CICERO_DIDOT: ci_msg(3, "cicero;didot"); break;
-        case CPT9_GRID_UNIT_DIDOT: ci_msg(3, "didot"); break;
-        default: ci_msg(3, "unknown [!]"); break;
-    }
-    ci_msg(3,"\n");
-    ci_msg(3,"%sUnknown var 00: %08x %08x (%u %u)\n",
-        ci_msg_chunk_var_tab,
-        grid->unk00[0],grid->unk00[1],
-        grid->unk00[0],grid->unk00[1]
-    );
-    ci_msg(3,"%sUnknown var 01: %u %u %u %u %u %u %u %u\n",
-        ci_msg_chunk_var_tab,
-        grid->unk01[0],grid->unk01[1],grid->unk01[2],grid->unk01[3],
-        grid->unk01[4],grid->unk01[5],grid->unk01[6],grid->unk01[7]
-    );
-
+    if (!ci_ChunkCount(CI_F_GRID_YUNIT, len)) return;
+    gridx = ci_GridScale(xunit)*ci_ChunkF64(buf, len, CI_F_GRID_XDENSITY, 0);
+    if (xunit == CPT9_GRID_UNIT_PIXEL) gridx *= ci.xdpi;
+    gridy = ci_GridScale(yunit)*ci_ChunkF64(buf, len, CI_F_GRID_YDENSITY, 0);
+    if (yunit == CPT9_GRID_UNIT_PIXEL) gridy *= ci.ydpi;
+    ci_msg(3,"%sGrid density: %.4f %s / %.4f %s\n", ci_msg_chunk_var_tab,
+        gridx, ci_GridUnitName(xunit), gridy, ci_GridUnitName(yunit));
 }
 
-// 'path'
-// FIXME: len is wrong, should be some constant probably
-void ci_ProcessChunkPath(uint8_t *buf, uint32_t len) {
-    CPT9_CPath *path = (CPT9_CPath *) buf;
-    char *name = (char *)&path->name;
-    gchar *name_ansi = g_convert(name, len, ci_charset, ci_cfg.charset, NULL, NULL, NULL);
-    ci_msg(3,"%sPath name ANSI: ", ci_msg_chunk_var_tab);
-    if (name_ansi) { ci_msg(3, "%s\n", name_ansi); g_free(name_ansi); }
-    else ci_msg(3, "[conv failed]\n"); 
-    ci_msg(3,"%sUnknown var 00..04: %d %d %d %d %d\n",
-        ci_msg_chunk_var_tab,
-        path->unk00,path->unk01,path->unk02,path->unk03,path->unk04
-    );
+// Windows GUID of 16 bytes as {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}.
+void ci_GuidString(char *s, const uint8_t *g) {
+    sprintf(s, "{%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x}",
+        g[3], g[2], g[1], g[0], g[5], g[4], g[7], g[6],
+        g[8], g[9], g[10], g[11], g[12], g[13], g[14], g[15]);
 }
 
-// 'pthw'
-// Here len is OK, because pthw contains UCS-2 string only
-void ci_ProcessChunkPthw(uint8_t *buf, uint32_t len) {
-    CPT9_CPthw *path = (CPT9_CPthw *) buf;
-    char *name = (char *)&path->name;
-    gchar *name_ucs = g_convert(name, len, ci_charset, CPT_WIDE_CHARSET, NULL, NULL, NULL);
-    ci_msg(3,"%sPath name UCS-2: ", ci_msg_chunk_var_tab);
-    if (name_ucs) { ci_msg(3, "%s\n", name_ucs); g_free(name_ucs); }
-    else ci_msg(3, "[conv failed]\n"); 
-}
-
-
-// 'bnam'
-void ci_ProcessChunkBnam(uint8_t *buf, uint32_t len) {
-    char *name = (char *) buf;
-    gchar *name_ansi = g_convert(name, len, ci_charset, ci_cfg.charset, NULL, NULL, NULL);
-    ci_msg(3,"%sBackground name ANSI: ", ci_msg_chunk_var_tab);
-    if (name_ansi) { ci_msg(3, "%s\n", name_ansi); g_free(name_ansi); }
-    else ci_msg(3, "[conv failed]\n"); 
-}
-
-// 'bnwm'
-void ci_ProcessChunkBnwm(uint8_t *buf, uint32_t len) {
-    char *name = (char *) buf;
-    gchar *name_ucs = g_convert(name, len, ci_charset, CPT_WIDE_CHARSET, NULL, NULL, NULL);
-    ci_msg(3,"%sBackground name UCS-2: ", ci_msg_chunk_var_tab);
-    if (name_ucs) { ci_msg(3, "%s\n", name_ucs); g_free(name_ucs); }
-    else ci_msg(3, "[conv failed]\n"); 
-}
-
-// 'oinf'
-void ci_ProcessChunkOinf(uint8_t *buf, uint32_t len) {
-    CPT9_COinf *oinf = (CPT9_COinf *) buf;
-    char *name_a = (char *)&oinf->name_a;
-    char *name_w = (char *)&oinf->name_w;
-    gchar *name_ucs = g_convert(name_w, CPT9_OINF_NAME_LEN_W, ci_charset, CPT_WIDE_CHARSET, NULL, NULL, NULL);
-    gchar *name_ansi = g_convert(name_a, CPT9_OINF_NAME_LEN_A, ci_charset, ci_cfg.charset, NULL, NULL, NULL);
-    ci_msg(3,"%sObject name ANSI: ", ci_msg_chunk_var_tab);
-    if (name_ansi) { ci_msg(3, "%s\n", name_ansi); g_free(name_ansi); }
-    else ci_msg(3, "[conv failed]\n"); 
-    ci_msg(3,"%sObject name UCS-2: ", ci_msg_chunk_var_tab);
-    if (name_ucs) { ci_msg(3, "%s\n", name_ucs); g_free(name_ucs); }
-    else ci_msg(3, "[conv failed]\n"); 
-
-    ci_msg(3,"%sUnknown var 00: %d %d %d %d %d %d\n",
-        ci_msg_chunk_var_tab,
-        oinf->unk00[0],oinf->unk00[1],oinf->unk00[2],oinf->unk00[3],oinf->unk00[4],oinf->unk00[5]
-    );
-    ci_msg(3,"%sUnknown var 01: %d %d %d %d %d %d\n",
-        ci_msg_chunk_var_tab,
-        oinf->unk01[0],oinf->unk01[1],oinf->unk01[2],oinf->unk01[3],oinf->unk01[4],oinf->unk01[5]
-    );
-    ci_msg(3,"%sUnknown var 02: %d %d %d %d %d %d %d\n",
-        ci_msg_chunk_var_tab,
-        oinf->unk02[0],oinf->unk02[1],oinf->unk02[2],oinf->unk02[3],oinf->unk02[4],oinf->unk02[5]
-    );
-
+// String field of a chunk converted to given charset, NULL if it failed.
+// Empty if it's not in chunk.
+gchar *ci_ChunkString(const uint8_t *buf, uint32_t len, uint32_t field, const gchar *to) {
+    uint32_t n;
+    const uint8_t *str = ci_ChunkAt(buf, len, field, 0, &n);
+    if (!str) { str = buf; n = 0; }
+    return ci_Convert((const gchar *) str, n, to,
+        (ci_chunk_field[field].kind == CI_FIELD_ANSI ? ci_cfg.charset : CPT_WIDE_CHARSET));
 }
 
+// Prints a field of a chunk as "label: values" line (text serializer).
+void ci_ChunkPrintField(const uint8_t *buf, uint32_t len, uint32_t field) {
+    const CI_chunk_field *cf = &ci_chunk_field[field];
+    uint32_t i, n = ci_ChunkCount(field, len);
+    char guid[40];
+    gchar *str;
+    ci_msg(3,"%s%s:", ci_msg_chunk_var_tab, cf->label);
+    switch (cf->kind) {
+        case CI_FIELD_ANSI:
+        case CI_FIELD_UCS2:
+            str = ci_ChunkString(buf, len, field, ci_charset);
+            ci_msg(3, " %s\n", (str ? str : "[conv failed]"));
+            return;
+        case CI_FIELD_GUID:
+            if (n < 16) break;
+            ci_GuidString(guid, ci_ChunkAt(buf, len, field, 0, NULL));
+            ci_msg(3, " %s\n", guid);
+            return;
+        case CI_FIELD_F64:
+            for (i=0; i < n; i++) ci_msg(3, " %.4f", ci_ChunkF64(buf, len, field, i));
+            break;
+        case CI_FIELD_X32:
+            for (i=0; i < n; i++) ci_msg(3, " %08x", ci_ChunkU32(buf, len, field, i));
+            if (!n) break;
+            for (i=0; i < n; i++) ci_msg(3, "%s%u", (i ? " " : " ("), ci_ChunkU32(buf, len, field, i));
+            ci_msg(3, ")");
+            break;
+        default:
+            for (i=0; i < n; i++)
+                ci_msg(3, (cf->kind == CI_FIELD_I32 ? " %d" : " %u"), ci_ChunkU32(buf, len, field, i));
+    }
+    if (n < cf->count) ci_msg(3, " [out of chunk]");
+    ci_msg(3, "\n");
+}
+
+// Decodes known chunk types, as described by ci_chunk.h schema.
+void ci_ProcessChunk(uint32_t chnk, uint8_t *buf, uint32_t len) {
+    int type = ci_ChunkType(chnk);
+    uint32_t f;
+    if (type < 0) return;
+    if (chnk == CPT9_CHUNK_GRID) ci_ChunkGridPrint(buf, len);
+    for (f = ci_chunk_type[type].field; f < ci_chunk_type[type+1].field; f++)
+        if (!(ci_chunk_field[f].flags & CI_FIELD_HIDE)) ci_ChunkPrintField(buf, len, f);
+}
+
+// Prints chunk c of block id at offs as NDJSON record, with fields of
+// decoded chunk types (JSON serializer).
+void ci_ChunkJson(uint32_t offs, uint32_t id, const CI_chunk *c, const uint8_t *buf) {
+    const CI_chunk_field *cf;
+    int type = ci_ChunkType(c->id);
+    uint32_t f, i, n;
+    char guid[40];
+    gchar *str;
+    double v;
+    ci_print("{\"file\":");
+    ci_JsonPrint(ci_filename);
+    ci_print(",\"block\":%u,\"chunk\":", id);
+    ci_JsonPrint(ci_Ascii32(c->id));
+    ci_print(",\"known\":%s,\"offset\":%u,\"len\":%u", (type >= 0 ? "true" : "false"), offs + c->offs - 8, c->len);
+    if (type < 0 || ci_chunk_type[type].field == ci_chunk_type[type+1].field) {
+        ci_print("}\n");
+        return;
+    }
+    ci_print(",\"fields\":{");
+    for (f = ci_chunk_type[type].field; f < ci_chunk_type[type+1].field; f++) {
+        cf = &ci_chunk_field[f];
+        n = ci_ChunkCount(f, c->len);
+        ci_print("%s\"%s\":", (f > ci_chunk_type[type].field ? "," : ""), cf->key);
+        switch (cf->kind) {
+            case CI_FIELD_ANSI:
+            case CI_FIELD_UCS2:
+                if ((str = ci_ChunkString(buf, c->len, f, "UTF-8"))) ci_JsonPrint(str);
+                else ci_print("null");
+                continue;
+            case CI_FIELD_GUID:
+                if (n < 16) { ci_print("null"); continue; }
+                ci_GuidString(guid, ci_ChunkAt(buf, c->len, f, 0, NULL));
+                ci_print("\"%s\"", guid);
+                continue;
+        }
+        if (cf->count > 1) ci_print("[");
+        else if (!n) ci_print("null");
+        for (i=0; i < n; i++) {
+            if (i) ci_print(",");
+            if (cf->kind == CI_FIELD_F64) {
+                v = ci_ChunkF64(buf, c->len, f, i);
+                if (isfinite(v)) ci_print("%.17g", v);
+                else ci_print("null");
+            } else if (cf->kind == CI_FIELD_I32) ci_print("%d", (int32_t) ci_ChunkU32(buf, c->len, f, i));
+            else ci_print("%u", ci_ChunkU32(buf, c->len, f, i));
+        }
+        if (cf->count > 1) ci_print("]");
+    }
+    ci_print("}}\n");
+}
+
+// Object name of 'oinf' chunk in given charset: UCS-2 one, or ANSI one
+// if that's empty or not convertible. NULL if there is none.
+gchar *ci_ChunkObjectName(uint8_t *buf, uint32_t len, const gchar *to) {
+    gchar *name;
+    if (len < ci_ChunkSize(CI_CHUNK_T_OINF, 0)) return NULL;
+    name = ci_ChunkString(buf, len, CI_F_OINF_NAME_W, to);
+    if (name && *name) return name;
+    name = ci_ChunkString(buf, len, CI_F_OINF_NAME_A, to);
+    return (name && *name ? name : NULL);
+}
+
+// Chunk area is something like this:
+// uint32_t asize
+// uint32_t unk (always 1)
+// An then:
+// uint32_t chunk_len;
+// uint32_t chunk_id;
+// uint8_t data[chunk_len];
+// ...
+// Walks it once and notes where chunks are, payloads are decoded only by
+// those who ask for them. Doesn't abort, idx->end tells why walk stopped,
+// so chunks before a corrupt one are still there.
+void ci_IndexChunks9(uint8_t *buf, uint32_t size, uint32_t area_size, CI_chunk_index *idx) {
+    uint32_t offset, len = 0, size_idx = 0, chunk_area_size = 8;
+    CI_chunk *c;
+    idx->chunk = NULL;
+    idx->num = 0;
+    idx->end = CI_CHUNKS_BLOCK;
+    for (offset=CPT9_Block_sz+8; offset < size; offset+=len+8) {
+        // OK, this was propably last chunk, don't go beyond
+        // TODO: I put this check here, because I've met situations:
+        // block->size1 == 0 -> direct skip to data, but also:
+        // block->size1 == 8 -> we search for chunks, but 8 bytes is too small for any
+        if (chunk_area_size == area_size) {
+            idx->end = CI_CHUNKS_AREA;
+            break;
+        }
+        if (!ci_InFileAt(buf, offset, 8)) {
+            idx->end = CI_CHUNKS_CORRUPT;
+            break;
+        }
+        len = GETu32(buf, offset);      // get chunk len
+        // If len == 0 something's not OK
+        if (!len) {
+            idx->end = CI_CHUNKS_LEN0;
+            break;
+        }
+        // Whole chunk has to be in the file
+        if (!ci_InFileAt(buf, offset+8, len)) {
+            idx->end = CI_CHUNKS_CORRUPT;
+            break;
+        }
+        if (idx->num == size_idx) {
+            size_idx = 2*size_idx + 16;
+            c = (CI_chunk *) ci_ArenaAlloc(&ci_arena, size_idx*sizeof(CI_chunk));
+            if (idx->num) memcpy(c, idx->chunk, idx->num*sizeof(CI_chunk));
+            idx->chunk = c;
+        }
+        c = &idx->chunk[idx->num++];
+        c->id = GETu32(buf, offset+4);  // get chunk id
+        c->offs = offset+8;
+        c->len = len;
+        // Add to chunk area size for checking
+        chunk_area_size += len + 8;
+    }
+}
+
+// Index of first chunk of given id at or after from, idx->num if none.
+uint32_t ci_ChunkFind(const CI_chunk_index *idx, uint32_t id, uint32_t from) {
+    for (; from < idx->num; from++) if (idx->chunk[from].id == id) break;
+    return from;
+}
+
+int ci_WhereHas(const void *ctx, uint32_t id) {
+    const CI_chunk_index *idx = (const CI_chunk_index *) ctx;
+    return ci_ChunkFind(idx, id, 0) < idx->num;
+}
+
+// Counts block for each --where any()/count() it matches. Once blocks
+// left can't change the result, the file is done (first block may do).
+void ci_WhereBlock9(CPT9_Block *block, CI_chunk_index *idx) {
+    CI_where_block b;
+    uint32_t i;
+    int match;
+    b.v[CI_WB_WIDTH] = block->width;
+    b.v[CI_WB_HEIGHT] = block->height;
+    b.v[CI_WB_BPP] = block->bpp;
+    b.v[CI_WB_TILE_W] = block->tile_w;
+    b.v[CI_WB_TILE_H] = block->tile_h;
+    b.v[CI_WB_OBJECT] = (block->unk02 == 1);
+    b.v[CI_WB_CHUNKS] = idx->num;
+    b.has = ci_WhereHas;
+    b.ctx = idx;
+    for (i=0; i < ci_where.aggs; i++)
+        if (ci_WhereBlock(&ci_where, i, &b)) CI_STAT_ADD(ci_where_count[i], 1);
+    // Blocks done are read before counts, other threads' ones may be in
+    // counts already but not in done: left is never too small then
+    CI_STAT_ADD(ci_where_done, 1);
+    match = ci_WhereEval(&ci_where, &ci_where_file, ci_where_count, ci_where_blocks - CI_STAT_ADD(ci_where_done, 0));
+    if (match != CI_WHERE_UNKNOWN) {
+        ci_where_match = match;
+        ci_Abort(EXIT_SUCCESS);
+    }
+}
+
+// --- Arrow export of files, blocks and chunks (--arrow) ---
+// Three tables written as Arrow IPC files into given directory. Every
+// thread fills batches of its own, full ones are written at once by
+// whoever filled them, workers included; footer is written by main
+// process at end.
+
+enum { CI_AR_FILES, CI_AR_BLOCKS, CI_AR_CHUNKS, CI_AR_TABLES };
+
+enum {
+    CI_AF_FILE, CI_AF_STATUS, CI_AF_SIZE, CI_AF_VERSION, CI_AF_MODEL, CI_AF_XDPI, CI_AF_YDPI,
+    CI_AF_FLAGS, CI_AF_ICC, CI_AF_WCOMMENT, CI_AF_PALETTE, CI_AF_BLOCKS, CI_AF_NUM
+};
+const CI_arrow_col ci_arrow_files[CI_AF_NUM] = {
+    { "file", CI_ARROW_UTF8 }, { "status", CI_ARROW_I32 }, { "size", CI_ARROW_U64 },
+    { "version", CI_ARROW_U32 }, { "color_model", CI_ARROW_U32 }, { "xdpi", CI_ARROW_U32 },
+    { "ydpi", CI_ARROW_U32 }, { "flags", CI_ARROW_U32 }, { "icc", CI_ARROW_U8 },
+    { "wide_comment", CI_ARROW_U8 }, { "palette", CI_ARROW_U32 }, { "blocks", CI_ARROW_U32 }
+};
+
+enum {
+    CI_AB_FILE, CI_AB_BLOCK, CI_AB_OFFSET, CI_AB_SIZE, CI_AB_WIDTH, CI_AB_HEIGHT, CI_AB_TILE_W,
+    CI_AB_TILE_H, CI_AB_BPP, CI_AB_UNK00, CI_AB_UNK01, CI_AB_UNK02, CI_AB_OBJECT, CI_AB_PAL_SIZE,
+    CI_AB_CHUNKS, CI_AB_NAME, CI_AB_NUM
+};
+const CI_arrow_col ci_arrow_blocks[CI_AB_NUM] = {
+    { "file", CI_ARROW_UTF8 }, { "block", CI_ARROW_U32 }, { "offset", CI_ARROW_U64 },
+    { "size", CI_ARROW_U32 }, { "width", CI_ARROW_U32 }, { "height", CI_ARROW_U32 },
+    { "tile_w", CI_ARROW_U32 }, { "tile_h", CI_ARROW_U32 }, { "bpp", CI_ARROW_U32 },
+    { "unk00", CI_ARROW_U32 }, { "unk01", CI_ARROW_U32 }, { "unk02", CI_ARROW_U32 },
+    { "object", CI_ARROW_U8 }, { "pal_size", CI_ARROW_U32 }, { "chunks", CI_ARROW_U32 },
+    { "name", CI_ARROW_UTF8 }
+};
+
+enum { CI_AC_FILE, CI_AC_BLOCK, CI_AC_CHUNK, CI_AC_KNOWN, CI_AC_OFFSET, CI_AC_LEN, CI_AC_TEXT, CI_AC_NUM };
+const CI_arrow_col ci_arrow_chunks[CI_AC_NUM] = {
+    { "file", CI_ARROW_UTF8 }, { "block", CI_ARROW_U32 }, { "chunk", CI_ARROW_UTF8 },
+    { "known", CI_ARROW_U8 }, { "offset", CI_ARROW_U64 }, { "len", CI_ARROW_U32 },
+    { "text", CI_ARROW_UTF8 }
+};
+
+CI_arrow ci_arrow[CI_AR_TABLES];
+CI_arrow_batch (*ci_arrow_thr)[CI_AR_TABLES];       // batches of each thread, 0 is main one
+uint32_t ci_arrow_threads;
+CI_TLS CI_arrow_batch *ci_arrow_batch;              // ... of this thread
+uint32_t ci_arrow_head;                             // 1 size & version of current file read, 2 all of header
+uint64_t ci_arrow_file[CI_AF_NUM];                  // ... into these
+
+// Creates table files, before workers are forked.
+void ci_ArrowBegin(void) {
+    static const char *name[CI_AR_TABLES] = { "files.arrow", "blocks.arrow", "chunks.arrow" };
+    static const CI_arrow_col *col[CI_AR_TABLES] = { ci_arrow_files, ci_arrow_blocks, ci_arrow_chunks };
+    static const uint32_t cols[CI_AR_TABLES] = { CI_AF_NUM, CI_AB_NUM, CI_AC_NUM };
+    char *path = (char *) malloc(strlen(ci_cfg.arrow) + 16);
+    uint32_t i, t;
+
+    mkdir(ci_cfg.arrow, 0755);
+    for (t=0; t < CI_AR_TABLES; t++) {
+        sprintf(path, "%s%c%s", ci_cfg.arrow, ci_path_separator, name[t]);
+        if (ci_ArrowOpen(&ci_arrow[t], path, col[t], cols[t])) {
+            printf("%s Can't create %s!\n", ci_error_str, path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(path);
+    ci_arrow_threads = ci_cfg.threads;
+    ci_arrow_thr = (CI_arrow_batch (*)[CI_AR_TABLES]) malloc(ci_arrow_threads*sizeof(*ci_arrow_thr));
+    for (i=0; i < ci_arrow_threads; i++)
+        for (t=0; t < CI_AR_TABLES; t++) ci_ArrowBatchInit(&ci_arrow_thr[i][t], &ci_arrow[t]);
+    ci_arrow_batch = ci_arrow_thr[0];
+}
+
+// Header fields of file for its row, right after header is read. CPT6
+// header is different, its fields stay null.
+void ci_ArrowHeader(void) {
+    ci_arrow_head = 1;
+    ci_arrow_file[CI_AF_SIZE] = ci_filesize;
+    ci_arrow_file[CI_AF_VERSION] = ci.version;
+    if (ci.version == 0x600) return;
+    ci_arrow_head = 2;
+    ci_arrow_file[CI_AF_MODEL] = ci_f_header->color_model;
+    ci_arrow_file[CI_AF_XDPI] = lround((double) (ci_f_header->xdpi) * cpt_dpi_scale);
+    ci_arrow_file[CI_AF_YDPI] = lround((double) (ci_f_header->ydpi) * cpt_dpi_scale);
+    ci_arrow_file[CI_AF_FLAGS] = ci_f_header->flags;
+    ci_arrow_file[CI_AF_ICC] = !!(ci_f_header->flags & CPT_EMB_ICC_PROFILE);
+    ci_arrow_file[CI_AF_WCOMMENT] = !!(ci_f_header->flags & CPT_EMB_WIDE_COMMENT);
+    ci_arrow_file[CI_AF_PALETTE] = ci_f_header->palette_entries;
+    ci_arrow_file[CI_AF_BLOCKS] = ci_f_header->blocks_num;
+}
+
+// Row of file once it's done; fields of header not read are null.
+void ci_ArrowFile(int status) {
+    CI_arrow_batch *b = &ci_arrow_batch[CI_AR_FILES];
+    uint32_t i;
+    ci_ArrowStr(b, CI_AF_FILE, ci_filename);
+    ci_ArrowInt(b, CI_AF_STATUS, (uint32_t) status);
+    if (ci_arrow_head)
+        for (i=CI_AF_SIZE; i < (ci_arrow_head > 1 ? CI_AF_NUM : CI_AF_MODEL); i++)
+            if (i != CI_AF_SIZE || ci_filesize >= 0) ci_ArrowInt(b, i, ci_arrow_file[i]);
+    ci_ArrowRow(b);
+    ci_arrow_head = 0;
+}
+
+// First string field of a decoded chunk that isn't empty, in UTF-8.
+gchar *ci_ArrowChunkText(const CI_chunk *c, const uint8_t *buf) {
+    int type = ci_ChunkType(c->id);
+    uint32_t f;
+    gchar *str;
+    if (type < 0) return NULL;
+    for (f = ci_chunk_type[type].field; f < ci_chunk_type[type+1].field; f++) {
+        if (ci_chunk_field[f].kind != CI_FIELD_ANSI && ci_chunk_field[f].kind != CI_FIELD_UCS2) continue;
+        if ((str = ci_ChunkString(buf, c->len, f, "UTF-8")) && *str) return str;
+    }
+    return NULL;
+}
+
+// Rows of block id at offs and of its chunks.
+void ci_ArrowBlock9(uint32_t offs, uint32_t size, uint32_t id, uint8_t *buf, CPT9_Block *block, CI_chunk_index *idx) {
+    CI_arrow_batch *b = &ci_arrow_batch[CI_AR_BLOCKS];
+    const CI_chunk *c;
+    uint32_t i;
+
+    ci_ArrowStr(b, CI_AB_FILE, ci_filename);
+    ci_ArrowInt(b, CI_AB_BLOCK, id);
+    ci_ArrowInt(b, CI_AB_OFFSET, offs);
+    ci_ArrowInt(b, CI_AB_SIZE, size);
+    ci_ArrowInt(b, CI_AB_WIDTH, block->width);
+    ci_ArrowInt(b, CI_AB_HEIGHT, block->height);
+    ci_ArrowInt(b, CI_AB_TILE_W, block->tile_w);
+    ci_ArrowInt(b, CI_AB_TILE_H, block->tile_h);
+    ci_ArrowInt(b, CI_AB_BPP, block->bpp);
+    ci_ArrowInt(b, CI_AB_UNK00, block->unk00);
+    ci_ArrowInt(b, CI_AB_UNK01, block->unk01);
+    ci_ArrowInt(b, CI_AB_UNK02, block->unk02);
+    ci_ArrowInt(b, CI_AB_OBJECT, block->unk02 == 1);
+    ci_ArrowInt(b, CI_AB_PAL_SIZE, block->pal_size);
+    ci_ArrowInt(b, CI_AB_CHUNKS, idx->num);
+    if ((i = ci_ChunkFind(idx, CPT9_CHUNK_OINF, 0)) < idx->num)
+        ci_ArrowStr(b, CI_AB_NAME, ci_ChunkObjectName(buf+idx->chunk[i].offs, idx->chunk[i].len, "UTF-8"));
+    ci_ArrowRow(b);
+
+    b = &ci_arrow_batch[CI_AR_CHUNKS];
+    for (i=0; i < idx->num; i++) {
+        c = &idx->chunk[i];
+        ci_ArrowStr(b, CI_AC_FILE, ci_filename);
+        ci_ArrowInt(b, CI_AC_BLOCK, id);
+        ci_ArrowStr(b, CI_AC_CHUNK, ci_Ascii32(c->id));
+        ci_ArrowInt(b, CI_AC_KNOWN, ci_ChunkType(c->id) >= 0);
+        ci_ArrowInt(b, CI_AC_OFFSET, (uint64_t) offs + c->offs - 8);
+        ci_ArrowInt(b, CI_AC_LEN, c->len);
+        ci_ArrowStr(b, CI_AC_TEXT, ci_ArrowChunkText(c, buf+c->offs));
+        ci_ArrowRow(b);
+    }
+}
+
+// Writes what's left in batches of all threads, in every process.
+void ci_ArrowFlushAll(void) {
+    uint32_t i, t;
+    for (i=0; i < ci_arrow_threads; i++)
+        for (t=0; t < CI_AR_TABLES; t++) ci_ArrowFlush(&ci_arrow_thr[i][t]);
+}
+
+void ci_ArrowSaveAll(FILE *out) {
+    uint32_t t;
+    for (t=0; t < CI_AR_TABLES; t++) ci_ArrowSave(&ci_arrow[t], out);
+}
+
+void ci_ArrowLoadAll(FILE *in) {
+    uint32_t t;
+    for (t=0; t < CI_AR_TABLES; t++) ci_ArrowLoad(&ci_arrow[t], in);
+}
+
+// Footers, once all workers are done, by main process.
+void ci_ArrowEnd(void) {
+    static const char *name[CI_AR_TABLES] = { "files", "blocks", "chunks" };
+    uint32_t i, t;
+    for (t=0; t < CI_AR_TABLES; t++)
+        if (ci_ArrowClose(&ci_arrow[t])) ci_msg(0, "%s Can't write %s table into %s!\n", ci_error_str, name[t], ci_cfg.arrow);
+    for (i=0; i < ci_arrow_threads; i++)
+        for (t=0; t < CI_AR_TABLES; t++) ci_ArrowBatchFree(&ci_arrow_thr[i][t]);
+    free(ci_arrow_thr);
+    ci_arrow_thr = NULL;
+    ci_arrow_batch = NULL;
+}
+
+void ci_ArrowReport(void) {
+    printf("Arrow export %s: %"PRIu64" file(s), %"PRIu64" block(s), %"PRIu64" chunk(s) in %u record batch(es)\n",
+        ci_cfg.arrow, ci_arrow[CI_AR_FILES].rows, ci_arrow[CI_AR_BLOCKS].rows, ci_arrow[CI_AR_CHUNKS].rows,
+        ci_arrow[CI_AR_FILES].blocks + ci_arrow[CI_AR_BLOCKS].blocks + ci_arrow[CI_AR_CHUNKS].blocks);
+}
+
+// --- Pixel statistics of raw tiles (-ps) ---
+
+CI_pstat ci_pstat_file[CI_PSTAT_LAYOUTS];           // totals of file, by bpp
+CI_TLS CI_pstat *ci_pstat_acc = ci_pstat_file;      // ... gathered by this thread
+
+// Channel holding mask or alpha of blocks of given bpp, -1 if there's
+// none: 1 or 8 bpp blocks of other models are masks, 32 bpp non-CMYK
+// ones have alpha last.
+int ci_PstatCoverage(uint32_t bpp) {
+    uint32_t model_bpp;
+    switch (ci_f_header->color_model) {
+        case CPT_BW1: model_bpp = 1; break;
+        case CPT_GRAY8:
+        case CPT_RGB8: model_bpp = 8; break;
+        case CPT_GRAY16: model_bpp = 16; break;
+        case CPT_CMYK32: model_bpp = 32; break;
+        case CPT_RGB48: model_bpp = 48; break;
+        default: model_bpp = 24;
+    }
+    if (bpp == 32 && model_bpp != 32) return 3;
+    if ((bpp == 1 || bpp == 8) && model_bpp != bpp) return 0;
+    return -1;
+}
+
+// Short output of block goes with it (level 8), of file with the header
+// (level 4).
+void ci_PstatPrint(const char *what, CI_pstat *s, uint32_t level) {
+    uint32_t ch, v, k, bins, step;
+    int cov = ci_PstatCoverage(s->bpp);
+    uint64_t n;
+    ci_PstatFinish(s);
+    ci_msg(1, "    Pixel statistics%s: %"PRIu64" pixels in %"PRIu64" raw tile(s)", what, s->pixels, s->tiles);
+    if (s->tiles_packed) ci_msg(1, ", %"PRIu64" compressed ones not decoded", s->tiles_packed);
+    if (s->tiles_missing) ci_msg(1, ", %"PRIu64" not in memory", s->tiles_missing);
+    ci_msg(1, "\n");
+    ci_msg(level, " | ps %"PRIu64"/%"PRIu64, s->tiles, s->tiles + s->tiles_packed + s->tiles_missing);
+    if (!s->pixels) return;
+    // 16 bins, all 256 with -v; 16-bit channels by high byte
+    bins = (s->depth == 1 ? 2 : (ci_cfg.verbose2 ? CI_PSTAT_BINS : 16));
+    step = (s->depth == 1 ? 1 : CI_PSTAT_BINS / bins);
+    for (ch=0; ch < s->channels; ch++) {
+        ci_msg(1, "    Channel %u: min %u, max %u, mean %.2f\n", ch, s->min[ch], s->max[ch], ci_PstatMean(s, ch));
+        ci_msg(1, "    Channel %u histogram (%u bins):", ch, bins);
+        for (k=0; k < bins; k++) {
+            for (n=0, v=k*step; v < (k+1)*step; v++) n += s->hist[ch][v];
+            ci_msg(1, " %"PRIu64, n);
+        }
+        ci_msg(1, "\n");
+        ci_msg(level, " %u-%u/%.1f", s->min[ch], s->max[ch], ci_PstatMean(s, ch));
+    }
+    if (cov >= 0) {
+        ci_msg(1, "    %s coverage: %.2f%% (%"PRIu64" pixels)\n", (s->channels == 1 ? "Mask" : "Alpha"),
+            100.0 * ci_PstatNonzero(s, cov) / s->pixels, ci_PstatNonzero(s, cov));
+        ci_msg(level, " cov%.1f", 100.0 * ci_PstatNonzero(s, cov) / s->pixels);
+    }
+}
+
+// Number of tiles in data pair list of block (at *offset, as in
+// ci_ProcessBlock9()) if they make up its row-major tile grid; else 0,
+// told as what skipped.
+uint32_t ci_TileGrid9(uint32_t offs, uint8_t *buf, CPT9_Block *block, uint32_t *offset, const char *what) {
+    uint32_t n, cols, data_start;
+    *offset = CPT9_Block_sz + block->size1;
+    if (!block->tile_w || !block->tile_h || !ci_InFileAt(buf, *offset, 4)) return 0;
+    data_start = GETu32(buf, *offset);
+    cols = (block->width + block->tile_w - 1) / block->tile_w;
+    n = ((uint64_t) data_start > (uint64_t) offs + *offset ? (data_start - offs - *offset + 7) / 8 : 0);
+    if ((uint64_t) cols * ((block->height + block->tile_h - 1) / block->tile_h) != n) {
+        ci_msg(1, "    %s: %u tiles don't make up %ux%u tile grid, skipped\n", what, n, block->tile_w, block->tile_h);
+        return 0;
+    }
+    return n;
+}
+
+// Statistics of raw tiles of block, added to totals of this thread too.
+// Edge tiles count as far as they're in the block.
+void ci_PstatBlock9(uint32_t offs, uint8_t *buf, CPT9_Block *block) {
+    CI_pstat s;
+    uint32_t i, n, cols, offset, pair[2], tx, ty;
+    if (ci_PstatInit(&s, block->bpp)) {
+        ci_msg(1, "    Pixel statistics: %u bpp pixels not known, skipped\n", block->bpp);
+        return;
+    }
+    if (!(n = ci_TileGrid9(offs, buf, block, &offset, "Pixel statistics"))) return;
+    cols = (block->width + block->tile_w - 1) / block->tile_w;
+    for (i=0; i < n; i++) {
+        pair[0] = GETu32(buf, offset+8*i);
+        pair[1] = GETu32(buf, offset+8*i+4);
+        tx = (i % cols) * block->tile_w;
+        ty = (i / cols) * block->tile_h;
+        ci_PstatTile(&s, ci_TileView(pair[0], pair[1]), pair[1], block->tile_w, block->tile_h,
+            block->width - tx, block->height - ty);
+    }
+    ci_PstatPrint("", &s, 8);
+    ci_PstatMerge(&ci_pstat_acc[ci_PstatLayout(block->bpp)], &s);
+}
+
+void ci_PstatBegin(void) {
+    ci_PstatInitAll(ci_pstat_file);
+}
+
+// Totals of file, one for each bpp its blocks have.
+void ci_PstatEnd(void) {
+    uint32_t i;
+    char what[32];
+    for (i=0; i < CI_PSTAT_LAYOUTS; i++) {
+        CI_pstat *s = &ci_pstat_file[i];
+        if (!s->tiles && !s->tiles_packed && !s->tiles_missing) continue;
+        sprintf(what, " of file (%u bpp)", s->bpp);
+        ci_PstatPrint(what, s, 4);
+    }
+}
+
+// --- Perceptual hashes of blocks and files (-ph) ---
+
+#define CI_PHASH_FILE           UINT32_MAX      // index of file's own hash
+
+// Hash of a block or file found in one of the files
+typedef struct _CI_phash_entry {
+    uint64_t    hash;
+    uint32_t    file;           // index to ci_files[]
+    uint32_t    member;         // ... and to ci_member_name[] (1-based), 0 if none
+    uint32_t    index;          // block number, CI_PHASH_FILE for file
+} CI_phash_entry;
+
+// Hash of block of current file, set by thread which processed it
+typedef struct _CI_phash_block {
+    uint64_t    hash;
+    uint64_t    pixels;
+    uint32_t    valid;
+} CI_phash_block;
+
+CI_phash_entry *ci_phash = NULL;
+uint32_t ci_phash_num = 0;
+CI_phash_block *ci_phash_blk;           // blocks of current file, in ci_arena
+uint8_t ci_phash_lut[256];              // luma of palette colors of current file
+
+void ci_PhashAdd(uint64_t hash, uint32_t index) {
+    if (!(ci_phash_num & 1023)) ci_phash = (CI_phash_entry *) realloc(ci_phash, (ci_phash_num+1024)*sizeof(CI_phash_entry));
+    ci_phash[ci_phash_num].hash = hash;
+    ci_phash[ci_phash_num].file = ci_file_idx;
+    ci_phash[ci_phash_num].member = ci_MemberName();
+    ci_phash[ci_phash_num].index = index;
+    ci_phash_num++;
+}
+
+// Called after file header, before blocks: room for their hashes, luma
+// of 8-bit palette colors.
+void ci_PhashBegin(void) {
+    uint32_t i;
+    const CPT_RGB *c = (const CPT_RGB *) ci_palette;
+    ci_phash_blk = (CI_phash_block *) ci_ArenaAlloc(&ci_arena, (ci.blocks_num+1)*sizeof(CI_phash_block));
+    memset(ci_phash_blk, 0, (ci.blocks_num+1)*sizeof(CI_phash_block));
+    memset(ci_phash_lut, 0, sizeof(ci_phash_lut));
+    if (ci_f_header->color_model == CPT_RGB8 && ci.pal_entries <= 256 && ci_InFile(c, ci.pal_entries*CPT_RGB_sz))
+        for (i=0; i < ci.pal_entries; i++) ci_phash_lut[i] = (c[i].r + 2*c[i].g + c[i].b) / 4;
+}
+
+// Hash of block from luma grid of its raw tiles.
+void ci_PhashBlock9(uint32_t offs, uint32_t id, uint8_t *buf, CPT9_Block *block) {
+    CI_phash p;
+    uint32_t i, n, cols, offset, pair[2], flags = 0, model = ci_f_header->color_model;
+    uint64_t hash;
+    if (model == CPT_CMYK32 && block->bpp == 32) flags |= CI_PHASH_CMYK;
+    if (model == CPT_LAB24 && block->bpp == 24) flags |= CI_PHASH_LAB;
+    if (ci_PhashInit(&p, block->bpp, flags, block->width, block->height,
+        (model == CPT_RGB8 && block->bpp == 8 && ci.pal_entries ? ci_phash_lut : NULL))) {
+        ci_msg(1, "    Perceptual hash: %u bpp pixels not known, skipped\n", block->bpp);
+        ci_msg(8, " | ph -");
+        return;
+    }
+    if (!(n = ci_TileGrid9(offs, buf, block, &offset, "Perceptual hash"))) {
+        ci_msg(8, " | ph -");
+        return;
+    }
+    cols = (block->width + block->tile_w - 1) / block->tile_w;
+    for (i=0; i < n; i++) {
+        pair[0] = GETu32(buf, offset+8*i);
+        pair[1] = GETu32(buf, offset+8*i+4);
+        ci_PhashTile(&p, ci_TileView(pair[0], pair[1]), pair[1], block->tile_w, block->tile_h,
+            (i % cols) * block->tile_w, (i / cols) * block->tile_h);
+    }
+    if (ci_PhashFinish(&p, &hash)) {
+        if (p.tiles_skipped) ci_msg(1, "    Perceptual hash: none, %"PRIu64" of %u tiles compressed or not in memory\n", p.tiles_skipped, n);
+        else ci_msg(1, "    Perceptual hash: none, block smaller than %ux%u\n", CI_PHASH_W, CI_PHASH_H);
+        ci_msg(8, " | ph -");
+        return;
+    }
+    ci_msg(1, "    Perceptual hash: %016"PRIx64"\n", hash);
+    ci_msg(8, " | ph %016"PRIx64, hash);
+    ci_phash_blk[id].hash = hash;
+    ci_phash_blk[id].pixels = (uint64_t) block->width * block->height;
+    ci_phash_blk[id].valid = 1;
+}
+
+// Hash of file is the one of its largest hashed block, mostly background.
+// Hashes of blocks and file are kept for ci_PhashReport().
+void ci_PhashEnd(void) {
+    uint32_t i, best = UINT32_MAX;
+    for (i=0; i < ci.blocks_num; i++) {
+        if (!ci_phash_blk[i].valid) continue;
+        ci_PhashAdd(ci_phash_blk[i].hash, i);
+        if (best == UINT32_MAX || ci_phash_blk[i].pixels > ci_phash_blk[best].pixels) best = i;
+    }
+    if (best == UINT32_MAX) {
+        ci_msg(1, "    Perceptual hash of file: none\n");
+        ci_msg(4, " | ph -");
+        return;
+    }
+    ci_PhashAdd(ci_phash_blk[best].hash, CI_PHASH_FILE);
+    ci_msg(1, "    Perceptual hash of file: %016"PRIx64" (block %04x)\n", ci_phash_blk[best].hash, best);
+    ci_msg(4, " | ph %016"PRIx64, ci_phash_blk[best].hash);
+}
+
+void ci_PhashSave(FILE *out) {
+    fwrite(&ci_phash_num, sizeof(uint32_t), 1, out);
+    fwrite(ci_phash, sizeof(CI_phash_entry), ci_phash_num, out);
+}
+
+void ci_PhashLoad(FILE *in) {
+    uint32_t i, n;
+    if (fread(&n, sizeof(uint32_t), 1, in) != 1) return;
+    ci_phash = (CI_phash_entry *) realloc(ci_phash, ((ci_phash_num+n+1024) & ~1023)*sizeof(CI_phash_entry));
+    n = fread(ci_phash+ci_phash_num, sizeof(CI_phash_entry), n, in);
+    for (i=0; i < n; i++) if (ci_phash[ci_phash_num+i].member) ci_phash[ci_phash_num+i].member += ci_member_base;
+    ci_phash_num += n;
+}
+
+// Files first, then blocks, both in order they were processed in.
+int ci_PhashCmp(const void *a, const void *b) {
+    const CI_phash_entry *x = a, *y = b;
+    if ((x->index == CI_PHASH_FILE) != (y->index == CI_PHASH_FILE)) return (x->index == CI_PHASH_FILE ? -1 : 1);
+    if (x->file != y->file) return (x->file < y->file ? -1 : 1);
+    if (x->member != y->member) return (x->member < y->member ? -1 : 1);
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+// Prints clusters (2+ members) of near hashes of e[0..n-1], each member
+// with its distance from the first one. Returns number of clusters.
+uint32_t ci_PhashReportKind(const char *kind, CI_phash_entry *e, uint32_t n) {
+    uint64_t *hash = (uint64_t *) malloc((n+1)*sizeof(uint64_t));
+    uint32_t *root = (uint32_t *) malloc((n+1)*sizeof(uint32_t));
+    uint32_t *next = (uint32_t *) malloc((n+1)*sizeof(uint32_t));
+    uint32_t *last = (uint32_t *) malloc((n+1)*sizeof(uint32_t));
+    uint32_t *size = (uint32_t *) calloc(n+1, sizeof(uint32_t));
+    uint32_t i, k, clusters = 0;
+    for (i=0; i < n; i++) hash[i] = e[i].hash;
+    ci_PhashCluster(hash, n, ci_cfg.phash_dist, root);
+    // Members of each cluster listed from its root (the smallest index)
+    for (i=0; i < n; i++) {
+        next[i] = UINT32_MAX;
+        if (root[i] != i) next[last[root[i]]] = i;
+        last[root[i]] = i;
+        size[root[i]]++;
+    }
+    for (i=0; i < n; i++) {
+        if (root[i] != i || size[i] < 2) continue;
+        clusters++;
+        printf("%s near %016"PRIx64": %u members\n", kind, e[i].hash, size[i]);
+        for (k=i; k != UINT32_MAX; k = next[k]) {
+            printf("    %016"PRIx64" %2u %s", e[k].hash, ci_PhashDistance(e[i].hash, e[k].hash), ci_HashedName(e[k].file, e[k].member));
+            if (e[k].index != CI_PHASH_FILE) printf(" %04x", e[k].index);
+            printf("\n");
+        }
+    }
+    free(size);
+    free(last);
+    free(next);
+    free(root);
+    free(hash);
+    return clusters;
+}
+
+void ci_PhashReport(void) {
+    uint32_t files, clusters[2];
+    if (ci_phash_num) qsort(ci_phash, ci_phash_num, sizeof(CI_phash_entry), ci_PhashCmp);
+    for (files=0; files < ci_phash_num && ci_phash[files].index == CI_PHASH_FILE; files++);
+    clusters[0] = ci_PhashReportKind("files", ci_phash, files);
+    clusters[1] = ci_PhashReportKind("blocks", ci_phash + files, ci_phash_num - files);
+    printf("Near duplicates (at most %u bits apart): %u file hashes in %u cluster(s), %u block hashes in %u cluster(s)\n",
+        ci_cfg.phash_dist, files, clusters[0], ci_phash_num - files, clusters[1]);
+}
+
+// --- Structural diff of two files (--diff) ---
+
+CI_diff_file ci_diff[2];
+char *ci_diff_name[2];
+uint32_t ci_diff_files = 0;             // files (members) given so far
+uint32_t ci_diff_failed = 0;            // ... not read through, 1 + index
+CI_diff_file *ci_diff_cur = NULL;       // current one, NULL past second
+
+void ci_DiffBegin(void) {
+    ci_diff_cur = NULL;
+    if (ci_diff_files < 2) {
+        ci_diff_cur = &ci_diff[ci_diff_files];
+        ci_DiffInit(ci_diff_cur);
+        ci_diff_name[ci_diff_files] = strdup(ci_filename);
+    }
+    ci_diff_files++;
+}
+
+// File header fields compared; comments, palette and ICC profile hashed.
+void ci_DiffHeader(void) {
+    CI_diff_file *d = ci_diff_cur;
+    uint32_t len;
+    if (!d) return;
+    ci_DiffField(d, "format", ci.version, 0);
+    ci_DiffField(d, "color model", ci_f_header->color_model, 0);
+    ci_DiffField(d, "xdpi", ci.xdpi, 0);
+    ci_DiffField(d, "ydpi", ci.ydpi, 0);
+    ci_DiffField(d, "flags", ci_f_header->flags, 0);
+    ci_DiffField(d, "blocks", ci.blocks_num, 0);
+    ci_DiffField(d, "palette entries", ci.pal_entries, 0);
+    if (ci.pal_entries && ci_InFile(ci_palette, ci.pal_entries*CPT_RGB_sz))
+        ci_DiffField(d, "palette", ci_Hash64(ci_palette, ci.pal_entries*CPT_RGB_sz, 0), 1);
+    if (ci.emb_icc) {
+        if (ci_icc->type == CPT_ICC_EMBEDDED && ci_InFile(&ci_icc->data, ci_icc->len))
+            ci_DiffField(d, "ICC profile", ci_Hash64(&ci_icc->data, ci_icc->len, 0), 1);
+        else ci_DiffField(d, "ICC profile", ci_icc->type, 1);
+    }
+    for (len=0; len < CPT_NOTE_LEN_A && ci_f_header->notes[len]; len++);
+    ci_DiffField(d, "comment", ci_Hash64(ci_f_header->notes, len, 0), 1);
+    ci_wcomment = (CPT_WideComment *) (ci_data + ci.wcomment_offs);
+    if (ci_InFileAt(ci_data, ci.wcomment_offs, CPT_WideComment_sz) && ci_wcomment->magic == CPT_WIDE_COMMENT_MAGIC) {
+        for (len=0; len+1 < CPT_NOTE_LEN_W && (ci_wcomment->notes[len] || ci_wcomment->notes[len+1]); len += 2);
+        ci_DiffField(d, "comment (UCS-2)", ci_Hash64(ci_wcomment->notes, len, 0), 1);
+    }
+}
+
+// Block, hashes of its chunks and of its tiles from data pair list (as
+// in ci_ProcessBlock9()). Pixels aren't decoded; tile data only hashed
+// if it's in memory, of streamed input that's if block fits in buffer.
+void ci_DiffBlock9(uint32_t offs, uint32_t id, uint8_t *buf, CPT9_Block *block, CI_chunk_index *idx) {
+    CI_diff_block *b;
+    uint32_t i, offset, data_start, pair[2];
+    gchar *name = NULL;
+    if (!ci_diff_cur) return;
+    if ((i = ci_ChunkFind(idx, CPT9_CHUNK_OINF, 0)) < idx->num)
+        name = ci_ChunkObjectName(buf+idx->chunk[i].offs, idx->chunk[i].len, ci_charset);
+    b = ci_DiffBlock(ci_diff_cur, id, name);
+    b->width = block->width;
+    b->height = block->height;
+    b->tile_w = block->tile_w;
+    b->tile_h = block->tile_h;
+    b->bpp = block->bpp;
+    b->head = ci_Hash64(block, CPT9_Block_sz, 0);
+    for (i=0; i < idx->num; i++)
+        ci_DiffChunk(ci_diff_cur, idx->chunk[i].id, buf+idx->chunk[i].offs, idx->chunk[i].len);
+    offset = CPT9_Block_sz + block->size1;
+    if (!ci_InFileAt(buf, offset, 4)) return;
+    data_start = GETu32(buf, offset);
+    for (i=0; (uint64_t) offs + offset + i < data_start; i+=8) {
+        pair[0] = GETu32(buf, offset+i);
+        pair[1] = GETu32(buf, offset+i+4);
+        ci_DiffTile(ci_diff_cur, ci_TileView(pair[0], pair[1]), pair[1]);
+    }
+}
+
+void ci_DiffPrintName(const CI_diff_block *x) {
+    if (x->name) printf(" '%s'", x->name);
+}
+
+// Prints changes of block x of a to y of b, returns 1 if there are any.
+uint32_t ci_DiffPrintBlock(const CI_diff_block *x, const CI_diff_block *y, uint64_t *tiles_changed) {
+    CI_diff_chunks *ch = (CI_diff_chunks *) malloc((x->chunks + y->chunks + 1) * sizeof(CI_diff_chunks));
+    CI_diff_region *reg;
+    uint32_t i, n, regions, changed, unknown, cols, any = 0;
+    const char *sep = ":";
+
+    n = ci_DiffChunksCompare(&ci_diff[0], x, &ci_diff[1], y, ch);
+    regions = ci_DiffTilesCompare(&ci_diff[0], x, &ci_diff[1], y, &reg, &changed, &unknown);
+    if (x->head == y->head && !n && !changed && !unknown && regions != CI_DIFF_NONE) {
+        free(ch);
+        return 0;
+    }
+    printf("block %04x -> %04x", x->id, y->id);
+    ci_DiffPrintName(y);
+    if (x->width != y->width || x->height != y->height) {
+        printf("%s size %ux%u -> %ux%u", sep, x->width, x->height, y->width, y->height);
+        sep = ",";
+        any = 1;
+    }
+    if (x->bpp != y->bpp) {
+        printf("%s %u -> %u bpp", sep, x->bpp, y->bpp);
+        sep = ",";
+        any = 1;
+    }
+    if (x->tile_w != y->tile_w || x->tile_h != y->tile_h) {
+        printf("%s tiles %ux%u -> %ux%u", sep, x->tile_w, x->tile_h, y->tile_w, y->tile_h);
+        sep = ",";
+        any = 1;
+    }
+    if (x->head != y->head && !any) {
+        printf("%s header", sep);
+        sep = ",";
+    }
+    for (i=0; i < n; i++) {
+        printf("%s chunk '%s'", sep, ci_Ascii32(ch[i].id));
+        if (ch[i].changed) printf(" %ux changed", ch[i].changed);
+        if (ch[i].added) printf(" %ux added", ch[i].added);
+        if (ch[i].removed) printf(" %ux removed", ch[i].removed);
+        sep = ",";
+    }
+    if (regions == CI_DIFF_NONE) {
+        printf("%s %u of %u tile(s) reused", sep, ci_DiffTilesReused(&ci_diff[0], x, &ci_diff[1], y), y->tiles);
+        *tiles_changed += y->tiles;
+    } else if (changed || unknown) {
+        printf("%s %u of %u tile(s) changed", sep, changed, y->tiles);
+        if (unknown) printf(" (%u not in memory)", unknown);
+        // Pixel rectangles WxH+X+Y, or ranges of tile list
+        cols = ci_DiffGrid(y);
+        for (i=0; i < regions; i++) {
+            if (cols) {
+                uint64_t x0 = (uint64_t) reg[i].x0 * y->tile_w, y0 = (uint64_t) reg[i].y0 * y->tile_h;
+                uint64_t x1 = (uint64_t) reg[i].x1 * y->tile_w, y1 = (uint64_t) reg[i].y1 * y->tile_h;
+                if (x1 > y->width) x1 = y->width;
+                if (y1 > y->height) y1 = y->height;
+                printf(" %"PRIu64"x%"PRIu64"+%"PRIu64"+%"PRIu64, x1-x0, y1-y0, x0, y0);
+            } else if (reg[i].x1 - reg[i].x0 == 1) printf(" #%u", reg[i].x0);
+            else printf(" #%u-%u", reg[i].x0, reg[i].x1-1);
+        }
+        *tiles_changed += changed;
+    }
+    printf("\n");
+    free(reg);
+    free(ch);
+    return 1;
+}
+
+// Aligns blocks of the two files, prints what differs.
+void ci_DiffReport(void) {
+    CI_diff_file *a = &ci_diff[0], *b = &ci_diff[1];
+    const CI_diff_field *fa, *fb;
+    uint32_t i, same = 0, changed = 0, removed = 0, added = 0;
+    uint64_t tiles_changed = 0;
+
+    if (ci_diff_files != 2) {
+        printf("%s "CI_ARG_DIFF" takes two files, %u given!\n", ci_error_str, ci_diff_files);
+    } else if (ci_diff_failed) {
+        printf("%s %s couldn't be read, files not compared!\n", ci_error_str, ci_diff_name[ci_diff_failed-1]);
+    } else {
+        printf("--- %s\n+++ %s\n", ci_diff_name[0], ci_diff_name[1]);
+        for (i=0; i < a->fields; i++) {
+            fa = &a->field[i];
+            fb = ci_DiffFieldFind(b, fa->name);
+            if (!fb) printf("header %s removed\n", fa->name);
+            else if (fa->value == fb->value) continue;
+            else if (fa->hash) printf("header %s changed\n", fa->name);
+            else printf("header %s: %"PRIu64" -> %"PRIu64"\n", fa->name, fa->value, fb->value);
+        }
+        for (i=0; i < b->fields; i++)
+            if (!ci_DiffFieldFind(a, b->field[i].name)) printf("header %s added\n", b->field[i].name);
+        ci_DiffAlign(a, b);
+        for (i=0; i < a->blocks; i++) {
+            if (a->block[i].match == CI_DIFF_NONE) {
+                printf("block %04x", a->block[i].id);
+                ci_DiffPrintName(&a->block[i]);
+                printf(" removed\n");
+                removed++;
+            } else if (ci_DiffPrintBlock(&a->block[i], &b->block[a->block[i].match], &tiles_changed)) changed++;
+            else same++;
+        }
+        for (i=0; i < b->blocks; i++) {
+            if (b->block[i].match != CI_DIFF_NONE) continue;
+            printf("block %04x", b->block[i].id);
+            ci_DiffPrintName(&b->block[i]);
+            printf(" added\n");
+            added++;
+        }
+        printf("Diff: %u block(s) same, %u changed, %u removed, %u added; %"PRIu64" of %u tile(s) changed, %"PRIu64" bytes hashed\n",
+            same, changed, removed, added, tiles_changed, b->tiles, a->hashed + b->hashed);
+    }
+    for (i=0; i < 2 && i < ci_diff_files; i++) {
+        ci_DiffFree(&ci_diff[i]);
+        free(ci_diff_name[i]);
+    }
+}
 
-
 // Verbose output is pretty readable. Short output:
 // bpp sizex sizey | unknown dwords
 void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
-    uint32_t offset, val, chnk, len=0, i;
-    uint8_t *buf = (uint8_t *) (ci_data + offs);
-    CPT9_Block *block = (CPT9_Block *) (ci_data + offs);
-    if (!ci_cfg.verbose && ci_cfg.silent_header) printf(" | ");
+    uint32_t offset, val, chnk, i;
+    CI_chunk_index idx = { NULL, 0, CI_CHUNKS_AREA };
+    CI_chunk *c;
+    uint8_t *buf = (uint8_t *) ci_BlockView(offs, size);
+    CPT9_Block *block = (CPT9_Block *) ci_View(buf, CPT9_Block_sz);
+    if (!ci_cfg.verbose && ci_cfg.silent_header) ci_print(" | ");
 //    ci_msg(8, " | ");
 
     // Block header info
@@ -859,17 +3782,18 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
         block->unk00, block->unk01, block->unk02, block->size1, block->pal_size,
         block->unk03[0], block->unk03[1], block->unk03[2], block->unk03[3], block->unk03[4]
     );
+    if (ci_cfg.census) ci_CensusBlock(block);
 
     // Find chunks in block
-    uint32_t chunk_area_size = 0;
-    
     if (ci_cfg.output_chunks) ci_msg(8," |");
-    // If it's non-zero, let's try to read chunk info
+    // If it's non-zero, let's try to read chunk info; --where alone
+    // doesn't need it unless it asks for has()
     uint32_t area_size;
     uint32_t area_unk;  // notice: == block->unk01 (?)
-    if (block->size1) {
+    if (block->size1 && (!ci_cfg.where || ci_where.chunks || ci_cfg.text_index || ci_cfg.arrow)) {
         area_size = GETu32(buf, CPT9_Block_sz);
         area_unk = GETu32(buf, CPT9_Block_sz+4);
+        if (ci_cfg.census) ci_CensusAdd(CI_CS_AREA_UNK, 0, area_unk);
         if (ci_cfg.output_chunks) {
             ci_msg(1,"    Chunk table size (block info/area info+pal_size): %u/%u\n", block->size1, area_size+block->pal_size);
             ci_msg(1,"    Chunk table unknown variable: %u (%08x) \n", area_unk, area_unk);
@@ -883,63 +3807,56 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
             ci_msg(1," Using area info.\n");
             ci_msg(8," chk_sz0!");
         }
-        // Chunk area is something like this:
-        // uint32_t asize
-        // uint32_t unk (always 1)
-        // An then:
-        // uint32_t chunk_len;    
-        // uint32_t chunk_id;
-        // uint8_t data[chunk_len];
-        // ...
-        chunk_area_size = 8;
-        for (i=0, offset=CPT9_Block_sz+8; offset < size; offset+=len+8, i++) {
-            // OK, this was propably last chunk, don't go beyond
-            // TODO: I put this check here, because I've met situations:
-            // block->size1 == 0 -> direct skip to data, but also:
-            // block->size1 == 8 -> we search for chunks, but 8 bytes is too small for any
-            if (chunk_area_size == area_size) {
-                if (ci_cfg.output_chunks)
-                    ci_msg(1, "    [--] END of chunks (%u found, data follows @ 0x%08x)\n", i, CPT9_Block_sz + area_size);
-                break;
-            }
-
-            len = GETu32(buf, offset);      // get chunk len
-            chnk = GETu32(buf, offset+4);   // get chunk id
-            // If len == 0 something's not OK
-            if (!len) {
-                ci_msg(1, "%s Chunk corrupt?! (len=0)\n", ci_error_str);
-                ci_msg(4, " chk_len0!");
-                exit(EXIT_FAILURE);
-            }
-            // Add to chunk area size for checking
-            chunk_area_size += len + 8;
+        ci_IndexChunks9(buf, size, area_size, &idx);
+        for (i=0; i < idx.num; i++) {
+            c = &idx.chunk[i];
+            CI_STAT_ADD(ci_stats.chunks, 1);
+            if (ci_cfg.census) ci_CensusChunk(c->id, buf+c->offs, c->len);
+            if (ci_cfg.chunks_json) ci_ChunkJson(offs, id, c, buf+c->offs);
             // If chunk id found in our table, it's fine
             if (ci_cfg.output_chunks) {
-                if (ci_IsChunk(chnk)) {
-                    ci_msg(1, "    [**] CHUNK: '%s' @ 0x%08x (%u=%u+8 bytes)\n", ci_Ascii32(chnk), offset, len+8, len);
-                    ci_msg(10, " %s", ci_Ascii32(chnk));
+                if (ci_IsChunk(c->id)) {
+                    ci_msg(1, "    [**] CHUNK: '%s' @ 0x%08x (%u=%u+8 bytes)\n", ci_Ascii32(c->id), c->offs-8, c->len+8, c->len);
+                    ci_msg(10, " %s", ci_Ascii32(c->id));
                 } else { // Whoa, what's this then? New type chunk? :-)
-                    ci_msg(1, "    [**] ?????: '%s' @ 0x%08x (%u=%u+8 bytes)\n", ci_Ascii32(chnk), offset, len+8, len);
+                    ci_msg(1, "    [**] ?????: '%s' @ 0x%08x (%u=%u+8 bytes)\n", ci_Ascii32(c->id), c->offs-8, c->len+8, c->len);
                     ci_msg(10, " ????");
                 }
-                uint8_t *chnk_offs = buf+offset+8;
-                switch (chnk) {
-                    case CPT9_CHUNK_GRID: ci_ProcessChunkGrid(chnk_offs, len); break;
-                    case CPT9_CHUNK_BNAM: ci_ProcessChunkBnam(chnk_offs, len); break;
-                    case CPT9_CHUNK_BNWM: ci_ProcessChunkBnwm(chnk_offs, len); break;
-                    case CPT9_CHUNK_PATH: ci_ProcessChunkPath(chnk_offs, len); break;
-                    case CPT9_CHUNK_PTHW: ci_ProcessChunkPthw(chnk_offs, len); break;
-                    case CPT9_CHUNK_OINF: ci_ProcessChunkOinf(chnk_offs, len); break;
-                }
+                ci_ProcessChunk(c->id, buf+c->offs, c->len);
             }
         }
-    } else {
+        // Only 'oinf' chunks decoded
+        if (ci_cfg.object_names) {
+            for (i=0; (i = ci_ChunkFind(&idx, CPT9_CHUNK_OINF, i)) < idx.num; i++) {
+                gchar *name = ci_ChunkObjectName(buf+idx.chunk[i].offs, idx.chunk[i].len, ci_charset);
+                ci_print("%s %04x %s\n", ci_filename, id, (name ? name : "[conv failed]"));
+            }
+        }
+        if (ci_cfg.text_index) ci_TextBlock9(id, buf, &idx);
+        switch (idx.end) {
+            case CI_CHUNKS_AREA:
+                if (ci_cfg.output_chunks)
+                    ci_msg(1, "    [--] END of chunks (%u found, data follows @ 0x%08x)\n", idx.num, CPT9_Block_sz + area_size);
+                break;
+            case CI_CHUNKS_LEN0:
+                ci_msg(1, "%s Chunk corrupt?! (len=0)\n", ci_error_str);
+                ci_msg(4, " chk_len0!");
+                ci_Abort(EXIT_FAILURE);
+            case CI_CHUNKS_CORRUPT:
+                ci_Corrupt();
+        }
+        if (ci_cfg.census) ci_CensusAdd(CI_CS_CHUNKS, 0, idx.num);
+    } else if (!block->size1) {
         if (ci_cfg.output_chunks) {
             ci_msg(1,"    Chunk table size is 0, skipping...\n");
             ci_msg(8," 0 ?");
         }
     }
     
+    if (ci_cfg.where) ci_WhereBlock9(block, &idx);
+    if (ci_cfg.diff) ci_DiffBlock9(offs, id, buf, block, &idx);
+    if (ci_cfg.arrow) ci_ArrowBlock9(offs, size, id, buf, block, &idx);
+
     // If there were any chunks, we skipped them now
     offset = CPT9_Block_sz + block->size1;
     // We should be at data offset now. However, let's check for sure
@@ -949,7 +3866,7 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
         if (ci_IsChunk(chnk)) {
             ci_msg(1, "%s Something's wrong, size1==0 but chunk found!\n", ci_error_str);
             ci_msg(8, " chk_fnd!");
-            exit(EXIT_FAILURE);
+            ci_Abort(EXIT_FAILURE);
         }
     }
 
@@ -963,7 +3880,7 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
     // uint8_t *data;
     // Marker may indicate type of compression; values:
     // 0, 1, 4, 5, 0x00030005, but also no marker
-    if (ci_cfg.output_data) {
+    if (ci_cfg.output_data || ci_cfg.census) {
         ci_msg(8, " |");
         uint32_t pair[3], val;
         uint32_t data_start = GETu32(buf, offset);
@@ -971,12 +3888,14 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
         printed[0] = 0;
         printed[1] = 0;
         printed[2] = 0;
-        for (i=0; buf+offset+i < ci_data + data_start; i+=8) {
+        for (i=0; (uint64_t) offs + offset + i < data_start; i+=8) {
             pair[0] = GETu32(buf, offset+i);
             pair[1] = GETu32(buf, offset+i+4);
-            val = GETu32(ci_data, pair[0]);
+            val = ci_TileMarker(pair[0]);
             ci_msg(1, "    [**] 0x%08x (% 5u bytes): 0x%08x\n", pair[0], pair[1], val);
             ci_msg(10, " %08x %08x",pair[0], pair[1]);
+            CI_STAT_ADD(ci_stats.tiles, 1);
+            if (ci_cfg.census) ci_CensusAdd(CI_CS_MARKER, 0, val);
             switch (val) {
                 case 0x00000004: if (!printed[0]) { printed[0] = 1; ci_msg(8, " %08x", val); } break;
                 case 0x00000005: if (!printed[1]) { printed[1] = 1; ci_msg(8, " %08x", val); } break;
@@ -986,6 +3905,7 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
             }
         }
         ci_msg(1,"    [--] END of list (%u element(s))", i>>3);
+        if (ci_cfg.census) ci_CensusAdd(CI_CS_PAIRS, 0, i>>3);
         ci_msg(10," %u", i>>3, pair[2]);
         // Check if there may be more offsets and warn
         if (offset+i+12 <= size) {
@@ -997,81 +3917,513 @@ void ci_ProcessBlock9(uint32_t offs, uint32_t size, uint32_t id) {
         }
         ci_msg(1, "\n");
     }
-    if (!ci_cfg.verbose && !ci_cfg.silent_header) printf("\n");
+    if (ci_cfg.pixel_stats) ci_PstatBlock9(offs, buf, block);
+    if (ci_cfg.phash) ci_PhashBlock9(offs, id, buf, block);
+    if (!ci_cfg.verbose && !ci_cfg.silent_header) ci_print("\n");
+}
+
+// Processes i-th block according to file version. What the block put
+// into ci_arena (chunk index, strings) is printed by now, so it goes.
+void ci_ProcessBlock(uint32_t i) {
+    uint32_t size;
+    CI_arena_mark mark = ci_ArenaMark(&ci_arena);
+    if (ci_stream) size = ci_StreamBlock(i);
+    else size = (i < ci.blocks_num-1 ? ci_blocks_table[i+1].offs - ci_blocks_table[i].offs : ci_filesize - ci_blocks_table[i].offs );
+    CI_STAT_ADD(ci_stats.blocks, 1);
+    switch (ci.version) {
+        case 0x700:
+        case 0x701:
+        case 0x800: break;  // TODO - CPT78 ci_ProcessBlock ?
+        case 0x900: ci_ProcessBlock9(ci_blocks_table[i].offs, size, i); break;
+    }
+    ci_ArenaRewind(&ci_arena, mark);
+}
+
+#ifdef CI_THREADS
+// --- Blocks processed by threads ---
+
+uint32_t ci_par_1st;                    // first block processed
+uint32_t ci_par_last;                   // last block processed
+uint32_t ci_par_next;                   // next block to take by a thread
+uint32_t ci_par_stop;                   // first block aborted so far
+CI_blockout *ci_par_out;                // outputs of blocks, 1st..last
+CI_pstat *ci_par_pstat;                 // -ps totals of threads, if any
+
+// Takes blocks until none left; blocks after an aborted one are skipped,
+// their output would not be printed anyway.
+// Strings of a block are printed into its output, so the thread's arena
+// is rewound after each block.
+void *ci_BlockThread(void *arg) {
+    uint32_t i, stop;
+    CI_arena_mark mark = ci_ArenaMark(&ci_arena);
+    while ((i = __sync_fetch_and_add(&ci_par_next, 1)) <= ci_par_last && i < ci_par_stop) {
+        ci_out = &ci_par_out[i - ci_par_1st];
+        if (!setjmp(ci_out->jmp)) ci_ProcessBlock(i);
+        else {
+            ci_out->aborted = 1;
+            while ((stop = ci_par_stop) > i && !__sync_bool_compare_and_swap(&ci_par_stop, stop, i));
+        }
+        ci_out->done = 1;
+        ci_out = NULL;
+        ci_ArenaRewind(&ci_arena, mark);
+    }
+    return NULL;
+}
+
+// Started threads run this, their arena and converters end with them.
+// Arg is their slot: own -ps totals and --arrow batches.
+void *ci_BlockThreadStart(void *arg) {
+    uintptr_t i = (uintptr_t) arg;
+    ci_pstat_acc = (ci_par_pstat ? ci_par_pstat + i*CI_PSTAT_LAYOUTS : ci_pstat_file);
+    if (ci_cfg.arrow) ci_arrow_batch = ci_arrow_thr[i];
+    ci_BlockThread(arg);
+    ci_ArenaFree(&ci_arena);
+    ci_ConvertersClose();
+    return NULL;
+}
+
+// Processes blocks 1st..last by threads, then prints their output and
+// adds their census values in block order. Stops at first aborted block.
+void ci_ProcessBlocksThreaded(uint32_t block_1st, uint32_t block_last) {
+    uint32_t i, j, k, n = block_last - block_1st + 1;
+    uint32_t threads = (ci_cfg.threads < n ? ci_cfg.threads : n);
+    pthread_t *thread = (pthread_t *) malloc(threads*sizeof(pthread_t));
+    CI_blockout *o;
+    int status = -1;
+
+    ci_par_1st = block_1st;
+    ci_par_last = block_last;
+    ci_par_next = block_1st;
+    ci_par_stop = UINT32_MAX;
+    ci_par_out = (CI_blockout *) calloc(n, sizeof(CI_blockout));
+    // Each thread gathers -ps totals of its own, added to file's at end
+    if (ci_cfg.pixel_stats) {
+        ci_par_pstat = (CI_pstat *) malloc(threads*CI_PSTAT_LAYOUTS*sizeof(CI_pstat));
+        for (i=1; i < threads; i++) ci_PstatInitAll(ci_par_pstat + i*CI_PSTAT_LAYOUTS);
+    }
+    // This thread works too
+    for (i=1; i < threads; i++)
+        if (pthread_create(&thread[i], NULL, ci_BlockThreadStart, (void *) (uintptr_t) i)) break;
+    ci_BlockThread(NULL);
+    for (j=1; j < i; j++) pthread_join(thread[j], NULL);
+    free(thread);
+    if (ci_par_pstat) {
+        for (j=1; j < i; j++)
+            for (k=0; k < CI_PSTAT_LAYOUTS; k++) ci_PstatMerge(&ci_pstat_file[k], &ci_par_pstat[j*CI_PSTAT_LAYOUTS + k]);
+        free(ci_par_pstat);
+        ci_par_pstat = NULL;
+    }
+
+    for (i=0; i < n; i++) {
+        o = &ci_par_out[i];
+        if (!o->done) break;
+        if (o->len) {
+            uint64_t t = (ci_cfg.stats ? ci_Now() : 0);
+            if (ci_report) ci_OutWrite(ci_report, o->text, o->len);
+            else fwrite(o->text, 1, o->len, stdout);
+            if (ci_cfg.stats) ci_stats.t_output += ci_Now() - t;
+        }
+        for (j=0; j < o->census_len; j++)
+            ci_CensusAdd(o->census[j].field, o->census[j].idx, o->census[j].value);
+        if (o->aborted) { status = o->status; break; }
+    }
+    for (i=0; i < n; i++) {
+        free(ci_par_out[i].text);
+        free(ci_par_out[i].census);
+    }
+    free(ci_par_out);
+    ci_par_out = NULL;
+    if (status >= 0) ci_Abort(status);
 }
+#endif
 
 
 // When calling this function we assume following variables are correct:
 //      * ci.blocks_num == number of blocks
 //      * ci_blocks_table == pointer to table of blocks.
 void ci_ProcessFileBlocks(void) {
-    uint32_t i, size;
-    FILE *w;
+    uint32_t i, size, block_1st, block_last;
+    char label[16];
+    // Streamed input: blocks are read one by one, whole ones not kept
+    if (ci_stream) {
+        ci_StreamHeadEnd();
+        if (ci_cfg.dump_blocks) ci_msg(1, "%s blocks of streamed file not dumped!\n", ci_warning_str);
+    }
     // --- Blocks dumping ---
-    if (ci_cfg.dump_blocks) {
-        // Directory, 1(.) + 1(/) + basename + 7'.blocks' + \0
-        char *dirname = (char *) malloc(10+strlen(ci_basename));
-        // Directory + file 1(.)+1(/)+basename+1(/)+basename+4(.ext)+
-        char *pathname = (char *) malloc(16+2*strlen(ci_basename));
-        sprintf(dirname, ".%c%s.blocks", ci_path_separator, ci_basename);
-        mkdir(dirname, 0755);
+    if (ci_cfg.dump_blocks && !ci_stream) {
+        char *dirname = ci_ArenaPrintf(&ci_arena, ".%c%s.blocks", ci_path_separator, ci_basename);
+        // Directory + file 1(/)+basename+5(.xxxx)+\0, block number may take more
+        char *pathname = (char *) ci_ArenaAlloc(&ci_arena, strlen(dirname)+strlen(ci_basename)+16);
+        if (!ci_cfg.store) mkdir(dirname, 0755);
         // Process all blocks
         for (i=0; i < ci.blocks_num; i++) {
             sprintf(pathname, "%s%c%s.%04x", dirname, ci_path_separator, ci_basename, i);
-            w = fopen(pathname, "wb");
+            sprintf(label, "block %04x", i);
             // Size of block = difference between next offset and current,
             // with exception of last block (file size - current offset)
             size = (i < ci.blocks_num-1 ?
                 ci_blocks_table[i+1].offs - ci_blocks_table[i].offs :
                 ci_filesize - ci_blocks_table[i].offs
             );
-            fwrite(ci_data + ci_blocks_table[i].offs, 1, size, w);
-            fclose(w);
+            if (ci_blocks_table[i].offs > ci_filesize || size > ci_filesize - ci_blocks_table[i].offs) {
+                ci_msg(1, "%s block %04x out of file, not dumped!\n", ci_warning_str, i);
+                continue;
+            }
+            ci_DumpData(pathname, label, ci_data + ci_blocks_table[i].offs, size);
+        }
+    }
+
+    // --- Block hashes ---
+    // Streamed ones are hashed as they are read (ci_StreamBlock())
+    if (ci_cfg.dedup && !ci_stream) {
+        for (i=0; i < ci.blocks_num; i++) {
+            size = (i < ci.blocks_num-1 ?
+                ci_blocks_table[i+1].offs - ci_blocks_table[i].offs :
+                ci_filesize - ci_blocks_table[i].offs
+            );
+            if (ci_blocks_table[i].offs > ci_filesize || size > ci_filesize - ci_blocks_table[i].offs) continue;
+            ci_DedupAdd(CI_DUP_BLOCK, ci_data + ci_blocks_table[i].offs, size, i);
         }
-        free(pathname);
-        free(dirname);
     }
 
     // If user specified a range of blocks using '-br'...
     if (ci_cfg.block_range) {
         // Check if ranges are sane
-        if (ci_cfg.block_1st > ci.blocks_num-1) 
-            ci_cfg.block_1st = ci.blocks_num-1;
-        if (ci_cfg.block_last > ci.blocks_num-1) 
-            ci_cfg.block_last = ci.blocks_num-1;
+        block_1st = ci_cfg.block_1st;
+        block_last = ci_cfg.block_last;
+        if (block_1st > ci.blocks_num-1) 
+            block_1st = ci.blocks_num-1;
+        if (block_last > ci.blocks_num-1) 
+            block_last = ci.blocks_num-1;
         ci_msg(1,"Specified "CI_ARG_BLOCK_RANGE" option, scanning block");
-        if (ci_cfg.block_1st == ci_cfg.block_last) ci_msg(1," %u", ci_cfg.block_1st);
-        else ci_msg(1, "s %u-%u", ci_cfg.block_1st, ci_cfg.block_last);
+        if (block_1st == block_last) ci_msg(1," %u", block_1st);
+        else ci_msg(1, "s %u-%u", block_1st, block_last);
         ci_msg(1, "...\n");
     } else {
-        ci_cfg.block_1st = 0;
-        ci_cfg.block_last = ci.blocks_num-1;
+        block_1st = 0;
+        block_last = ci.blocks_num-1;
     }
+    if (ci_cfg.where) ci_where_blocks = (ci.blocks_num && block_last >= block_1st ? block_last - block_1st + 1 : 0);
     // Process all, or just given blocks
-    for (i=ci_cfg.block_1st; i <= ci_cfg.block_last; i++) {
-        size = (i < ci.blocks_num-1 ? ci_blocks_table[i+1].offs - ci_blocks_table[i].offs : ci_filesize - ci_blocks_table[i].offs );
-        switch (ci.version) {
-            case 0x700:
-            case 0x701:         
-            case 0x800: break;  // TODO - CPT78 ci_ProcessBlock ?
-            case 0x900: ci_ProcessBlock9(ci_blocks_table[i].offs, size, i); break;
+#ifdef CI_THREADS
+    if (ci_cfg.threads > 1 && !ci_stream && ci.blocks_num && block_last > block_1st) {
+        ci_ProcessBlocksThreaded(block_1st, block_last);
+        return;
+    }
+#endif
+    // Streamed: kernel reads head of next block while one is parsed
+    if (ci_stream && ci.blocks_num) ci_PlanAhead(&ci_plan, ci_blocks_table[block_1st].offs, CI_PLAN_BLOCK);
+    for (i=block_1st; i <= block_last; i++) {
+        if (ci_stream && i < block_last) ci_PlanAhead(&ci_plan, ci_blocks_table[i+1].offs, CI_PLAN_BLOCK);
+        ci_ProcessBlock(i);
+    }
+}
+
+// Processes single file (or archive member, see ci_member). Returns its
+// exit status; errors found in the file end up here through ci_Abort(),
+// so next file can be processed.
+int ci_ProcessInput(char *name) {
+    // Unchanged since it was indexed, nothing to do
+    if (ci_cfg.text_index && ci_TextFileBegin(name)) return EXIT_SUCCESS;
+    ci_SetFileName(name);
+    ci_abort_status = EXIT_SUCCESS;
+    ci_where_match = CI_WHERE_FALSE;
+    if (ci_cfg.stats) ci_StatsBegin();
+    if (ci_cfg.diff) ci_DiffBegin();
+    if (ci_cfg.pixel_stats) ci_PstatBegin();
+    if (!setjmp(ci_abort_jmp)) {
+        ci_abort_armed = 1;
+        if (ci_cfg.edit) ci_EditBegin();
+        ci_StatsPhase(&ci_stats.t_read);
+        ci_ReadFileContents();
+        ci_StatsPhase(&ci_stats.t_header);
+        ci_ProcessFileHeader();
+        if (ci_cfg.edit) ci_EditHeader();
+        if (ci_cfg.diff) ci_DiffHeader();
+        if (ci_cfg.phash) ci_PhashBegin();
+        ci_StatsPhase(&ci_stats.t_blocks);
+        ci_ProcessFileBlocks();
+        if (ci_cfg.pixel_stats) ci_PstatEnd();
+        if (ci_cfg.phash) ci_PhashEnd();
+        if (ci_cfg.repack) ci_RepackFile();
+        if (ci_cfg.where) ci_where_match = ci_WhereEval(&ci_where, &ci_where_file, ci_where_count, 0);
+    }
+    ci_StatsPhase(NULL);
+    ci_abort_armed = 0;
+    if (ci_cfg.census) ci_CensusFile(ci_abort_status);
+    if (ci_cfg.stats) ci_StatsEnd(ci_abort_status);
+    if (ci_where_match == CI_WHERE_TRUE) ci_print("%s\n", ci_filename);
+    if (ci_cfg.edit && ci_abort_status != EXIT_SUCCESS) ci_print("%s not edited\n", ci_filename);
+    if (ci_cfg.repack && ci_abort_status != EXIT_SUCCESS) ci_print("%s not repacked\n", ci_filename);
+    if (ci_cfg.diff && ci_abort_status != EXIT_SUCCESS && ci_diff_cur && !ci_diff_failed) ci_diff_failed = ci_diff_files;
+    if (ci_cfg.arrow) ci_ArrowFile(ci_abort_status);
+    ci_FinishFile();
+    ci_ReportFlush();
+    return ci_abort_status;
+}
+
+// Is it name of a .cpt file (maybe gzip or zstd compressed)?
+int ci_IsCptName(const char *name) {
+    static const char *ext[] = { ".cpt", ".cpt.gz", ".cpt.zst" };
+    size_t i, len = strlen(name);
+    for (i=0; i < sizeof(ext)/sizeof(ext[0]); i++)
+        if (len >= strlen(ext[i]) && !g_ascii_strcasecmp(name + len - strlen(ext[i]), ext[i])) return 1;
+    return 0;
+}
+
+// Processes .cpt members of tar or zip archive, each one as a file named
+// archive:member. Tar is read forward only, so it may come from a pipe.
+int ci_ProcessArchive(char *name) {
+    CI_archive a;
+    FILE *file = (strcmp(name, "-") ? fopen(name, "rb") : stdin);
+    char *member;
+    int r, status = EXIT_SUCCESS;
+
+    if (!file) {
+        ci_msg(0, "%s Can't open file %s!\n", ci_error_str, name);
+        return EXIT_FAILURE;
+    }
+#ifdef WIN32
+    if (file == stdin) _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    if ((r = ci_ArchiveOpen(&a, file))) {
+        if (r == CI_ARCH_ERR_SEEK) ci_msg(0, "%s zip archive %s can't be read from a pipe!\n", ci_error_str, name);
+        else ci_msg(0, "%s %s is not a tar or zip archive!\n", ci_error_str, name);
+        if (file != stdin) fclose(file);
+        return EXIT_FAILURE;
+    }
+    while ((r = ci_ArchiveNext(&a)) > 0) {
+        if (!ci_IsCptName(a.name)) continue;
+        // In ci_arena, goes with the member's ci_FinishFile()
+        member = ci_ArenaPrintf(&ci_arena, "%s:%s", name, a.name);
+        if (!a.supported) {
+            ci_msg(0, "%s %s: compression method %u not supported, skipped!\n", ci_error_str, member, a.method);
+            status = EXIT_FAILURE;
+        } else {
+            ci_member = &a.in;
+            ci_member_path = a.name;
+            if (ci_ProcessInput(member) != EXIT_SUCCESS) status = EXIT_FAILURE;
+            ci_member = NULL;
+            ci_member_path = NULL;
+        }
+    }
+    if (r < 0) {
+        ci_msg(0, "%s Archive %s is corrupt!\n", ci_error_str, name);
+        status = EXIT_FAILURE;
+    }
+    ci_ArchiveClose(&a);
+    if (file != stdin) fclose(file);
+    return status;
+}
+
+// Processes idx-th file given; with -a all .cpt files in it.
+int ci_ProcessFile(uint32_t idx) {
+    ci_file_idx = idx;
+    if (ci_cfg.archive) return ci_ProcessArchive(ci_files[idx]);
+    return ci_ProcessInput(ci_files[idx]);
+}
+
+// --- Batch mode: aggregated results of all files ---
+
+void ci_BatchBegin(void) {
+    if (ci_cfg.census) ci_CensusInit(&ci_census);
+    if (ci_cfg.stats) ci_stats_total.t_total = ci_Now();
+    if (ci_cfg.arrow) ci_ArrowBegin();
+    if (ci_cfg.repack) mkdir(ci_cfg.repack, 0755);
+}
+
+// Called in every process (worker) after its last file.
+void ci_BatchEnd(void) {
+    ci_StoreEnd();
+    ci_TextEnd();
+    if (ci_cfg.arrow) ci_ArrowFlushAll();
+}
+
+void ci_BatchSave(FILE *out) {
+    if (ci_cfg.store) ci_StoreSave(out);
+    if (ci_cfg.text_index) ci_TextSave(out);
+    if (ci_cfg.arrow) ci_ArrowSaveAll(out);
+    if (ci_cfg.repack) ci_RepackSave(out);
+    if (ci_cfg.census) ci_CensusSave(out);
+    if (ci_cfg.archive && (ci_cfg.dedup || ci_cfg.phash)) ci_MemberSave(out);
+    if (ci_cfg.dedup) ci_DedupSave(out);
+    if (ci_cfg.phash) ci_PhashSave(out);
+    if (ci_cfg.stats) ci_StatsSave(out);
+}
+
+void ci_BatchLoad(FILE *in) {
+    if (ci_cfg.store) ci_StoreLoad(in);
+    if (ci_cfg.text_index) ci_TextLoad(in);
+    if (ci_cfg.arrow) ci_ArrowLoadAll(in);
+    if (ci_cfg.repack) ci_RepackLoad(in);
+    if (ci_cfg.census) ci_CensusLoad(in);
+    if (ci_cfg.archive && (ci_cfg.dedup || ci_cfg.phash)) ci_MemberLoad(in);
+    if (ci_cfg.dedup) ci_DedupLoad(in);
+    if (ci_cfg.phash) ci_PhashLoad(in);
+    if (ci_cfg.stats) ci_StatsLoad(in);
+}
+
+void ci_BatchReport(void) {
+    if (ci_cfg.store && ci_cfg.verbose) ci_StoreReport();
+    if (ci_cfg.text_index) ci_TextReport();
+    if (ci_cfg.arrow) ci_ArrowReport();
+    if (ci_cfg.repack) ci_RepackReport();
+    if (ci_cfg.census) ci_CensusReport();
+    if (ci_cfg.dedup) ci_DedupReport();
+    if (ci_cfg.phash) ci_PhashReport();
+    if (ci_cfg.diff) ci_DiffReport();
+    if (ci_cfg.stats) ci_StatsReport();
+}
+
+int ci_RunFiles(uint32_t first, uint32_t end);
+
+#ifdef CI_URING
+// Reads of a file prefetched by --uring, planned after its head: block
+// table (unless it's in head), then heads of the blocks looked at. So
+// header probe needs no reads of its own.
+void ci_UringPlan(CI_uring_file *u) {
+    const CPT_FileHeader *h = (const CPT_FileHeader *) ci_UringData(u, 0, CPT_FileHeader_sz);
+    const CPT_BlockTableEntry *t;
+    uint32_t i, n, first = 0, last;
+    uint64_t end;
+    // CPT7/8/9 only, not CPT6 nor compressed files
+    for (i=0; h && i < CPT_VERSIONS_NUM && memcmp(h->magic, cpt_version[i].magic, cpt_version[i].len); i++);
+    if (!h || i == CPT_VERSIONS_NUM || !(n = h->blocks_num) || n > u->size/CPT_BlockTableEntry_sz) return;
+    t = (const CPT_BlockTableEntry *) ci_UringData(u, h->blocks_table_offs, n*CPT_BlockTableEntry_sz);
+    if (!t) {
+        ci_UringRead(u, h->blocks_table_offs, n*CPT_BlockTableEntry_sz);
+        return;
+    }
+    last = n-1;
+    if (ci_cfg.block_range) {
+        first = (ci_cfg.block_1st < n ? ci_cfg.block_1st : n-1);
+        last = (ci_cfg.block_last < n ? ci_cfg.block_last : n-1);
+    }
+    for (i=first; i <= last; i++) {
+        end = (i < n-1 ? t[i+1].offs : u->size);
+        if (end > t[i].offs) ci_UringRead(u, t[i].offs, (end - t[i].offs < CI_URING_BLOCK ? end - t[i].offs : CI_URING_BLOCK));
+    }
+}
+
+// Processes files first..end-1 with ci_cfg.uring of them prefetched at
+// once, see ci_uring.c. Ones it doesn't prefetch ('-', pipes, errors) are
+// processed the usual way.
+int ci_RunFilesUring(uint32_t first, uint32_t end) {
+    static int init = 0;
+    uint32_t i, next = first;
+    int status = EXIT_SUCCESS;
+    if (!init) {
+        init = (ci_UringInit(ci_cfg.uring, ci_UringPlan) ? -1 : 1);
+        if (init < 0) ci_msg(1, "%s io_uring not available, files read one by one!\n", ci_warning_str);
+    }
+    if (init < 0) {
+        ci_cfg.uring = 0;
+        return ci_RunFiles(first, end);
+    }
+    for (i=first; i < end; i++) {
+        while (next < end && next < i + ci_cfg.uring) {
+            ci_UringAdd(strcmp(ci_files[next], "-") ? ci_files[next] : NULL);
+            next++;
+        }
+        ci_file_idx = i;
+        if ((ci_member = ci_UringNext())) {
+            if (ci_ProcessInput(ci_files[i]) != EXIT_SUCCESS) status = EXIT_FAILURE;
+            ci_member = NULL;
+        } else if (ci_ProcessFile(i) != EXIT_SUCCESS) status = EXIT_FAILURE;
+        ci_UringDone();
+    }
+    return status;
+}
+#endif
+
+// Processes files first..end-1, one after another.
+int ci_RunFiles(uint32_t first, uint32_t end) {
+    uint32_t i;
+    int status = EXIT_SUCCESS;
+#ifdef CI_URING
+    if (ci_cfg.uring) return ci_RunFilesUring(first, end);
+#endif
+    for (i=first; i < end; i++)
+        if (ci_ProcessFile(i) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    return status;
+}
+
+#ifndef WIN32
+// Processes all files using ci_cfg.workers processes. Files are handed out
+// through a shared counter, so slow files don't hold up others (with
+// --uring as many at once as are prefetched). Every worker sends its
+// partial results through a pipe, these are merged here.
+int ci_RunWorkers(void) {
+    uint32_t w, i, n = ci_cfg.workers, chunk = (ci_cfg.uring ? ci_cfg.uring : 1);
+    int status = EXIT_SUCCESS, wstatus, fd[2];
+    pid_t *pid = (pid_t *) malloc(n*sizeof(pid_t));
+    FILE **res = (FILE **) malloc(n*sizeof(FILE *));
+    // Next file to take, and lock of stdout
+    uint32_t *next = (uint32_t *) mmap(NULL, 2*sizeof(uint32_t), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+
+    if (next == MAP_FAILED) {
+        printf("%s Can't set up worker processes!\n", ci_error_str);
+        exit(EXIT_FAILURE);
+    }
+    next[0] = next[1] = 0;
+    fflush(stdout);
+    for (w=0; w < n; w++) {
+        if (pipe(fd) || (pid[w] = fork()) < 0) {
+            printf("%s Can't set up worker processes!\n", ci_error_str);
+            exit(EXIT_FAILURE);
+        }
+        if (!pid[w]) {
+            // Worker
+            FILE *out;
+            close(fd[0]);
+            for (i=0; i < w; i++) fclose(res[i]);
+            out = fdopen(fd[1], "wb");
+            ci_report = (CI_blockout *) calloc(1, sizeof(CI_blockout));
+            ci_report_lock = next + 1;
+            while ((i = __sync_fetch_and_add(next, chunk)) < ci_files_num) {
+                if (ci_RunFiles(i, (ci_files_num - i < chunk ? ci_files_num : i + chunk)) != EXIT_SUCCESS) status = EXIT_FAILURE;
+                ci_ReportFlush();
+            }
+            ci_BatchEnd();
+            ci_ReportFlush();
+            fflush(stdout);
+            ci_BatchSave(out);
+            fclose(out);
+            _exit(status);
         }
+        close(fd[1]);
+        res[w] = fdopen(fd[0], "rb");
     }
+    for (w=0; w < n; w++) {
+        ci_BatchLoad(res[w]);
+        fclose(res[w]);
+        waitpid(pid[w], &wstatus, 0);
+        if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    }
+    munmap(next, 2*sizeof(uint32_t));
+    free(res);
+    free(pid);
+    return status;
 }
+#endif
 
 void ci_AtExit(void) {
-    if (!ci_cfg.verbose && ci_cfg.silent_header) printf("\n");
-//    ci_msg(8, "\n");
-    if (f) fclose(f);
-    free(ci_filename_short__);
-    free(ci_tempname);
-    free(ci_basename);
-    free(ci_data);
+    ci_FinishFile();
+#ifdef CI_URING
+    ci_UringEnd();
+#endif
+    free(ci_files);
+    free(ci_stream_buf);
+    free(ci_stream_marker);
+    ci_ArenaFree(&ci_arena);
+    ci_ConvertersClose();
 }
 
 
+#ifndef CI_FUZZ
 int main(int argc, char *argv[]) {
     uint32_t i, j;
+    int status;
 
     // Default parameters - verbosity configuration
     ci_cfg.verbose = 1;
@@ -1100,11 +4452,18 @@ int main(int argc, char *argv[]) {
     ci_msg(3,"\n");
 
     // Actual data reading handling
-    ci_ReadFileContents();
-    ci_ProcessFileHeader();
-    ci_ProcessFileBlocks();
+    ci_BatchBegin();
+#ifndef WIN32
+    if (ci_cfg.workers > 1 && ci_files_num > 1) status = ci_RunWorkers();
+    else
+#endif
+    status = ci_RunFiles(0, ci_files_num);
+    ci_BatchEnd();
+    if (ci_cfg.text_index) ci_TextCompact();
+    if (ci_cfg.arrow) ci_ArrowEnd();
+    ci_BatchReport();
 
-    return EXIT_SUCCESS;
+    return status;
 
 }
-
+#endif
@@ -0,0 +1,79 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo fuzzing harness: common setup.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+ /*
+  * Harnesses include the whole program (without main()), so they can call
+  * its parsers directly. Build with 'make fuzz' (libFuzzer, clang) or
+  * 'make fuzz-afl' (AFL, with fuzz_main.c as driver); seeds: fuzz/seeds,
+  * inputs found go to fuzz/corpus.
+  */
+
+#ifndef _CI_FUZZ_H_
+#define _CI_FUZZ_H_
+
+#define CI_FUZZ
+#include "../cptinfo.c"
+
+// One time setup: everything printed (to /dev/null), so all output code
+// runs too; no dumps.
+static void ci_FuzzInit(void) {
+    static int done = 0;
+    if (done) return;
+    done = 1;
+    ci_cfg.verbose = 1;
+    ci_cfg.verbose2 = 1;
+    ci_cfg.output_chunks = 1;
+    ci_cfg.output_data = 1;
+    ci_cfg.output_reserved = 1;
+    ci_cfg.verbosity_level = 1 | 2;
+    ci_cfg.workers = 1;
+    ci_cfg.threads = 1;
+    ci_cfg.charset = (char *) ci_default_charset_a;
+    ci_charset = "UTF-8";
+    ci_filename = ci_filename_short__ = "fuzz.cpt";
+    if (!freopen("/dev/null", "w", stdout)) exit(EXIT_FAILURE);
+}
+
+// Runs fn over a copy of input in a buffer of exact size (so ASan sees
+// any read past the end), with ci_Abort() returning here.
+static void ci_FuzzRun(const uint8_t *data, size_t size, void (*fn)(void)) {
+    ci_FuzzInit();
+    if (size > INT32_MAX) return;
+    memset(&ci, 0, sizeof(ci));
+    ci_data = (uint8_t *) malloc(size ? size : 1);
+    memcpy(ci_data, data, size);
+    ci_filesize = size;
+    ci_data_len = size;
+    if (!setjmp(ci_abort_jmp)) {
+        ci_abort_armed = 1;
+        fn();
+    }
+    ci_abort_armed = 0;
+    free(ci_data);
+    ci_data = NULL;
+    ci_ArenaReset(&ci_arena);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
@@ -0,0 +1,35 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo fuzzing harness: file header and 'after header' data (ICC, palette, comments).
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+#include "ci_fuzz.h"
+
+static void ci_FuzzHeader(void) {
+    if (ci_filesize < CPT_FileHeader_sz) return;
+    ci_IdentifyFile();
+    ci_ProcessFileHeader();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    ci_FuzzRun(data, size, ci_FuzzHeader);
+    return 0;
+}
@@ -0,0 +1,60 @@
+ /*
+  * CPTInfo - Corel PhotoPaint file information tool.
+  * Copyright (c) 2006-2008 Jakub Argasiński (argasek@gmail.com).
+  *
+  * CPTInfo fuzzing harness driver for AFL and for replaying inputs.
+  *
+  * This is a part of CPTInfo.
+  *
+  * CPTInfo is free software; you can redistribute it and/or modify it
+  * under the terms of the GNU Lesser General Public License as published by
+  * the Free Software Foundation; either version 2 of the License, or (at your
+  * option) any later version.
+  *
+  * This program is distributed in the hope that it will be useful, but WITHOUT
+  * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+  * License for more details.
+  *
+  * You should have received a copy of the GNU Lesser General Public License
+  * along with this library; if not, write to the Free Software Foundation,
+  * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  */
+
+ /*
+  * Linked with a harness instead of libFuzzer: runs every file given,
+  * or stdin if none (AFL: afl-fuzz -i corpus -o out fuzz/afl_file).
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void ci_FuzzOne(FILE *in) {
+    uint8_t *data = NULL;
+    size_t size = 0, n;
+    do {
+        data = (uint8_t *) realloc(data, size + 65536);
+        n = fread(data + size, 1, 65536, in);
+        size += n;
+    } while (n);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    FILE *in;
+    if (argc < 2) ci_FuzzOne(stdin);
+    for (i=1; i < argc; i++) {
+        if (!(in = fopen(argv[i], "rb"))) {
+            fprintf(stderr, "ERROR: Can't open file %s!\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        ci_FuzzOne(in);
+        fclose(in);
+    }
+    return EXIT_SUCCESS;
+}